@@ -5,11 +5,15 @@
  * Created on June 13, 2024, 8:47 PM
  */
 
-#include "rocketlib/include/i2c.h"
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "IOExpanderDriver.h"
+#include "hal.h"
+#include "i2c_async.h"
+
 #define PCA_ADDRESS 0x41
 
 #define INPUT 0x00
@@ -17,14 +21,61 @@
 #define POLARITY_REG 0x02
 #define CONFIGURATION 0x03
 
-//
-void pca_set_output(uint8_t states) {
-    i2c_write_reg8(PCA_ADDRESS, OUTPUT, states);
-    i2c_write_reg8(PCA_ADDRESS, CONFIGURATION, 0); // temp fix so that we can set states before default pcb config causes them to open 
+static uint8_t output_data;
+static uint8_t config_data = 0;
+static uint8_t read_data;
+
+static i2c_txn_t output_txn = {
+    .addr = PCA_ADDRESS, .reg = OUTPUT, .data = &output_data, .len = 1, .read = false};
+static i2c_txn_t config_txn = {
+    .addr = PCA_ADDRESS, .reg = CONFIGURATION, .data = &config_data, .len = 1, .read = false};
+static i2c_txn_t read_txn = {
+    .addr = PCA_ADDRESS, .reg = OUTPUT, .data = &read_data, .len = 1, .read = true};
+
+// Latest requested states, written out once the transaction in flight is done
+static volatile uint8_t pending_states;
+static volatile bool pending = false;
+
+static void output_done(i2c_txn_t *txn);
+
+static bool submit_output(void) {
+    output_data = pending_states;
+    if (!i2c_async_submit(&output_txn)) {
+        return false;
+    }
+    pending = false;
+    // temp fix so that we can set states before default pcb config causes them to open
+    i2c_async_submit(&config_txn);
+    return true;
+}
+
+static void output_done(i2c_txn_t *txn) {
+    (void)txn;
+    // pca_set_output() can be called from the ISR
+    bool gie = hal_irq_disable();
+    // states changed while the last write was on the bus
+    if (pending && !i2c_txn_pending(&output_txn)) {
+        submit_output();
+    }
+    hal_irq_restore(gie);
+}
+
+void pca_init() {
+    output_txn.callback = output_done;
+}
+
+bool pca_set_output(uint8_t states) {
+    pending_states = states;
+    pending = true;
+    if (i2c_txn_pending(&output_txn)) {
+        // coalesced, output_done() writes the latest value
+        return true;
+    }
+    return submit_output();
 }
 
 uint8_t pca_get_output() {
-    uint8_t current_state;
-    i2c_read_reg8(PCA_ADDRESS, OUTPUT, &current_state);
-    return current_state;
+    read_data = 0;
+    i2c_async_transfer_blocking(&read_txn);
+    return read_data;
 }
@@ -7,10 +7,17 @@
 
 #ifndef IOEXPANDERDRIVER_H
 #define IOEXPANDERDRIVER_H
+#include <stdbool.h>
 #include <stdint.h>
 
+// the PCA9536 has four I/O pins, P0-P3
+#define PCA_NUM_PINS 4
+
+// Runs on top of i2c_async, i2c_async_init() must be called first
 void pca_init();
-void pca_set_output(uint8_t states);
+// Non-blocking, queues the write. Returns false if the I2C queue is full.
+bool pca_set_output(uint8_t states);
+// Blocking, only use before the main loop starts
 uint8_t pca_get_output();
 
 #endif /* IOEXPANDERDRIVER_H */
@@ -1,25 +1,48 @@
 #include <stdbool.h>
 #include <stdint.h>
-#include <xc.h>
 
 #include "IOExpanderDriver.h"
 #include "actuator.h"
 #include "canlib/canlib.h"
+#include "hal.h"
 #include "sensor_general.h"
+#include "solenoid_capture.h"
 
 uint8_t actuator_states = 0;
+static uint32_t change_millis[PCA_NUM_PINS] = {0};
+// the expander's pins are inputs until the first write configures them
+static bool outputs_driven = false;
 
 void actuator_init() {
+    pca_init();
     actuator_states = pca_get_output();
 }
 
-void actuator_set(enum ACTUATOR_STATE state, uint8_t pin_num) {
+bool actuator_set(enum ACTUATOR_STATE state, uint8_t pin_num) {
+    if (pin_num >= PCA_NUM_PINS) {
+        return false;
+    }
+
+    // also called from the sequence executor in the timer ISR
+    bool gie = hal_irq_disable();
+
+    uint8_t previous_states = actuator_states;
+
     if (state == ACTUATOR_OFF) {
         actuator_states &= ~(1 << pin_num);
     } else if (state == ACTUATOR_ON) {
         actuator_states |= (1 << pin_num);
     }
     pca_set_output(actuator_states);
+    outputs_driven = true;
+    bool changed = actuator_states != previous_states;
+    if (changed) {
+        change_millis[pin_num] = millis();
+        solenoid_capture_start(pin_num, state);
+    }
+
+    hal_irq_restore(gie);
+    return changed;
 }
 
 void set_actuator_LED(enum ACTUATOR_STATE state, enum ACTUATOR_ID actuator) {
@@ -32,6 +55,9 @@ void set_actuator_LED(enum ACTUATOR_STATE state, enum ACTUATOR_ID actuator) {
 
 // TODO update this
 enum ACTUATOR_STATE get_actuator_state(uint8_t pin_num) {
+    if (!outputs_driven) {
+        return ACTUATOR_UNK;
+    }
 
     // temp code
     uint8_t state = (actuator_states >> pin_num) & 0x01;
@@ -42,3 +68,17 @@ enum ACTUATOR_STATE get_actuator_state(uint8_t pin_num) {
 
     return ACTUATOR_OFF;
 }
+
+uint32_t get_actuator_change_millis(uint8_t pin_num) {
+    if (pin_num >= PCA_NUM_PINS) {
+        return 0;
+    }
+    bool gie = hal_irq_disable();
+    uint32_t t = change_millis[pin_num];
+    hal_irq_restore(gie);
+    return t;
+}
+
+uint8_t get_actuator_outputs(void) {
+    return actuator_states;
+}
@@ -5,8 +5,15 @@
 #include <stdbool.h>
 
 void actuator_init();
-void actuator_set(enum ACTUATOR_STATE state, uint8_t pin_num);
+// Returns true if the output changed
+bool actuator_set(enum ACTUATOR_STATE state, uint8_t pin_num);
 void set_actuator_LED(enum ACTUATOR_STATE state, enum ACTUATOR_ID actuator);
+// ACTUATOR_UNK until actuator_set() first writes the outputs, the expander's power-on
+// output value doesn't drive anything
 enum ACTUATOR_STATE get_actuator_state(uint8_t pin_num);
+// All output bits as last written to the IO expander
+uint8_t get_actuator_outputs(void);
+// millis() of the last time actuator_set() changed this output
+uint32_t get_actuator_change_millis(uint8_t pin_num);
 
 #endif /*ACTUATOR_H*/
@@ -0,0 +1,126 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "canlib/canlib.h"
+
+#include "adc_cal.h"
+#include "error_checks.h"
+#include "hal.h"
+#include "prop_msg.h"
+#include "sensor_general.h"
+
+#define FULL_SCALE 4095
+
+// running cycle
+static uint32_t offset_sum = 0;
+static uint32_t full_scale_sum = 0;
+static uint8_t conversions = 0; // VSS on even, FVR on odd
+static bool cycle_done = false;
+static enum ADC_CAL_RESULT result = ADC_CAL_INCOMPLETE;
+
+// smoothed, what the correction is worked out from
+static uint16_t offset_x16 = 0;
+static uint16_t full_scale_x16 = FULL_SCALE * 16;
+
+// from the first good cycle, for the drift
+static bool have_first = false;
+static uint16_t first_offset_x16;
+static uint16_t first_full_scale_x16;
+
+void adc_cal_start(void) {
+    if (!cycle_done) {
+        result = ADC_CAL_INCOMPLETE;
+    }
+    offset_sum = 0;
+    full_scale_sum = 0;
+    conversions = 0;
+    cycle_done = false;
+}
+
+static void reject(enum ADC_CAL_RESULT bad, uint16_t reading_x16) {
+    uint8_t fault_data[3];
+    fault_data[0] = bad;
+    fault_data[1] = (reading_x16 >> 8) & 0xff;
+    fault_data[2] = (reading_x16 >> 0) & 0xff;
+
+    result = bad;
+    fault_raise(FAULT_ADC_REF, fault_data, 3);
+}
+
+static uint16_t smooth(uint16_t value_x16, uint16_t cycle_x16) {
+    int32_t step = ((int32_t)cycle_x16 - value_x16) / (1 << ADC_CAL_SMOOTHING_SHIFT);
+    return (uint16_t)(value_x16 + step);
+}
+
+static void finish(void) {
+    cycle_done = true;
+
+    uint16_t cycle_offset_x16 = (uint16_t)offset_sum;
+    uint16_t cycle_full_scale_x16 = (uint16_t)full_scale_sum;
+    if (cycle_offset_x16 > ADC_CAL_MAX_OFFSET * 16) {
+        reject(ADC_CAL_BAD_OFFSET, cycle_offset_x16);
+        return;
+    }
+    if (cycle_full_scale_x16 < ADC_CAL_MIN_FULL_SCALE * 16) {
+        reject(ADC_CAL_BAD_FULL_SCALE, cycle_full_scale_x16);
+        return;
+    }
+
+    if (have_first) {
+        offset_x16 = smooth(offset_x16, cycle_offset_x16);
+        full_scale_x16 = smooth(full_scale_x16, cycle_full_scale_x16);
+    } else {
+        // nothing to smooth from yet
+        have_first = true;
+        offset_x16 = cycle_offset_x16;
+        full_scale_x16 = cycle_full_scale_x16;
+        first_offset_x16 = offset_x16;
+        first_full_scale_x16 = full_scale_x16;
+    }
+
+    // the bounds above keep the span over 4015 counts and the gain under 1.02
+    uint32_t gain_q15 =
+        ((uint32_t)FULL_SCALE * 16 << 15) / (uint32_t)(full_scale_x16 - offset_x16);
+    set_adc_correction(offset_x16, (uint16_t)gain_q15);
+
+    result = ADC_CAL_OK;
+    fault_clear(FAULT_ADC_REF);
+}
+
+void adc_cal_sample(void) {
+    if (cycle_done) {
+        return;
+    }
+
+    if (conversions & 1) {
+        full_scale_sum += hal_adc_read(HAL_ADC_FVR);
+    } else {
+        offset_sum += hal_adc_read(HAL_ADC_VSS);
+    }
+    if (++conversions >= 2 * ADC_CAL_SAMPLES) {
+        finish();
+    }
+}
+
+static int8_t drift(uint16_t now_x16, uint16_t first_x16) {
+    int16_t diff = (int16_t)(now_x16 - first_x16);
+    if (diff > INT8_MAX) {
+        return INT8_MAX;
+    }
+    return diff < INT8_MIN ? INT8_MIN : (int8_t)diff;
+}
+
+void adc_cal_report(void) {
+    uint8_t payload[7];
+    payload[0] = (offset_x16 >> 8) & 0xff;
+    payload[1] = (offset_x16 >> 0) & 0xff;
+    payload[2] = (full_scale_x16 >> 8) & 0xff;
+    payload[3] = (full_scale_x16 >> 0) & 0xff;
+    payload[4] = have_first ? (uint8_t)drift(offset_x16, first_offset_x16) : 0;
+    payload[5] = have_first ? (uint8_t)drift(full_scale_x16, first_full_scale_x16) : 0;
+    payload[6] = result;
+
+    can_msg_t msg;
+    build_prop_msg(PROP_MSG_ADC_CAL, payload, sizeof(payload), &msg);
+    txb_enqueue(&msg);
+}
@@ -0,0 +1,47 @@
+#ifndef ADC_CAL_H
+#define ADC_CAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Runtime self-calibration of the ADC against its internal references. A cycle averages
+// ADC_CAL_SAMPLES conversions of VSS, the offset, and of FVR buffer 1, the full-scale
+// reading, and moves the offset and gain correction in sensor_general.h towards what they
+// give. The corrections are smoothed over cycles so one never steps the pressures.
+//
+// ADREF takes the FVR as the positive reference, so converting FVR buffer 1 measures the
+// converter's own full-scale error, not the FVR voltage. The reference itself stays with
+// the span calibration (pres_cal.h). A full-scale error that reads high clips at 4095 and
+// can't be seen, only one that reads low is corrected.
+//
+// The conversions are taken one per adc_cal_sample(), which main.c calls right after a
+// pressure sample, so the next one is a whole task period away.
+
+// of each reference per cycle, their sums are in 1/16 counts
+#define ADC_CAL_SAMPLES 16
+
+// a cycle moves the correction 1/2^n of the way to what it measured
+#define ADC_CAL_SMOOTHING_SHIFT 2
+
+// a cycle outside these leaves the correction alone and raises FAULT_ADC_REF
+#define ADC_CAL_MAX_OFFSET 16 // counts
+#define ADC_CAL_MIN_FULL_SCALE (4095 - 64) // counts, 1.6 % low
+
+enum ADC_CAL_RESULT {
+    ADC_CAL_OK = 0,
+    ADC_CAL_INCOMPLETE, // not enough conversions since the last cycle started
+    ADC_CAL_BAD_OFFSET,
+    ADC_CAL_BAD_FULL_SCALE
+};
+
+// Start a cycle, the last one's conversions are dropped if it didn't finish
+void adc_cal_start(void);
+
+// One conversion towards the current cycle, call between pressure samples
+void adc_cal_sample(void);
+
+// Send the correction as PROP_MSG_ADC_CAL, with its drift since the first cycle and the
+// result of the last one
+void adc_cal_report(void);
+
+#endif /* ADC_CAL_H */
@@ -0,0 +1,385 @@
+// Microbenchmarks for the sensor conversions and filters in sensor_general.c and
+// error_checks.c, plus candidate replacements, over all 4096 ADC codes.
+//
+// On the host every kernel is timed and compared against a long double reference of the
+// ideal conversion at the middle of each code:
+//
+//   make && ./bench > bench.csv
+//   ./bench --codes codes.csv      every kernel's output for every code as well
+//
+// Built with XC8 (make cycles) the same kernels run on a PIC18F26K83, in the MPLAB
+// simulator or on a board, and Timer1 counts instruction cycles per call. The results go
+// out on UART1, see sim.mdb. XC8's double is 32 bits unless -fdouble=64, so "double"
+// kernels are really float there.
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "error_checks.h"
+#include "hal.h"
+#include "sensor_general.h"
+
+#ifdef __XC8
+#include <xc.h>
+#else
+#include <time.h>
+#endif
+
+#define NUM_CODES 4096
+
+// LOW_PASS_ALPHA(2.5 s) at 64 Hz, as in sensor_general.c
+#define IIR_ALPHA ((1000.0 / PRES_TIME_DIFF_ms * 2.5 / 5.0) / (1 + 1000.0 / PRES_TIME_DIFF_ms * 2.5 / 5.0))
+// same filter in Q8, (1 - alpha) * 65536
+#define IIR_K_Q16 ((int32_t)((1.0 - IIR_ALPHA) * 65536.0 + 0.5))
+
+// hal.h stand-ins, the kernels read whatever code the loop is on
+static uint16_t adc_code;
+uint16_t hal_adc_read(hal_adc_channel_t channel) {
+    (void)channel;
+    return adc_code;
+}
+void hal_led_init(void) {
+}
+void hal_led_set(enum hal_led led, bool on) {
+    (void)led;
+    (void)on;
+}
+
+// ---- kernels, each takes a code and returns the converted value ----
+// The firmware returns are unsigned but negative readings wrap, they are read back as
+// int16_t here the way the ground station does.
+
+static int32_t k_nop(uint16_t code) {
+    return code;
+}
+
+static int32_t k_pres_4_20(uint16_t code) {
+    adc_code = code;
+    return (int32_t)get_pressure_4_20_psi(HAL_ADC_ANB0);
+}
+
+// (raw + 0.5) / 4096 * 3.3 V / 100 R, 4-20 mA over 1450 psi, in Q16:
+// psi = (2 * raw + 1) * 23925 / 65536 - 362.5
+static int32_t k_pres_4_20_fixed(uint16_t code) {
+    return ((int32_t)(2 * code + 1) * 23925 - 23756800) / 65536;
+}
+
+static int32_t k_pres_pneumatic(uint16_t code) {
+    adc_code = code;
+    return (int16_t)get_pressure_pneumatic_psi(HAL_ADC_ANB2);
+}
+
+static int32_t k_temperature(uint16_t code) {
+    adc_code = code;
+    return (int16_t)get_temperature_c(HAL_ADC_ANB1);
+}
+
+// Thermistor by linear interpolation in a 65 point table, one point every 64 codes
+#define TEMP_TABLE_SHIFT 6
+#define TEMP_TABLE_LEN ((NUM_CODES >> TEMP_TABLE_SHIFT) + 1)
+static int16_t temp_table[TEMP_TABLE_LEN]; // 1/16 C
+
+static double ref_temperature(double code);
+
+static void temp_table_init(void) {
+    for (uint16_t i = 0; i < TEMP_TABLE_LEN; i++) {
+        // the ends are outside the thermistor's range, clamp them
+        double code = (double)(i << TEMP_TABLE_SHIFT);
+        if (code < 1) {
+            code = 1;
+        } else if (code > NUM_CODES - 2) {
+            code = NUM_CODES - 2;
+        }
+        temp_table[i] = (int16_t)lround(ref_temperature(code) * 16);
+    }
+}
+
+static int32_t k_temperature_table(uint16_t code) {
+    uint8_t i = code >> TEMP_TABLE_SHIFT;
+    int16_t frac = code & ((1 << TEMP_TABLE_SHIFT) - 1);
+    int32_t t = temp_table[i] + (((int32_t)(temp_table[i + 1] - temp_table[i]) * frac) >> TEMP_TABLE_SHIFT);
+    return t / 16;
+}
+
+static int32_t k_batt_mV(uint16_t code) {
+    return BATT_RAW_TO_mV(code);
+}
+
+static int32_t k_curr_5v_mA(uint16_t code) {
+    return (uint16_t)(SENSE_RAW_TO_uV(code) / R8_5V_SHUNT_mR);
+}
+
+static int32_t k_curr_12v_mA(uint16_t code) {
+    return (uint16_t)(SENSE_RAW_TO_uV(code) / R7_12V_SHUNT_mR);
+}
+
+// The filters run over a shuffled order of codes so the state keeps moving. Both are fed
+// the 4-20 mA pressure of the code, as main.c does.
+static double iir_double_state;
+static int32_t iir_q8_state;
+
+static int32_t k_iir_double(uint16_t code) {
+    adc_code = code;
+    return (int16_t)update_pressure_psi_low_pass(HAL_ADC_ANB0, &iir_double_state);
+}
+
+static int32_t k_iir_q8(uint16_t code) {
+    adc_code = code;
+    int32_t x = (int16_t)get_pressure_4_20_psi(HAL_ADC_ANB0);
+    iir_q8_state += (((x << 8) - iir_q8_state) * IIR_K_Q16) >> 16;
+    return (int16_t)(iir_q8_state >> 8);
+}
+
+// ---- references ----
+
+static double ref_volts(double code) {
+    return (code + 0.5) / 4096.0 * 3.3;
+}
+
+static double ref_pres_4_20(double code) {
+    return (ref_volts(code) / 100.0 - 0.004) / 0.016 * 1450.0;
+}
+
+static double ref_pres_pneumatic(double code) {
+    return (ref_volts(code) * 2.5 - 1) / 4 * 165.34 + 5.2;
+}
+
+static double ref_temperature(double code) {
+    double v = ref_volts(code);
+    double r = 3.3 * 10000.0 / v - 10000.0;
+    return 1.0 / (1.0 / 298.15 + log(r / 10000.0) / 3434.0) - 273.15;
+}
+
+static double ref_batt_mV(double code) {
+    return ref_volts(code) * 4000.0;
+}
+
+static double ref_curr_5v_mA(double code) {
+    return ref_volts(code) * 1e4 / R8_5V_SHUNT_mR;
+}
+
+static double ref_curr_12v_mA(double code) {
+    return ref_volts(code) * 1e4 / R7_12V_SHUNT_mR;
+}
+
+static long double ref_iir_state;
+
+// Fed the firmware's integer pressure, so only the filter arithmetic is compared
+static double ref_iir(double code) {
+    adc_code = (uint16_t)code;
+    int16_t x = (int16_t)get_pressure_4_20_psi(HAL_ADC_ANB0);
+    ref_iir_state = IIR_ALPHA * ref_iir_state + (1.0L - IIR_ALPHA) * x;
+    return (double)ref_iir_state;
+}
+
+typedef struct {
+    const char *kernel;
+    const char *impl;
+    const char *unit;
+    int32_t (*fn)(uint16_t code);
+    double (*ref)(double code);
+    bool filter; // keeps state, run over the shuffled order and reset before each pass
+    uint16_t err_lo, err_hi; // codes the error is measured over
+} bench_t;
+
+// Thermistor codes for -40 C to 125 C, the ends run off to infinity
+#define TEMP_CODE_LO 118
+#define TEMP_CODE_HI 3881
+#define ALL 0, NUM_CODES - 1
+
+static const bench_t benches[] = {
+    {"nop", "call overhead", "-", k_nop, NULL, false, ALL},
+    {"pres_4_20", "Q16 line (firmware)", "psi", k_pres_4_20, ref_pres_4_20, false, ALL},
+    {"pres_4_20", "fixed Q16", "psi", k_pres_4_20_fixed, ref_pres_4_20, false, ALL},
+    {"pres_pneumatic", "float (firmware)", "psi", k_pres_pneumatic, ref_pres_pneumatic, false, ALL},
+    {"temperature", "float log() (firmware)", "C", k_temperature, ref_temperature, false,
+     TEMP_CODE_LO, TEMP_CODE_HI},
+    {"temperature", "65 point table", "C", k_temperature_table, ref_temperature, false,
+     TEMP_CODE_LO, TEMP_CODE_HI},
+    {"batt", "integer (firmware)", "mV", k_batt_mV, ref_batt_mV, false, ALL},
+    {"curr_5v", "integer (firmware)", "mA", k_curr_5v_mA, ref_curr_5v_mA, false, ALL},
+    {"curr_12v", "integer (firmware)", "mA", k_curr_12v_mA, ref_curr_12v_mA, false, ALL},
+    {"pres_low_pass", "double IIR (firmware)", "psi", k_iir_double, ref_iir, true, ALL},
+    {"pres_low_pass", "Q8 integer IIR", "psi", k_iir_q8, ref_iir, true, ALL},
+};
+#define NUM_BENCHES (sizeof(benches) / sizeof(benches[0]))
+
+static uint16_t order[NUM_CODES];
+
+// Fixed shuffle so every run and target sees the same sequence
+static void order_init(bool shuffled) {
+    for (uint16_t i = 0; i < NUM_CODES; i++) {
+        order[i] = i;
+    }
+    if (!shuffled) {
+        return;
+    }
+    uint32_t lcg = 12345;
+    for (uint16_t i = NUM_CODES - 1; i > 0; i--) {
+        lcg = lcg * 1103515245 + 12345;
+        uint16_t j = (uint16_t)((lcg >> 8) % (i + 1));
+        uint16_t t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+}
+
+static void reset_filters(void) {
+    iir_double_state = 0;
+    iir_q8_state = 0;
+    ref_iir_state = 0;
+}
+
+#ifdef __XC8
+
+// MPLAB simulator UART1 output window, or the board's UART1 TX pin
+void putch(char c) {
+    while (!U1ERRIRbits.TXMTIF) {
+    }
+    U1TXB = c;
+}
+
+static uint16_t timer1_read(void) {
+    uint8_t low = TMR1L; // latches TMR1H with RD16
+    return ((uint16_t)TMR1H << 8) | low;
+}
+
+int main(void) {
+    U1CON0bits.TXEN = 1;
+    U1CON1bits.ON = 1;
+
+    // Timer1 on FOSC/4 counts instruction cycles
+    T1CLK = 0x01;
+    T1CONbits.RD16 = 1;
+    T1CONbits.ON = 1;
+
+    temp_table_init();
+    printf("kernel,impl,cycles_per_call\n");
+    for (uint8_t b = 0; b < NUM_BENCHES; b++) {
+        const bench_t *bench = &benches[b];
+        order_init(bench->filter);
+        reset_filters();
+
+        uint32_t total = 0;
+        for (uint16_t i = 0; i < NUM_CODES; i++) {
+            uint16_t start = timer1_read();
+            bench->fn(order[i]);
+            total += (uint16_t)(timer1_read() - start);
+        }
+        printf("%s,%s,%lu\n", bench->kernel, bench->impl, total / NUM_CODES);
+    }
+    for (;;) {
+    }
+}
+
+#else
+
+#define DEFAULT_REPS 200
+
+static volatile int32_t sink;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-r REPS] [--codes FILE]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+    int reps = DEFAULT_REPS;
+    const char *codes_path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            reps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--codes") == 0 && i + 1 < argc) {
+            codes_path = argv[++i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (reps <= 0) {
+        usage(argv[0]);
+    }
+
+    temp_table_init();
+
+    static int32_t outputs[NUM_BENCHES][NUM_CODES];
+    printf("kernel,impl,unit,ns_per_call,max_abs_err,rms_err,worst_code\n");
+    for (size_t b = 0; b < NUM_BENCHES; b++) {
+        const bench_t *bench = &benches[b];
+        order_init(bench->filter);
+
+        // accuracy, one pass
+        reset_filters();
+        double max_err = 0, sum_sq = 0;
+        uint16_t worst = 0;
+        for (uint16_t i = 0; i < NUM_CODES; i++) {
+            uint16_t code = order[i];
+            int32_t out = bench->fn(code);
+            outputs[b][code] = out;
+            if (bench->ref && code >= bench->err_lo && code <= bench->err_hi) {
+                double err = out - bench->ref(code);
+                sum_sq += err * err;
+                if (fabs(err) > max_err) {
+                    max_err = fabs(err);
+                    worst = code;
+                }
+            }
+        }
+
+        // speed
+        double start = now_ns();
+        for (int r = 0; r < reps; r++) {
+            reset_filters();
+            for (uint16_t i = 0; i < NUM_CODES; i++) {
+                sink = bench->fn(order[i]);
+            }
+        }
+        double ns = (now_ns() - start) / ((double)reps * NUM_CODES);
+
+        if (bench->ref) {
+            printf("%s,%s,%s,%.2f,%.3f,%.3f,%u\n",
+                   bench->kernel,
+                   bench->impl,
+                   bench->unit,
+                   ns,
+                   max_err,
+                   sqrt(sum_sq / (bench->err_hi - bench->err_lo + 1)),
+                   worst);
+        } else {
+            printf("%s,%s,%s,%.2f,,,\n", bench->kernel, bench->impl, bench->unit, ns);
+        }
+    }
+
+    if (codes_path) {
+        FILE *f = fopen(codes_path, "w");
+        if (!f) {
+            perror(codes_path);
+            return EXIT_FAILURE;
+        }
+        fprintf(f, "code");
+        for (size_t b = 1; b < NUM_BENCHES; b++) {
+            fprintf(f, ",%s %s", benches[b].kernel, benches[b].impl);
+        }
+        fprintf(f, "\n");
+        for (uint16_t code = 0; code < NUM_CODES; code++) {
+            fprintf(f, "%u", code);
+            for (size_t b = 1; b < NUM_BENCHES; b++) {
+                fprintf(f, ",%ld", (long)outputs[b][code]);
+            }
+            fprintf(f, "\n");
+        }
+        fclose(f);
+    }
+    return EXIT_SUCCESS;
+}
+
+#endif
@@ -0,0 +1,147 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "canlib/canlib.h"
+
+#include "can_recovery.h"
+#include "event_log.h"
+#include "hal.h"
+#include "prop_msg.h"
+
+static can_timing_t can_timing;
+static void (*can_handler)(const can_msg_t *msg);
+static uint8_t *pool;
+static size_t pool_size;
+
+static uint8_t reinit_attempts = 0; // re-inits since the bus went quiet, 0 while healthy
+static uint32_t dead_since_millis; // last message before the bus went quiet
+static uint32_t reinit_millis;
+static uint16_t recovery_ms = 0; // from the last message to the first one after recovering
+
+static uint16_t reinits = 0;
+static uint16_t resets = 0;
+
+// ECAN error tracking
+static bool bus_off = false;
+static uint16_t bus_offs = 0;
+static uint8_t tx_err_peak = 0;
+static uint8_t rx_err_peak = 0;
+
+static volatile bool report_requested = false;
+static uint8_t report_pending = 0; // messages of the report still to send
+
+void can_recovery_init(const can_timing_t *timing,
+                       void (*handler)(const can_msg_t *msg),
+                       uint8_t *tx_pool,
+                       size_t tx_pool_size,
+                       uint16_t previous_resets) {
+    can_timing = *timing;
+    can_handler = handler;
+    pool = tx_pool;
+    pool_size = tx_pool_size;
+    resets = previous_resets;
+}
+
+static void reinit(void) {
+    bool gie = hal_irq_disable();
+    can_init(&can_timing, can_handler);
+    txb_init(pool, pool_size, can_send, can_send_rdy);
+    hal_irq_restore(gie);
+
+    if (reinit_attempts < UINT8_MAX) {
+        reinit_attempts++;
+    }
+    reinits++;
+    reinit_millis = millis();
+    event_log_append(EVENT_CAN_REINIT, reinit_attempts);
+}
+
+static void track_errors(void) {
+    uint8_t tx_err = hal_can_tx_errors();
+    uint8_t rx_err = hal_can_rx_errors();
+    if (tx_err > tx_err_peak) {
+        tx_err_peak = tx_err;
+    }
+    if (rx_err > rx_err_peak) {
+        rx_err_peak = rx_err;
+    }
+
+    if (hal_can_bus_off() && !bus_off) {
+        bus_off = true;
+        bus_offs++;
+    } else if (!hal_can_bus_off()) {
+        bus_off = false;
+    }
+}
+
+static void send_report(void) {
+    uint8_t payload[PROP_MSG_MAX_PAYLOAD];
+    can_msg_t msg;
+
+    if (report_pending == 2) {
+        payload[0] = (reinits >> 8) & 0xff;
+        payload[1] = (reinits >> 0) & 0xff;
+        payload[2] = (resets >> 8) & 0xff;
+        payload[3] = (resets >> 0) & 0xff;
+        payload[4] = (recovery_ms >> 8) & 0xff;
+        payload[5] = (recovery_ms >> 0) & 0xff;
+        build_prop_msg(PROP_MSG_CAN_RECOVERY, payload, 6, &msg);
+    } else {
+        payload[0] = (bus_offs >> 8) & 0xff;
+        payload[1] = (bus_offs >> 0) & 0xff;
+        payload[2] = tx_err_peak;
+        payload[3] = rx_err_peak;
+        payload[4] = hal_can_tx_errors();
+        payload[5] = hal_can_rx_errors();
+        build_prop_msg(PROP_MSG_CAN_ERRORS, payload, 6, &msg);
+    }
+
+    if (txb_enqueue(&msg)) {
+        report_pending--;
+    }
+}
+
+bool can_recovery_heartbeat(uint32_t last_message_millis, uint32_t dead_time_ms) {
+    track_errors();
+
+    if (report_requested) {
+        report_requested = false;
+        report_pending = 2;
+    }
+    if (report_pending > 0) {
+        send_report();
+    }
+
+    uint32_t now = millis();
+
+    if (reinit_attempts == 0) {
+        if (now - last_message_millis > dead_time_ms) {
+            dead_since_millis = last_message_millis;
+            reinit();
+        }
+        return false;
+    }
+
+    // last_message_millis only moves forward once something has been received
+    if (last_message_millis != dead_since_millis) {
+        uint32_t elapsed = last_message_millis - dead_since_millis;
+        recovery_ms = elapsed > UINT16_MAX ? UINT16_MAX : (uint16_t)elapsed;
+        reinit_attempts = 0;
+        report_pending = 2;
+        return false;
+    }
+
+    // keeps re-initializing while the caller holds off on the reset
+    if (now - reinit_millis > dead_time_ms) {
+        reinit();
+    }
+    return reinit_attempts > CAN_MAX_REINITS;
+}
+
+uint16_t can_recovery_get_resets(void) {
+    return resets;
+}
+
+void can_recovery_request_report(void) {
+    report_requested = true;
+}
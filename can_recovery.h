@@ -0,0 +1,39 @@
+#ifndef CAN_RECOVERY_H
+#define CAN_RECOVERY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "canlib/canlib.h"
+
+// Tiered recovery from a silent CAN bus. Tier 1 re-initializes just the CAN module and
+// the TX buffer, which takes well under a millisecond and leaves the rest of the board
+// running. Tier 2 is a full RESET(), only asked for once CAN_MAX_REINITS re-inits in a
+// row haven't brought any traffic back.
+//
+// PROP_MSG_CAN_RECOVERY: re-inits (2), resets (2), ms from the last message before the
+// bus went quiet to the first one after it recovered (2)
+// PROP_MSG_CAN_ERRORS: bus-off events (2), peak TX and RX error counts, current TX and RX
+// error counts
+
+#define CAN_MAX_REINITS 3
+
+// Same settings main passes to can_init() and txb_init(), kept for the re-init
+void can_recovery_init(const can_timing_t *timing,
+                       void (*handler)(const can_msg_t *msg),
+                       uint8_t *tx_pool,
+                       size_t tx_pool_size,
+                       uint16_t resets);
+
+// Call from the main loop. Returns true once the bus has stayed dead through every
+// re-init, the caller decides whether it is safe to RESET() from there.
+bool can_recovery_heartbeat(uint32_t last_message_millis, uint32_t dead_time_ms);
+
+// Number of tier 2 resets so far, to be carried across the RESET()
+uint16_t can_recovery_get_resets(void);
+
+// Send the recovery and error counters. Safe to call from the ISR.
+void can_recovery_request_report(void);
+
+#endif /* CAN_RECOVERY_H */
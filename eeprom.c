@@ -0,0 +1,93 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <xc.h>
+
+#include "eeprom.h"
+
+#define NVM_REG_EEPROM 0b00
+
+typedef struct {
+    uint16_t addr;
+    uint8_t data;
+} eeprom_write_t;
+
+static eeprom_write_t queue[EEPROM_WRITE_QUEUE_LEN];
+static uint8_t queue_head = 0;
+static uint8_t queue_count = 0;
+
+static uint8_t read_byte(uint16_t addr) {
+    NVMCON1bits.REG = NVM_REG_EEPROM;
+    NVMADRH = (addr >> 8) & 0xff;
+    NVMADRL = addr & 0xff;
+    NVMCON1bits.RD = 1;
+    return NVMDAT;
+}
+
+static void start_write(uint16_t addr, uint8_t data) {
+    NVMCON1bits.REG = NVM_REG_EEPROM;
+    NVMADRH = (addr >> 8) & 0xff;
+    NVMADRL = addr & 0xff;
+    NVMDAT = data;
+    NVMCON1bits.WREN = 1;
+
+    // unlock sequence, must not be interrupted
+    bool gie = INTCON0bits.GIE;
+    INTCON0bits.GIE = 0;
+    NVMCON2 = 0x55;
+    NVMCON2 = 0xAA;
+    NVMCON1bits.WR = 1;
+    INTCON0bits.GIE = gie;
+}
+
+void eeprom_read(uint16_t addr, uint8_t *buf, uint8_t len) {
+    // can't read while a write is in progress
+    while (NVMCON1bits.WR) {
+    }
+    for (uint8_t i = 0; i < len; i++) {
+        buf[i] = read_byte(addr + i);
+    }
+}
+
+bool eeprom_write(uint16_t addr, const uint8_t *buf, uint8_t len) {
+    if (addr + len > EEPROM_SIZE || queue_count + len > EEPROM_WRITE_QUEUE_LEN) {
+        return false;
+    }
+    for (uint8_t i = 0; i < len; i++) {
+        eeprom_write_t *slot = &queue[(queue_head + queue_count) % EEPROM_WRITE_QUEUE_LEN];
+        slot->addr = addr + i;
+        slot->data = buf[i];
+        queue_count++;
+    }
+    return true;
+}
+
+bool eeprom_busy(void) {
+    return queue_count > 0 || NVMCON1bits.WR;
+}
+
+void eeprom_heartbeat(void) {
+    if (NVMCON1bits.WR) {
+        return;
+    }
+    NVMCON1bits.WREN = 0;
+
+    while (queue_count > 0) {
+        eeprom_write_t *next = &queue[queue_head];
+        queue_head = (queue_head + 1) % EEPROM_WRITE_QUEUE_LEN;
+        queue_count--;
+
+        // skip bytes that already hold the value, saves both time and wear
+        if (read_byte(next->addr) != next->data) {
+            start_write(next->addr, next->data);
+            return;
+        }
+    }
+}
+
+void eeprom_flush(void) {
+    while (eeprom_busy()) {
+        CLRWDT();
+        eeprom_heartbeat();
+    }
+    NVMCON1bits.WREN = 0;
+}
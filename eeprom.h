@@ -0,0 +1,32 @@
+#ifndef EEPROM_H
+#define EEPROM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Data EEPROM driver. Reads are immediate, writes are queued and written out one byte at
+// a time from eeprom_heartbeat() so the main loop never waits on the ~4 ms write cycle.
+
+#define EEPROM_SIZE 1024
+#define EEPROM_WRITE_QUEUE_LEN 32
+
+// Layout
+#define EEPROM_HALL_CAL_ADDR 0x000 // 8 bytes per valve, see hall_detector.c
+#define EEPROM_PRES_CAL_ADDR 0x040 // 8 bytes per pressure channel, see pres_cal.c
+#define EEPROM_EVENT_LOG_ADDR 0x100 // ring of 8 byte records, see event_log.h
+#define EEPROM_EVENT_LOG_SIZE 0x300
+
+void eeprom_read(uint16_t addr, uint8_t *buf, uint8_t len);
+
+// Queue a write. All or nothing: returns false if the queue can't hold all of it.
+bool eeprom_write(uint16_t addr, const uint8_t *buf, uint8_t len);
+
+bool eeprom_busy(void);
+
+// Block until the queue is empty, for use right before a reset
+void eeprom_flush(void);
+
+// Call from the main loop
+void eeprom_heartbeat(void);
+
+#endif /* EEPROM_H */
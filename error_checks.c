@@ -1,115 +1,244 @@
-#include <xc.h>
-
 #include "canlib/canlib.h"
 
-#include "mcc_generated_files/system/system.h"
+#include "hal.h"
 
 #include "error_checks.h"
 // #include "board.h"
 #include "actuator.h"
+#include "event_log.h"
+#include "prop_msg.h"
+
+// error code sent for each fault
+static const enum BOARD_STATUS fault_codes[NUM_FAULTS] = {
+    E_BATT_UNDER_VOLTAGE, // FAULT_BATT_UNDER_VOLTAGE
+    E_BATT_OVER_VOLTAGE, // FAULT_BATT_OVER_VOLTAGE
+    E_BATT_UNDER_VOLTAGE, // FAULT_BATT_CRITICAL
+    E_5V_OVER_CURRENT, // FAULT_5V_OVER_CURRENT
+    E_BATT_OVER_CURRENT, // FAULT_12V_OVER_CURRENT
+    E_ACTUATOR_STATE, // FAULT_VALVE_TIMING
+    E_ACTUATOR_STATE, // FAULT_SOLENOID
+    E_SENSOR, // FAULT_PRES_RATE
+    E_SENSOR, // FAULT_CC_OSC
+    E_ACTUATOR_STATE, // FAULT_VALVE_MISMATCH
+    E_SENSOR, // FAULT_PRES_LOOP
+    E_SENSOR, // FAULT_ADC_REF
+};
+
+#define FAULT_DATA_LEN 4
+
+typedef struct {
+    bool active;
+    uint32_t raised_millis;
+    uint32_t last_sent_millis;
+    uint16_t repeat_ms;
+    uint8_t data[FAULT_DATA_LEN];
+    uint8_t data_len;
+    fault_counter_t counter;
+} fault_t;
+
+static fault_t faults[NUM_FAULTS];
+
+static volatile bool counters_requested = false;
+static uint8_t counters_send_idx = NUM_FAULTS;
 
-const float mA_SENSE_CONVERT_FACTOR =
-    10000 * 3.3 / 4096.0f; //  uV conversion / 100 V/V multiplier * vref / 12bit adc
-const float BATT_CONVERT_FACTOR = 1000 * 3.3 / 4096.0f; // mV conversion * vref / 12bit adc
 //******************************************************************************
-//                              STATUS CHECKS                                 //
+//                              FAULT MANAGER                                 //
 //******************************************************************************
 
-static bool battery_voltage_critical = false;
+static void send_fault(fault_t *f, enum FAULT_ID fault) {
+    can_msg_t error_msg;
+    build_board_stat_msg(millis(), fault_codes[fault], f->data, f->data_len, &error_msg);
+    txb_enqueue(&error_msg);
+    f->last_sent_millis = millis();
+}
 
-bool check_battery_voltage_error(adcc_channel_t battery_channel) { // returns mV
-    adc_result_t batt_raw = ADCC_GetSingleConversion(battery_channel);
-    // adc_result_t batt_raw = 0;
+void fault_raise(enum FAULT_ID fault, const uint8_t *data, uint8_t len) {
+    fault_t *f = &faults[fault];
 
-    // Vref: 3.3V, Resolution: 12 bits -> raw ADC value is precisely in mV
-    uint16_t batt_voltage_mV = (float)batt_raw * BATT_CONVERT_FACTOR;
+    if (len > FAULT_DATA_LEN) {
+        len = FAULT_DATA_LEN;
+    }
+    for (uint8_t i = 0; i < len; i++) {
+        f->data[i] = data[i];
+    }
+    f->data_len = len;
 
-    // get the un-scaled battery voltage (voltage divider)
-    // we don't care too much about precision - some truncation is fine
-    batt_voltage_mV = batt_voltage_mV * 4;
-
-    if (batt_voltage_mV < ACTUATOR_BATT_UNDERVOLTAGE_THRESHOLD_mV ||
-        batt_voltage_mV > ACTUATOR_BATT_OVERVOLTAGE_THRESHOLD_mV) {
-
-        uint32_t timestamp = millis();
-        uint8_t batt_data[2] = {0};
-        batt_data[0] = (batt_voltage_mV >> 8) & 0xff;
-        batt_data[1] = (batt_voltage_mV >> 0) & 0xff;
-        enum BOARD_STATUS error_code = batt_voltage_mV < ACTUATOR_BATT_UNDERVOLTAGE_THRESHOLD_mV
-                                           ? E_BATT_UNDER_VOLTAGE
-                                           : E_BATT_OVER_VOLTAGE;
-
-        can_msg_t error_msg;
-        build_board_stat_msg(timestamp, error_code, batt_data, 2, &error_msg);
-        txb_enqueue(&error_msg);
-
-        // main loop should check this and go to safe state if needed
-        if (batt_voltage_mV < ACTUATOR_BATT_UNDERVOLTAGE_PANIC_THRESHOLD_mV) {
-            // need to go to safe state
-            battery_voltage_critical = true;
-        } else {
-            // low on battery but still ok
-            battery_voltage_critical = false;
+    if (f->active) {
+        return;
+    }
+
+    f->active = true;
+    f->raised_millis = millis();
+    f->repeat_ms = FAULT_REPEAT_MIN_ms;
+    f->counter.occurrences++;
+    send_fault(f, fault);
+    event_log_append(EVENT_FAULT_RAISED, ((uint16_t)fault << 8) | (len > 0 ? data[0] : 0));
+}
+
+void fault_clear(enum FAULT_ID fault) {
+    fault_t *f = &faults[fault];
+    if (!f->active) {
+        return;
+    }
+    f->active = false;
+    f->counter.time_in_fault_ms += millis() - f->raised_millis;
+    event_log_append(EVENT_FAULT_CLEARED, (uint16_t)fault << 8);
+}
+
+bool fault_is_active(enum FAULT_ID fault) {
+    return faults[fault].active;
+}
+
+uint16_t get_active_fault_mask(void) {
+    uint16_t mask = 0;
+    for (uint8_t i = 0; i < NUM_FAULTS; i++) {
+        if (faults[i].active) {
+            mask |= (uint16_t)1 << i;
         }
+    }
+    return mask;
+}
 
-        // shit's bad yo
-        return false;
+void get_fault_counter(enum FAULT_ID fault, fault_counter_t *counter) {
+    const fault_t *f = &faults[fault];
+    *counter = f->counter;
+    // include the time of the current episode
+    if (f->active) {
+        counter->time_in_fault_ms += millis() - f->raised_millis;
     }
+}
 
-    // also send the battery voltage as a sensor data message
-    // this may or may not be the best place to put this
-    can_msg_t batt_msg;
-    build_analog_data_msg(millis(), SENSOR_BATT_VOLT, batt_voltage_mV, &batt_msg);
-    txb_enqueue(&batt_msg);
+void set_fault_counter(enum FAULT_ID fault, const fault_counter_t *counter) {
+    faults[fault].counter = *counter;
+}
 
-    // things look ok
-    battery_voltage_critical = false;
-    return true;
+void fault_request_counters(void) {
+    counters_requested = true;
 }
 
-bool is_batt_voltage_critical(void) {
-    return battery_voltage_critical;
+static bool send_fault_counter(enum FAULT_ID fault) {
+    fault_counter_t counter;
+    get_fault_counter(fault, &counter);
+
+    uint8_t payload[7];
+    payload[0] = fault;
+    payload[1] = (counter.occurrences >> 8) & 0xff;
+    payload[2] = (counter.occurrences >> 0) & 0xff;
+    payload[3] = (counter.time_in_fault_ms >> 24) & 0xff;
+    payload[4] = (counter.time_in_fault_ms >> 16) & 0xff;
+    payload[5] = (counter.time_in_fault_ms >> 8) & 0xff;
+    payload[6] = (counter.time_in_fault_ms >> 0) & 0xff;
+
+    can_msg_t msg;
+    build_prop_msg(PROP_MSG_FAULT_COUNTERS, payload, sizeof(payload), &msg);
+    return txb_enqueue(&msg);
 }
 
-bool check_5v_current_error(adcc_channel_t current_channel) { // Check bus current error
+void fault_heartbeat(void) {
+    if (counters_requested) {
+        counters_requested = false;
+        counters_send_idx = 0;
+    }
+    if (counters_send_idx < NUM_FAULTS && send_fault_counter(counters_send_idx)) {
+        counters_send_idx++;
+    }
 
-    adc_result_t voltage_raw = ADCC_GetSingleConversion(current_channel);
-    float uV = voltage_raw * mA_SENSE_CONVERT_FACTOR;
-    uint16_t curr_draw_mA = uV / 62; // 62 is R8 rating in mR
+    for (uint8_t i = 0; i < NUM_FAULTS; i++) {
+        fault_t *f = &faults[i];
+        if (f->active && (millis() - f->last_sent_millis) > f->repeat_ms) {
+            send_fault(f, i);
+            if (f->repeat_ms < FAULT_REPEAT_MAX_ms) {
+                f->repeat_ms *= 2;
+            }
+        }
+    }
+}
 
-    if (curr_draw_mA > BUS_OVERCURRENT_THRESHOLD_mA) {
-        uint32_t timestamp = millis();
-        uint8_t curr_data[2] = {0};
-        curr_data[0] = (curr_draw_mA >> 8) & 0xff;
-        curr_data[1] = (curr_draw_mA >> 0) & 0xff;
+void send_board_status(void) {
+    uint16_t mask = get_active_fault_mask();
+    can_msg_t board_stat_msg;
 
-        can_msg_t error_msg;
-        build_board_stat_msg(timestamp, E_5V_OVER_CURRENT, curr_data, 2, &error_msg);
-        txb_enqueue(&error_msg);
-        return false;
+    if (mask == 0) {
+        build_board_stat_msg(millis(), E_NOMINAL, NULL, 0, &board_stat_msg);
+    } else {
+        uint8_t first = 0;
+        while (!(mask & ((uint16_t)1 << first))) {
+            first++;
+        }
+        uint8_t mask_data[2];
+        mask_data[0] = (mask >> 8) & 0xff;
+        mask_data[1] = (mask >> 0) & 0xff;
+        build_board_stat_msg(millis(), fault_codes[first], mask_data, 2, &board_stat_msg);
     }
 
-    // things look ok
-    return true;
+    txb_enqueue(&board_stat_msg);
+}
+
+//******************************************************************************
+//                              STATUS CHECKS                                 //
+//******************************************************************************
+
+// Raise above `raise_above`, clear once back below `clear_below`
+static void check_high(enum FAULT_ID fault, uint16_t value, uint16_t raise_above, uint16_t clear_below) {
+    if (value > raise_above) {
+        uint8_t data[2] = {(value >> 8) & 0xff, (value >> 0) & 0xff};
+        fault_raise(fault, data, 2);
+    } else if (value < clear_below) {
+        fault_clear(fault);
+    }
 }
 
-bool check_12v_current_error(adcc_channel_t current_channel) { // check battery current error
-    adc_result_t voltage_raw = ADCC_GetSingleConversion(current_channel);
-    float uV = voltage_raw * mA_SENSE_CONVERT_FACTOR;
-    uint16_t curr_draw_mA = uV / 15; // 15 is R7 rating in mR
-
-    if (curr_draw_mA > BAT_OVERCURRENT_THRESHOLD_mA) {
-        uint32_t timestamp = millis();
-        uint8_t curr_data[2] = {0};
-        curr_data[0] = (curr_draw_mA >> 8) & 0xff;
-        curr_data[1] = (curr_draw_mA >> 0) & 0xff;
-
-        can_msg_t error_msg;
-        build_board_stat_msg(timestamp, E_BATT_OVER_CURRENT, curr_data, 2, &error_msg);
-        txb_enqueue(&error_msg);
-        return false;
+// Raise below `raise_below`, clear once back above `clear_above`
+static void check_low(enum FAULT_ID fault, uint16_t value, uint16_t raise_below, uint16_t clear_above) {
+    if (value < raise_below) {
+        uint8_t data[2] = {(value >> 8) & 0xff, (value >> 0) & 0xff};
+        fault_raise(fault, data, 2);
+    } else if (value > clear_above) {
+        fault_clear(fault);
     }
+}
+
+void check_board_status(hal_adc_channel_t battery_channel,
+                        hal_adc_channel_t current_5v_channel,
+                        hal_adc_channel_t current_12v_channel) {
+    // all three conversions back to back, then the checks
+    uint16_t batt_raw = hal_adc_read(battery_channel);
+    uint16_t curr_5v_raw = hal_adc_read(current_5v_channel);
+    uint16_t curr_12v_raw = hal_adc_read(current_12v_channel);
+
+    // we don't care too much about precision - some truncation is fine
+    uint16_t batt_voltage_mV = BATT_RAW_TO_mV(batt_raw);
+    uint16_t curr_5v_mA = SENSE_RAW_TO_uV(curr_5v_raw) / R8_5V_SHUNT_mR;
+    uint16_t curr_12v_mA = SENSE_RAW_TO_uV(curr_12v_raw) / R7_12V_SHUNT_mR;
+
+    check_low(FAULT_BATT_UNDER_VOLTAGE,
+              batt_voltage_mV,
+              ACTUATOR_BATT_UNDERVOLTAGE_THRESHOLD_mV,
+              ACTUATOR_BATT_UNDERVOLTAGE_THRESHOLD_mV + BATT_HYSTERESIS_mV);
+    // main loop checks this and goes to safe state
+    check_low(FAULT_BATT_CRITICAL,
+              batt_voltage_mV,
+              ACTUATOR_BATT_UNDERVOLTAGE_PANIC_THRESHOLD_mV,
+              ACTUATOR_BATT_UNDERVOLTAGE_PANIC_THRESHOLD_mV + BATT_HYSTERESIS_mV);
+    check_high(FAULT_BATT_OVER_VOLTAGE,
+               batt_voltage_mV,
+               ACTUATOR_BATT_OVERVOLTAGE_THRESHOLD_mV,
+               ACTUATOR_BATT_OVERVOLTAGE_THRESHOLD_mV - BATT_HYSTERESIS_mV);
+    check_high(FAULT_5V_OVER_CURRENT,
+               curr_5v_mA,
+               BUS_OVERCURRENT_THRESHOLD_mA,
+               BUS_OVERCURRENT_THRESHOLD_mA - CURRENT_HYSTERESIS_mA);
+    check_high(FAULT_12V_OVER_CURRENT,
+               curr_12v_mA,
+               BAT_OVERCURRENT_THRESHOLD_mA,
+               BAT_OVERCURRENT_THRESHOLD_mA - CURRENT_HYSTERESIS_mA);
+
+    // also send the battery voltage as a sensor data message
+    can_msg_t batt_msg;
+    build_analog_data_msg(millis(), SENSOR_BATT_VOLT, batt_voltage_mV, &batt_msg);
+    txb_enqueue(&batt_msg);
+}
 
-    // things look ok
-    return true;
+bool is_batt_voltage_critical(void) {
+    return fault_is_active(FAULT_BATT_CRITICAL);
 }
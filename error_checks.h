@@ -2,8 +2,10 @@
 #define ERROR_CHECKS_H
 
 #include "canlib/message_types.h"
+#include "hal.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 
 // at this voltage, the actuator will revert to its safe state
 #define ACTUATOR_BATT_UNDERVOLTAGE_PANIC_THRESHOLD_mV 9000
@@ -14,14 +16,77 @@
 // at this voltage, a warning will be sent out over CAN
 #define ACTUATOR_BATT_OVERVOLTAGE_THRESHOLD_mV 14000
 
+// a voltage fault clears once it's this far back inside its threshold
+#define BATT_HYSTERESIS_mV 200
+
 // From 5V bus line. At this current, a warning will be sent out over CAN
 #define BUS_OVERCURRENT_THRESHOLD_mA 100
 #define BAT_OVERCURRENT_THRESHOLD_mA 150
 
-// General board status checkers
-bool check_battery_voltage_error(adcc_channel_t battery_channel);
-bool check_5v_current_error(adcc_channel_t current_channel);
-bool check_12v_current_error(adcc_channel_t current_channel);
+// a current fault clears once it's this far back under its threshold
+#define CURRENT_HYSTERESIS_mA 10
+
+// Vref: 3.3V, Resolution: 12 bits. Integer versions of the old float factors:
+// battery mV = raw * 3300 / 4096, times 4 for the divider
+// sense uV = raw * 10000 * 3.3 / 4096 (100 V/V amplifier), divided by the shunt in mR
+#define BATT_RAW_TO_mV(raw) ((uint16_t)(((uint32_t)(raw) * 3300 * 4) >> 12))
+#define SENSE_RAW_TO_uV(raw) (((uint32_t)(raw) * 33000) >> 12)
+#define R8_5V_SHUNT_mR 62
+#define R7_12V_SHUNT_mR 15
+
+// While a fault stays active its board status message is repeated, starting at
+// FAULT_REPEAT_MIN_ms and doubling up to FAULT_REPEAT_MAX_ms
+#define FAULT_REPEAT_MIN_ms 1000
+#define FAULT_REPEAT_MAX_ms 16000
+
+enum FAULT_ID {
+    FAULT_BATT_UNDER_VOLTAGE = 0,
+    FAULT_BATT_OVER_VOLTAGE,
+    FAULT_BATT_CRITICAL,
+    FAULT_5V_OVER_CURRENT,
+    FAULT_12V_OVER_CURRENT,
+    FAULT_VALVE_TIMING,
+    FAULT_SOLENOID,
+    FAULT_PRES_RATE,
+    FAULT_CC_OSC,
+    FAULT_VALVE_MISMATCH,
+    FAULT_PRES_LOOP,
+    FAULT_ADC_REF,
+    NUM_FAULTS
+};
+
+typedef struct {
+    uint16_t occurrences;
+    uint32_t time_in_fault_ms;
+} fault_counter_t;
+
+// Fault manager. A board status message with the fault's error code goes out when it is
+// raised, then again at a backing-off interval while it stays active. Raising an
+// already active fault only updates the data sent with the repeats.
+void fault_raise(enum FAULT_ID fault, const uint8_t *data, uint8_t len);
+void fault_clear(enum FAULT_ID fault);
+bool fault_is_active(enum FAULT_ID fault);
+uint16_t get_active_fault_mask(void);
+void get_fault_counter(enum FAULT_ID fault, fault_counter_t *counter);
+// For carrying the counters across a warm restart, before any faults are raised
+void set_fault_counter(enum FAULT_ID fault, const fault_counter_t *counter);
+
+// Send every fault's counters, a message per main loop pass. Safe to call from the ISR.
+void fault_request_counters(void);
+
+// Call from the main loop: sends repeats for active faults and requested counters
+void fault_heartbeat(void);
+
+// Send one board status message covering every active fault: E_NOMINAL if there are none,
+// otherwise the error code of the first active fault and the fault bitmask.
+void send_board_status(void);
+
+// Read the battery and current sense channels and raise or clear their faults. The
+// battery voltage also goes out as a sensor message.
+void check_board_status(hal_adc_channel_t battery_channel,
+                        hal_adc_channel_t current_5v_channel,
+                        hal_adc_channel_t current_12v_channel);
+
 bool is_batt_voltage_critical(void);
 
 #endif /* ERROR_CHECKS_H */
@@ -0,0 +1,154 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "canlib/canlib.h"
+
+#include "eeprom.h"
+#include "event_log.h"
+#include "prop_msg.h"
+
+#define NUM_RECORDS (EEPROM_EVENT_LOG_SIZE / EVENT_LOG_RECORD_LEN)
+
+// records waiting for room in the EEPROM write queue
+#define PENDING_LEN 8
+
+#define MAX_TIMESTAMP 0xffffffUL
+
+static uint8_t next_slot = 0;
+static uint8_t next_seq = 0;
+static uint8_t boot = 0;
+
+static uint8_t pending[PENDING_LEN][EVENT_LOG_RECORD_LEN];
+static uint8_t pending_head = 0;
+static uint8_t pending_count = 0;
+
+static volatile bool dump_requested = false;
+static bool dumping = false;
+static uint8_t dump_idx;
+static uint8_t dump_sent;
+
+static uint16_t slot_addr(uint8_t slot) {
+    return EEPROM_EVENT_LOG_ADDR + (uint16_t)slot * EVENT_LOG_RECORD_LEN;
+}
+
+void event_log_init(uint16_t reset_cause) {
+    // The newest record is the last one whose successor doesn't continue its sequence
+    // number. Fewer slots than sequence numbers, so the wrap is always visible.
+    uint8_t header[3];
+    uint8_t newest = NUM_RECORDS;
+    uint8_t prev_seq = 0;
+    bool prev_valid = false;
+
+    for (uint8_t slot = 0; slot < NUM_RECORDS; slot++) {
+        eeprom_read(slot_addr(slot), header, 3);
+        bool valid = header[1] != EVENT_INVALID;
+
+        if (prev_valid && (!valid || header[0] != (uint8_t)(prev_seq + 1))) {
+            newest = slot - 1;
+            break;
+        }
+        if (valid) {
+            newest = slot; // whole ring is in sequence so far
+        }
+        prev_valid = valid;
+        prev_seq = header[0];
+    }
+
+    if (newest < NUM_RECORDS) {
+        eeprom_read(slot_addr(newest), header, 3);
+        next_slot = (newest + 1) % NUM_RECORDS;
+        next_seq = header[0] + 1;
+        boot = header[2] + 1;
+    }
+
+    event_log_append(EVENT_BOOT, reset_cause);
+}
+
+bool event_log_append(enum EVENT_TYPE type, uint16_t arg) {
+    if (pending_count >= PENDING_LEN) {
+        return false;
+    }
+
+    uint32_t now = millis();
+    if (now > MAX_TIMESTAMP) {
+        now = MAX_TIMESTAMP;
+    }
+
+    uint8_t *record = pending[(pending_head + pending_count) % PENDING_LEN];
+    record[0] = next_seq++;
+    record[1] = type;
+    record[2] = boot;
+    record[3] = (now >> 16) & 0xff;
+    record[4] = (now >> 8) & 0xff;
+    record[5] = (now >> 0) & 0xff;
+    record[6] = (arg >> 8) & 0xff;
+    record[7] = (arg >> 0) & 0xff;
+    pending_count++;
+    return true;
+}
+
+static bool dump_one(void) {
+    uint8_t record[EVENT_LOG_RECORD_LEN];
+    can_msg_t msg;
+
+    if (dump_idx >= NUM_RECORDS) {
+        record[1] = EVENT_LOG_END;
+        record[2] = boot;
+        record[3] = record[4] = record[5] = 0;
+        record[6] = 0;
+        record[7] = dump_sent;
+        build_prop_msg(PROP_MSG_EVENT_LOG, &record[1], EVENT_LOG_RECORD_LEN - 1, &msg);
+        if (txb_enqueue(&msg)) {
+            dumping = false;
+        }
+        return true;
+    }
+
+    // oldest slot is the one we're about to overwrite next
+    eeprom_read(slot_addr((next_slot + dump_idx) % NUM_RECORDS), record, EVENT_LOG_RECORD_LEN);
+    if (record[1] == EVENT_INVALID) {
+        dump_idx++;
+        return false;
+    }
+
+    build_prop_msg(PROP_MSG_EVENT_LOG, &record[1], EVENT_LOG_RECORD_LEN - 1, &msg);
+    if (txb_enqueue(&msg)) {
+        dump_idx++;
+        dump_sent++;
+    }
+    return true;
+}
+
+void event_log_heartbeat(void) {
+    // move as many buffered records into the EEPROM queue as it has room for
+    while (pending_count > 0 &&
+           eeprom_write(slot_addr(next_slot), pending[pending_head], EVENT_LOG_RECORD_LEN)) {
+        next_slot = (next_slot + 1) % NUM_RECORDS;
+        pending_head = (pending_head + 1) % PENDING_LEN;
+        pending_count--;
+    }
+
+    if (dump_requested) {
+        dump_requested = false;
+        dumping = true;
+        dump_idx = 0;
+        dump_sent = 0;
+    }
+    if (dumping) {
+        // skip over erased slots without waiting a pass for each
+        while (dumping && !dump_one()) {
+        }
+    }
+}
+
+void event_log_flush(void) {
+    while (pending_count > 0) {
+        event_log_heartbeat();
+        eeprom_flush();
+    }
+    eeprom_flush();
+}
+
+void event_log_request_dump(void) {
+    dump_requested = true;
+}
@@ -0,0 +1,68 @@
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Black-box event log, kept as a ring of fixed size records in data EEPROM so it
+// survives resets. Every record goes to the next slot, which spreads the wear evenly.
+// Appending only copies the record into RAM, it is written out by event_log_heartbeat().
+//
+// Record layout (8 bytes):
+//   [0]    sequence number, +1 per record, used to find the newest record at boot
+//   [1]    enum EVENT_TYPE
+//   [2]    boot number, low 8 bits
+//   [3..5] millis() since that boot, big endian, saturates at 0xffffff (~4.6 h)
+//   [6..7] argument, big endian, meaning depends on the type
+//
+// Over CAN each record is sent as PROP_MSG_EVENT_LOG with bytes [1..7], oldest first,
+// followed by an EVENT_LOG_END record whose argument is the number of records sent.
+
+#define EVENT_LOG_RECORD_LEN 8
+
+enum EVENT_TYPE {
+    EVENT_BOOT = 0x01, // arg: STATUS << 8 | PCON0 as they were at reset
+    EVENT_RESET_REQUEST = 0x02, // arg: enum RESET_REASON
+    EVENT_FAULT_RAISED = 0x03, // arg: enum FAULT_ID << 8 | first data byte
+    EVENT_FAULT_CLEARED = 0x04, // arg: enum FAULT_ID << 8
+    EVENT_SAFE_STATE_ENTER = 0x05, // arg: enum SAFE_STATE_REASON
+    EVENT_SAFE_STATE_EXIT = 0x06,
+    EVENT_ACTUATORS = 0x07, // arg: output bits << 8 | requested bits
+    EVENT_CAN_REINIT = 0x08, // arg: attempt since the bus went quiet
+    EVENT_LOG_END = 0xfe,
+    EVENT_INVALID = 0xff // erased EEPROM
+};
+
+enum RESET_REASON { RESET_BUS_DEAD = 1, RESET_CAN_CMD };
+
+enum SAFE_STATE_REASON { SAFE_STATE_CAN_IDLE = 1, SAFE_STATE_BATT_CRITICAL };
+
+// Find the end of the log and record this boot. reset_cause is from
+// hal_get_reset_cause(), read before anything else touches PCON0.
+void event_log_init(uint16_t reset_cause);
+
+// Bounded time, never waits on the EEPROM. Returns false if the RAM buffer is full.
+bool event_log_append(enum EVENT_TYPE type, uint16_t arg);
+
+// Call from the main loop
+void event_log_heartbeat(void);
+
+// Write out everything that's buffered, blocking. For right before a RESET().
+void event_log_flush(void);
+
+// Send the whole log over CAN, a record per main loop pass. Safe to call from the ISR.
+void event_log_request_dump(void);
+
+// hal_get_reset_cause() bits. The PCON0 ones are active low, except for the stack flags.
+#define RESET_CAUSE_nBOR 0x0001
+#define RESET_CAUSE_nPOR 0x0002
+#define RESET_CAUSE_nRI 0x0004 // RESET instruction
+#define RESET_CAUSE_nRMCLR 0x0008
+#define RESET_CAUSE_nRWDT 0x0010
+#define RESET_CAUSE_nWDTWV 0x0020 // watchdog window violation
+#define RESET_CAUSE_STKUNF 0x0040
+#define RESET_CAUSE_STKOVF 0x0080
+#define RESET_CAUSE_nPD 0x2000 // STATUS bits
+#define RESET_CAUSE_nTO 0x4000
+
+#endif /* EVENT_LOG_H */
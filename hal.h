@@ -0,0 +1,70 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Thin hardware abstraction used by the application code, so the same main loop and
+// sensor/actuator logic builds for the board and for the host simulator. The PIC18
+// backend is hal_pic18.h/.c, the host one lives in host/. Register-level drivers
+// (i2c_async.c, eeprom.c and canlib's PIC18 driver) stay PIC-specific and have their own
+// host counterparts in host/.
+//
+// Each backend header provides:
+//   hal_adc_channel_t and HAL_ADC_xxx for the analog inputs the board uses
+//   HAL_PERSISTENT, qualifier for RAM the startup code must leave alone
+//   HAL_TICK_us, period of the tick timer
+//   HAL_SAMPLE_us, period of the sample timer
+//   HAL_TIMESTAMP_us, resolution of hal_timestamp()
+
+#ifdef HAL_HOST
+#include "host/hal_host.h"
+#else
+#include "hal_pic18.h"
+#endif
+
+enum hal_led { HAL_LED_GREEN, HAL_LED_BLUE, HAL_LED_RED };
+
+// Clocks, pins and analog setup. argc/argv are only used by the host backend.
+void hal_init(int argc, char **argv);
+
+// hal_irq_disable() returns whether interrupts were enabled, to pass to hal_irq_restore()
+bool hal_irq_disable(void);
+void hal_irq_restore(bool enabled);
+void hal_irq_enable(void);
+
+void hal_watchdog_clear(void);
+void hal_reset(void);
+
+// STATUS << 8 | PCON0 as the last reset left them, see RESET_CAUSE_* in event_log.h.
+// Re-arms the flags for the next reset, so call it once, before anything else.
+uint16_t hal_get_reset_cause(void);
+
+// 12 bit result, passed to input_record_adc(). Main loop only, it shares the converter
+// with the sample timer interrupt and waits for the conversion with interrupts on.
+uint16_t hal_adc_read(hal_adc_channel_t channel);
+
+// Free-running, in HAL_TIMESTAMP_us units. Wraps.
+uint32_t hal_timestamp(void);
+
+void hal_led_init(void);
+void hal_led_set(enum hal_led led, bool on);
+
+void hal_can_pins_init(void);
+uint8_t hal_can_tx_errors(void);
+uint8_t hal_can_rx_errors(void);
+bool hal_can_bus_off(void);
+
+// Interrupt every HAL_TICK_us that runs sequence_handle_timer_interrupt()
+void hal_tick_timer_start(void);
+void hal_tick_timer_stop(void);
+// Time into the current tick
+uint16_t hal_tick_timer_elapsed_us(void);
+
+// Interrupt every HAL_SAMPLE_us that converts channel and passes the result to
+// instability_handle_sample_interrupt(). The conversion isn't waited for, each result
+// goes out on the tick after the one that started it.
+void hal_sample_timer_start(hal_adc_channel_t channel);
+void hal_sample_timer_stop(void);
+
+#endif /* HAL_H */
@@ -0,0 +1,272 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <xc.h>
+
+#include "canlib/canlib.h"
+
+#include "mcc_generated_files/system/system.h"
+
+#include "hal.h"
+#include "i2c_async.h"
+#include "input_record.h"
+#include "instability.h"
+#include "sequence.h"
+
+// Timer2 clocked from FOSC/4 (3 MHz) with a 1:4 prescaler, 150 counts per tick
+#define T2_CLK_FOSC_4 0x01
+#define T2_PRESCALE_1_4 0b010
+#define T2_COUNTS_PER_TICK 150
+#define T2_COUNT_TO_us(count) (((uint16_t)(count) * 4) / 3)
+
+// Timer4 the same, with a 1:10 postscaler for 2 ms
+#define T4_POSTSCALE_1_10 9
+
+// PCON0 after re-arming: the active-low reset flags set, stack flags cleared
+#define PCON0_REARMED 0x3f
+// STATUS nTO is bit 6 and nPD bit 5, the bits under them are ALU flags
+#define STATUS_TO_PD_MASK 0x60
+
+// PPS codes for the CAN pins
+#define PPS_CANTX 0x33
+#define PPS_CANRX_RC0 0x10
+
+// The converter is shared by hal_adc_read() in the main loop and the sample timer
+// interrupt, and neither waits on a conversion with interrupts off. The interrupt starts
+// a conversion and collects it on its next tick. hal_adc_read() only holds interrupts
+// off to take the converter over and to hand it back.
+static hal_adc_channel_t sample_channel;
+static volatile bool sample_converting = false; // a sample conversion is in the converter
+static volatile bool sample_done = false; // sample_raw is still to be passed on
+static volatile bool sample_deferred = false; // a tick came while hal_adc_read() converted
+static volatile bool read_converting = false;
+static volatile uint16_t sample_raw;
+
+void hal_init(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    // MCC generated initializer
+    SYSTEM_Initialize();
+}
+
+bool hal_irq_disable(void) {
+    bool gie = INTCON0bits.GIE;
+    INTCON0bits.GIE = 0;
+    return gie;
+}
+
+void hal_irq_restore(bool enabled) {
+    INTCON0bits.GIE = enabled;
+}
+
+void hal_irq_enable(void) {
+    INTCON0bits.GIE = 1;
+}
+
+void hal_watchdog_clear(void) {
+    CLRWDT();
+}
+
+void hal_reset(void) {
+    RESET();
+}
+
+uint16_t hal_get_reset_cause(void) {
+    uint16_t cause = ((uint16_t)(STATUS & STATUS_TO_PD_MASK) << 8) | PCON0;
+    PCON0 = PCON0_REARMED;
+    return cause;
+}
+
+static void adc_start(hal_adc_channel_t channel) {
+    ADPCH = channel;
+    ADCON0bits.ADGO = 1;
+}
+
+static uint16_t adc_result(void) {
+    return ((uint16_t)ADRESH << 8) | ADRESL;
+}
+
+// With interrupts off
+static void collect_sample(void) {
+    if (sample_converting && !ADCON0bits.ADGO) {
+        sample_raw = adc_result();
+        input_record_adc(sample_channel, sample_raw);
+        sample_converting = false;
+        sample_done = true;
+    }
+}
+
+uint16_t hal_adc_read(hal_adc_channel_t channel) {
+    // a sample conversion has to finish first, wait for it with interrupts on
+    bool gie;
+    while (1) {
+        gie = hal_irq_disable();
+        collect_sample();
+        if (!sample_converting) {
+            break;
+        }
+        hal_irq_restore(gie);
+    }
+    read_converting = true;
+    adc_start(channel);
+    hal_irq_restore(gie);
+
+    while (ADCON0bits.ADGO) {
+    }
+
+    gie = hal_irq_disable();
+    uint16_t raw = adc_result();
+    input_record_adc(channel, raw);
+    read_converting = false;
+    if (sample_deferred) {
+        // a few us late, rather than a whole period
+        sample_deferred = false;
+        sample_converting = true;
+        adc_start(sample_channel);
+    }
+    hal_irq_restore(gie);
+    return raw;
+}
+
+static void sample_tick(void) {
+    collect_sample();
+    if (read_converting) {
+        sample_deferred = true;
+    } else if (!sample_converting) {
+        sample_converting = true;
+        adc_start(sample_channel);
+    }
+    if (sample_done) {
+        sample_done = false;
+        instability_handle_sample_interrupt(sample_raw);
+    }
+}
+
+uint32_t hal_timestamp(void) {
+    return millis();
+}
+
+void hal_led_init(void) {
+    TRISA4 = 0; // set A4, A3, A2 as output
+    TRISA3 = 0;
+    TRISA2 = 0;
+    LATA4 = 1; // turn the leds off
+    LATA3 = 1;
+    LATA2 = 1;
+}
+
+// LEDs are active low
+void hal_led_set(enum hal_led led, bool on) {
+    switch (led) {
+        case HAL_LED_GREEN:
+            LATA2 = !on;
+            break;
+        case HAL_LED_BLUE:
+            LATA3 = !on;
+            break;
+        case HAL_LED_RED:
+            LATA4 = !on;
+            break;
+        default:
+            break;
+    }
+}
+
+void hal_can_pins_init(void) {
+    // Set up CAN TX
+    TRISC1 = 0;
+    RC1PPS = PPS_CANTX;
+
+    // Set up CAN RX
+    TRISC0 = 1;
+    ANSELC0 = 0;
+    CANRXPPS = PPS_CANRX_RC0;
+}
+
+uint8_t hal_can_tx_errors(void) {
+    return TXERRCNT;
+}
+
+uint8_t hal_can_rx_errors(void) {
+    return RXERRCNT;
+}
+
+bool hal_can_bus_off(void) {
+    return COMSTATbits.TXBO;
+}
+
+void hal_tick_timer_start(void) {
+    T2CLKCON = T2_CLK_FOSC_4;
+    T2HLT = 0; // free running, software gated
+    T2PR = T2_COUNTS_PER_TICK - 1;
+    T2TMR = 0;
+    T2CONbits.CKPS = T2_PRESCALE_1_4;
+    T2CONbits.OUTPS = 0; // 1:1
+    TMR2IF = 0;
+    TMR2IE = 1;
+    T2CONbits.ON = 1;
+}
+
+void hal_tick_timer_stop(void) {
+    TMR2IE = 0;
+    T2CONbits.ON = 0;
+    TMR2IF = 0;
+}
+
+uint16_t hal_tick_timer_elapsed_us(void) {
+    return T2_COUNT_TO_us(T2TMR);
+}
+
+void hal_sample_timer_start(hal_adc_channel_t channel) {
+    sample_channel = channel;
+    T4CLKCON = T2_CLK_FOSC_4;
+    T4HLT = 0;
+    T4PR = T2_COUNTS_PER_TICK - 1;
+    T4TMR = 0;
+    T4CONbits.CKPS = T2_PRESCALE_1_4;
+    T4CONbits.OUTPS = T4_POSTSCALE_1_10;
+    TMR4IF = 0;
+    TMR4IE = 1;
+    T4CONbits.ON = 1;
+}
+
+void hal_sample_timer_stop(void) {
+    TMR4IE = 0;
+    T4CONbits.ON = 0;
+    TMR4IF = 0;
+
+    // the last conversion isn't passed on, only hal_adc_read() could be waiting for it
+    while (sample_converting && ADCON0bits.ADGO) {
+    }
+    sample_converting = false;
+    sample_done = false;
+    sample_deferred = false;
+}
+
+static void __interrupt() interrupt_handler() {
+    if (PIR5) {
+        can_handle_interrupt();
+    }
+
+    // Timer0 has overflowed - update millis() function
+    // This happens approximately every 500us
+    if (PIE3bits.TMR0IE == 1 && PIR3bits.TMR0IF == 1) {
+        timer0_handle_interrupt();
+        PIR3bits.TMR0IF = 0;
+    }
+
+    // on-board sequence executor tick
+    if (TMR2IE && TMR2IF) {
+        TMR2IF = 0;
+        sequence_handle_timer_interrupt();
+    }
+
+    // chamber pressure sampling
+    if (TMR4IE && TMR4IF) {
+        TMR4IF = 0;
+        sample_tick();
+    }
+
+    if (I2C1IF || I2C1EIF || I2C1RXIF || (I2C1TXIE && I2C1TXIF)) {
+        i2c_async_handle_interrupt();
+    }
+}
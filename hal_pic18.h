@@ -0,0 +1,31 @@
+#ifndef HAL_PIC18_H
+#define HAL_PIC18_H
+
+// PIC18F26K83 side of hal.h
+
+#include "mcc_generated_files/adc/adcc.h"
+#include "mcc_generated_files/system/clock.h" // _XTAL_FREQ
+
+typedef adcc_channel_t hal_adc_channel_t;
+
+#define HAL_ADC_ANA0 channel_ANA0
+#define HAL_ADC_ANA1 channel_ANA1
+#define HAL_ADC_ANB0 channel_ANB0
+#define HAL_ADC_ANB1 channel_ANB1
+#define HAL_ADC_ANB2 channel_ANB2
+#define HAL_ADC_ANB4 channel_ANB4
+#define HAL_ADC_ANB5 channel_ANB5
+#define HAL_ADC_ANC2 channel_ANC2
+// internal references, for the ADC self-calibration
+#define HAL_ADC_VSS channel_VSS
+#define HAL_ADC_FVR channel_FVR_Buffer1
+
+#define HAL_PERSISTENT __persistent
+
+#define HAL_TICK_us 200
+#define HAL_SAMPLE_us 2000
+
+// millis()
+#define HAL_TIMESTAMP_us 1000
+
+#endif /* HAL_PIC18_H */
@@ -0,0 +1,198 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "canlib/canlib.h"
+
+#include "eeprom.h"
+#include "hall_detector.h"
+#include "prop_msg.h"
+
+#define HALL_CAL_MAGIC 0x5a
+#define HALL_CAL_RECORD_LEN 6
+#define HALL_CAL_SLOT_LEN 8
+
+static uint8_t record_checksum(const uint8_t *record) {
+    uint8_t sum = 0;
+    for (uint8_t i = 0; i < HALL_CAL_RECORD_LEN - 1; i++) {
+        sum += record[i];
+    }
+    return ~sum;
+}
+
+static void set_levels(hall_detector_t *det, uint16_t closed, uint16_t open) {
+    det->closed_level = closed;
+    det->open_level = open;
+    det->open_is_high = open > closed;
+
+    uint16_t span = det->open_is_high ? open - closed : closed - open;
+    uint16_t mid = det->open_is_high ? closed + span / 2 : open + span / 2;
+    uint16_t band = span / HALL_HYSTERESIS_DIV;
+
+    if (det->open_is_high) {
+        det->open_threshold = mid + band;
+        det->close_threshold = mid - band;
+    } else {
+        det->open_threshold = mid - band;
+        det->close_threshold = mid + band;
+    }
+}
+
+static bool load_levels(hall_detector_t *det) {
+    uint8_t record[HALL_CAL_RECORD_LEN];
+    eeprom_read(det->eeprom_addr, record, HALL_CAL_RECORD_LEN);
+
+    if (record[0] != HALL_CAL_MAGIC ||
+        record[HALL_CAL_RECORD_LEN - 1] != record_checksum(record)) {
+        return false;
+    }
+
+    uint16_t closed = ((uint16_t)record[1] << 8) | record[2];
+    uint16_t open = ((uint16_t)record[3] << 8) | record[4];
+    set_levels(det, closed, open);
+    return true;
+}
+
+static bool save_levels(const hall_detector_t *det) {
+    uint8_t record[HALL_CAL_RECORD_LEN];
+    record[0] = HALL_CAL_MAGIC;
+    record[1] = (det->closed_level >> 8) & 0xff;
+    record[2] = (det->closed_level >> 0) & 0xff;
+    record[3] = (det->open_level >> 8) & 0xff;
+    record[4] = (det->open_level >> 0) & 0xff;
+    record[5] = record_checksum(record);
+    return eeprom_write(det->eeprom_addr, record, HALL_CAL_RECORD_LEN);
+}
+
+void hall_detector_init(hall_detector_t *det,
+                        enum ACTUATOR_ID actuator,
+                        uint8_t index,
+                        uint16_t default_closed,
+                        uint16_t default_open) {
+    det->actuator = actuator;
+    det->eeprom_addr = EEPROM_HALL_CAL_ADDR + index * HALL_CAL_SLOT_LEN;
+    det->state = ACTUATOR_UNK;
+    det->debounce = 0;
+    det->cal_state = HALL_CAL_IDLE;
+
+    if (load_levels(det)) {
+        det->source = HALL_CAL_EEPROM;
+    } else {
+        set_levels(det, default_closed, default_open);
+        det->source = HALL_CAL_DEFAULT;
+    }
+}
+
+bool hall_detector_in_state(const hall_detector_t *det, uint16_t flux, enum ACTUATOR_STATE state) {
+    if (state == ACTUATOR_ON) {
+        return det->open_is_high ? flux > det->open_threshold : flux < det->open_threshold;
+    }
+    return det->open_is_high ? flux < det->close_threshold : flux > det->close_threshold;
+}
+
+enum ACTUATOR_STATE hall_detector_update(hall_detector_t *det, uint16_t flux) {
+    enum ACTUATOR_STATE candidate = det->state;
+
+    if (hall_detector_in_state(det, flux, ACTUATOR_ON)) {
+        candidate = ACTUATOR_ON;
+    } else if (hall_detector_in_state(det, flux, ACTUATOR_OFF)) {
+        candidate = ACTUATOR_OFF;
+    }
+    // inside the hysteresis band: keep whatever we had
+
+    if (candidate == det->state) {
+        det->debounce = 0;
+    } else if (++det->debounce >= HALL_DEBOUNCE_COUNT) {
+        det->state = candidate;
+        det->debounce = 0;
+    }
+
+    return det->state;
+}
+
+enum ACTUATOR_STATE hall_detector_state(const hall_detector_t *det) {
+    return det->state;
+}
+
+void hall_detector_cal_start(hall_detector_t *det) {
+    det->cal_state = HALL_CAL_WAIT_CLOSED;
+    det->cal_start_millis = millis();
+    det->cal_accum = 0;
+    det->cal_count = 0;
+}
+
+// Average HALL_CAL_SAMPLES samples once `state` has been held long enough. Returns true
+// when the average is ready.
+static bool cal_accumulate(hall_detector_t *det,
+                           uint16_t flux,
+                           enum ACTUATOR_STATE state,
+                           enum ACTUATOR_STATE commanded,
+                           uint32_t held_ms) {
+    if (commanded != state || held_ms < HALL_CAL_SETTLE_ms) {
+        // command changed part way through, start this level over
+        det->cal_accum = 0;
+        det->cal_count = 0;
+        return false;
+    }
+    det->cal_accum += flux;
+    det->cal_count++;
+    return det->cal_count >= HALL_CAL_SAMPLES;
+}
+
+bool hall_detector_cal_update(hall_detector_t *det,
+                              uint16_t flux,
+                              enum ACTUATOR_STATE commanded,
+                              uint32_t held_ms) {
+    switch (det->cal_state) {
+        case HALL_CAL_WAIT_CLOSED:
+            if (cal_accumulate(det, flux, ACTUATOR_OFF, commanded, held_ms)) {
+                det->cal_closed_level = det->cal_accum / det->cal_count;
+                det->cal_accum = 0;
+                det->cal_count = 0;
+                det->cal_state = HALL_CAL_WAIT_OPEN;
+            }
+            break;
+
+        case HALL_CAL_WAIT_OPEN:
+            if (cal_accumulate(det, flux, ACTUATOR_ON, commanded, held_ms)) {
+                uint16_t open = det->cal_accum / det->cal_count;
+                uint16_t closed = det->cal_closed_level;
+                uint16_t span = open > closed ? open - closed : closed - open;
+
+                if (span < HALL_CAL_MIN_SPAN) {
+                    det->cal_state = HALL_CAL_FAILED;
+                    return true;
+                }
+
+                set_levels(det, closed, open);
+                save_levels(det);
+                det->source = HALL_CAL_LEARNED;
+                det->cal_state = HALL_CAL_IDLE;
+                return true;
+            }
+            break;
+
+        default:
+            return false;
+    }
+
+    if ((millis() - det->cal_start_millis) > HALL_CAL_TIMEOUT_ms) {
+        det->cal_state = HALL_CAL_FAILED;
+        return true;
+    }
+    return false;
+}
+
+void hall_detector_report(const hall_detector_t *det) {
+    uint8_t payload[7];
+    payload[0] = det->actuator;
+    payload[1] = (det->open_threshold >> 8) & 0xff;
+    payload[2] = (det->open_threshold >> 0) & 0xff;
+    payload[3] = (det->close_threshold >> 8) & 0xff;
+    payload[4] = (det->close_threshold >> 0) & 0xff;
+    payload[5] = det->source;
+    payload[6] = det->cal_state;
+
+    can_msg_t msg;
+    build_prop_msg(PROP_MSG_HALL_CAL, payload, sizeof(payload), &msg);
+    txb_enqueue(&msg);
+}
@@ -0,0 +1,92 @@
+#ifndef HALL_DETECTOR_H
+#define HALL_DETECTOR_H
+
+#include "canlib/message_types.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Per-valve open/closed detection from a hall sensor. The open and closed flux levels
+// come from EEPROM if the valve has been calibrated, otherwise from bench defaults.
+// Switching thresholds sit either side of the midpoint (hysteresis) and a new state has
+// to be seen on HALL_DEBOUNCE_COUNT samples in a row before it is reported.
+
+// Bench measurement:
+// Fuel INJ: Closed 3415, Open 2600
+// Ox INJ: Closed 670, Open 2240
+#define HALL_FUEL_DEFAULT_CLOSED 3415
+#define HALL_FUEL_DEFAULT_OPEN 2600
+#define HALL_OX_DEFAULT_CLOSED 670
+#define HALL_OX_DEFAULT_OPEN 2240
+
+// thresholds are this fraction of the open-closed span either side of the midpoint
+#define HALL_HYSTERESIS_DIV 8
+
+#define HALL_DEBOUNCE_COUNT 3
+
+// auto-calibration
+#define HALL_CAL_SETTLE_ms 500 // wait after a state change before averaging
+#define HALL_CAL_SAMPLES 32
+#define HALL_CAL_MIN_SPAN 200 // reject calibrations with less difference than this
+#define HALL_CAL_TIMEOUT_ms 60000
+
+enum HALL_CAL_SOURCE { HALL_CAL_DEFAULT = 0, HALL_CAL_EEPROM, HALL_CAL_LEARNED };
+
+enum HALL_CAL_STATE {
+    HALL_CAL_IDLE = 0,
+    HALL_CAL_WAIT_CLOSED,
+    HALL_CAL_WAIT_OPEN,
+    HALL_CAL_FAILED
+};
+
+typedef struct {
+    enum ACTUATOR_ID actuator;
+    uint16_t eeprom_addr;
+
+    uint16_t open_level;
+    uint16_t closed_level;
+    uint16_t open_threshold; // crossing this towards open_level means open
+    uint16_t close_threshold; // crossing this towards closed_level means closed
+    bool open_is_high;
+    enum HALL_CAL_SOURCE source;
+
+    enum ACTUATOR_STATE state;
+    uint8_t debounce;
+
+    // calibration
+    enum HALL_CAL_STATE cal_state;
+    uint32_t cal_start_millis;
+    uint32_t cal_accum;
+    uint8_t cal_count;
+    uint16_t cal_closed_level;
+} hall_detector_t;
+
+// Load calibration from EEPROM slot `index`, falling back to the given defaults
+void hall_detector_init(hall_detector_t *det,
+                        enum ACTUATOR_ID actuator,
+                        uint8_t index,
+                        uint16_t default_closed,
+                        uint16_t default_open);
+
+// Feed a new sample, returns the debounced state
+enum ACTUATOR_STATE hall_detector_update(hall_detector_t *det, uint16_t flux);
+
+enum ACTUATOR_STATE hall_detector_state(const hall_detector_t *det);
+
+// Raw comparison against the threshold for `state`, no debouncing
+bool hall_detector_in_state(const hall_detector_t *det, uint16_t flux, enum ACTUATOR_STATE state);
+
+// Learn the closed and open levels over the next commanded close/open cycle
+void hall_detector_cal_start(hall_detector_t *det);
+
+// Feed calibration with the commanded state and how long it's been held. Returns true
+// when calibration finishes, successfully or not.
+bool hall_detector_cal_update(hall_detector_t *det,
+                              uint16_t flux,
+                              enum ACTUATOR_STATE commanded,
+                              uint32_t held_ms);
+
+// Send the current thresholds over CAN
+void hall_detector_report(const hall_detector_t *det);
+
+#endif /* HALL_DETECTOR_H */
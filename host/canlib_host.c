@@ -0,0 +1,179 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <net/if.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include "canlib/canlib.h"
+
+#include "../hal.h"
+#include "canlib_host.h"
+#include "scenario.h"
+
+// Host stand-ins for canlib's PIC18 CAN and timer drivers. Everything the board sends is
+// written to stdout in candump -L format, so the tools in tools/ work on simulator output,
+// and to the SocketCAN interface if one was opened.
+
+// Without SocketCAN the board would be alone on the bus, hear nothing and have
+// can_recovery reset it a few seconds in. The other propulsion board stands in for the
+// rest of the bus and sends its status at the rate main.c does.
+#define PEER_STATUS_PERIOD_ms 500
+#if (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_INJ)
+#define PEER_BOARD_ID BOARD_ID_PROPULSION_VENT
+#else
+#define PEER_BOARD_ID BOARD_ID_PROPULSION_INJ
+#endif
+
+static void (*rx_handler)(const can_msg_t *msg) = NULL;
+static int sock = -1;
+static const char *iface_name = "sim";
+static bool quiet = false;
+static bool peer = true;
+static uint64_t next_peer_us = 0;
+
+bool can_host_open(const char *iface) {
+    sock = socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK, CAN_RAW);
+    if (sock < 0) {
+        perror("socket");
+        return false;
+    }
+
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, iface, IFNAMSIZ - 1);
+    if (ioctl(sock, SIOCGIFINDEX, &ifr) < 0) {
+        perror(iface);
+        close(sock);
+        sock = -1;
+        return false;
+    }
+
+    struct sockaddr_can addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        close(sock);
+        sock = -1;
+        return false;
+    }
+
+    iface_name = iface;
+    return true;
+}
+
+void can_host_inject(const can_msg_t *msg) {
+    if (rx_handler) {
+        // same context as the CAN interrupt on the board
+        bool irq = hal_irq_disable();
+        rx_handler(msg);
+        hal_irq_restore(irq);
+    }
+}
+
+void can_host_set_peer(bool on) {
+    peer = on;
+}
+
+static void poll_peer(void) {
+    uint64_t now = hal_host_micros();
+    if (now < next_peer_us) {
+        return;
+    }
+    next_peer_us = now + PEER_STATUS_PERIOD_ms * 1000;
+
+    can_msg_t msg;
+    build_board_stat_msg((uint32_t)(now / 1000), E_NOMINAL, NULL, 0, &msg);
+    msg.sid = MSG_GENERAL_BOARD_STATUS | PEER_BOARD_ID;
+    can_host_inject(&msg);
+}
+
+void can_host_poll(void) {
+    struct can_frame frame;
+
+    if (sock < 0 && peer) {
+        poll_peer();
+    }
+
+    while (sock >= 0 && read(sock, &frame, sizeof(frame)) == sizeof(frame)) {
+        // canlib only uses standard data frames
+        if (frame.can_id & (CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_ERR_FLAG)) {
+            continue;
+        }
+
+        can_msg_t msg;
+        msg.sid = frame.can_id & CAN_SFF_MASK;
+        msg.data_len = frame.can_dlc > 8 ? 8 : frame.can_dlc;
+        memcpy(msg.data, frame.data, msg.data_len);
+        can_host_inject(&msg);
+    }
+}
+
+void can_init(const can_timing_t *timing, void (*receive_callback)(const can_msg_t *message)) {
+    (void)timing;
+    rx_handler = receive_callback;
+}
+
+void can_host_set_quiet(bool on) {
+    quiet = on;
+}
+
+void can_send(const can_msg_t *message) {
+    if (quiet) {
+        return;
+    }
+    uint64_t now = hal_host_micros();
+    scenario_sent(message, now);
+    printf("(%" PRIu64 ".%06" PRIu64 ") %s %03X#",
+           now / 1000000,
+           now % 1000000,
+           iface_name,
+           message->sid);
+    for (uint8_t i = 0; i < message->data_len; i++) {
+        printf("%02X", message->data[i]);
+    }
+    printf("\n");
+
+    if (sock >= 0) {
+        struct can_frame frame;
+        memset(&frame, 0, sizeof(frame));
+        frame.can_id = message->sid & CAN_SFF_MASK;
+        frame.can_dlc = message->data_len;
+        memcpy(frame.data, message->data, message->data_len);
+        if (write(sock, &frame, sizeof(frame)) != sizeof(frame) && errno != ENOBUFS) {
+            perror("can write");
+        }
+    }
+}
+
+// Holds frames back in the TX buffer while the socket queue is full, like a busy bus
+bool can_send_rdy(void) {
+    if (sock < 0) {
+        return true;
+    }
+    struct pollfd pfd = {.fd = sock, .events = POLLOUT};
+    return poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLOUT);
+}
+
+void can_handle_interrupt(void) {
+}
+
+void timer0_init(void) {
+}
+
+void timer0_handle_interrupt(void) {
+}
+
+uint32_t millis(void) {
+    return (uint32_t)(hal_host_micros() / 1000);
+}
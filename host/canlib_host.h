@@ -0,0 +1,26 @@
+#ifndef CANLIB_HOST_H
+#define CANLIB_HOST_H
+
+#include <stdbool.h>
+
+#include "canlib/canlib.h"
+
+// Bind the CAN driver stand-in to a SocketCAN interface (vcan0 needs no hardware).
+// Without it frames are only written to stdout and nothing is ever received.
+bool can_host_open(const char *iface);
+
+// Hand every frame waiting on the socket to the receive callback, as the CAN interrupt
+// would. Called once per main loop pass.
+void can_host_poll(void);
+
+// Without a SocketCAN interface a simulated peer board sends its status every 500 ms,
+// so the bus isn't dead. Off for testing the recovery from a dead bus.
+void can_host_set_peer(bool on);
+
+// Drop sent frames instead of printing them, for the fuzzer
+void can_host_set_quiet(bool on);
+
+// Deliver one frame to the receive callback as if it came off the bus
+void can_host_inject(const can_msg_t *msg);
+
+#endif /* CANLIB_HOST_H */
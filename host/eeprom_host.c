@@ -0,0 +1,61 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../eeprom.h"
+#include "eeprom_host.h"
+
+static uint8_t mem[EEPROM_SIZE];
+static FILE *backing = NULL;
+
+void eeprom_host_init(const char *path) {
+    memset(mem, 0xff, sizeof(mem));
+    if (!path) {
+        return;
+    }
+
+    backing = fopen(path, "r+b");
+    if (backing) {
+        size_t len = fread(mem, 1, sizeof(mem), backing);
+        (void)len; // a short file is erased past its end
+    } else {
+        backing = fopen(path, "w+b");
+        if (!backing) {
+            perror(path);
+            return;
+        }
+    }
+    fseek(backing, 0, SEEK_SET);
+    fwrite(mem, 1, sizeof(mem), backing);
+    fflush(backing);
+}
+
+void eeprom_read(uint16_t addr, uint8_t *buf, uint8_t len) {
+    for (uint8_t i = 0; i < len; i++) {
+        buf[i] = mem[(addr + i) % EEPROM_SIZE];
+    }
+}
+
+// Writes land right away, there is no write cycle to wait out
+bool eeprom_write(uint16_t addr, const uint8_t *buf, uint8_t len) {
+    for (uint8_t i = 0; i < len; i++) {
+        mem[(addr + i) % EEPROM_SIZE] = buf[i];
+    }
+    if (backing) {
+        fseek(backing, 0, SEEK_SET);
+        fwrite(mem, 1, sizeof(mem), backing);
+        fflush(backing);
+    }
+    return true;
+}
+
+bool eeprom_busy(void) {
+    return false;
+}
+
+void eeprom_flush(void) {
+}
+
+void eeprom_heartbeat(void) {
+}
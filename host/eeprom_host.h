@@ -0,0 +1,8 @@
+#ifndef EEPROM_HOST_H
+#define EEPROM_HOST_H
+
+// Host stand-in for the data EEPROM, implements eeprom.h. Starts erased (0xff), or from
+// the contents of path, which every write then goes through to.
+void eeprom_host_init(const char *path);
+
+#endif /* EEPROM_HOST_H */
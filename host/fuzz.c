@@ -0,0 +1,203 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "canlib/canlib.h"
+
+#include "../actuator.h"
+#include "../error_checks.h"
+#include "../hal.h"
+#include "canlib_host.h"
+#include "fuzz.h"
+
+#ifdef __AFL_FUZZ_TESTCASE_LEN
+__AFL_FUZZ_INIT();
+#endif
+
+#define MAX_INPUT_LEN (1 << 16)
+
+// must match main.c
+#define MAX_CAN_IDLE_TIME_MS 20000
+#define STATUS_TIME_DIFF_ms 500
+#if (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_INJ)
+#define INJECTOR_PIN 0
+#define FILL_DUMP_PIN 2
+#define VALVE_PINS ((1 << INJECTOR_PIN) | (1 << FILL_DUMP_PIN))
+#define SAFE_STATE_PINS (1 << FILL_DUMP_PIN) // the injector keeps its state
+extern volatile enum ACTUATOR_STATE requested_actuator_state_fill;
+extern volatile enum ACTUATOR_STATE requested_actuator_state_inj;
+#elif (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_VENT)
+#define VENT_VALVE_PIN 0
+#define VALVE_PINS (1 << VENT_VALVE_PIN)
+#define SAFE_STATE_PINS (1 << VENT_VALVE_PIN)
+extern volatile enum ACTUATOR_STATE requested_actuator_state_vent;
+#endif
+
+// margin for the status pass to come around
+#define SAFE_STATE_DEADLINE_us ((STATUS_TIME_DIFF_ms + 2 * FUZZ_LOOP_us / 1000 + 1) * 1000ULL)
+
+static const char *input_path = NULL;
+static const uint8_t *input = NULL;
+static size_t input_len = 0;
+static size_t pos = 0;
+static bool started = false;
+static bool in_tail = false;
+
+static uint64_t run_until_us = 0;
+static uint64_t last_frame_us = 0;
+static bool batt_critical = false;
+static uint64_t batt_critical_since_us;
+static uint8_t last_outputs = 0;
+// read back from the expander at boot, the unused pins keep whatever they had
+static uint8_t boot_outputs;
+
+static uint8_t next_byte(void) {
+    return pos < input_len ? input[pos++] : 0;
+}
+
+static void read_input(void) {
+#ifdef __AFL_FUZZ_TESTCASE_LEN
+    input = __AFL_FUZZ_TESTCASE_BUF;
+    input_len = __AFL_FUZZ_TESTCASE_LEN;
+#else
+    static uint8_t buf[MAX_INPUT_LEN];
+    FILE *f = input_path ? fopen(input_path, "rb") : stdin;
+    if (!f) {
+        perror(input_path);
+        exit(EXIT_FAILURE);
+    }
+    input_len = fread(buf, 1, sizeof(buf), f);
+    input = buf;
+    if (f != stdin) {
+        fclose(f);
+    }
+#endif
+}
+
+static void violation(const char *what, uint64_t now_us) {
+    fprintf(stderr, "invariant violated at %.3f s: %s\n", now_us / 1e6, what);
+    abort();
+}
+
+static bool requested_on(uint8_t pin) {
+#if (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_INJ)
+    if (pin == INJECTOR_PIN) {
+        return requested_actuator_state_inj == ACTUATOR_ON;
+    }
+    if (pin == FILL_DUMP_PIN) {
+        return requested_actuator_state_fill == ACTUATOR_ON;
+    }
+#elif (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_VENT)
+    if (pin == VENT_VALVE_PIN) {
+        return requested_actuator_state_vent == ACTUATOR_ON;
+    }
+#endif
+    return false;
+}
+
+static bool valid_state(enum ACTUATOR_STATE state) {
+    return state == ACTUATOR_ON || state == ACTUATOR_OFF;
+}
+
+static void check_invariants(uint64_t now_us) {
+#if (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_INJ)
+    if (!valid_state(requested_actuator_state_inj) || !valid_state(requested_actuator_state_fill)) {
+        violation("requested actuator state out of range", now_us);
+    }
+#elif (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_VENT)
+    if (!valid_state(requested_actuator_state_vent)) {
+        violation("requested actuator state out of range", now_us);
+    }
+#endif
+
+    uint8_t outputs = get_actuator_outputs();
+    if ((outputs ^ boot_outputs) & ~VALVE_PINS) {
+        violation("output changed outside the valve pins", now_us);
+    }
+
+    uint8_t turned_on = outputs & ~last_outputs;
+    for (uint8_t pin = 0; pin < 8; pin++) {
+        if ((turned_on & (1 << pin)) && !requested_on(pin)) {
+            violation("output turned on without being requested", now_us);
+        }
+    }
+    last_outputs = outputs;
+
+    bool critical = is_batt_voltage_critical();
+    if (critical && !batt_critical) {
+        batt_critical_since_us = now_us;
+    }
+    batt_critical = critical;
+
+    bool idle = now_us - last_frame_us > MAX_CAN_IDLE_TIME_MS * 1000ULL + SAFE_STATE_DEADLINE_us;
+    bool low_batt = batt_critical && now_us - batt_critical_since_us > SAFE_STATE_DEADLINE_us;
+    if ((idle || low_batt) && (outputs & SAFE_STATE_PINS)) {
+        violation(idle ? "not in safe state after CAN idle" : "not in safe state on low battery",
+                  now_us);
+    }
+}
+
+static void inject_frame(uint8_t dlc, uint64_t now_us) {
+    can_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.sid = ((uint16_t)next_byte() << 8 | next_byte()) & 0x7ff;
+    msg.data_len = dlc; // the raw DLC, 9-15 still only carry 8 bytes
+    for (uint8_t i = 0; i < dlc && i < 8; i++) {
+        msg.data[i] = next_byte();
+    }
+    last_frame_us = now_us;
+    can_host_inject(&msg);
+}
+
+void fuzz_init(int argc, char **argv) {
+    if (argc > 2) {
+        fprintf(stderr, "usage: %s [INPUT]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    input_path = argc == 2 ? argv[1] : NULL;
+}
+
+void fuzz_step(uint64_t now_us) {
+    if (!started) {
+        // everything before this is the same for every input
+        started = true;
+#ifdef __AFL_HAVE_MANUAL_CONTROL
+        __AFL_INIT();
+#endif
+        read_input();
+        last_frame_us = now_us;
+        boot_outputs = get_actuator_outputs();
+        last_outputs = boot_outputs;
+    }
+
+    check_invariants(now_us);
+
+    if (now_us > FUZZ_MAX_RUN_ms * 1000ULL) {
+        exit(EXIT_SUCCESS);
+    }
+
+    while (now_us >= run_until_us) {
+        if (pos >= input_len) {
+            if (in_tail) {
+                exit(EXIT_SUCCESS);
+            }
+            in_tail = true;
+            run_until_us = now_us + FUZZ_TAIL_ms * 1000ULL;
+            return;
+        }
+
+        uint8_t op = next_byte();
+        if (op < 0x40) {
+            inject_frame(op & 0x0f, now_us);
+        } else if (op < 0x80) {
+            run_until_us = now_us + ((op & 0x3f) + 1) * 1000ULL;
+        } else if (op < 0xc0) {
+            run_until_us = now_us + ((op & 0x3f) + 1) * 500000ULL;
+        } else {
+            uint16_t raw = (uint16_t)next_byte() << 8 | next_byte();
+            hal_host_set_adc((hal_adc_channel_t)(op & 0x07), raw & 0xfff);
+        }
+    }
+}
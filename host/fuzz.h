@@ -0,0 +1,39 @@
+#ifndef FUZZ_H
+#define FUZZ_H
+
+#include <stdint.h>
+
+// Fuzzing backend for the host build (-DHAL_HOST_FUZZ). The firmware boots as usual, then
+// the input drives it as a sequence of operations, one byte each plus arguments:
+//
+//   0x00-0x3f  CAN frame: low nibble is the DLC as the CAN module would report it
+//              (0-15), then SID (2, big endian) and min(DLC, 8) data bytes
+//   0x40-0x7f  run (op & 0x3f) + 1 ms
+//   0x80-0xbf  run ((op & 0x3f) + 1) * 500 ms
+//   0xc0-0xff  set ADC channel (op & 0x07) to the next 2 bytes, big endian, 12 bits
+//
+// Missing argument bytes at the end of the input read as zero. After the last operation
+// the run goes on for FUZZ_TAIL_ms so the next status pass sees the final state.
+//
+// Invariants are checked on every main loop pass, and a violation aborts:
+//   - requested actuator states are only ever ACTUATOR_ON or ACTUATOR_OFF
+//   - output bits outside the board's valve pins never change
+//   - an output only turns on if that valve is requested on
+//   - the safe state holds once the bus has been idle for MAX_CAN_IDLE_TIME_MS plus a
+//     status period, or the battery has been critical for a status period
+//
+// Built with afl-clang-fast, the fork server starts after the firmware's init code, so
+// every run skips the boot. Built with a plain compiler, it runs one input from a file
+// or stdin, for reproducing crashes.
+
+#define FUZZ_LOOP_us 1000
+#define FUZZ_TAIL_ms 1000
+// Upper bound on virtual time per input
+#define FUZZ_MAX_RUN_ms 120000
+
+void fuzz_init(int argc, char **argv);
+
+// Once per main loop pass, from hal_watchdog_clear()
+void fuzz_step(uint64_t now_us);
+
+#endif /* FUZZ_H */
@@ -0,0 +1,424 @@
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../hal.h"
+#include "../input_record.h"
+#include "../instability.h"
+#include "../sequence.h"
+#include "canlib_host.h"
+#include "eeprom_host.h"
+#include "fuzz.h"
+#include "plant.h"
+#include "replay.h"
+#include "scenario.h"
+
+// PCON0 and STATUS as left by a power-on reset
+#define POWER_ON_RESET_CAUSE 0x603d
+
+#define PLANT_LOG_PERIOD_ms 10
+
+static uint16_t adc[HAL_ADC_NUM_CHANNELS];
+// Channels set with --adc, the plant model leaves these alone
+static bool adc_pinned[HAL_ADC_NUM_CHANNELS];
+
+static uint64_t now_us = 0;
+static uint32_t loop_us = 100;
+static uint64_t duration_us = 10000000;
+static bool verbose = false;
+
+static bool replaying = false;
+
+// Paced to the wall clock while on a real SocketCAN interface
+static bool realtime = false;
+static struct timespec start_time;
+
+static bool irq_enabled = false;
+
+static bool tick_running = false;
+static uint64_t tick_start_us;
+static uint16_t tick_stopped_us = 0; // like T2TMR, the count holds where the timer stopped
+static uint64_t next_tick_us;
+
+static bool sample_running = false;
+static uint64_t next_sample_us;
+static hal_adc_channel_t sample_channel;
+static bool sample_converted = false;
+static uint16_t sample_raw;
+
+static bool leds[3];
+
+#ifndef HAL_HOST_FUZZ
+// the fuzz build takes every input from the fuzzer, none of the command line
+static const char *const adc_names[HAL_ADC_NUM_CHANNELS] = {
+    "ANA0", "ANA1", "ANB0", "ANB1", "ANB2", "ANB4", "ANB5", "ANC2", "VSS", "FVR"};
+
+static FILE *record_out = NULL;
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -d, --duration-ms MS   virtual time to run for (default 10000)\n"
+            "  -l, --loop-us US       virtual time per main loop pass (default 100)\n"
+            "  -a, --adc CH=RAW       pin a channel to a raw value, e.g. ANB1=1200\n"
+            "  -p, --plant NAME=VAL   set a plant model parameter\n"
+            "  -P, --plant-params     list the plant model parameters and exit\n"
+            "  -s, --scenario FILE    timed plant parameter changes and CAN frames\n"
+            "  -t, --plant-log FILE   CSV trace of the plant state every 10 ms\n"
+            "  -S, --seed N           sensor noise seed\n"
+            "  -r, --record FILE      record the ADC and CAN inputs to FILE\n"
+            "  -R, --replay FILE      take the inputs from a recording instead\n"
+            "  -e, --eeprom FILE      back the data EEPROM with FILE\n"
+            "  -c, --can IFACE        join a SocketCAN interface, runs in real time\n"
+            "  -B, --bus-dead         no peer board on the simulated bus\n"
+            "  -v, --verbose          log LEDs and resets to stderr\n",
+            prog);
+    exit(EXIT_FAILURE);
+}
+
+static void set_adc_option(const char *prog, const char *arg) {
+    const char *eq = strchr(arg, '=');
+    if (eq) {
+        for (int i = 0; i < HAL_ADC_NUM_CHANNELS; i++) {
+            if (strlen(adc_names[i]) == (size_t)(eq - arg) &&
+                strncmp(adc_names[i], arg, eq - arg) == 0) {
+                adc[i] = (uint16_t)strtoul(eq + 1, NULL, 0) & 0xfff;
+                adc_pinned[i] = true;
+                return;
+            }
+        }
+    }
+    fprintf(stderr, "bad --adc value: %s\n", arg);
+    usage(prog);
+}
+
+static void record_sink(const uint8_t *data, uint16_t len) {
+    if (fwrite(data, 1, len, record_out) != len) {
+        perror("record");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void record_close(void) {
+    input_record_flush();
+    fclose(record_out);
+}
+
+static void set_plant_option(const char *prog, const char *arg) {
+    char name[64];
+    const char *eq = strchr(arg, '=');
+    if (eq && (size_t)(eq - arg) < sizeof(name)) {
+        memcpy(name, arg, eq - arg);
+        name[eq - arg] = '\0';
+        if (plant_set(name, strtod(eq + 1, NULL))) {
+            return;
+        }
+    }
+    fprintf(stderr, "bad --plant value: %s\n", arg);
+    usage(prog);
+}
+#endif
+
+void hal_init(int argc, char **argv) {
+#ifdef HAL_HOST_FUZZ
+    // every input comes from the fuzzer, see fuzz.c
+    eeprom_host_init(NULL);
+    plant_init(1);
+    plant_step(0);
+    can_host_set_quiet(true);
+    loop_us = FUZZ_LOOP_us;
+    duration_us = UINT64_MAX;
+    fuzz_init(argc, argv);
+#else
+    static const struct option options[] = {{"duration-ms", required_argument, NULL, 'd'},
+                                            {"loop-us", required_argument, NULL, 'l'},
+                                            {"adc", required_argument, NULL, 'a'},
+                                            {"plant", required_argument, NULL, 'p'},
+                                            {"plant-params", no_argument, NULL, 'P'},
+                                            {"scenario", required_argument, NULL, 's'},
+                                            {"plant-log", required_argument, NULL, 't'},
+                                            {"seed", required_argument, NULL, 'S'},
+                                            {"record", required_argument, NULL, 'r'},
+                                            {"replay", required_argument, NULL, 'R'},
+                                            {"eeprom", required_argument, NULL, 'e'},
+                                            {"can", required_argument, NULL, 'c'},
+                                            {"bus-dead", no_argument, NULL, 'B'},
+                                            {"verbose", no_argument, NULL, 'v'},
+                                            {NULL, 0, NULL, 0}};
+
+    const char *eeprom_path = NULL;
+    const char *can_iface = NULL;
+    const char *scenario_path = NULL;
+    const char *plant_log_path = NULL;
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    uint64_t seed = 1;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "d:l:a:p:Ps:t:S:r:R:e:c:Bv", options, NULL)) != -1) {
+        switch (opt) {
+            case 'd':
+                duration_us = strtoull(optarg, NULL, 0) * 1000;
+                break;
+            case 'l':
+                loop_us = strtoul(optarg, NULL, 0);
+                if (loop_us == 0) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'a':
+                set_adc_option(argv[0], optarg);
+                break;
+            case 'p':
+                set_plant_option(argv[0], optarg);
+                break;
+            case 'P':
+                plant_list_params(stdout);
+                exit(EXIT_SUCCESS);
+            case 's':
+                scenario_path = optarg;
+                break;
+            case 't':
+                plant_log_path = optarg;
+                break;
+            case 'S':
+                seed = strtoull(optarg, NULL, 0);
+                break;
+            case 'r':
+                record_path = optarg;
+                break;
+            case 'R':
+                replay_path = optarg;
+                break;
+            case 'e':
+                eeprom_path = optarg;
+                break;
+            case 'c':
+                can_iface = optarg;
+                break;
+            case 'B':
+                can_host_set_peer(false);
+                break;
+            case 'v':
+                verbose = true;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (replay_path && (scenario_path || can_iface)) {
+        fprintf(stderr, "--replay provides all the inputs, no --scenario or --can\n");
+        usage(argv[0]);
+    }
+
+    eeprom_host_init(eeprom_path);
+
+    if (scenario_path && !scenario_load(scenario_path)) {
+        exit(EXIT_FAILURE);
+    }
+    if (scenario_end_us()) {
+        duration_us = scenario_end_us();
+    }
+    if (plant_log_path) {
+        FILE *f = fopen(plant_log_path, "w");
+        if (!f) {
+            perror(plant_log_path);
+            exit(EXIT_FAILURE);
+        }
+        plant_log_open(f, PLANT_LOG_PERIOD_ms);
+    }
+    // settle the ADC channels before the firmware's first read
+    plant_init(seed);
+    plant_step(0);
+
+    if (replay_path) {
+        if (!replay_open(replay_path)) {
+            exit(EXIT_FAILURE);
+        }
+        replaying = true;
+        // exact replay needs the recording's timing
+        if (replay_loop_us()) {
+            loop_us = replay_loop_us();
+            duration_us = replay_duration_us();
+        }
+    }
+
+    if (record_path) {
+        record_out = fopen(record_path, "wb");
+        if (!record_out) {
+            perror(record_path);
+            exit(EXIT_FAILURE);
+        }
+        input_record_set_sink(record_sink);
+        atexit(record_close);
+        input_record_start(loop_us, duration_us / 1000);
+    }
+
+    if (can_iface) {
+        if (!can_host_open(can_iface)) {
+            exit(EXIT_FAILURE);
+        }
+        realtime = true;
+        clock_gettime(CLOCK_MONOTONIC, &start_time);
+    }
+#endif
+}
+
+// Sleep until the wall clock catches up with virtual time
+static void pace(void) {
+    struct timespec target = start_time;
+    target.tv_sec += now_us / 1000000;
+    target.tv_nsec += (now_us % 1000000) * 1000;
+    if (target.tv_nsec >= 1000000000) {
+        target.tv_sec++;
+        target.tv_nsec -= 1000000000;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &target, NULL);
+}
+
+bool hal_irq_disable(void) {
+    bool enabled = irq_enabled;
+    irq_enabled = false;
+    return enabled;
+}
+
+void hal_irq_restore(bool enabled) {
+    irq_enabled = enabled;
+}
+
+void hal_irq_enable(void) {
+    irq_enabled = true;
+}
+
+// One main loop pass worth of virtual time, with the interrupts that fall in it
+void hal_watchdog_clear(void) {
+    now_us += loop_us;
+    if (realtime) {
+        pace();
+    }
+
+#ifdef HAL_HOST_FUZZ
+    fuzz_step(now_us);
+#else
+    if (replaying) {
+        replay_advance(now_us);
+    } else {
+        can_host_poll();
+        scenario_poll(now_us);
+        plant_step(loop_us);
+    }
+#endif
+
+    while (tick_running && next_tick_us <= now_us) {
+        next_tick_us += HAL_TICK_us;
+        sequence_handle_timer_interrupt();
+    }
+    while (sample_running && next_sample_us <= now_us) {
+        next_sample_us += HAL_SAMPLE_us;
+        // like the PIC, a conversion goes out on the tick after the one that started it
+        if (sample_converted) {
+            instability_handle_sample_interrupt(sample_raw);
+        }
+        sample_raw = hal_adc_read(sample_channel);
+        sample_converted = true;
+    }
+
+    if (now_us >= duration_us) {
+        exit(scenario_checks_passed() ? EXIT_SUCCESS : HAL_HOST_EXIT_CHECK);
+    }
+}
+
+void hal_reset(void) {
+    if (verbose) {
+        fprintf(stderr, "%.3f: reset\n", now_us / 1e6);
+    }
+    exit(HAL_HOST_EXIT_RESET);
+}
+
+uint16_t hal_get_reset_cause(void) {
+    return POWER_ON_RESET_CAUSE;
+}
+
+uint16_t hal_adc_read(hal_adc_channel_t channel) {
+    uint16_t raw;
+    // the internal references aren't in recordings, they read what the plant left them at
+    if (!replaying || input_record_channel_index(channel) < 0 ||
+        !replay_adc(channel, now_us, &raw)) {
+        raw = channel < HAL_ADC_NUM_CHANNELS ? adc[channel] : 0;
+    }
+    input_record_adc(channel, raw);
+    return raw;
+}
+
+uint32_t hal_timestamp(void) {
+    return (uint32_t)now_us;
+}
+
+void hal_led_init(void) {
+    memset(leds, 0, sizeof(leds));
+}
+
+void hal_led_set(enum hal_led led, bool on) {
+    static const char *const names[] = {"green", "blue", "red"};
+    if (verbose && leds[led] != on) {
+        fprintf(stderr, "%.3f: %s LED %s\n", now_us / 1e6, names[led], on ? "on" : "off");
+    }
+    leds[led] = on;
+}
+
+void hal_can_pins_init(void) {
+}
+
+uint8_t hal_can_tx_errors(void) {
+    return 0;
+}
+
+uint8_t hal_can_rx_errors(void) {
+    return 0;
+}
+
+bool hal_can_bus_off(void) {
+    return false;
+}
+
+void hal_tick_timer_start(void) {
+    tick_running = true;
+    tick_start_us = now_us;
+    next_tick_us = now_us + HAL_TICK_us;
+}
+
+void hal_tick_timer_stop(void) {
+    if (tick_running) {
+        tick_stopped_us = (now_us - tick_start_us) % HAL_TICK_us;
+    }
+    tick_running = false;
+}
+
+uint16_t hal_tick_timer_elapsed_us(void) {
+    return tick_running ? (now_us - tick_start_us) % HAL_TICK_us : tick_stopped_us;
+}
+
+void hal_sample_timer_start(hal_adc_channel_t channel) {
+    sample_channel = channel;
+    sample_converted = false;
+    sample_running = true;
+    next_sample_us = now_us + HAL_SAMPLE_us;
+}
+
+void hal_sample_timer_stop(void) {
+    sample_running = false;
+}
+
+uint64_t hal_host_micros(void) {
+    return now_us;
+}
+
+void hal_host_set_adc(hal_adc_channel_t channel, uint16_t raw) {
+    if (channel < HAL_ADC_NUM_CHANNELS && !adc_pinned[channel]) {
+        adc[channel] = raw & 0xfff;
+    }
+}
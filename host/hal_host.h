@@ -0,0 +1,44 @@
+#ifndef HAL_HOST_H
+#define HAL_HOST_H
+
+#include <stdint.h>
+
+// Host simulator side of hal.h. Time is virtual and moves forward by a fixed step on every
+// main loop pass (hal_watchdog_clear()), so the firmware runs as fast as the host can go
+// and a run is repeatable.
+
+typedef enum {
+    HAL_ADC_ANA0,
+    HAL_ADC_ANA1,
+    HAL_ADC_ANB0,
+    HAL_ADC_ANB1,
+    HAL_ADC_ANB2,
+    HAL_ADC_ANB4,
+    HAL_ADC_ANB5,
+    HAL_ADC_ANC2,
+    HAL_ADC_VSS,
+    HAL_ADC_FVR,
+    HAL_ADC_NUM_CHANNELS
+} hal_adc_channel_t;
+
+#define HAL_PERSISTENT
+
+// same crystal as the board, canlib works out the CAN bit timing from it
+#define _XTAL_FREQ 12000000
+
+#define HAL_TICK_us 200
+#define HAL_SAMPLE_us 2000
+
+#define HAL_TIMESTAMP_us 1
+
+// Exit status when the firmware calls hal_reset()
+#define HAL_HOST_EXIT_RESET 3
+
+// Virtual time since hal_init()
+uint64_t hal_host_micros(void);
+
+// Raw 12 bit value hal_adc_read() returns for the channel until it is set again. Ignored
+// for channels pinned with --adc.
+void hal_host_set_adc(hal_adc_channel_t channel, uint16_t raw);
+
+#endif /* HAL_HOST_H */
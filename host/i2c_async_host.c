@@ -0,0 +1,101 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "../i2c_async.h"
+#include "i2c_async_host.h"
+
+// Host stand-in for i2c_async.c with a PCA9536 on the bus. Transactions finish as soon
+// as they are submitted, callbacks still only run from i2c_async_heartbeat().
+
+#define PCA9536_ADDR 0x41
+#define PCA9536_NUM_REGS 4
+#define PCA9536_INPUT 0x00
+#define PCA9536_OUTPUT 0x01
+#define PCA9536_CONFIG 0x03
+
+// Power-on values: outputs high, every pin an input
+static uint8_t pca_regs[PCA9536_NUM_REGS] = {0x0f, 0xff, 0x00, 0xff};
+
+static i2c_txn_t *done[I2C_ASYNC_QUEUE_LEN];
+static uint8_t done_head = 0;
+static uint8_t done_count = 0;
+
+static i2c_async_stats_t stats = {0};
+
+void i2c_async_init(enum i2c_speed speed) {
+    (void)speed;
+    done_head = 0;
+    done_count = 0;
+}
+
+static enum i2c_txn_status pca9536_transfer(i2c_txn_t *txn) {
+    for (uint8_t i = 0; i < txn->len; i++) {
+        uint8_t reg = (txn->reg + i) % PCA9536_NUM_REGS;
+        if (txn->read) {
+            if (reg == PCA9536_INPUT) {
+                // output pins read back what they drive, inputs float high
+                uint8_t config = pca_regs[PCA9536_CONFIG];
+                txn->data[i] = ((pca_regs[PCA9536_OUTPUT] & ~config) | config) & 0x0f;
+            } else {
+                txn->data[i] = pca_regs[reg];
+            }
+        } else if (reg != PCA9536_INPUT) {
+            pca_regs[reg] = txn->data[i];
+        }
+    }
+    return I2C_TXN_DONE;
+}
+
+bool i2c_async_submit(i2c_txn_t *txn) {
+    if (i2c_txn_pending(txn)) {
+        return false;
+    }
+    if (done_count >= I2C_ASYNC_QUEUE_LEN) {
+        stats.queue_full++;
+        return false;
+    }
+
+    if (txn->addr == PCA9536_ADDR) {
+        txn->status = pca9536_transfer(txn);
+        stats.completed++;
+    } else {
+        txn->status = I2C_TXN_NACK;
+        stats.nacks++;
+    }
+
+    done[(done_head + done_count) % I2C_ASYNC_QUEUE_LEN] = txn;
+    done_count++;
+    return true;
+}
+
+bool i2c_async_transfer_blocking(i2c_txn_t *txn) {
+    if (!i2c_async_submit(txn)) {
+        return false;
+    }
+    i2c_async_heartbeat();
+    return txn->status == I2C_TXN_DONE;
+}
+
+void i2c_async_heartbeat(void) {
+    while (done_count > 0) {
+        i2c_txn_t *txn = done[done_head];
+        done_head = (done_head + 1) % I2C_ASYNC_QUEUE_LEN;
+        done_count--;
+
+        if (txn->callback) {
+            txn->callback(txn);
+        }
+    }
+}
+
+void i2c_async_handle_interrupt(void) {
+}
+
+const i2c_async_stats_t *i2c_async_get_stats(void) {
+    return &stats;
+}
+
+uint8_t i2c_host_pca9536_outputs(void) {
+    return pca_regs[PCA9536_OUTPUT] & ~pca_regs[PCA9536_CONFIG] & 0x0f;
+}
@@ -0,0 +1,9 @@
+#ifndef I2C_ASYNC_HOST_H
+#define I2C_ASYNC_HOST_H
+
+#include <stdint.h>
+
+// Pins the simulated PCA9536 is driving high, pins configured as inputs read as 0
+uint8_t i2c_host_pca9536_outputs(void);
+
+#endif /* I2C_ASYNC_HOST_H */
@@ -0,0 +1,456 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "canlib/message_types.h"
+
+#include "../hal.h"
+#include "i2c_async_host.h"
+#include "plant.h"
+
+#define VREF 3.3
+#define ADC_FULL_SCALE 4096.0
+
+#define PSI_TO_PA 6894.76
+#define RHO_OX 800.0 // kg/m^3, liquid N2O
+#define RHO_FUEL 790.0
+
+// Output pins and ADC channels, must match main.c
+#if (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_INJ)
+#define INJECTOR_PIN 0
+#define FILL_DUMP_PIN 2
+#define PRES_FUEL_CH HAL_ADC_ANB1
+#define PRES_PNEUMATICS_CH HAL_ADC_ANB2
+#define PRES_CC_CH HAL_ADC_ANB0
+#define HALL_FUEL_CH HAL_ADC_ANB4
+#define HALL_OX_CH HAL_ADC_ANB5
+#elif (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_VENT)
+#define VENT_VALVE_PIN 0
+#define PRES_OX_CH HAL_ADC_ANB0
+#define TEMP_VENT_CH HAL_ADC_ANB1
+#endif
+#define CURR_5V_CH HAL_ADC_ANA0
+#define CURR_12V_CH HAL_ADC_ANA1
+#define BATT_CH HAL_ADC_ANC2
+
+typedef struct {
+    double ambient_c;
+    double ox_temp_c;
+    double ox_mass_kg; // liquid
+    double ox_tau_ambient_s; // tank warming back up towards ambient
+    double ox_evap_c_per_kg; // cooling per kg of ox leaving the tank
+    double ox_blowdown_tau_s; // vapour-only pressure decay once the liquid is gone
+    double vent_flow_kg_s;
+    double dump_flow_kg_s;
+    double inj_ox_cda_m2;
+    double inj_fuel_cda_m2;
+    double fuel_supply_psi;
+    double fuel_tau_s;
+    double cc_psi_per_kg_s;
+    double cc_tau_s;
+    double cc_osc_psi; // chamber pressure oscillation amplitude at full flow
+    double cc_osc_hz;
+    double pneumatics_psi;
+    double pneumatics_dip_psi; // per injector actuation
+    double pneumatics_tau_s;
+    double solenoid_delay_ms; // command to the valve starting to move
+    double injector_travel_ms;
+    double vent_travel_ms;
+    double fill_travel_ms;
+    double coil_peak_ma;
+    double coil_hold_ma;
+    double base_12v_ma;
+    double base_5v_ma;
+    double batt_v;
+    double batt_r_ohm;
+    double hall_fuel_closed; // raw counts
+    double hall_fuel_open;
+    double hall_ox_closed;
+    double hall_ox_open;
+    double pres_noise_psi;
+    double pres_loop_offset_ma; // transmitter zero error, -0.2 reads 3.8 mA at 0 psi
+    double temp_noise_c;
+    double hall_noise;
+    double current_noise_ma;
+    // converter error in the pressure, temperature and reference conversions
+    double adc_offset_counts;
+    double adc_gain_err; // fraction, -0.01 reads 1 % low
+    // valves the simulated board doesn't drive, 1 is energized
+    double injector_cmd;
+    double vent_cmd;
+    double fill_cmd;
+} plant_params_t;
+
+static plant_params_t params = {
+    .ambient_c = 20,
+    .ox_temp_c = 20,
+    .ox_mass_kg = 10,
+    .ox_tau_ambient_s = 600,
+    .ox_evap_c_per_kg = 1.5,
+    .ox_blowdown_tau_s = 2,
+    .vent_flow_kg_s = 0.05,
+    .dump_flow_kg_s = 0.2,
+    .inj_ox_cda_m2 = 2e-5,
+    .inj_fuel_cda_m2 = 6e-6,
+    .fuel_supply_psi = 600,
+    .fuel_tau_s = 0.03,
+    .cc_psi_per_kg_s = 250,
+    .cc_tau_s = 0.05,
+    .cc_osc_psi = 0,
+    .cc_osc_hz = 100,
+    .pneumatics_psi = 100,
+    .pneumatics_dip_psi = 5,
+    .pneumatics_tau_s = 0.5,
+    .solenoid_delay_ms = 15,
+    .injector_travel_ms = 60,
+    .vent_travel_ms = 40,
+    .fill_travel_ms = 40,
+    .coil_peak_ma = 500,
+    .coil_hold_ma = 50,
+    .base_12v_ma = 20,
+    .base_5v_ma = 40,
+    .batt_v = 12.0,
+    .batt_r_ohm = 0.5,
+    .hall_fuel_closed = 3415,
+    .hall_fuel_open = 2600,
+    .hall_ox_closed = 670,
+    .hall_ox_open = 2240,
+    .pres_noise_psi = 2,
+    .pres_loop_offset_ma = 0,
+    .temp_noise_c = 0.1,
+    .hall_noise = 8,
+    .current_noise_ma = 2,
+    .adc_offset_counts = 0,
+    .adc_gain_err = 0,
+    .injector_cmd = 0,
+    .vent_cmd = 0,
+    .fill_cmd = 0,
+};
+
+#define PARAM(name) {#name, &params.name}
+static const struct {
+    const char *name;
+    double *value;
+} param_table[] = {
+    PARAM(ambient_c),          PARAM(ox_temp_c),          PARAM(ox_mass_kg),
+    PARAM(ox_tau_ambient_s),   PARAM(ox_evap_c_per_kg),   PARAM(ox_blowdown_tau_s),
+    PARAM(vent_flow_kg_s),     PARAM(dump_flow_kg_s),     PARAM(inj_ox_cda_m2),
+    PARAM(inj_fuel_cda_m2),    PARAM(fuel_supply_psi),    PARAM(fuel_tau_s),
+    PARAM(cc_psi_per_kg_s),    PARAM(cc_tau_s),           PARAM(cc_osc_psi),
+    PARAM(cc_osc_hz),          PARAM(pneumatics_psi),     PARAM(pneumatics_dip_psi),
+    PARAM(pneumatics_tau_s),   PARAM(solenoid_delay_ms),  PARAM(injector_travel_ms),
+    PARAM(vent_travel_ms),     PARAM(fill_travel_ms),     PARAM(coil_peak_ma),
+    PARAM(coil_hold_ma),       PARAM(base_12v_ma),        PARAM(base_5v_ma),
+    PARAM(batt_v),             PARAM(batt_r_ohm),         PARAM(hall_fuel_closed),
+    PARAM(hall_fuel_open),     PARAM(hall_ox_closed),     PARAM(hall_ox_open),
+    PARAM(pres_noise_psi),     PARAM(temp_noise_c),       PARAM(hall_noise),
+    PARAM(current_noise_ma),   PARAM(adc_offset_counts),  PARAM(adc_gain_err),
+    PARAM(injector_cmd),       PARAM(vent_cmd),           PARAM(fill_cmd),
+    PARAM(pres_loop_offset_ma),
+};
+#define NUM_PARAMS (sizeof(param_table) / sizeof(param_table[0]))
+
+// A solenoid valve: the coil current follows the command right away, the valve starts
+// moving solenoid_delay_ms later and takes travel_ms to get across
+typedef struct {
+    bool energized;
+    double since_ms; // time since the last command change
+    double position; // 0 closed, 1 open
+} valve_t;
+
+enum { VALVE_INJECTOR, VALVE_VENT, VALVE_FILL, NUM_VALVES };
+
+static struct {
+    double t_s;
+    valve_t valves[NUM_VALVES];
+    double ox_temp_c;
+    double ox_mass_kg;
+    double ox_psi;
+    double fuel_psi;
+    double cc_psi;
+    double pneumatics_psi;
+    double ox_flow_kg_s;
+    double current_12v_ma;
+} state;
+
+static uint64_t rng;
+
+static FILE *log_out = NULL;
+static uint32_t log_period_us;
+static uint32_t log_elapsed_us;
+
+// xorshift64*
+static double uniform(void) {
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+    return ((rng * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Irwin-Hall approximation, plenty for sensor noise
+static double gaussian(double sigma) {
+    double sum = uniform() + uniform() + uniform() + uniform() - 2.0;
+    return sum * sigma * 1.7320508; // sqrt(12 / 4)
+}
+
+static uint16_t to_raw(double volts) {
+    double raw = volts / VREF * ADC_FULL_SCALE * (1 + params.adc_gain_err);
+    raw += params.adc_offset_counts;
+    if (raw < 0) {
+        return 0;
+    }
+    return raw > ADC_FULL_SCALE - 1 ? ADC_FULL_SCALE - 1 : (uint16_t)raw;
+}
+
+// 4-20 mA transducer, 0-1450 psi, into 100 R
+static uint16_t pres_4_20_raw(double psi) {
+    psi += gaussian(params.pres_noise_psi);
+    if (psi < 0) {
+        psi = 0;
+    } else if (psi > 1450) {
+        psi = 1450;
+    }
+    double ma = 4 + 16 * psi / 1450 + params.pres_loop_offset_ma;
+    return to_raw(ma / 1000 * 100);
+}
+
+#if (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_INJ)
+// PSE530 through the 15k/10k divider, inverse of get_pressure_pneumatic_psi()
+static uint16_t pres_pneumatic_raw(double psi) {
+    psi += gaussian(params.pres_noise_psi);
+    double v_sensor = (psi - 5.2) / 165.34 * 4 + 1;
+    return to_raw(v_sensor / 2.5);
+}
+
+static uint16_t hall_raw(double closed, double open, double position) {
+    // flux isn't linear in plunger travel, it changes fastest mid stroke
+    double s = position * position * (3 - 2 * position);
+    double raw = closed + (open - closed) * s + gaussian(params.hall_noise);
+    return raw < 0 ? 0 : raw > ADC_FULL_SCALE - 1 ? ADC_FULL_SCALE - 1 : (uint16_t)raw;
+}
+#elif (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_VENT)
+// 10k thermistor under a 10k divider resistor, inverse of get_temperature_c()
+static uint16_t temp_raw(double temp_c) {
+    temp_c += gaussian(params.temp_noise_c);
+    double r = 10000.0 * exp(3434.0 * (1 / (temp_c + 273.15) - 1 / 298.15));
+    return to_raw(VREF * 10000.0 / (r + 10000.0));
+}
+#endif
+
+static uint16_t shunt_raw(double ma, double shunt_mr) {
+    ma += gaussian(params.current_noise_ma);
+    double uv = (ma < 0 ? 0 : ma) * shunt_mr;
+    double raw = uv * ADC_FULL_SCALE / 33000.0;
+    return raw > ADC_FULL_SCALE - 1 ? ADC_FULL_SCALE - 1 : (uint16_t)raw;
+}
+
+// N2O vapour pressure, an exponential fit that's within ~10% from 0 to 30 C
+static double ox_vapour_psi(double temp_c) {
+    return 745 * exp(0.0245 * (temp_c - 20));
+}
+
+static double coil_current_ma(const valve_t *v) {
+    if (!v->energized) {
+        return 0;
+    }
+    double t = v->since_ms;
+    double delay = params.solenoid_delay_ms;
+    if (t < delay) {
+        return params.coil_peak_ma * (1 - exp(-t / 2.0));
+    }
+    // back EMF from the moving plunger pulls the current down, then it settles to hold
+    double dip = 0.6 * params.coil_peak_ma;
+    return params.coil_hold_ma + (dip - params.coil_hold_ma) * exp(-(t - delay) / 10.0);
+}
+
+static void step_valve(valve_t *v, bool energized, double travel_ms, double dt_ms) {
+    if (energized != v->energized) {
+        v->energized = energized;
+        v->since_ms = 0;
+    } else {
+        v->since_ms += dt_ms;
+    }
+    if (v->since_ms < params.solenoid_delay_ms) {
+        return;
+    }
+    double step = dt_ms / travel_ms;
+    if (energized) {
+        v->position = v->position + step > 1 ? 1 : v->position + step;
+    } else {
+        v->position = v->position - step < 0 ? 0 : v->position - step;
+    }
+}
+
+static double first_order(double value, double target, double tau_s, double dt_s) {
+    return target + (value - target) * exp(-dt_s / tau_s);
+}
+
+static double orifice_kg_s(double cda, double rho, double dp_psi) {
+    return dp_psi > 0 ? cda * sqrt(2 * rho * dp_psi * PSI_TO_PA) : 0;
+}
+
+void plant_init(uint64_t seed) {
+    rng = seed ? seed : 0x9e3779b97f4a7c15ULL;
+    memset(&state, 0, sizeof(state));
+    state.ox_temp_c = params.ox_temp_c;
+    state.ox_mass_kg = params.ox_mass_kg;
+    state.ox_psi = ox_vapour_psi(state.ox_temp_c);
+    state.fuel_psi = params.fuel_supply_psi;
+    state.pneumatics_psi = params.pneumatics_psi;
+}
+
+void plant_step(uint32_t dt_us) {
+    double dt_s = dt_us / 1e6;
+    double dt_ms = dt_us / 1e3;
+    state.t_s += dt_s;
+
+    uint8_t outputs = i2c_host_pca9536_outputs();
+#if (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_INJ)
+    bool injector = outputs & (1 << INJECTOR_PIN);
+    bool fill = outputs & (1 << FILL_DUMP_PIN);
+    bool vent = params.vent_cmd != 0;
+#elif (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_VENT)
+    bool injector = params.injector_cmd != 0;
+    bool fill = params.fill_cmd != 0;
+    bool vent = outputs & (1 << VENT_VALVE_PIN);
+#endif
+
+    valve_t *inj = &state.valves[VALVE_INJECTOR];
+    bool was_injector = inj->energized;
+    step_valve(inj, injector, params.injector_travel_ms, dt_ms);
+    step_valve(&state.valves[VALVE_VENT], vent, params.vent_travel_ms, dt_ms);
+    step_valve(&state.valves[VALVE_FILL], fill, params.fill_travel_ms, dt_ms);
+
+    // pneumatic injector draws on the pneumatics supply every time it moves
+    if (injector != was_injector) {
+        state.pneumatics_psi -= params.pneumatics_dip_psi;
+    }
+    state.pneumatics_psi =
+        first_order(state.pneumatics_psi, params.pneumatics_psi, params.pneumatics_tau_s, dt_s);
+
+    // flows out of the ox tank
+    double inj_open = inj->position;
+    double ox_flow = inj_open * orifice_kg_s(params.inj_ox_cda_m2, RHO_OX, state.ox_psi - state.cc_psi);
+    double fuel_flow =
+        inj_open * orifice_kg_s(params.inj_fuel_cda_m2, RHO_FUEL, state.fuel_psi - state.cc_psi);
+    double out_flow = ox_flow + state.valves[VALVE_VENT].position * params.vent_flow_kg_s +
+                      state.valves[VALVE_FILL].position * params.dump_flow_kg_s;
+    state.ox_flow_kg_s = ox_flow;
+
+    double out_kg = out_flow * dt_s;
+    if (state.ox_mass_kg > 0) {
+        // boiling off what leaves cools the rest, the tank walls warm it back up
+        state.ox_mass_kg = state.ox_mass_kg > out_kg ? state.ox_mass_kg - out_kg : 0;
+        state.ox_temp_c -= params.ox_evap_c_per_kg * out_kg;
+        state.ox_temp_c =
+            first_order(state.ox_temp_c, params.ambient_c, params.ox_tau_ambient_s, dt_s);
+        state.ox_psi = ox_vapour_psi(state.ox_temp_c);
+    } else if (out_flow > 0) {
+        state.ox_psi = first_order(state.ox_psi, 0, params.ox_blowdown_tau_s, dt_s);
+    }
+
+    // fuel manifold sags while flowing, the chamber follows the total mass flow
+    double fuel_target = params.fuel_supply_psi - inj_open * 0.4 * (params.fuel_supply_psi - state.cc_psi);
+    state.fuel_psi = first_order(state.fuel_psi, fuel_target, params.fuel_tau_s, dt_s);
+    double cc_target = params.cc_psi_per_kg_s * (ox_flow + fuel_flow);
+    if (cc_target > state.ox_psi) {
+        cc_target = state.ox_psi;
+    }
+    state.cc_psi = first_order(state.cc_psi, cc_target, params.cc_tau_s, dt_s);
+
+    double coil_ma = 0;
+#if (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_INJ)
+    coil_ma = coil_current_ma(inj) + coil_current_ma(&state.valves[VALVE_FILL]);
+#elif (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_VENT)
+    coil_ma = coil_current_ma(&state.valves[VALVE_VENT]);
+#endif
+    state.current_12v_ma = params.base_12v_ma + coil_ma;
+
+    hal_host_set_adc(CURR_5V_CH, shunt_raw(params.base_5v_ma, 62));
+    hal_host_set_adc(CURR_12V_CH, shunt_raw(state.current_12v_ma, 15));
+    double batt_mv = (params.batt_v - params.batt_r_ohm * state.current_12v_ma / 1000) * 1000;
+    hal_host_set_adc(BATT_CH, (uint16_t)(batt_mv * ADC_FULL_SCALE / (VREF * 1000 * 4)));
+    // the reference reads full scale unless the converter reads low
+    hal_host_set_adc(HAL_ADC_VSS, to_raw(0));
+    hal_host_set_adc(HAL_ADC_FVR, to_raw(VREF));
+
+#if (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_INJ)
+    hal_host_set_adc(PRES_FUEL_CH, pres_4_20_raw(state.fuel_psi));
+    // combustion instability, growing with the flow
+    double cc_osc = params.cc_osc_psi * inj_open * sin(2 * M_PI * params.cc_osc_hz * state.t_s);
+    hal_host_set_adc(PRES_CC_CH, pres_4_20_raw(state.cc_psi + cc_osc));
+    hal_host_set_adc(PRES_PNEUMATICS_CH, pres_pneumatic_raw(state.pneumatics_psi));
+    // the fuel and ox injectors move together off the one pneumatic valve
+    hal_host_set_adc(HALL_FUEL_CH, hall_raw(params.hall_fuel_closed, params.hall_fuel_open, inj_open));
+    hal_host_set_adc(HALL_OX_CH, hall_raw(params.hall_ox_closed, params.hall_ox_open, inj_open));
+#elif (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_VENT)
+    hal_host_set_adc(PRES_OX_CH, pres_4_20_raw(state.ox_psi));
+    hal_host_set_adc(TEMP_VENT_CH, temp_raw(state.ox_temp_c));
+#endif
+
+    if (log_out) {
+        log_elapsed_us += dt_us;
+        if (log_elapsed_us >= log_period_us) {
+            log_elapsed_us -= log_period_us;
+            fprintf(log_out,
+                    "%.4f,%.3f,%.3f,%.3f,%.2f,%.2f,%.2f,%.2f,%.3f,%.3f,%.1f\n",
+                    state.t_s,
+                    state.valves[VALVE_INJECTOR].position,
+                    state.valves[VALVE_VENT].position,
+                    state.valves[VALVE_FILL].position,
+                    state.ox_psi,
+                    state.ox_temp_c,
+                    state.fuel_psi,
+                    state.cc_psi,
+                    state.ox_mass_kg,
+                    state.ox_flow_kg_s,
+                    state.current_12v_ma);
+        }
+    }
+}
+
+static double *find_param(const char *name) {
+    for (size_t i = 0; i < NUM_PARAMS; i++) {
+        if (strcmp(param_table[i].name, name) == 0) {
+            return param_table[i].value;
+        }
+    }
+    return NULL;
+}
+
+bool plant_set(const char *name, double value) {
+    double *param = find_param(name);
+    if (!param) {
+        return false;
+    }
+    *param = value;
+    // the tank state starts from these, setting them mid run moves the tank there too
+    if (param == &params.ox_temp_c) {
+        state.ox_temp_c = value;
+        state.ox_psi = ox_vapour_psi(value);
+    } else if (param == &params.ox_mass_kg) {
+        state.ox_mass_kg = value;
+    }
+    return true;
+}
+
+bool plant_has_param(const char *name) {
+    return find_param(name) != NULL;
+}
+
+void plant_list_params(FILE *out) {
+    for (size_t i = 0; i < NUM_PARAMS; i++) {
+        fprintf(out, "%s=%g\n", param_table[i].name, *param_table[i].value);
+    }
+}
+
+void plant_log_open(FILE *out, uint32_t period_ms) {
+    log_out = out;
+    log_period_us = period_ms * 1000;
+    log_elapsed_us = 0;
+    fprintf(out,
+            "t_s,injector_pos,vent_pos,fill_pos,ox_psi,ox_temp_c,fuel_psi,cc_psi,ox_mass_kg,"
+            "ox_flow_kg_s,current_12v_ma\n");
+}
@@ -0,0 +1,33 @@
+#ifndef PLANT_H
+#define PLANT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Propulsion plant model for the host simulator. Closes the loop between the simulated
+// PCA9536 outputs and the ADC channels: valve actuation delay and travel, ox tank
+// pressure and temperature, fuel and chamber pressure, pneumatics, hall flux, solenoid
+// current on the 12 V rail, sensor noise and the transducer transfer functions.
+//
+// The model covers the whole system. Valves driven by the board being simulated follow
+// its outputs; the other board's valves follow the *_cmd parameters.
+
+// Seed the noise generator and reset the state to the parameters
+void plant_init(uint64_t seed);
+
+// Advance by dt_us and write new values to every ADC channel the board reads
+void plant_step(uint32_t dt_us);
+
+// Set a parameter by name, e.g. "ox_temp_c". Returns false if there is no such parameter.
+bool plant_set(const char *name, double value);
+
+bool plant_has_param(const char *name);
+
+// Print the parameter names and their values
+void plant_list_params(FILE *out);
+
+// Write a CSV row of the plant state every period_ms of virtual time
+void plant_log_open(FILE *out, uint32_t period_ms);
+
+#endif /* PLANT_H */
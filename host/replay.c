@@ -0,0 +1,199 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "canlib/canlib.h"
+
+#include "../hal.h"
+#include "../input_record.h"
+#include "canlib_host.h"
+#include "replay.h"
+
+#define READ_BUFFER_SIZE (1 << 16)
+
+enum record_type { REC_ADC, REC_TIME, REC_CAN, REC_END };
+
+typedef struct {
+    enum record_type type;
+    uint8_t index; // ADC
+    uint16_t raw;
+    uint64_t delta; // TIME, in timestamp units
+    can_msg_t msg; // CAN
+} record_t;
+
+static FILE *in = NULL;
+static const char *in_path;
+static uint32_t unit_us;
+static uint32_t loop_us;
+static uint64_t duration_us;
+static bool exact;
+
+static record_t next;
+static uint64_t stream_us = 0; // time of the next record
+static uint64_t offset = INPUT_RECORD_HEADER_LEN; // of the next record, for error messages
+
+static int get_byte(void) {
+    int c = getc(in);
+    if (c != EOF) {
+        offset++;
+    }
+    return c;
+}
+
+static void bad_stream(const char *what) {
+    fprintf(stderr, "%s: %s at offset %" PRIu64 "\n", in_path, what, offset);
+    exit(EXIT_FAILURE);
+}
+
+static uint32_t get_be(uint8_t bytes) {
+    uint32_t value = 0;
+    while (bytes-- > 0) {
+        int c = get_byte();
+        if (c == EOF) {
+            bad_stream("truncated record");
+        }
+        value = value << 8 | (uint8_t)c;
+    }
+    return value;
+}
+
+// Read the record after the current one into next
+static void read_next(void) {
+    int tag = get_byte();
+    if (tag == EOF || tag == INPUT_RECORD_TAG_OVERFLOW) {
+        next.type = REC_END;
+        return;
+    }
+
+    if (tag < INPUT_RECORD_TAG_TIME) {
+        next.type = REC_ADC;
+        next.index = (uint8_t)(tag >> 4);
+        next.raw = (uint16_t)((tag & 0x0f) << 8 | get_be(1));
+    } else if (tag == INPUT_RECORD_TAG_TIME) {
+        next.type = REC_TIME;
+        next.delta = 0;
+        for (unsigned shift = 0;; shift += 7) {
+            int c = get_byte();
+            if (c == EOF || shift > 56) {
+                bad_stream("bad time record");
+            }
+            next.delta |= (uint64_t)(c & 0x7f) << shift;
+            if (!(c & 0x80)) {
+                break;
+            }
+        }
+    } else if ((tag & 0xf0) == INPUT_RECORD_TAG_CAN && (tag & 0x0f) <= 8) {
+        next.type = REC_CAN;
+        next.msg.data_len = tag & 0x0f;
+        next.msg.sid = (uint16_t)get_be(2);
+        for (uint8_t i = 0; i < next.msg.data_len; i++) {
+            next.msg.data[i] = (uint8_t)get_be(1);
+        }
+    } else {
+        bad_stream("unknown record");
+    }
+}
+
+bool replay_open(const char *path) {
+    in_path = path;
+    in = fopen(path, "rb");
+    if (!in) {
+        perror(path);
+        return false;
+    }
+    setvbuf(in, NULL, _IOFBF, READ_BUFFER_SIZE);
+
+    uint8_t header[INPUT_RECORD_HEADER_LEN];
+    if (fread(header, 1, sizeof(header), in) != sizeof(header) || memcmp(header, "PREC", 4) != 0 ||
+        header[4] != INPUT_RECORD_VERSION) {
+        fprintf(stderr, "%s: not an input recording\n", path);
+        return false;
+    }
+    if (header[5] != BOARD_UNIQUE_ID) {
+        fprintf(stderr, "%s: recorded on board 0x%02x, this is 0x%02x\n", path, header[5],
+                BOARD_UNIQUE_ID);
+        return false;
+    }
+    unit_us = (uint32_t)header[6] << 8 | header[7];
+    loop_us = (uint32_t)header[8] << 8 | header[9];
+    duration_us = ((uint64_t)header[10] << 24 | (uint64_t)header[11] << 16 |
+                   (uint64_t)header[12] << 8 | header[13]) * 1000;
+    exact = loop_us != 0;
+    if (unit_us == 0) {
+        fprintf(stderr, "%s: bad timestamp unit\n", path);
+        return false;
+    }
+
+    read_next();
+    return true;
+}
+
+uint32_t replay_loop_us(void) {
+    return loop_us;
+}
+
+uint64_t replay_duration_us(void) {
+    return duration_us;
+}
+
+static void diverged(hal_adc_channel_t channel, uint64_t now_us) {
+    fprintf(stderr,
+            "replay diverged at %.6f s: firmware read ch %d, recording has ",
+            now_us / 1e6,
+            (int)channel);
+    switch (next.type) {
+        case REC_ADC:
+            fprintf(stderr, "a read of ch %d at %.6f s\n", next.index, stream_us / 1e6);
+            break;
+        case REC_CAN:
+            fprintf(stderr, "a frame at %.6f s\n", stream_us / 1e6);
+            break;
+        default:
+            fprintf(stderr, "nothing more\n");
+            break;
+    }
+    exit(HAL_HOST_EXIT_DIVERGED);
+}
+
+void replay_advance(uint64_t now_us) {
+    for (;;) {
+        switch (next.type) {
+            case REC_TIME:
+                if (stream_us + next.delta * unit_us > now_us) {
+                    return;
+                }
+                stream_us += next.delta * unit_us;
+                break;
+            case REC_CAN:
+                can_host_inject(&next.msg);
+                break;
+            case REC_ADC:
+                if (exact) {
+                    return; // belongs to a read in this pass
+                }
+                hal_host_set_adc(input_record_channel(next.index), next.raw);
+                break;
+            case REC_END:
+            default:
+                return;
+        }
+        read_next();
+    }
+}
+
+bool replay_adc(hal_adc_channel_t channel, uint64_t now_us, uint16_t *raw) {
+    if (!exact) {
+        return false;
+    }
+
+    if (next.type != REC_ADC || stream_us != now_us ||
+        input_record_channel(next.index) != channel) {
+        diverged(channel, now_us);
+    }
+    *raw = next.raw;
+    read_next();
+    return true;
+}
@@ -0,0 +1,39 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../hal.h"
+
+// Feeds an input recording (input_record.h) back into the firmware in place of the plant
+// model, the scenario and the CAN interface. The file is read as it is consumed, so a
+// recording of any length replays in constant memory.
+//
+// Recordings from the host build carry the main loop period, and replay is exact: every
+// ADC read gets the value recorded for the same read and every frame arrives on the same
+// main loop pass, so the firmware's output is bit-identical. A read the recording doesn't
+// have means the firmware took a different path, which ends the run with
+// HAL_HOST_EXIT_DIVERGED.
+//
+// Board recordings don't know the loop period. Their frames are delivered on the first
+// pass at or after their timestamp, and each channel holds its last recorded value (the
+// plant model's starting value until the first one).
+
+#define HAL_HOST_EXIT_DIVERGED 4
+
+// Reads the header. Prints why and returns false if the file can't be replayed.
+bool replay_open(const char *path);
+
+// Main loop period and run length the recording was made with, 0 for board recordings
+uint32_t replay_loop_us(void);
+uint64_t replay_duration_us(void);
+
+// Deliver every frame that is due, once per main loop pass
+void replay_advance(uint64_t now_us);
+
+// Value for an ADC read. Returns false for board recordings, the channel's held value
+// (hal_host_set_adc()) applies then.
+bool replay_adc(hal_adc_channel_t channel, uint64_t now_us, uint16_t *raw);
+
+#endif /* REPLAY_H */
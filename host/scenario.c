@@ -0,0 +1,281 @@
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "canlib/canlib.h"
+
+#include "canlib_host.h"
+#include "plant.h"
+#include "scenario.h"
+
+#define MAX_LINE 256
+#define MAX_NAME 32
+
+enum event_type { EVENT_SET, EVENT_FRAME, EVENT_END, EVENT_EXPECT, EVENT_FORBID };
+
+// A frame the board sends, with '.' nibbles matching anything and the data matched as a
+// prefix, or in full when it ends in '$'
+typedef struct {
+    uint16_t sid;
+    uint8_t data[8];
+    uint8_t mask[8];
+    uint8_t len;
+    bool exact;
+} frame_pattern_t;
+
+typedef struct {
+    uint64_t t_us;
+    bool forbid;
+    frame_pattern_t pattern;
+    char text[MAX_LINE];
+    bool seen; // a match at or after t_us
+} scenario_check_t;
+
+typedef struct {
+    uint64_t t_us;
+    enum event_type type;
+    char name[MAX_NAME];
+    double value;
+    can_msg_t msg;
+    frame_pattern_t pattern;
+} scenario_event_t;
+
+static scenario_event_t *events = NULL;
+static size_t num_events = 0;
+static size_t next_event = 0;
+static uint64_t end_us = 0;
+
+static scenario_check_t *checks = NULL;
+static size_t num_checks = 0;
+
+static int hex_nibble(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c = (char)tolower((unsigned char)c);
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+// SID#DATA, e.g. 180#8C000102
+static bool parse_frame(const char *text, can_msg_t *msg) {
+    char *end;
+    unsigned long sid = strtoul(text, &end, 16);
+    if (end == text || *end != '#' || sid > 0x7ff) {
+        return false;
+    }
+    msg->sid = (uint16_t)sid;
+    msg->data_len = 0;
+    for (const char *p = end + 1; *p && !isspace((unsigned char)*p); p += 2) {
+        int hi = hex_nibble(p[0]);
+        int lo = p[1] ? hex_nibble(p[1]) : -1;
+        if (hi < 0 || lo < 0 || msg->data_len >= 8) {
+            return false;
+        }
+        msg->data[msg->data_len++] = (uint8_t)(hi << 4 | lo);
+    }
+    return true;
+}
+
+static bool parse_pattern(const char *text, frame_pattern_t *pattern) {
+    char *end;
+    unsigned long sid = strtoul(text, &end, 16);
+    if (end == text || *end != '#' || sid > 0x7ff) {
+        return false;
+    }
+    pattern->sid = (uint16_t)sid;
+    pattern->len = 0;
+    pattern->exact = false;
+    for (const char *p = end + 1; *p && !isspace((unsigned char)*p); p += 2) {
+        if (*p == '$') {
+            pattern->exact = true;
+            return !p[1] || isspace((unsigned char)p[1]);
+        }
+        if (!p[1] || pattern->len >= 8) {
+            return false;
+        }
+        uint8_t byte = 0;
+        uint8_t mask = 0;
+        for (int i = 0; i < 2; i++) {
+            byte <<= 4;
+            mask <<= 4;
+            if (p[i] != '.') {
+                int nibble = hex_nibble(p[i]);
+                if (nibble < 0) {
+                    return false;
+                }
+                byte |= (uint8_t)nibble;
+                mask |= 0xf;
+            }
+        }
+        pattern->data[pattern->len] = byte;
+        pattern->mask[pattern->len] = mask;
+        pattern->len++;
+    }
+    return true;
+}
+
+static bool pattern_matches(const frame_pattern_t *pattern, const can_msg_t *msg) {
+    if (msg->sid != pattern->sid || msg->data_len < pattern->len) {
+        return false;
+    }
+    if (pattern->exact && msg->data_len != pattern->len) {
+        return false;
+    }
+    for (uint8_t i = 0; i < pattern->len; i++) {
+        if ((msg->data[i] & pattern->mask[i]) != pattern->data[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool parse_line(const char *line, scenario_event_t *ev) {
+    double t_ms;
+    char type[8];
+    char arg[MAX_LINE];
+    int fields = sscanf(line, "%lf %7s %255s", &t_ms, type, arg);
+    if (fields < 2 || t_ms < 0) {
+        return false;
+    }
+    ev->t_us = (uint64_t)(t_ms * 1000);
+
+    if (strcmp(type, "end") == 0) {
+        ev->type = EVENT_END;
+        return fields == 2;
+    }
+    if (fields != 3) {
+        return false;
+    }
+
+    if (strcmp(type, "set") == 0) {
+        ev->type = EVENT_SET;
+        if (strlen(arg) >= MAX_NAME || sscanf(line, "%*f %*s %*s %lf", &ev->value) != 1) {
+            return false;
+        }
+        strcpy(ev->name, arg);
+        // catch typos now rather than at t_ms
+        return plant_has_param(ev->name);
+    }
+    if (strcmp(type, "frame") == 0) {
+        ev->type = EVENT_FRAME;
+        return parse_frame(arg, &ev->msg);
+    }
+    if (strcmp(type, "expect") == 0 || strcmp(type, "forbid") == 0) {
+        ev->type = type[0] == 'e' ? EVENT_EXPECT : EVENT_FORBID;
+        return parse_pattern(arg, &ev->pattern);
+    }
+    return false;
+}
+
+static void add_check(const scenario_event_t *ev, const char *text) {
+    checks = realloc(checks, (num_checks + 1) * sizeof(*checks));
+    if (!checks) {
+        perror("scenario");
+        exit(EXIT_FAILURE);
+    }
+    scenario_check_t *check = &checks[num_checks++];
+    check->t_us = ev->t_us;
+    check->forbid = ev->type == EVENT_FORBID;
+    check->pattern = ev->pattern;
+    snprintf(check->text, sizeof(check->text), "%s", text);
+    check->seen = false;
+}
+
+bool scenario_load(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+
+    char line[MAX_LINE];
+    unsigned line_no = 0;
+    size_t capacity = 0;
+    uint64_t last_us = 0;
+    bool ended = false;
+    while (fgets(line, sizeof(line), f)) {
+        line_no++;
+        line[strcspn(line, "\r\n")] = '\0';
+        const char *p = line;
+        while (isspace((unsigned char)*p)) {
+            p++;
+        }
+        if (*p == '\0' || *p == '#') {
+            continue;
+        }
+
+        if (num_events == capacity) {
+            capacity = capacity ? capacity * 2 : 32;
+            events = realloc(events, capacity * sizeof(*events));
+            if (!events) {
+                perror("scenario");
+                exit(EXIT_FAILURE);
+            }
+        }
+        scenario_event_t *ev = &events[num_events];
+        if (ended || !parse_line(p, ev) || ev->t_us < last_us) {
+            fprintf(stderr, "%s:%u: bad or out of order event: %s\n", path, line_no, p);
+            fclose(f);
+            return false;
+        }
+        last_us = ev->t_us;
+        if (ev->type == EVENT_END) {
+            // nothing can come after it
+            ended = true;
+            end_us = ev->t_us;
+            continue;
+        }
+        if (ev->type == EVENT_EXPECT || ev->type == EVENT_FORBID) {
+            // checked against what the board sends, not run in time
+            add_check(ev, p);
+            continue;
+        }
+        num_events++;
+    }
+
+    fclose(f);
+    return true;
+}
+
+uint64_t scenario_end_us(void) {
+    return end_us;
+}
+
+void scenario_sent(const can_msg_t *msg, uint64_t now_us) {
+    for (size_t i = 0; i < num_checks; i++) {
+        scenario_check_t *check = &checks[i];
+        if (!check->seen && now_us >= check->t_us && pattern_matches(&check->pattern, msg)) {
+            check->seen = true;
+            if (check->forbid) {
+                fprintf(stderr, "%.3f: forbidden frame: %s\n", now_us / 1e6, check->text);
+            }
+        }
+    }
+}
+
+bool scenario_checks_passed(void) {
+    bool passed = true;
+    for (size_t i = 0; i < num_checks; i++) {
+        if (!checks[i].forbid && !checks[i].seen) {
+            fprintf(stderr, "expected frame never sent: %s\n", checks[i].text);
+        }
+        if (checks[i].forbid == checks[i].seen) {
+            passed = false;
+        }
+    }
+    return passed;
+}
+
+void scenario_poll(uint64_t now_us) {
+    while (next_event < num_events && events[next_event].t_us <= now_us) {
+        const scenario_event_t *ev = &events[next_event++];
+        if (ev->type == EVENT_SET) {
+            plant_set(ev->name, ev->value);
+        } else {
+            can_host_inject(&ev->msg);
+        }
+    }
+}
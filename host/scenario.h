@@ -0,0 +1,45 @@
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "canlib/canlib.h"
+
+// Timed scenario for the host simulator. One event per line, in time order:
+//
+//   # comment
+//   <t_ms> set <plant parameter> <value>
+//   <t_ms> frame <SID>#<HEX DATA>
+//   <t_ms> expect <SID>#<HEX DATA>
+//   <t_ms> forbid <SID>#<HEX DATA>
+//   <t_ms> end
+//
+// "set" changes a plant parameter, "frame" delivers a CAN frame to the board as if it
+// came off the bus, in the candump -L notation so frames can be pasted from a log.
+// "end" stops the run there, in place of --duration-ms, and has to be the last line.
+//
+// "expect" and "forbid" check what the board sends from t_ms to the end of the run: at
+// least one matching frame, or none. The data is matched as a prefix, and a '.' nibble
+// matches anything, e.g. 52B#......0B for any E_ACTUATOR_STATE board status from
+// the INJ board. A run that doesn't pass its checks exits with HAL_HOST_EXIT_CHECK.
+
+// Exit status of a run whose checks failed
+#define HAL_HOST_EXIT_CHECK 5
+
+// Parse the whole file up front. Prints the offending line and returns false on error.
+bool scenario_load(const char *path);
+
+// When the scenario ends the run, 0 if it has no "end"
+uint64_t scenario_end_us(void);
+
+// Check a frame the board sent
+void scenario_sent(const can_msg_t *msg, uint64_t now_us);
+
+// Print the checks that failed, true if there were none
+bool scenario_checks_passed(void);
+
+// Run every event due at or before now_us
+void scenario_poll(uint64_t now_us);
+
+#endif /* SCENARIO_H */
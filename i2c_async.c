@@ -0,0 +1,339 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <xc.h>
+
+#include "canlib/canlib.h"
+
+#include "mcc_generated_files/system/system.h"
+
+#include "i2c_async.h"
+
+// I2C1CLK clock sources, see the I2CxCLK register in the datasheet
+#define I2C_CLK_HFINTOSC 0b0010
+#define I2C_CLK_MFINTOSC 0b0011
+
+// OSCFRQ settings for HFINTOSC
+#define HFINTOSC_2MHZ 0x1
+#define HFINTOSC_4MHZ 0x2
+
+// Host mode, 7 bit address
+#define I2C_MODE_HOST_7BIT 0b100
+
+// SCL half period used while bit-banging bus recovery, gives roughly 100 kHz
+#define RECOVERY_HALF_PERIOD_us 5
+
+// PPS output codes for the I2C pins, from pins.c
+#define PPS_SCL1 0x21
+#define PPS_SDA1 0x22
+#define PPS_LAT 0x00
+
+// Circular queue of transactions, head is the one on the bus
+static i2c_txn_t *volatile queue[I2C_ASYNC_QUEUE_LEN];
+static volatile uint8_t queue_head = 0;
+static volatile uint8_t queue_count = 0;
+
+// Finished transactions waiting for their callback to be run from the main loop
+static i2c_txn_t *volatile done[I2C_ASYNC_QUEUE_LEN];
+static volatile uint8_t done_head = 0;
+static volatile uint8_t done_count = 0;
+
+// Position within the active transaction
+static volatile uint8_t data_idx = 0;
+static volatile bool reg_phase = false; // true while the register address of a read is sent
+static volatile enum i2c_txn_status active_result = I2C_TXN_DONE;
+
+static i2c_async_stats_t stats = {0};
+
+static void start_head(void);
+
+static void module_enable(void) {
+    I2C1CON0bits.MODE = I2C_MODE_HOST_7BIT;
+    I2C1CON1bits.ACKCNT = 1; // NACK the last byte of a read
+    I2C1CON2bits.ABD = 0; // address comes from I2C1ADB1
+
+    I2C1PIR = 0;
+    I2C1ERR = 0;
+    I2C1PIEbits.PCIE = 1; // stop condition, end of every transaction
+    I2C1PIEbits.CNTIE = 1; // byte count reached zero, used for the repeated start
+    I2C1ERRbits.NACKIE = 1;
+    I2C1ERRbits.BCLIE = 1;
+
+    I2C1IE = 1;
+    I2C1EIE = 1;
+    I2C1RXIE = 1;
+    I2C1TXIE = 0; // only enabled while there is data left to load
+
+    I2C1CON0bits.EN = 1;
+}
+
+void i2c_async_init(enum i2c_speed speed) {
+    I2C1CON0bits.EN = 0;
+
+    // SCL is one fifth of the module clock, or one quarter with FME set
+    switch (speed) {
+        case I2C_SPEED_FAST:
+            OSCFRQ = HFINTOSC_2MHZ;
+            I2C1CLK = I2C_CLK_HFINTOSC;
+            I2C1CON2bits.FME = 0;
+            break;
+        case I2C_SPEED_FAST_PLUS:
+            OSCFRQ = HFINTOSC_4MHZ;
+            I2C1CLK = I2C_CLK_HFINTOSC;
+            I2C1CON2bits.FME = 1;
+            break;
+        case I2C_SPEED_STANDARD:
+        default:
+            I2C1CLK = I2C_CLK_MFINTOSC;
+            I2C1CON2bits.FME = 0;
+            break;
+    }
+
+    queue_head = 0;
+    queue_count = 0;
+    done_head = 0;
+    done_count = 0;
+
+    module_enable();
+}
+
+// Clock SCL until the target lets go of SDA, then issue a stop. Used when a transaction
+// times out with the bus held low.
+static void bus_recover(void) {
+    I2C1CON0bits.EN = 0;
+
+    RC3PPS = PPS_LAT;
+    RC4PPS = PPS_LAT;
+    LATC3 = 1;
+    LATC4 = 1;
+    TRISC3 = 0;
+    TRISC4 = 0;
+
+    for (uint8_t i = 0; i < 9 && RC4 == 0; i++) {
+        LATC3 = 0;
+        __delay_us(RECOVERY_HALF_PERIOD_us);
+        LATC3 = 1;
+        __delay_us(RECOVERY_HALF_PERIOD_us);
+    }
+
+    // stop condition: SDA rises while SCL is high
+    LATC3 = 0;
+    LATC4 = 0;
+    __delay_us(RECOVERY_HALF_PERIOD_us);
+    LATC3 = 1;
+    __delay_us(RECOVERY_HALF_PERIOD_us);
+    LATC4 = 1;
+    __delay_us(RECOVERY_HALF_PERIOD_us);
+
+    RC3PPS = PPS_SCL1;
+    RC4PPS = PPS_SDA1;
+
+    stats.bus_recoveries++;
+    module_enable();
+}
+
+// Move the head transaction to the done list. Must be called with interrupts disabled or
+// from the ISR.
+static void finish_head(enum i2c_txn_status result) {
+    i2c_txn_t *txn = queue[queue_head];
+
+    I2C1TXIE = 0;
+    txn->status = result;
+
+    switch (result) {
+        case I2C_TXN_DONE:
+            stats.completed++;
+            break;
+        case I2C_TXN_NACK:
+            stats.nacks++;
+            break;
+        case I2C_TXN_BUS_COLLISION:
+            stats.bus_collisions++;
+            break;
+        case I2C_TXN_TIMEOUT:
+            stats.timeouts++;
+            break;
+        default:
+            break;
+    }
+
+    if (done_count < I2C_ASYNC_QUEUE_LEN) {
+        done[(done_head + done_count) % I2C_ASYNC_QUEUE_LEN] = txn;
+        done_count++;
+    }
+
+    queue_head = (queue_head + 1) % I2C_ASYNC_QUEUE_LEN;
+    queue_count--;
+
+    if (queue_count > 0) {
+        start_head();
+    }
+}
+
+// Put the head transaction on the bus
+static void start_head(void) {
+    i2c_txn_t *txn = queue[queue_head];
+
+    txn->status = I2C_TXN_ACTIVE;
+    txn->start_millis = millis();
+    active_result = I2C_TXN_DONE;
+    data_idx = 0;
+
+    I2C1PIR = 0;
+    I2C1ERRbits.NACKIF = 0;
+    I2C1ERRbits.BCLIF = 0;
+    I2C1STAT1bits.CLRBF = 1;
+
+    I2C1ADB1 = (uint8_t)(txn->addr << 1);
+    I2C1TXB = txn->reg;
+
+    if (txn->read) {
+        // write the register address, then hold the bus for a repeated start
+        reg_phase = true;
+        I2C1CNT = 1;
+        I2C1CON0bits.RSEN = 1;
+    } else {
+        reg_phase = false;
+        I2C1CNT = txn->len + 1;
+        I2C1CON0bits.RSEN = 0;
+        if (txn->len > 0) {
+            I2C1TXIE = 1;
+        }
+    }
+
+    I2C1CON0bits.S = 1;
+}
+
+bool i2c_async_submit(i2c_txn_t *txn) {
+    if (i2c_txn_pending(txn)) {
+        return false;
+    }
+
+    bool gie = INTCON0bits.GIE;
+    INTCON0bits.GIE = 0;
+
+    if (queue_count >= I2C_ASYNC_QUEUE_LEN) {
+        stats.queue_full++;
+        INTCON0bits.GIE = gie;
+        return false;
+    }
+
+    if (txn->timeout_ms == 0) {
+        txn->timeout_ms = I2C_ASYNC_DEFAULT_TIMEOUT_ms;
+    }
+    txn->status = I2C_TXN_QUEUED;
+    queue[(queue_head + queue_count) % I2C_ASYNC_QUEUE_LEN] = txn;
+    queue_count++;
+
+    if (queue_count == 1) {
+        start_head();
+    }
+
+    INTCON0bits.GIE = gie;
+    return true;
+}
+
+bool i2c_async_transfer_blocking(i2c_txn_t *txn) {
+    if (!i2c_async_submit(txn)) {
+        return false;
+    }
+    while (i2c_txn_pending(txn)) {
+        CLRWDT();
+        i2c_async_heartbeat();
+    }
+    return txn->status == I2C_TXN_DONE;
+}
+
+void i2c_async_heartbeat(void) {
+    // the caller may have interrupts off, leave them the way they were
+    bool gie = INTCON0bits.GIE;
+    INTCON0bits.GIE = 0;
+    if (queue_count > 0) {
+        i2c_txn_t *txn = queue[queue_head];
+        if (txn->status == I2C_TXN_ACTIVE && (millis() - txn->start_millis) > txn->timeout_ms) {
+            // Something is holding the bus, clock it free before starting the next one.
+            // Bounded to ~200us, so it is fine to do this with interrupts off.
+            bus_recover();
+            finish_head(I2C_TXN_TIMEOUT);
+        }
+    }
+    INTCON0bits.GIE = gie;
+
+    while (done_count > 0) {
+        INTCON0bits.GIE = 0;
+        i2c_txn_t *txn = done[done_head];
+        done_head = (done_head + 1) % I2C_ASYNC_QUEUE_LEN;
+        done_count--;
+        INTCON0bits.GIE = gie;
+
+        if (txn->callback) {
+            txn->callback(txn);
+        }
+    }
+}
+
+void i2c_async_handle_interrupt(void) {
+    if (queue_count == 0) {
+        // spurious, nothing on the bus
+        I2C1PIR = 0;
+        I2C1ERRbits.NACKIF = 0;
+        I2C1ERRbits.BCLIF = 0;
+        I2C1TXIE = 0;
+        return;
+    }
+
+    i2c_txn_t *txn = queue[queue_head];
+
+    if (I2C1EIF) {
+        if (I2C1ERRbits.BCLIF) {
+            // lost arbitration, the module drops off the bus so there is no stop to wait for
+            I2C1ERRbits.BCLIF = 0;
+            I2C1CON0bits.EN = 0;
+            I2C1CON0bits.EN = 1;
+            finish_head(I2C_TXN_BUS_COLLISION);
+            return;
+        }
+        if (I2C1ERRbits.NACKIF) {
+            // host sends the stop itself, finish on PCIF
+            I2C1ERRbits.NACKIF = 0;
+            active_result = I2C_TXN_NACK;
+            I2C1TXIE = 0;
+        }
+    }
+
+    if (I2C1TXIE && I2C1TXIF) {
+        if (data_idx < txn->len) {
+            I2C1TXB = txn->data[data_idx++];
+        }
+        if (data_idx >= txn->len) {
+            I2C1TXIE = 0;
+        }
+    }
+
+    if (I2C1RXIF) {
+        uint8_t byte = I2C1RXB;
+        if (!reg_phase && data_idx < txn->len) {
+            txn->data[data_idx++] = byte;
+        }
+    }
+
+    if (I2C1PIRbits.CNTIF) {
+        I2C1PIRbits.CNTIF = 0;
+        if (reg_phase && active_result == I2C_TXN_DONE) {
+            // register address is out, repeated start into the read
+            reg_phase = false;
+            I2C1ADB1 = (uint8_t)((txn->addr << 1) | 1);
+            I2C1CNT = txn->len;
+            I2C1CON0bits.RSEN = 0;
+            I2C1CON0bits.S = 1;
+        }
+    }
+
+    if (I2C1PIRbits.PCIF) {
+        I2C1PIRbits.PCIF = 0;
+        finish_head(active_result);
+    }
+}
+
+const i2c_async_stats_t *i2c_async_get_stats(void) {
+    return &stats;
+}
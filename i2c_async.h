@@ -0,0 +1,74 @@
+#ifndef I2C_ASYNC_H
+#define I2C_ASYNC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Interrupt-driven transaction queue for the I2C1 host. Transactions are owned by the
+// caller and must stay alive until they complete. Completion callbacks are run from
+// i2c_async_heartbeat(), never from the ISR.
+
+#define I2C_ASYNC_QUEUE_LEN 8
+#define I2C_ASYNC_DEFAULT_TIMEOUT_ms 5
+
+enum i2c_speed {
+    I2C_SPEED_STANDARD, // 100 kHz
+    I2C_SPEED_FAST, // 400 kHz
+    I2C_SPEED_FAST_PLUS // 1 MHz, only for targets that support Fm+
+};
+
+enum i2c_txn_status {
+    I2C_TXN_IDLE = 0,
+    I2C_TXN_QUEUED,
+    I2C_TXN_ACTIVE,
+    I2C_TXN_DONE,
+    I2C_TXN_NACK,
+    I2C_TXN_BUS_COLLISION,
+    I2C_TXN_TIMEOUT
+};
+
+typedef struct i2c_txn {
+    uint8_t addr; // 7 bit address
+    uint8_t reg;
+    uint8_t *data; // source for writes, destination for reads
+    uint8_t len;
+    bool read;
+    uint8_t timeout_ms;
+    void (*callback)(struct i2c_txn *txn); // may be NULL
+
+    // owned by the engine
+    volatile enum i2c_txn_status status;
+    uint32_t start_millis;
+} i2c_txn_t;
+
+typedef struct {
+    uint16_t completed;
+    uint16_t nacks;
+    uint16_t bus_collisions;
+    uint16_t timeouts;
+    uint16_t bus_recoveries;
+    uint16_t queue_full;
+} i2c_async_stats_t;
+
+void i2c_async_init(enum i2c_speed speed);
+
+// Queue a transaction. Returns false if it is already pending or the queue is full.
+bool i2c_async_submit(i2c_txn_t *txn);
+
+static inline bool i2c_txn_pending(const i2c_txn_t *txn) {
+    return txn->status == I2C_TXN_QUEUED || txn->status == I2C_TXN_ACTIVE;
+}
+
+// Submit and spin until the transaction finishes. Only for init code, before the main
+// loop starts. Returns true on I2C_TXN_DONE.
+bool i2c_async_transfer_blocking(i2c_txn_t *txn);
+
+// Call from the main loop: handles timeouts and runs completion callbacks
+void i2c_async_heartbeat(void);
+
+// Call from the ISR when any of the I2C1 interrupt flags are set
+void i2c_async_handle_interrupt(void);
+
+const i2c_async_stats_t *i2c_async_get_stats(void);
+
+#endif /* I2C_ASYNC_H */
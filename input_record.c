@@ -0,0 +1,183 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "canlib/canlib.h"
+
+#include "hal.h"
+#include "input_record.h"
+#include "prop_msg.h"
+
+// Largest record: CAN tag, SID, 8 data bytes, plus a time record in front of it
+#define MAX_RECORD_LEN (1 + 5 + 1 + 2 + 8)
+#define DUMP_CHUNK_LEN 5
+
+// Stream index order, the same on every backend
+static const hal_adc_channel_t channels[] = {HAL_ADC_ANA0,
+                                             HAL_ADC_ANA1,
+                                             HAL_ADC_ANB0,
+                                             HAL_ADC_ANB1,
+                                             HAL_ADC_ANB2,
+                                             HAL_ADC_ANB4,
+                                             HAL_ADC_ANB5,
+                                             HAL_ADC_ANC2};
+#define NUM_CHANNELS (sizeof(channels) / sizeof(channels[0]))
+
+static uint8_t buf[INPUT_RECORD_SIZE];
+static uint16_t len = 0;
+static volatile bool recording = false;
+static uint32_t last_timestamp;
+
+static void (*sink)(const uint8_t *data, uint16_t len) = NULL;
+
+static volatile bool dump_requested = false;
+static bool dumping = false;
+static uint16_t dump_offset;
+
+int8_t input_record_channel_index(hal_adc_channel_t channel) {
+    for (uint8_t i = 0; i < NUM_CHANNELS; i++) {
+        if (channels[i] == channel) {
+            return (int8_t)i;
+        }
+    }
+    return -1;
+}
+
+hal_adc_channel_t input_record_channel(uint8_t index) {
+    return channels[index < NUM_CHANNELS ? index : 0];
+}
+
+static void put_be(uint32_t value, uint8_t bytes) {
+    while (bytes-- > 0) {
+        buf[len++] = (uint8_t)(value >> (8 * bytes));
+    }
+}
+
+void input_record_start(uint16_t loop_us, uint32_t duration_ms) {
+    bool irq = hal_irq_disable();
+    len = 0;
+    buf[len++] = 'P';
+    buf[len++] = 'R';
+    buf[len++] = 'E';
+    buf[len++] = 'C';
+    buf[len++] = INPUT_RECORD_VERSION;
+    buf[len++] = BOARD_UNIQUE_ID;
+    put_be(HAL_TIMESTAMP_us, 2);
+    put_be(loop_us, 2);
+    put_be(duration_ms, 4);
+    last_timestamp = hal_timestamp();
+    dumping = false;
+    recording = true;
+    hal_irq_restore(irq);
+}
+
+void input_record_stop(void) {
+    recording = false;
+}
+
+// Make room for a record and put the time in front of it. Interrupts must be off.
+// Returns false if recording had to stop.
+static bool begin_record(void) {
+    if (INPUT_RECORD_SIZE - len < MAX_RECORD_LEN) {
+        if (sink) {
+            sink(buf, len);
+            len = 0;
+        } else {
+            buf[len++] = INPUT_RECORD_TAG_OVERFLOW;
+            recording = false;
+            return false;
+        }
+    }
+
+    uint32_t now = hal_timestamp();
+    uint32_t delta = now - last_timestamp;
+    if (delta != 0) {
+        last_timestamp = now;
+        buf[len++] = INPUT_RECORD_TAG_TIME;
+        while (delta >= 0x80) {
+            buf[len++] = (uint8_t)(delta | 0x80);
+            delta >>= 7;
+        }
+        buf[len++] = (uint8_t)delta;
+    }
+    return true;
+}
+
+void input_record_adc(hal_adc_channel_t channel, uint16_t raw) {
+    if (!recording) {
+        return;
+    }
+    int8_t index = input_record_channel_index(channel);
+    if (index < 0) {
+        return;
+    }
+
+    bool irq = hal_irq_disable();
+    if (recording && begin_record()) {
+        buf[len++] = (uint8_t)(index << 4 | ((raw >> 8) & 0x0f));
+        buf[len++] = (uint8_t)raw;
+    }
+    hal_irq_restore(irq);
+}
+
+void input_record_can(const can_msg_t *msg) {
+    if (!recording) {
+        return;
+    }
+
+    bool irq = hal_irq_disable();
+    if (recording && begin_record()) {
+        uint8_t dlc = msg->data_len > 8 ? 8 : msg->data_len;
+        buf[len++] = INPUT_RECORD_TAG_CAN | dlc;
+        put_be(msg->sid, 2);
+        for (uint8_t i = 0; i < dlc; i++) {
+            buf[len++] = msg->data[i];
+        }
+    }
+    hal_irq_restore(irq);
+}
+
+void input_record_request_dump(void) {
+    recording = false;
+    dump_requested = true;
+}
+
+void input_record_heartbeat(void) {
+    if (dump_requested) {
+        dump_requested = false;
+        dumping = true;
+        dump_offset = 0;
+    }
+    if (!dumping) {
+        return;
+    }
+
+    uint8_t payload[2 + DUMP_CHUNK_LEN];
+    uint8_t chunk = len - dump_offset > DUMP_CHUNK_LEN ? DUMP_CHUNK_LEN : len - dump_offset;
+    payload[0] = (uint8_t)(dump_offset >> 8);
+    payload[1] = (uint8_t)dump_offset;
+    for (uint8_t i = 0; i < chunk; i++) {
+        payload[2 + i] = buf[dump_offset + i];
+    }
+
+    can_msg_t msg;
+    build_prop_msg(PROP_MSG_INPUT_RECORD, payload, 2 + chunk, &msg);
+    if (txb_enqueue(&msg)) {
+        if (chunk == 0) {
+            dumping = false; // that was the end marker
+        }
+        dump_offset += chunk;
+    }
+}
+
+void input_record_set_sink(void (*new_sink)(const uint8_t *data, uint16_t len)) {
+    sink = new_sink;
+}
+
+void input_record_flush(void) {
+    bool irq = hal_irq_disable();
+    if (sink && len > 0) {
+        sink(buf, len);
+        len = 0;
+    }
+    hal_irq_restore(irq);
+}
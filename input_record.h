@@ -0,0 +1,74 @@
+#ifndef INPUT_RECORD_H
+#define INPUT_RECORD_H
+
+#include "canlib/canlib.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hal.h"
+
+// Recording of everything the firmware reads from the outside world: every ADC
+// conversion result and every received CAN frame, in the order the firmware saw them.
+// The host build (host/replay.c) can feed a recording back into main.c.
+//
+// On the board the stream goes into a RAM buffer and recording stops when it is full.
+// PROP_CMD_INPUT_RECORD starts, stops and dumps it. The dump is a PROP_MSG_INPUT_RECORD
+// per 5 bytes: offset (2, big endian), then up to 5 stream bytes. It ends with a frame
+// that has no stream bytes and the total length as the offset.
+//
+// Stream format, all multi-byte fields big endian:
+//   header (14 bytes):
+//     "PREC", version, BOARD_UNIQUE_ID, timestamp unit in us (2), main loop period in us
+//     (2, 0 if unknown), run length in ms (4, 0 if unknown)
+//   records, told apart by their first byte:
+//     0iiirrrr rrrrrrrr   ADC conversion, i is the channel's index in the list in
+//                         input_record.c, r the 12 bit result
+//     0x80 <LEB128>       time advanced by this many timestamp units since the last record
+//     0x90 | dlc, SID (2), data (dlc)
+//                         received CAN frame
+//     0xff                buffer filled up, nothing was recorded after this
+
+#define INPUT_RECORD_VERSION 1
+#define INPUT_RECORD_HEADER_LEN 14
+
+#define INPUT_RECORD_TAG_TIME 0x80
+#define INPUT_RECORD_TAG_CAN 0x90
+#define INPUT_RECORD_TAG_OVERFLOW 0xff
+
+// RAM buffer. The host build empties it into a file through the sink before it fills.
+#ifndef INPUT_RECORD_SIZE
+#ifdef HAL_HOST
+#define INPUT_RECORD_SIZE 4096
+#else
+#define INPUT_RECORD_SIZE 512
+#endif
+#endif
+
+enum INPUT_RECORD_ACTION { INPUT_RECORD_STOP = 0, INPUT_RECORD_START, INPUT_RECORD_DUMP };
+
+// Clears the buffer and starts a new stream. Safe to call from the ISR.
+void input_record_start(uint16_t loop_us, uint32_t duration_ms);
+void input_record_stop(void);
+
+// Hooks, bounded time and safe to call from the ISR. Nothing happens unless recording.
+void input_record_adc(hal_adc_channel_t channel, uint16_t raw);
+void input_record_can(const can_msg_t *msg);
+
+// Portable channel index used in the stream, or -1 if the channel isn't one of them
+int8_t input_record_channel_index(hal_adc_channel_t channel);
+hal_adc_channel_t input_record_channel(uint8_t index);
+
+// Send the buffer over CAN, a frame per main loop pass. Recording stops for the dump.
+// Safe to call from the ISR.
+void input_record_request_dump(void);
+
+// Call from the main loop
+void input_record_heartbeat(void);
+
+// Host build: hand the buffer to sink whenever it fills, instead of stopping
+void input_record_set_sink(void (*sink)(const uint8_t *data, uint16_t len));
+// Hand whatever is buffered to the sink
+void input_record_flush(void);
+
+#endif /* INPUT_RECORD_H */
@@ -0,0 +1,273 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "canlib/canlib.h"
+
+#include "error_checks.h"
+#include "instability.h"
+#include "prop_msg.h"
+#include "sensor_general.h"
+
+#define SAMPLE_HZ (1000000UL / HAL_SAMPLE_us)
+
+// Goertzel coefficients 2 cos(w) are Q12. Samples are taken relative to the first one of
+// the block and clamped. A filter's state grows fastest for bins near 0 and near N / 2,
+// and from bin 3 to N / 2 - 3 it stays under 2^18, so coeff * state fits in 32 bits.
+#define COEFF_SHIFT 12
+#define MAX_DEV 2047
+#define MIN_BIN 3
+#define MAX_BIN (INSTABILITY_BLOCK_LEN / 2 - 3)
+
+typedef struct {
+    uint16_t freq_hz; // centre of the bin
+    int16_t coeff;
+    uint16_t limit_dpsi; // 0.1 psi, 0 for none
+    int32_t s1;
+    int32_t s2;
+} band_t;
+
+static hal_adc_channel_t channel;
+static band_t bands[INSTABILITY_MAX_BANDS];
+static uint8_t num_bands = 0;
+
+// written by the ISR, read by the main loop
+static volatile uint16_t queue[INSTABILITY_QUEUE_LEN];
+static volatile uint8_t queue_head = 0;
+static volatile bool overrun = false;
+static volatile uint8_t dropped = 0;
+static volatile uint8_t queue_tail = 0; // written by the main loop
+
+static bool sampling = false;
+static uint32_t last_open_millis;
+
+static uint8_t block_len = 0;
+static uint16_t block_first;
+static uint8_t quiet_blocks = 0;
+
+// strongest band since the last report
+static uint8_t report_blocks = 0;
+static uint8_t peak_band = 0;
+static uint16_t peak_dpsi = 0;
+static uint8_t over_mask = 0;
+
+void instability_init(hal_adc_channel_t adc_channel,
+                      const instability_band_t *config,
+                      uint8_t count) {
+    channel = adc_channel;
+    if (count > INSTABILITY_MAX_BANDS) {
+        count = INSTABILITY_MAX_BANDS;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        uint32_t bin = ((uint32_t)config[i].freq_hz * INSTABILITY_BLOCK_LEN + SAMPLE_HZ / 2) /
+                       SAMPLE_HZ;
+        if (bin < MIN_BIN) {
+            bin = MIN_BIN;
+        } else if (bin > MAX_BIN) {
+            bin = MAX_BIN;
+        }
+        double w = 6.283185307 * bin / INSTABILITY_BLOCK_LEN;
+        bands[i].freq_hz = (uint16_t)(bin * SAMPLE_HZ / INSTABILITY_BLOCK_LEN);
+        bands[i].coeff = (int16_t)floor(2 * cos(w) * (1 << COEFF_SHIFT) + 0.5);
+        bands[i].limit_dpsi = config[i].limit_psi * 10;
+    }
+    num_bands = count;
+}
+
+void instability_handle_sample_interrupt(uint16_t raw) {
+    uint8_t next = (queue_head + 1) % INSTABILITY_QUEUE_LEN;
+    if (next == queue_tail) {
+        // the main loop fell behind, it restarts the block
+        overrun = true;
+        if (dropped < UINT8_MAX) {
+            dropped++;
+        }
+        return;
+    }
+    queue[queue_head] = raw;
+    queue_head = next;
+}
+
+static uint16_t isqrt(uint32_t x) {
+    uint32_t root = 0;
+    uint32_t bit = 1UL << 30;
+    while (bit > x) {
+        bit >>= 2;
+    }
+    while (bit) {
+        if (x >= root + bit) {
+            x -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint16_t)root;
+}
+
+// Amplitude of the band's sinusoid over the block, in 0.1 psi
+static uint16_t amplitude_dpsi(const band_t *band) {
+    int32_t s1 = band->s1;
+    int32_t s2 = band->s2;
+    uint8_t shift = 0;
+    while (s1 >= 0x4000 || s1 <= -0x4000 || s2 >= 0x4000 || s2 <= -0x4000) {
+        s1 >>= 1;
+        s2 >>= 1;
+        shift++;
+    }
+    // |X|^2 = s1^2 + s2^2 - coeff s1 s2, and the amplitude is 2 |X| / N counts
+    int32_t power = s1 * s1 + s2 * s2 - (((int32_t)band->coeff * s1) >> COEFF_SHIFT) * s2;
+    if (power < 0) {
+        power = 0;
+    }
+    uint32_t counts_x32 = (uint32_t)isqrt((uint32_t)power) << shift;
+    uint32_t dpsi = counts_x32 * PRES_4_20_mpsi_PER_COUNT / (INSTABILITY_BLOCK_LEN / 2 * 100);
+    return dpsi > UINT16_MAX ? UINT16_MAX : (uint16_t)dpsi;
+}
+
+static void send_report(void) {
+    bool gie = hal_irq_disable();
+    uint8_t lost = dropped;
+    dropped = 0;
+    hal_irq_restore(gie);
+
+    uint8_t payload[6];
+    payload[0] = (bands[peak_band].freq_hz >> 8) & 0xff;
+    payload[1] = (bands[peak_band].freq_hz >> 0) & 0xff;
+    payload[2] = (peak_dpsi >> 8) & 0xff;
+    payload[3] = (peak_dpsi >> 0) & 0xff;
+    payload[4] = over_mask;
+    payload[5] = lost;
+
+    can_msg_t msg;
+    build_prop_msg(PROP_MSG_CC_OSC, payload, sizeof(payload), &msg);
+    txb_enqueue(&msg);
+
+    report_blocks = 0;
+    peak_dpsi = 0;
+    over_mask = 0;
+}
+
+static void finish_block(void) {
+    uint8_t worst = INSTABILITY_MAX_BANDS;
+    uint16_t worst_dpsi = 0;
+    for (uint8_t i = 0; i < num_bands; i++) {
+        uint16_t dpsi = amplitude_dpsi(&bands[i]);
+        if (dpsi >= peak_dpsi) {
+            peak_dpsi = dpsi;
+            peak_band = i;
+        }
+        if (bands[i].limit_dpsi && dpsi > bands[i].limit_dpsi) {
+            over_mask |= 1 << i;
+            if (dpsi >= worst_dpsi) {
+                worst = i;
+                worst_dpsi = dpsi;
+            }
+        }
+    }
+
+    if (worst < INSTABILITY_MAX_BANDS) {
+        uint8_t fault_data[4];
+        fault_data[0] = (bands[worst].freq_hz >> 8) & 0xff;
+        fault_data[1] = (bands[worst].freq_hz >> 0) & 0xff;
+        fault_data[2] = (worst_dpsi >> 8) & 0xff;
+        fault_data[3] = (worst_dpsi >> 0) & 0xff;
+        fault_raise(FAULT_CC_OSC, fault_data, 4);
+        quiet_blocks = 0;
+    } else if (quiet_blocks < INSTABILITY_CLEAR_BLOCKS) {
+        quiet_blocks++;
+        if (quiet_blocks == INSTABILITY_CLEAR_BLOCKS) {
+            fault_clear(FAULT_CC_OSC);
+        }
+    }
+
+    if (++report_blocks >= INSTABILITY_REPORT_BLOCKS) {
+        send_report();
+    }
+}
+
+static void add_sample(uint16_t raw) {
+    if (block_len == 0) {
+        block_first = raw;
+        for (uint8_t i = 0; i < num_bands; i++) {
+            bands[i].s1 = 0;
+            bands[i].s2 = 0;
+        }
+    }
+
+    int16_t x = (int16_t)(raw - block_first);
+    if (x > MAX_DEV) {
+        x = MAX_DEV;
+    } else if (x < -MAX_DEV) {
+        x = -MAX_DEV;
+    }
+    for (uint8_t i = 0; i < num_bands; i++) {
+        band_t *band = &bands[i];
+        int32_t s = x + (((int32_t)band->coeff * band->s1) >> COEFF_SHIFT) - band->s2;
+        band->s2 = band->s1;
+        band->s1 = s;
+    }
+
+    if (++block_len == INSTABILITY_BLOCK_LEN) {
+        block_len = 0;
+        finish_block();
+    }
+}
+
+static void start_sampling(void) {
+    queue_head = 0;
+    queue_tail = 0;
+    overrun = false;
+    block_len = 0;
+    report_blocks = 0;
+    peak_dpsi = 0;
+    over_mask = 0;
+    quiet_blocks = 0;
+    sampling = true;
+    hal_sample_timer_start(channel);
+}
+
+static void stop_sampling(void) {
+    hal_sample_timer_stop();
+    sampling = false;
+    if (report_blocks) {
+        send_report();
+    }
+    // nothing to go on until the injector opens again
+    fault_clear(FAULT_CC_OSC);
+}
+
+void instability_heartbeat(bool injector_open) {
+    if (num_bands == 0) {
+        return;
+    }
+
+    if (injector_open) {
+        last_open_millis = millis();
+    }
+    bool wanted =
+        injector_open || (sampling && millis() - last_open_millis < INSTABILITY_TAIL_ms);
+    if (wanted && !sampling) {
+        start_sampling();
+    } else if (!wanted && sampling) {
+        stop_sampling();
+        return;
+    }
+    if (!sampling) {
+        return;
+    }
+
+    if (overrun) {
+        bool gie = hal_irq_disable();
+        overrun = false;
+        queue_tail = queue_head;
+        hal_irq_restore(gie);
+        block_len = 0;
+    }
+    while (queue_tail != queue_head) {
+        uint16_t raw = queue[queue_tail];
+        queue_tail = (queue_tail + 1) % INSTABILITY_QUEUE_LEN;
+        add_sample(raw);
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef INSTABILITY_H
+#define INSTABILITY_H
+
+#include "hal.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Chamber pressure oscillation monitor. While the injector is open, and for
+// INSTABILITY_TAIL_ms after it closes, the sample timer interrupt reads the chamber
+// pressure every HAL_SAMPLE_us. The main loop runs one Goertzel filter per configured
+// band over blocks of INSTABILITY_BLOCK_LEN samples. Every INSTABILITY_REPORT_BLOCKS
+// blocks it sends the strongest band's frequency and amplitude as PROP_MSG_CC_OSC.
+// A band above its limit raises FAULT_CC_OSC, which clears after
+// INSTABILITY_CLEAR_BLOCKS quiet blocks.
+//
+// Sampling at 500 Hz covers chugging but not the acoustic modes. Blocks of 64 samples
+// give bins 7.8 Hz apart. Band frequencies are rounded to the nearest bin and kept
+// between 23 and 227 Hz.
+
+#define INSTABILITY_BLOCK_LEN 64
+#define INSTABILITY_MAX_BANDS 4
+#define INSTABILITY_QUEUE_LEN 32 // samples waiting for the main loop
+#define INSTABILITY_REPORT_BLOCKS 2 // about 4 Hz
+#define INSTABILITY_CLEAR_BLOCKS 4
+#define INSTABILITY_TAIL_ms 500
+
+typedef struct {
+    uint16_t freq_hz;
+    uint16_t limit_psi; // amplitude, 0 to only report the band
+} instability_band_t;
+
+void instability_init(hal_adc_channel_t channel,
+                      const instability_band_t *bands,
+                      uint8_t num_bands);
+
+// Call from the main loop: starts and stops sampling, and analyses the queued samples
+void instability_heartbeat(bool injector_open);
+
+// Called from the sample timer ISR with a chamber pressure conversion
+void instability_handle_sample_interrupt(uint16_t raw);
+
+#endif /* INSTABILITY_H */
@@ -5,27 +5,52 @@
 #include "canlib/canlib.h"
 #include "canlib/message_types.h"
 
-#include "mcc_generated_files/system/system.h"
-
 #include "IOExpanderDriver.h"
 #include "actuator.h"
+#include "adc_cal.h"
+#include "can_recovery.h"
+#include "eeprom.h"
 #include "error_checks.h"
-#include "i2c.h"
+#include "event_log.h"
+#include "hal.h"
+#include "hall_detector.h"
+#include "i2c_async.h"
+#include "input_record.h"
+#include "instability.h"
+#include "pres_cal.h"
+#include "pres_loop.h"
+#include "pres_rate.h"
+#include "pres_stats.h"
+#include "prop_msg.h"
 #include "sensor_general.h"
-
-#include <xc.h>
+#include "sequence.h"
+#include "solenoid_capture.h"
+#include "valve_monitor.h"
+#include "valve_timing.h"
+#include "warm_restart.h"
 
 #define MAX_BUS_DEAD_TIME_ms 1000
 
 // Set any of these to zero to disable
 #define STATUS_TIME_DIFF_ms 500 // 2 Hz
+#define ADC_CAL_TIME_DIFF_ms 1000 // 1 Hz, reference conversions go between pressure samples
 
 #define MAX_CAN_IDLE_TIME_MS 20000
 
 #define SAFE_STATE_ENABLED 1
-adcc_channel_t current_sense_5v = channel_ANA0;
-adcc_channel_t current_sense_12v = channel_ANA1;
-adcc_channel_t batt_vol_sense = channel_ANC2;
+
+// Shortest frames that carry the fields we read, see message_types.h
+#define ACTUATOR_CMD_MIN_LEN 5 // timestamp (3), actuator id, state
+#define RESET_CMD_MIN_LEN 4 // timestamp (3), board id
+
+// Solenoid current signature limits on the 12 V rail. Starting points, to be tightened
+// once we have captured signatures from the real valves.
+#define SOLENOID_PEAK_MAX_mA 1000
+#define SOLENOID_HOLD_MIN_mA 20
+#define SOLENOID_HOLD_MAX_mA BAT_OVERCURRENT_THRESHOLD_mA
+hal_adc_channel_t current_sense_5v = HAL_ADC_ANA0;
+hal_adc_channel_t current_sense_12v = HAL_ADC_ANA1;
+hal_adc_channel_t batt_vol_sense = HAL_ADC_ANC2;
 
 // ADD more actuator ID's if propulsion wants more stuff
 #if (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_INJ)
@@ -41,12 +66,40 @@ adcc_channel_t batt_vol_sense = channel_ANC2;
 #define PRES_CC_TIME_DIFF_ms 16 // 64 Hz
 #define HALLSENSE_FUEL_TIME_DIFF_ms 250 // 4 Hz
 #define HALLSENSE_OX_TIME_DIFF_ms 250 // 4 Hz
-
-adcc_channel_t pres_fuel = channel_ANB1;
-adcc_channel_t pres_pneumatics = channel_ANB2;
-adcc_channel_t pres_cc = channel_ANB0;
-adcc_channel_t hallsense_fuel = channel_ANB4;
-adcc_channel_t hallsense_ox = channel_ANB5;
+#define HALLSENSE_DETECT_TIME_DIFF_ms 16 // 64 Hz, debounced valve state
+
+// dP/dt in psi/s that raises FAULT_PRES_RATE, 0 to disable. Starting points: tank
+// pressures fall while venting and burning, and chamber pressure at every shutdown.
+#define PRES_FUEL_RISE_LIMIT_psi_s 300
+#define PRES_FUEL_DROP_LIMIT_psi_s 0
+// Fuel pressure recovers to the supply pressure when the injector closes, much faster
+// than the limit. The fuel limits are off for this long after the injector output
+// changes: the valve's travel and the recovery, then a whole window past it.
+#define PRES_FUEL_RATE_SETTLE_ms 500
+#define PRES_CC_RISE_LIMIT_psi_s 2000 // hard start
+#define PRES_CC_DROP_LIMIT_psi_s 0
+
+// Chamber pressure oscillation bands and the amplitudes that raise FAULT_CC_OSC. Starting
+// points until we have data from a hot fire.
+static const instability_band_t cc_osc_bands[] = {
+    {40, 30},
+    {80, 30},
+    {125, 30},
+    {200, 30},
+};
+
+// How long an injector's hall sensor may disagree with the injector output before
+// FAULT_VALVE_MISMATCH. Travel and debouncing take about 120 ms. The monitors compare
+// against the output as driven, not the request the next STATUS pass applies, so the
+// wait for that pass doesn't count.
+#define FUEL_INJ_MISMATCH_ALLOWANCE_ms 500
+#define OX_INJ_MISMATCH_ALLOWANCE_ms 500
+
+hal_adc_channel_t pres_fuel = HAL_ADC_ANB1;
+hal_adc_channel_t pres_pneumatics = HAL_ADC_ANB2;
+hal_adc_channel_t pres_cc = HAL_ADC_ANB0;
+hal_adc_channel_t hallsense_fuel = HAL_ADC_ANB4;
+hal_adc_channel_t hallsense_ox = HAL_ADC_ANB5;
 
 double fuel_pres_low_pass = 0;
 double cc_pres_low_pass = 0;
@@ -54,12 +107,27 @@ double cc_pres_low_pass = 0;
 uint8_t fuel_pres_count = 0;
 uint8_t cc_pres_count = 0;
 
-/*
- * Fuel INJ: Closed 3415, Open 2600
- * Ox INJ: Closed 670, Open 2240
- */
-#define HALLSENSE_FUEL_THRESHOLD 3000
-#define HALLSENSE_OX_THRESHOLD 1450
+pres_stats_t fuel_pres_stats;
+pres_stats_t cc_pres_stats;
+
+pres_rate_t fuel_pres_rate;
+pres_rate_t cc_pres_rate;
+
+pres_loop_t fuel_pres_loop;
+pres_loop_t cc_pres_loop;
+
+hall_detector_t fuel_hall;
+hall_detector_t ox_hall;
+uint16_t hallsense_fuel_flux = 0;
+uint16_t hallsense_ox_flux = 0;
+
+// The fill dump valve has no position feedback yet. Give it a monitor fed from the same
+// task once it has.
+valve_monitor_t fuel_inj_monitor;
+valve_monitor_t ox_inj_monitor;
+
+volatile bool hall_cal_requested = false;
+volatile bool hall_report_requested = false;
 
 #elif (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_VENT)
 #define SAFE_STATE_VENT ACTUATOR_OFF
@@ -67,20 +135,38 @@ uint8_t cc_pres_count = 0;
 #define VENT_TEMP_TIME_DIFF_ms 250 // 4 Hz
 #define PRES_OX_TIME_DIFF_ms 16 // 64 Hz
 
-adcc_channel_t pres_ox = channel_ANB0;
-adcc_channel_t temp_vent = channel_ANB1;
+// dP/dt in psi/s that raises FAULT_PRES_RATE, 0 to disable
+#define PRES_OX_RISE_LIMIT_psi_s 100 // overpressure ramp
+#define PRES_OX_DROP_LIMIT_psi_s 0 // falls whenever we vent
+
+hal_adc_channel_t pres_ox = HAL_ADC_ANB0;
+hal_adc_channel_t temp_vent = HAL_ADC_ANB1;
 
 double ox_pres_low_pass = 0;
 
 uint8_t ox_pres_count = 0;
 
+pres_stats_t ox_pres_stats;
+
+pres_rate_t ox_pres_rate;
+
+pres_loop_t ox_pres_loop;
+
+// No position feedback on the vent valve yet, so nothing for valve_monitor to compare the
+// requested state against
+
 #else
 #error "INVALID_BOARD_UNIQUE_ID"
 
 #endif
 
 static void can_msg_handler(const can_msg_t *msg);
-static void send_status_ok(void);
+static void log_and_reset(enum RESET_REASON reason);
+static uint8_t get_requested_actuator_bits(void);
+static void restore_warm_state(const warm_state_t *state);
+static void sequence_step(uint8_t pin, enum ACTUATOR_STATE state);
+static void handle_sequence_cmd(const can_msg_t *msg);
+static void handle_input_record_cmd(uint8_t action);
 
 // Follows ACTUATOR_STATE in message_types.h
 // SHOULD ONLY BE MODIFIED IN ISR
@@ -94,15 +180,20 @@ volatile enum ACTUATOR_STATE requested_actuator_state_vent = SAFE_STATE_VENT;
 
 volatile bool seen_can_message = false;
 volatile bool seen_can_command = false;
+volatile bool reset_requested = false;
 
 // memory pool for the CAN tx buffer
 uint8_t tx_pool[200];
 
 #define IOEXP_I2C_ADDR 0x41
+// The PCA9536 is only rated for 400 kHz, use I2C_SPEED_FAST_PLUS with an Fm+ expander
+#define IOEXP_I2C_SPEED I2C_SPEED_FAST
 
 int main(int argc, char **argv) {
-    // MCC generated initializer
-    SYSTEM_Initialize();
+    // before anything can change PCON0
+    uint16_t reset_cause = hal_get_reset_cause();
+
+    hal_init(argc, argv);
 
     LED_init();
 
@@ -110,16 +201,9 @@ int main(int argc, char **argv) {
     timer0_init();
 
     // Enable global interrupts
-    INTCON0bits.GIE = 1;
-
-    // Set up CAN TX
-    TRISC1 = 0;
-    RC1PPS = 0x33;
+    hal_irq_enable();
 
-    // Set up CAN RX
-    TRISC0 = 1;
-    ANSELC0 = 0;
-    CANRXPPS = 0x10;
+    hal_can_pins_init();
 
     // set up CAN module
     can_timing_t can_setup;
@@ -129,33 +213,114 @@ int main(int argc, char **argv) {
     // set up CAN tx buffer
     txb_init(tx_pool, sizeof(tx_pool), can_send, can_send_rdy);
 
-    i2c_init(0);
+    i2c_async_init(IOEXP_I2C_SPEED);
 
     // Set up actuator
+    solenoid_capture_init(current_sense_12v);
+    const solenoid_envelope_t solenoid_envelope = {
+        SOLENOID_PEAK_MAX_mA, SOLENOID_HOLD_MIN_mA, SOLENOID_HOLD_MAX_mA, true};
+#if (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_INJ)
+    solenoid_capture_set_envelope(INJECTOR_PIN, ACTUATOR_INJECTOR_VALVE, &solenoid_envelope);
+    solenoid_capture_set_envelope(FILL_DUMP_PIN, ACTUATOR_FILL_DUMP_VALVE, &solenoid_envelope);
+#elif (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_VENT)
+    solenoid_capture_set_envelope(VENT_VALVE_PIN, ACTUATOR_VENT_VALVE, &solenoid_envelope);
+#endif
     actuator_init();
 
+    // stored pressure calibrations, before the first reading
+#if (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_INJ)
+    pres_cal_add(SENSOR_PRESSURE_FUEL, pres_fuel, 0);
+    pres_cal_add(SENSOR_PRESSURE_CC, pres_cc, 1);
+#elif (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_VENT)
+    pres_cal_add(SENSOR_PRESSURE_OX, pres_ox, 0);
+#endif
+    pres_cal_request_report();
+    adc_cal_start();
+
+    // pick up where we left off if this is a RESET() we did ourselves
+    warm_state_t warm_state = {0};
+    if (warm_restart_restore(reset_cause, &warm_state)) {
+        restore_warm_state(&warm_state);
+    } else {
+#if (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_INJ)
+        seed_pressure_psi_low_pass(pres_fuel, &fuel_pres_low_pass);
+        seed_pressure_psi_low_pass(pres_cc, &cc_pres_low_pass);
+#elif (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_VENT)
+        seed_pressure_psi_low_pass(pres_ox, &ox_pres_low_pass);
+#endif
+    }
+
+    // re-init CAN before resorting to a reset when the bus goes quiet
+    can_recovery_init(&can_setup, can_msg_handler, tx_pool, sizeof(tx_pool), warm_state.can_resets);
+
+    // black box, records why we came out of reset
+    event_log_init(reset_cause);
+    uint8_t logged_outputs = get_actuator_outputs();
+    uint8_t logged_requested = get_requested_actuator_bits();
+    bool in_safe_state = false;
+
+#if (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_INJ)
+    hall_detector_init(&fuel_hall,
+                       ACTUATOR_FUEL_INJECTOR,
+                       0,
+                       HALL_FUEL_DEFAULT_CLOSED,
+                       HALL_FUEL_DEFAULT_OPEN);
+    hall_detector_init(
+        &ox_hall, ACTUATOR_OX_INJECTOR, 1, HALL_OX_DEFAULT_CLOSED, HALL_OX_DEFAULT_OPEN);
+    hall_detector_report(&fuel_hall);
+    hall_detector_report(&ox_hall);
+
+    valve_timing_init(hallsense_fuel, hallsense_ox, &fuel_hall, &ox_hall);
+    valve_monitor_init(&fuel_inj_monitor, ACTUATOR_FUEL_INJECTOR, FUEL_INJ_MISMATCH_ALLOWANCE_ms);
+    valve_monitor_init(&ox_inj_monitor, ACTUATOR_OX_INJECTOR, OX_INJ_MISMATCH_ALLOWANCE_ms);
+    sequence_init((1 << INJECTOR_PIN) | (1 << FILL_DUMP_PIN), sequence_step);
+
+    // the tasks run every TIME_DIFF + 1 ms
+    pres_rate_init(&fuel_pres_rate,
+                   SENSOR_PRESSURE_FUEL,
+                   PRES_FUEL_TIME_DIFF_ms + 1,
+                   PRES_FUEL_RISE_LIMIT_psi_s,
+                   PRES_FUEL_DROP_LIMIT_psi_s);
+    pres_rate_init(&cc_pres_rate,
+                   SENSOR_PRESSURE_CC,
+                   PRES_CC_TIME_DIFF_ms + 1,
+                   PRES_CC_RISE_LIMIT_psi_s,
+                   PRES_CC_DROP_LIMIT_psi_s);
+    instability_init(pres_cc, cc_osc_bands, sizeof(cc_osc_bands) / sizeof(cc_osc_bands[0]));
+    pres_loop_init(&fuel_pres_loop, SENSOR_PRESSURE_FUEL);
+    pres_loop_init(&cc_pres_loop, SENSOR_PRESSURE_CC);
+#elif (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_VENT)
+    sequence_init(1 << VENT_VALVE_PIN, sequence_step);
+
+    // the task runs every TIME_DIFF + 1 ms
+    pres_rate_init(&ox_pres_rate,
+                   SENSOR_PRESSURE_OX,
+                   PRES_OX_TIME_DIFF_ms + 1,
+                   PRES_OX_RISE_LIMIT_psi_s,
+                   PRES_OX_DROP_LIMIT_psi_s);
+    pres_loop_init(&ox_pres_loop, SENSOR_PRESSURE_OX);
+#endif
+
     uint32_t last_message_millis = 0; // last time we saw a can message
     // loop timers
-    uint32_t last_status_millis = millis(); // unused?
-    uint32_t last_pres_low_millis = millis();
-
     uint32_t last_millis = millis();
     uint32_t last_command_millis = millis();
+    uint32_t last_adc_cal_millis = millis();
 
 #if (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_INJ)
     uint32_t last_pres_fuel_millis = millis();
     uint32_t last_pres_pneumatics_millis = millis();
     uint32_t last_pres_cc_millis = millis();
     uint32_t last_hallsense_fuel_millis = millis();
-    uint32_t last_hallsense_fill_millis = millis();
     uint32_t last_hallsense_ox_millis = millis();
+    uint32_t last_hallsense_detect_millis = millis();
 #elif (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_VENT)
     uint32_t last_pres_ox_millis = millis();
     uint32_t last_vent_temp_millis = millis();
 #endif
 
     while (1) {
-        CLRWDT(); // feed the watchdog, which is set for 256ms
+        hal_watchdog_clear(); // feed the watchdog, which is set for 256ms
 
         if (seen_can_message) {
             seen_can_message = false;
@@ -166,41 +331,47 @@ int main(int argc, char **argv) {
             last_command_millis = millis();
         }
 
+        // We've got too long without seeing a valid CAN message (including one of ours),
+        // and re-initializing the CAN module didn't bring it back
+        bool bus_dead = can_recovery_heartbeat(last_message_millis, MAX_BUS_DEAD_TIME_ms);
 #if (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_INJ)
-        if (((millis() - last_message_millis) > MAX_BUS_DEAD_TIME_ms) &&
-            (requested_actuator_state_inj == SAFE_STATE_INJ)) {
+        if (bus_dead && (requested_actuator_state_inj == SAFE_STATE_INJ)) {
             // Only reset if safe state is enabled (aka this isn't injector valve)
             // OR this is injector valve and the currently requested state is the safe
             // state (closed)
-
-            // We've got too long without seeing a valid CAN message (including one of ours)
-            RESET();
+            log_and_reset(RESET_BUS_DEAD);
         }
 #elif (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_VENT)
-        if ((millis() - last_message_millis) > MAX_BUS_DEAD_TIME_ms) {
-            RESET();
+        if (bus_dead) {
+            log_and_reset(RESET_BUS_DEAD);
         }
 #endif
+        if (reset_requested) {
+            log_and_reset(RESET_CAN_CMD);
+        }
         if (millis() - last_millis > STATUS_TIME_DIFF_ms) {
 
-            // check for general board status
-            bool status_ok = true;
-            status_ok &= check_battery_voltage_error(batt_vol_sense);
+            // check for general board status, fault transitions are sent right away
+            check_board_status(batt_vol_sense, current_sense_5v, current_sense_12v);
 
-            status_ok &= check_5v_current_error(current_sense_5v);
-            status_ok &= check_12v_current_error(current_sense_12v);
-
-            // if there was an issue, a message would already have been sent out
-            if (status_ok) {
-                send_status_ok();
-            }
+            // one message covering every active fault
+            send_board_status();
 
             // Set safe state if:
             // 1. We haven't heard CAN traffic in a while
             // 2. We're low on battery voltage
             // "thread safe" because main loop should never write to requested_actuator_state
-            if (SAFE_STATE_ENABLED && (((millis() - last_command_millis) > MAX_CAN_IDLE_TIME_MS) ||
-                                       is_batt_voltage_critical())) {
+            bool can_idle = (millis() - last_command_millis) > MAX_CAN_IDLE_TIME_MS;
+            if (SAFE_STATE_ENABLED && (can_idle || is_batt_voltage_critical())) {
+                if (!in_safe_state) {
+                    in_safe_state = true;
+                    event_log_append(EVENT_SAFE_STATE_ENTER,
+                                     can_idle ? SAFE_STATE_CAN_IDLE : SAFE_STATE_BATT_CRITICAL);
+                }
+
+
+                // safe state always wins over an on-board sequence
+                sequence_abort();
 
                 // Red LED flashes during safe state.
                 LED_heartbeat_R();
@@ -215,8 +386,15 @@ int main(int argc, char **argv) {
 #endif
 
             } else {
+                if (in_safe_state) {
+                    in_safe_state = false;
+                    event_log_append(EVENT_SAFE_STATE_EXIT, 0);
+                }
+
 #if (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_INJ)
-                actuator_set(requested_actuator_state_inj, INJECTOR_PIN);
+                if (actuator_set(requested_actuator_state_inj, INJECTOR_PIN)) {
+                    valve_timing_start(requested_actuator_state_inj);
+                }
                 set_actuator_LED(requested_actuator_state_inj, ACTUATOR_INJECTOR_VALVE);
 
                 actuator_set(requested_actuator_state_fill, FILL_DUMP_PIN);
@@ -247,6 +425,14 @@ int main(int argc, char **argv) {
             txb_enqueue(&stat_msg);
 #endif
 
+            // keep the last actuator states in the black box
+            if (get_actuator_outputs() != logged_outputs ||
+                get_requested_actuator_bits() != logged_requested) {
+                logged_outputs = get_actuator_outputs();
+                logged_requested = get_requested_actuator_bits();
+                event_log_append(EVENT_ACTUATORS, ((uint16_t)logged_outputs << 8) | logged_requested);
+            }
+
             // Visual heartbeat indicator
             LED_heartbeat_G();
 
@@ -270,12 +456,36 @@ int main(int argc, char **argv) {
 #if PRES_FUEL_TIME_DIFF_ms
         if (millis() - last_pres_fuel_millis > PRES_FUEL_TIME_DIFF_ms) {
             last_pres_fuel_millis = millis();
-            uint16_t fuel_pressure = update_pressure_psi_low_pass(pres_fuel, &fuel_pres_low_pass);
+            int16_t fuel_sample = (int16_t)get_pressure_4_20_psi(pres_fuel);
+            enum PRES_LOOP_SAMPLE fuel_loop = pres_loop_update(&fuel_pres_loop, fuel_sample);
+            if (fuel_sample < 0) {
+                // under 4 mA but in range, no pressure
+                fuel_sample = 0;
+            }
+            if (fuel_loop == PRES_LOOP_RECOVERED) {
+                // the filters still hold readings from before the fault
+                fuel_pres_low_pass = fuel_sample;
+                pres_rate_restart(&fuel_pres_rate);
+            }
+            // the filtered pressure holds its last value through invalid samples
+            uint16_t fuel_pressure = (uint16_t)fuel_pres_low_pass;
+            if (fuel_loop != PRES_LOOP_INVALID) {
+                fuel_pressure = filter_pressure_psi_low_pass(fuel_sample, &fuel_pres_low_pass);
+                pres_stats_add(&fuel_pres_stats, fuel_sample);
+                uint32_t inj_held_ms = millis() - get_actuator_change_millis(INJECTOR_PIN);
+                if (inj_held_ms < PRES_FUEL_RATE_SETTLE_ms) {
+                    pres_rate_hold(&fuel_pres_rate, PRES_FUEL_RATE_SETTLE_ms - inj_held_ms);
+                }
+                pres_rate_update(&fuel_pres_rate, fuel_sample);
+            }
             if ((fuel_pres_count & 0xf) == 0) {
                 can_msg_t sensor_msg;
                 build_analog_data_msg(
                     millis(), SENSOR_PRESSURE_FUEL, fuel_pressure, &sensor_msg);
                 txb_enqueue(&sensor_msg);
+                pres_stats_report(&fuel_pres_stats, SENSOR_PRESSURE_FUEL);
+                pres_loop_report(&fuel_pres_loop);
+                warm_restart_telemetry_sent();
             }
             fuel_pres_count++;
         }
@@ -284,20 +494,78 @@ int main(int argc, char **argv) {
 #if PRES_CC_TIME_DIFF_ms
         if (millis() - last_pres_cc_millis > PRES_CC_TIME_DIFF_ms) {
             last_pres_cc_millis = millis();
-            uint16_t cc_pressure = update_pressure_psi_low_pass(pres_cc, &cc_pres_low_pass);
+            int16_t cc_sample = (int16_t)get_pressure_4_20_psi(pres_cc);
+            enum PRES_LOOP_SAMPLE cc_loop = pres_loop_update(&cc_pres_loop, cc_sample);
+            if (cc_sample < 0) {
+                // under 4 mA but in range, no pressure
+                cc_sample = 0;
+            }
+            if (cc_loop == PRES_LOOP_RECOVERED) {
+                // the filters still hold readings from before the fault
+                cc_pres_low_pass = cc_sample;
+                pres_rate_restart(&cc_pres_rate);
+            }
+            // the filtered pressure holds its last value through invalid samples
+            uint16_t cc_pressure = (uint16_t)cc_pres_low_pass;
+            if (cc_loop != PRES_LOOP_INVALID) {
+                cc_pressure = filter_pressure_psi_low_pass(cc_sample, &cc_pres_low_pass);
+                pres_stats_add(&cc_pres_stats, cc_sample);
+                pres_rate_update(&cc_pres_rate, cc_sample);
+            }
             if ((cc_pres_count & 0xf) == 0) {
                 can_msg_t sensor_msg;
                 build_analog_data_msg(millis(), SENSOR_PRESSURE_CC, cc_pressure, &sensor_msg);
                 txb_enqueue(&sensor_msg);
+                pres_stats_report(&cc_pres_stats, SENSOR_PRESSURE_CC);
+                pres_loop_report(&cc_pres_loop);
+                warm_restart_telemetry_sent();
             }
             cc_pres_count++;
+
+            // the last pressure sample this pass, the next is a period away
+            adc_cal_sample();
+        }
+#endif
+
+#if HALLSENSE_DETECT_TIME_DIFF_ms
+        if (millis() - last_hallsense_detect_millis > HALLSENSE_DETECT_TIME_DIFF_ms) {
+            last_hallsense_detect_millis = millis();
+            hallsense_fuel_flux = get_hall_sensor_reading(hallsense_fuel);
+            hallsense_ox_flux = get_hall_sensor_reading(hallsense_ox);
+            hall_detector_update(&fuel_hall, hallsense_fuel_flux);
+            hall_detector_update(&ox_hall, hallsense_ox_flux);
+            enum ACTUATOR_STATE driven_inj = get_actuator_state(INJECTOR_PIN);
+            valve_monitor_update(&fuel_inj_monitor, driven_inj, hall_detector_state(&fuel_hall));
+            valve_monitor_update(&ox_inj_monitor, driven_inj, hall_detector_state(&ox_hall));
+
+            if (hall_cal_requested) {
+                hall_cal_requested = false;
+                hall_detector_cal_start(&fuel_hall);
+                hall_detector_cal_start(&ox_hall);
+            }
+            if (fuel_hall.cal_state != HALL_CAL_IDLE || ox_hall.cal_state != HALL_CAL_IDLE) {
+                // learn from whatever open/close cycle the ground commands
+                enum ACTUATOR_STATE commanded = get_actuator_state(INJECTOR_PIN);
+                uint32_t held_ms = millis() - get_actuator_change_millis(INJECTOR_PIN);
+                if (hall_detector_cal_update(&fuel_hall, hallsense_fuel_flux, commanded, held_ms)) {
+                    hall_detector_report(&fuel_hall);
+                }
+                if (hall_detector_cal_update(&ox_hall, hallsense_ox_flux, commanded, held_ms)) {
+                    hall_detector_report(&ox_hall);
+                }
+            }
+
+            if (hall_report_requested) {
+                hall_report_requested = false;
+                hall_detector_report(&fuel_hall);
+                hall_detector_report(&ox_hall);
+            }
         }
 #endif
 
 #if HALLSENSE_FUEL_TIME_DIFF_ms
         if (millis() - last_hallsense_fuel_millis > HALLSENSE_FUEL_TIME_DIFF_ms) {
             last_hallsense_fuel_millis = millis();
-            uint16_t hallsense_fuel_flux = get_hall_sensor_reading(hallsense_fuel);
             can_msg_t sensor_msg;
             build_analog_data_msg(millis(), SENSOR_HALL_FUEL_INJ, hallsense_fuel_flux, &sensor_msg);
             txb_enqueue(&sensor_msg);
@@ -306,7 +574,7 @@ int main(int argc, char **argv) {
             build_actuator_stat_msg(
                 millis(),
                 ACTUATOR_FUEL_INJECTOR,
-                ((hallsense_fuel_flux < HALLSENSE_FUEL_THRESHOLD) ? ACTUATOR_ON : ACTUATOR_OFF),
+                hall_detector_state(&fuel_hall),
                 requested_actuator_state_inj,
                 &stat_msg3);
             txb_enqueue(&stat_msg3);
@@ -316,7 +584,6 @@ int main(int argc, char **argv) {
 #if HALLSENSE_OX_TIME_DIFF_ms
         if (millis() - last_hallsense_ox_millis > HALLSENSE_OX_TIME_DIFF_ms) {
             last_hallsense_ox_millis = millis();
-            uint16_t hallsense_ox_flux = get_hall_sensor_reading(hallsense_ox);
             can_msg_t sensor_msg;
             build_analog_data_msg(millis(), SENSOR_HALL_OX_INJ, hallsense_ox_flux, &sensor_msg);
             txb_enqueue(&sensor_msg);
@@ -325,7 +592,7 @@ int main(int argc, char **argv) {
             build_actuator_stat_msg(
                 millis(),
                 ACTUATOR_OX_INJECTOR,
-                ((hallsense_ox_flux > HALLSENSE_OX_THRESHOLD) ? ACTUATOR_ON : ACTUATOR_OFF),
+                hall_detector_state(&ox_hall),
                 requested_actuator_state_inj,
                 &stat_msg1);
             txb_enqueue(&stat_msg1);
@@ -347,15 +614,87 @@ int main(int argc, char **argv) {
 #if PRES_OX_TIME_DIFF_ms
         if (millis() - last_pres_ox_millis > PRES_OX_TIME_DIFF_ms) {
             last_pres_ox_millis = millis();
-            uint16_t ox_pressure = update_pressure_psi_low_pass(pres_ox, &ox_pres_low_pass);
+            int16_t ox_sample = (int16_t)get_pressure_4_20_psi(pres_ox);
+            enum PRES_LOOP_SAMPLE ox_loop = pres_loop_update(&ox_pres_loop, ox_sample);
+            if (ox_sample < 0) {
+                // under 4 mA but in range, no pressure
+                ox_sample = 0;
+            }
+            if (ox_loop == PRES_LOOP_RECOVERED) {
+                // the filters still hold readings from before the fault
+                ox_pres_low_pass = ox_sample;
+                pres_rate_restart(&ox_pres_rate);
+            }
+            // the filtered pressure holds its last value through invalid samples
+            uint16_t ox_pressure = (uint16_t)ox_pres_low_pass;
+            if (ox_loop != PRES_LOOP_INVALID) {
+                ox_pressure = filter_pressure_psi_low_pass(ox_sample, &ox_pres_low_pass);
+                pres_stats_add(&ox_pres_stats, ox_sample);
+                pres_rate_update(&ox_pres_rate, ox_sample);
+            }
             if ((ox_pres_count & 0xf) == 0) {
                 can_msg_t sensor_msg;
                 build_analog_data_msg(millis(), SENSOR_PRESSURE_OX, ox_pressure, &sensor_msg);
                 txb_enqueue(&sensor_msg);
+                pres_stats_report(&ox_pres_stats, SENSOR_PRESSURE_OX);
+                pres_loop_report(&ox_pres_loop);
+                warm_restart_telemetry_sent();
             }
             ox_pres_count++;
+
+            // the next pressure sample is a period away
+            adc_cal_sample();
+        }
+#endif
+
+#if ADC_CAL_TIME_DIFF_ms
+        if (millis() - last_adc_cal_millis > ADC_CAL_TIME_DIFF_ms) {
+            last_adc_cal_millis = millis();
+
+            // the correction and how far it has moved, then the next cycle
+            adc_cal_report();
+            adc_cal_start();
         }
 #endif
+
+        // repeat active faults
+        fault_heartbeat();
+
+        // report on-board sequence progress
+        sequence_heartbeat();
+
+        // sample the 12 V rail after an output change
+        solenoid_capture_heartbeat();
+
+        // send requested valve agreement histograms
+        valve_monitor_heartbeat();
+
+        // average pressure channels for calibration commands
+        pres_cal_heartbeat();
+
+#if (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_INJ)
+        // time injector transitions after a command
+        valve_timing_heartbeat();
+
+        // look for chamber pressure oscillations while the injector is open, and the
+        // transducer loop is sound
+        instability_heartbeat(get_actuator_state(INJECTOR_PIN) == ACTUATOR_ON &&
+                              pres_loop_ok(&cc_pres_loop));
+#endif
+
+        // answer latency pings
+        prop_ping_heartbeat();
+
+        // send the input recording if it was asked for
+        input_record_heartbeat();
+
+        // finish I2C transactions and run their callbacks
+        i2c_async_heartbeat();
+
+        // write out buffered log records and queued EEPROM bytes
+        event_log_heartbeat();
+        eeprom_heartbeat();
+
         // send any queued CAN messages
         txb_heartbeat();
     }
@@ -363,20 +702,12 @@ int main(int argc, char **argv) {
     return (EXIT_SUCCESS);
 }
 
-static void __interrupt() interrupt_handler() {
-    if (PIR5) {
-        can_handle_interrupt();
-    }
-
-    // Timer0 has overflowed - update millis() function
-    // This happens approximately every 500us
-    if (PIE3bits.TMR0IE == 1 && PIR3bits.TMR0IF == 1) {
-        timer0_handle_interrupt();
-        PIR3bits.TMR0IF = 0;
-    }
-}
-
 static void can_msg_handler(const can_msg_t *msg) {
+    input_record_can(msg);
+    // DLC 9-15 is legal on the wire but still only carries 8 bytes
+    if (msg->data_len > 8) {
+        return;
+    }
     seen_can_message = true;
     uint16_t msg_type = get_message_type(msg);
     int dest_id = -1;
@@ -393,17 +724,31 @@ static void can_msg_handler(const can_msg_t *msg) {
             // see message_types.h for message format
             // vent position will be updated synchronously
 
+            // anything but on or off would leave the valve in whatever state it was and
+            // confuse the safe state and bus-dead checks
+            if (msg->data_len < ACTUATOR_CMD_MIN_LEN) {
+                break;
+            }
+            cmd_type = get_req_actuator_state(msg);
+            if (cmd_type != ACTUATOR_ON && cmd_type != ACTUATOR_OFF) {
+                break;
+            }
+
+            // a manual command for one of our valves takes over from a running sequence
 #if (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_INJ)
             if (get_actuator_id(msg) == ACTUATOR_INJECTOR_VALVE) {
-                requested_actuator_state_inj = get_req_actuator_state(msg);
+                sequence_abort();
+                requested_actuator_state_inj = cmd_type;
                 seen_can_command = true;
             } else if (get_actuator_id(msg) == ACTUATOR_FILL_DUMP_VALVE) {
-                requested_actuator_state_fill = get_req_actuator_state(msg);
+                sequence_abort();
+                requested_actuator_state_fill = cmd_type;
                 seen_can_command = true;
             }
 #elif (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_VENT)
             if (get_actuator_id(msg) == ACTUATOR_VENT_VALVE) {
-                requested_actuator_state_vent = get_req_actuator_state(msg);
+                sequence_abort();
+                requested_actuator_state_vent = cmd_type;
                 seen_can_command = true;
             }
 #endif
@@ -422,10 +767,88 @@ static void can_msg_handler(const can_msg_t *msg) {
             LED_OFF_R();
             break;
 
+        case MSG_DEBUG_MSG:
+            if (!is_prop_cmd(msg)) {
+                break;
+            }
+            switch (get_prop_msg_id(msg)) {
+                case PROP_CMD_SEQ_CLEAR:
+                case PROP_CMD_SEQ_STEP:
+                case PROP_CMD_SEQ_ARM:
+                case PROP_CMD_SEQ_FIRE:
+                case PROP_CMD_SEQ_ABORT:
+                    handle_sequence_cmd(msg);
+                    break;
+                case PROP_CMD_EVENT_LOG_DUMP:
+                    event_log_request_dump();
+                    break;
+                case PROP_CMD_CAN_RECOVERY_REPORT:
+                    can_recovery_request_report();
+                    break;
+                case PROP_CMD_PING:
+                    prop_ping_request(msg);
+                    break;
+                case PROP_CMD_INPUT_RECORD:
+                    if (get_prop_cmd_args_len(msg) >= 1) {
+                        handle_input_record_cmd(get_prop_cmd_args(msg)[0]);
+                    }
+                    break;
+                case PROP_CMD_FAULT_COUNTERS:
+                    fault_request_counters();
+                    break;
+                case PROP_CMD_VALVE_AGREEMENT_DUMP:
+                    valve_monitor_request_report();
+                    break;
+                case PROP_CMD_PRES_CAL_ZERO:
+                    if (get_prop_cmd_args_len(msg) >= 2) {
+                        const uint8_t *args = get_prop_cmd_args(msg);
+                        pres_cal_request_zero(args[0], (int8_t)args[1]);
+                    }
+                    break;
+                case PROP_CMD_PRES_CAL_SPAN:
+                    if (get_prop_cmd_args_len(msg) >= 3) {
+                        const uint8_t *args = get_prop_cmd_args(msg);
+                        int16_t ref_psi = (int16_t)(((uint16_t)args[1] << 8) | args[2]);
+                        pres_cal_request_span(args[0], ref_psi);
+                    }
+                    break;
+                case PROP_CMD_PRES_CAL_RESET:
+                    if (get_prop_cmd_args_len(msg) >= 1) {
+                        pres_cal_request_reset(get_prop_cmd_args(msg)[0]);
+                    }
+                    break;
+                case PROP_CMD_PRES_CAL_REPORT:
+                    pres_cal_request_report();
+                    break;
+                case PROP_CMD_SOLENOID_WINDOW:
+                    if (get_prop_cmd_args_len(msg) >= 1) {
+                        solenoid_capture_set_window(get_prop_cmd_args(msg)[0]);
+                    }
+                    break;
+#if (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_INJ)
+                case PROP_CMD_VALVE_TIMING_DUMP:
+                    valve_timing_request_history();
+                    break;
+                case PROP_CMD_HALL_CAL_START:
+                    hall_cal_requested = true;
+                    break;
+                case PROP_CMD_HALL_CAL_REPORT:
+                    hall_report_requested = true;
+                    break;
+#endif
+                default:
+                    break;
+            }
+            break;
+
         case MSG_RESET_CMD:
+            if (msg->data_len < RESET_CMD_MIN_LEN) {
+                break;
+            }
             dest_id = get_reset_board_id(msg);
             if (dest_id == BOARD_UNIQUE_ID || dest_id == 0) {
-                RESET();
+                // main loop logs the reason before resetting
+                reset_requested = true;
             }
             break;
 
@@ -435,10 +858,134 @@ static void can_msg_handler(const can_msg_t *msg) {
     }
 }
 
-// Send a CAN message with nominal status
-static void send_status_ok(void) {
-    can_msg_t board_stat_msg;
-    build_board_stat_msg(millis(), E_NOMINAL, NULL, 0, &board_stat_msg);
+// Runs in the ISR for each sequence step. Updating the requested state keeps the main loop
+// from undoing the step on its next pass.
+static void sequence_step(uint8_t pin, enum ACTUATOR_STATE state) {
+#if (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_INJ)
+    if (pin == INJECTOR_PIN) {
+        requested_actuator_state_inj = state;
+        if (actuator_set(state, INJECTOR_PIN)) {
+            valve_timing_start(state);
+        }
+    } else if (pin == FILL_DUMP_PIN) {
+        requested_actuator_state_fill = state;
+        actuator_set(state, FILL_DUMP_PIN);
+    }
+#elif (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_VENT)
+    if (pin == VENT_VALVE_PIN) {
+        requested_actuator_state_vent = state;
+        actuator_set(state, VENT_VALVE_PIN);
+    }
+#endif
+}
 
-    txb_enqueue(&board_stat_msg);
+static void handle_sequence_cmd(const can_msg_t *msg) {
+    const uint8_t *args = get_prop_cmd_args(msg);
+    uint8_t args_len = get_prop_cmd_args_len(msg);
+
+    seen_can_command = true;
+
+    switch (get_prop_msg_id(msg)) {
+        case PROP_CMD_SEQ_CLEAR:
+            sequence_clear();
+            break;
+
+        case PROP_CMD_SEQ_STEP:
+            if (args_len >= 5) {
+                sequence_load_step(args[0],
+                                   ((uint16_t)args[1] << 8) | args[2],
+                                   args[3],
+                                   (enum ACTUATOR_STATE)args[4]);
+            }
+            break;
+
+        case PROP_CMD_SEQ_ARM:
+            if (args_len >= 2) {
+                sequence_arm(args[0], args[1]);
+            }
+            break;
+
+        case PROP_CMD_SEQ_FIRE:
+            // same conditions as the safe state override in the main loop
+            if (SAFE_STATE_ENABLED && is_batt_voltage_critical()) {
+                sequence_abort();
+            } else {
+                sequence_fire();
+            }
+            break;
+
+        case PROP_CMD_SEQ_ABORT:
+            sequence_abort();
+            break;
+
+        default:
+            break;
+    }
+}
+
+// Record why we're resetting. Blocks for the EEPROM writes, which is fine since we're
+// about to reset anyway.
+static void log_and_reset(enum RESET_REASON reason) {
+    event_log_append(EVENT_RESET_REQUEST, reason);
+    event_log_flush();
+
+    warm_state_t state = {0};
+#if (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_INJ)
+    state.pres_low_pass[0] = fuel_pres_low_pass;
+    state.pres_low_pass[1] = cc_pres_low_pass;
+#elif (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_VENT)
+    state.pres_low_pass[0] = ox_pres_low_pass;
+#endif
+    state.requested_actuators = get_requested_actuator_bits();
+    for (uint8_t i = 0; i < NUM_FAULTS; i++) {
+        get_fault_counter(i, &state.fault_counters[i]);
+    }
+    state.can_resets = can_recovery_get_resets() + (reason == RESET_BUS_DEAD);
+    warm_restart_save(&state);
+
+    hal_reset();
+}
+
+// The decimation counters are left at zero so the filtered pressures go out on the first
+// sample after the restart
+static void restore_warm_state(const warm_state_t *state) {
+#if (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_INJ)
+    fuel_pres_low_pass = state->pres_low_pass[0];
+    cc_pres_low_pass = state->pres_low_pass[1];
+    requested_actuator_state_inj = (state->requested_actuators & 0x1) ? ACTUATOR_ON : ACTUATOR_OFF;
+    requested_actuator_state_fill = (state->requested_actuators & 0x2) ? ACTUATOR_ON : ACTUATOR_OFF;
+#elif (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_VENT)
+    ox_pres_low_pass = state->pres_low_pass[0];
+    requested_actuator_state_vent = (state->requested_actuators & 0x1) ? ACTUATOR_ON : ACTUATOR_OFF;
+#endif
+    for (uint8_t i = 0; i < NUM_FAULTS; i++) {
+        set_fault_counter(i, &state->fault_counters[i]);
+    }
+}
+
+// One bit per valve, set if it's requested on
+static uint8_t get_requested_actuator_bits(void) {
+#if (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_INJ)
+    return (requested_actuator_state_inj == ACTUATOR_ON ? 0x1 : 0) |
+           (requested_actuator_state_fill == ACTUATOR_ON ? 0x2 : 0);
+#elif (BOARD_UNIQUE_ID == BOARD_ID_PROPULSION_VENT)
+    return requested_actuator_state_vent == ACTUATOR_ON ? 0x1 : 0;
+#endif
+}
+
+static void handle_input_record_cmd(uint8_t action) {
+    switch (action) {
+        case INPUT_RECORD_STOP:
+            input_record_stop();
+            break;
+        case INPUT_RECORD_START:
+            // loop period and run length aren't known on the board
+            input_record_start(0, 0);
+            break;
+        case INPUT_RECORD_DUMP:
+            input_record_request_dump();
+            break;
+        default:
+            break;
+    }
 }
@@ -0,0 +1,319 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "canlib/canlib.h"
+
+#include "eeprom.h"
+#include "pres_cal.h"
+#include "prop_msg.h"
+#include "sensor_general.h"
+
+#define PRES_CAL_MAGIC 0xa5
+#define PRES_CAL_RECORD_LEN 7
+#define PRES_CAL_SLOT_LEN 8
+
+// largest pressure difference a span command can use, keeps the slope math in 32 bits
+#define MAX_SPAN_PSI 2047
+
+enum PRES_CAL_ACTION { ACTION_NONE = 0, ACTION_ZERO, ACTION_SPAN, ACTION_RESET };
+
+typedef struct {
+    enum SENSOR_ID sensor;
+    hal_adc_channel_t channel;
+    uint16_t eeprom_addr;
+
+    uint16_t zero_raw_x16;
+    int8_t zero_psi;
+    uint16_t scale_q16;
+    enum PRES_CAL_SOURCE source;
+    enum PRES_CAL_RESULT result;
+
+    // averaging
+    uint32_t sum;
+    uint16_t min;
+    uint16_t max;
+} pres_cal_t;
+
+static pres_cal_t channels[PRES_CAL_MAX_CHANNELS];
+static uint8_t num_channels = 0;
+
+// from the ISR
+static volatile enum PRES_CAL_ACTION pending_action = ACTION_NONE;
+static volatile uint8_t pending_sensor;
+static volatile int16_t pending_psi;
+
+static enum PRES_CAL_ACTION action = ACTION_NONE;
+static uint8_t action_mask; // channels being averaged
+static int16_t action_psi;
+static uint8_t sample_count;
+static uint32_t last_sample_millis;
+
+static volatile bool report_requested = false;
+static bool report_sending = false;
+static uint8_t report_idx = 0;
+
+static uint8_t record_checksum(const uint8_t *record) {
+    uint8_t sum = 0;
+    for (uint8_t i = 0; i < PRES_CAL_RECORD_LEN - 1; i++) {
+        sum += record[i];
+    }
+    return ~sum;
+}
+
+static bool load(pres_cal_t *cal) {
+    uint8_t record[PRES_CAL_RECORD_LEN];
+    eeprom_read(cal->eeprom_addr, record, PRES_CAL_RECORD_LEN);
+
+    if (record[0] != PRES_CAL_MAGIC ||
+        record[PRES_CAL_RECORD_LEN - 1] != record_checksum(record)) {
+        return false;
+    }
+
+    cal->zero_raw_x16 = ((uint16_t)record[1] << 8) | record[2];
+    cal->zero_psi = (int8_t)record[3];
+    cal->scale_q16 = ((uint16_t)record[4] << 8) | record[5];
+    return true;
+}
+
+static bool save(const pres_cal_t *cal) {
+    uint8_t record[PRES_CAL_RECORD_LEN];
+    record[0] = PRES_CAL_MAGIC;
+    record[1] = (cal->zero_raw_x16 >> 8) & 0xff;
+    record[2] = (cal->zero_raw_x16 >> 0) & 0xff;
+    record[3] = (uint8_t)cal->zero_psi;
+    record[4] = (cal->scale_q16 >> 8) & 0xff;
+    record[5] = (cal->scale_q16 >> 0) & 0xff;
+    record[6] = record_checksum(record);
+    return eeprom_write(cal->eeprom_addr, record, PRES_CAL_RECORD_LEN);
+}
+
+static void set_nominal(pres_cal_t *cal) {
+    cal->zero_raw_x16 = PRES_4_20_NOMINAL_ZERO_RAW_x16;
+    cal->zero_psi = 0;
+    cal->scale_q16 = PRES_4_20_NOMINAL_SCALE_Q16;
+}
+
+static void apply(const pres_cal_t *cal) {
+    set_pressure_4_20_cal(cal->channel, cal->zero_raw_x16, cal->zero_psi, cal->scale_q16);
+}
+
+void pres_cal_add(enum SENSOR_ID sensor, hal_adc_channel_t adc_channel, uint8_t index) {
+    if (num_channels >= PRES_CAL_MAX_CHANNELS) {
+        return;
+    }
+    pres_cal_t *cal = &channels[num_channels++];
+    cal->sensor = sensor;
+    cal->channel = adc_channel;
+    cal->eeprom_addr = EEPROM_PRES_CAL_ADDR + index * PRES_CAL_SLOT_LEN;
+    cal->result = PRES_CAL_OK;
+
+    if (load(cal)) {
+        cal->source = PRES_CAL_EEPROM;
+    } else {
+        set_nominal(cal);
+        cal->source = PRES_CAL_DEFAULT;
+    }
+    apply(cal);
+}
+
+static void request(enum PRES_CAL_ACTION new_action, uint8_t sensor, int16_t psi) {
+    // picked up by the next heartbeat
+    bool gie = hal_irq_disable();
+    pending_sensor = sensor;
+    pending_psi = psi;
+    pending_action = new_action;
+    hal_irq_restore(gie);
+}
+
+void pres_cal_request_zero(uint8_t sensor, int8_t zero_psi) {
+    request(ACTION_ZERO, sensor, zero_psi);
+}
+
+void pres_cal_request_span(uint8_t sensor, int16_t ref_psi) {
+    // the slope needs one channel at one reference
+    if (sensor != PRES_CAL_ALL_SENSORS) {
+        request(ACTION_SPAN, sensor, ref_psi);
+    }
+}
+
+void pres_cal_request_reset(uint8_t sensor) {
+    request(ACTION_RESET, sensor, 0);
+}
+
+void pres_cal_request_report(void) {
+    report_requested = true;
+}
+
+static uint8_t sensor_mask(uint8_t sensor) {
+    uint8_t mask = 0;
+    for (uint8_t i = 0; i < num_channels; i++) {
+        if (sensor == PRES_CAL_ALL_SENSORS || sensor == channels[i].sensor) {
+            mask |= 1 << i;
+        }
+    }
+    return mask;
+}
+
+static void reset(uint8_t mask) {
+    for (uint8_t i = 0; i < num_channels; i++) {
+        if (!(mask & (1 << i))) {
+            continue;
+        }
+        pres_cal_t *cal = &channels[i];
+        set_nominal(cal);
+        apply(cal);
+        cal->source = PRES_CAL_DEFAULT;
+        // a bad magic byte is enough to fall back to nominal at the next boot
+        uint8_t erased = 0xff;
+        bool saved = eeprom_write(cal->eeprom_addr, &erased, 1);
+        cal->result = saved ? PRES_CAL_OK : PRES_CAL_NOT_SAVED;
+    }
+}
+
+static void start(void) {
+    bool gie = hal_irq_disable();
+    action = pending_action;
+    uint8_t sensor = pending_sensor;
+    action_psi = pending_psi;
+    pending_action = ACTION_NONE;
+    hal_irq_restore(gie);
+
+    action_mask = sensor_mask(sensor);
+    if (action_mask == 0) {
+        // not one of ours
+        action = ACTION_NONE;
+        return;
+    }
+    if (action == ACTION_RESET) {
+        reset(action_mask);
+        action = ACTION_NONE;
+        pres_cal_request_report();
+        return;
+    }
+
+    for (uint8_t i = 0; i < num_channels; i++) {
+        channels[i].sum = 0;
+        channels[i].min = UINT16_MAX;
+        channels[i].max = 0;
+    }
+    sample_count = 0;
+    last_sample_millis = millis() - PRES_CAL_SAMPLE_ms;
+}
+
+static void sample(void) {
+    for (uint8_t i = 0; i < num_channels; i++) {
+        if (!(action_mask & (1 << i))) {
+            continue;
+        }
+        pres_cal_t *cal = &channels[i];
+        uint16_t raw = hal_adc_read(cal->channel);
+        cal->sum += raw;
+        if (raw < cal->min) {
+            cal->min = raw;
+        }
+        if (raw > cal->max) {
+            cal->max = raw;
+        }
+    }
+    sample_count++;
+}
+
+// New slope through the zero point and the span point, 0 if it isn't plausible
+static uint16_t span_scale(const pres_cal_t *cal, uint16_t avg_x16, int16_t ref_psi) {
+    int32_t delta_psi = (int32_t)ref_psi - cal->zero_psi;
+    int32_t delta_x16 = (int32_t)avg_x16 - cal->zero_raw_x16;
+    if (delta_psi <= 0 || delta_psi > MAX_SPAN_PSI || delta_x16 < PRES_CAL_MIN_SPAN * 16) {
+        return 0;
+    }
+    uint32_t scale = ((uint32_t)delta_psi << 20) / (uint32_t)delta_x16;
+    if (scale < PRES_4_20_NOMINAL_SCALE_Q16 / 2 || scale > UINT16_MAX) {
+        return 0;
+    }
+    return (uint16_t)scale;
+}
+
+static void finish(void) {
+    for (uint8_t i = 0; i < num_channels; i++) {
+        if (!(action_mask & (1 << i))) {
+            continue;
+        }
+        pres_cal_t *cal = &channels[i];
+        if (cal->max - cal->min > PRES_CAL_MAX_SPREAD) {
+            cal->result = PRES_CAL_NOISY;
+            continue;
+        }
+        // in corrected counts, so the calibration outlasts the ADC drifting
+        uint16_t avg_x16 = adc_correct_x16((uint16_t)(cal->sum * 16 / PRES_CAL_SAMPLES));
+
+        if (action == ACTION_ZERO) {
+            cal->zero_raw_x16 = avg_x16;
+            cal->zero_psi = (int8_t)action_psi;
+        } else {
+            uint16_t scale = span_scale(cal, avg_x16, action_psi);
+            if (scale == 0) {
+                cal->result = PRES_CAL_OUT_OF_RANGE;
+                continue;
+            }
+            cal->scale_q16 = scale;
+        }
+
+        apply(cal);
+        cal->source = PRES_CAL_LEARNED;
+        cal->result = save(cal) ? PRES_CAL_OK : PRES_CAL_NOT_SAVED;
+    }
+    action = ACTION_NONE;
+    pres_cal_request_report();
+}
+
+// One frame per call so a report doesn't fill the tx buffer
+static void send_report(void) {
+    if (report_requested) {
+        report_requested = false;
+        report_sending = true;
+        report_idx = 0;
+    }
+    if (!report_sending) {
+        return;
+    }
+    if (report_idx >= num_channels) {
+        report_sending = false;
+        return;
+    }
+
+    const pres_cal_t *cal = &channels[report_idx];
+    uint8_t payload[7];
+    payload[0] = cal->sensor;
+    payload[1] = (cal->zero_raw_x16 >> 8) & 0xff;
+    payload[2] = (cal->zero_raw_x16 >> 0) & 0xff;
+    payload[3] = (uint8_t)cal->zero_psi;
+    payload[4] = (cal->scale_q16 >> 8) & 0xff;
+    payload[5] = (cal->scale_q16 >> 0) & 0xff;
+    payload[6] = (cal->result << 4) | cal->source;
+
+    can_msg_t msg;
+    build_prop_msg(PROP_MSG_PRES_CAL, payload, sizeof(payload), &msg);
+    if (txb_enqueue(&msg)) {
+        report_idx++;
+    }
+}
+
+void pres_cal_heartbeat(void) {
+    send_report();
+
+    if (pending_action != ACTION_NONE) {
+        // a new command replaces one that's still averaging
+        start();
+    }
+    if (action == ACTION_NONE) {
+        return;
+    }
+
+    if (millis() - last_sample_millis < PRES_CAL_SAMPLE_ms) {
+        return;
+    }
+    last_sample_millis = millis();
+    sample();
+    if (sample_count >= PRES_CAL_SAMPLES) {
+        finish();
+    }
+}
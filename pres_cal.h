@@ -0,0 +1,66 @@
+#ifndef PRES_CAL_H
+#define PRES_CAL_H
+
+#include "canlib/message_types.h"
+#include "hal.h"
+#include "sensor_general.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Calibration of the 4-20 mA pressure channels. Each channel's conversion is a line
+// through a zero point (the ADC code that reads a known pressure, usually 0 psi vented
+// to atmosphere) with a slope in psi per count. The zero comes from averaging the channel
+// on an auto-zero command, the slope from averaging it at a reference pressure on a span
+// command. Both are kept in EEPROM and loaded at boot, channels without a record use the
+// nominal conversion from sensor_general.h. Zero points are in ADC codes after the
+// self-calibration's correction (adc_cal.h).
+
+// each channel here needs a slot for its coefficients in sensor_general.c
+#define PRES_CAL_MAX_CHANNELS PRES_4_20_MAX_CAL_CHANNELS
+
+// averaging, one sample of each channel per PRES_CAL_SAMPLE_ms
+#define PRES_CAL_SAMPLES 64
+#define PRES_CAL_SAMPLE_ms 4
+
+// reject an average if the channel moved more than this while it was taken
+#define PRES_CAL_MAX_SPREAD 24 // counts, about 18 psi
+
+// a span point has to be at least this far from the zero point
+#define PRES_CAL_MIN_SPAN 200 // counts
+
+// addresses every channel in the zero, reset and report commands
+#define PRES_CAL_ALL_SENSORS 0xff
+
+enum PRES_CAL_SOURCE { PRES_CAL_DEFAULT = 0, PRES_CAL_EEPROM, PRES_CAL_LEARNED };
+
+// outcome of the last command, sent with the calibration
+enum PRES_CAL_RESULT {
+    PRES_CAL_OK = 0,
+    PRES_CAL_NOISY, // the channel wasn't steady
+    PRES_CAL_OUT_OF_RANGE, // span point too close to the zero, or a slope far from nominal
+    PRES_CAL_NOT_SAVED // EEPROM write queue full, the calibration lasts until reset
+};
+
+// Load the calibration for sensor on adc_channel from EEPROM slot `index`
+void pres_cal_add(enum SENSOR_ID sensor, hal_adc_channel_t adc_channel, uint8_t index);
+
+// The command handlers below are safe to call from the ISR. A new command replaces one
+// that's still averaging.
+
+// Take the average of sensor (or PRES_CAL_ALL_SENSORS) as reading zero_psi
+void pres_cal_request_zero(uint8_t sensor, int8_t zero_psi);
+
+// Take the average of sensor as reading ref_psi, for the slope through its zero point
+void pres_cal_request_span(uint8_t sensor, int16_t ref_psi);
+
+// Back to the nominal conversion, and erase the stored calibration
+void pres_cal_request_reset(uint8_t sensor);
+
+// Send every channel's calibration as PROP_MSG_PRES_CAL, a frame per main loop pass
+void pres_cal_request_report(void);
+
+// Call from the main loop
+void pres_cal_heartbeat(void);
+
+#endif /* PRES_CAL_H */
@@ -0,0 +1,105 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "canlib/canlib.h"
+
+#include "error_checks.h"
+#include "pres_loop.h"
+#include "prop_msg.h"
+
+// channels with FAULT_PRES_LOOP active, by sensor id
+static uint16_t faulted_sensors = 0;
+
+void pres_loop_init(pres_loop_t *loop, enum SENSOR_ID sensor) {
+    loop->sensor = sensor;
+    loop->state = PRES_LOOP_OK;
+    loop->bad = 0;
+    loop->good = 0;
+    loop->invalid = 0;
+    loop->last_psi = 0;
+}
+
+static void trip(pres_loop_t *loop, enum PRES_LOOP_STATE state) {
+    loop->state = state;
+    loop->good = 0;
+
+    uint8_t fault_data[4];
+    fault_data[0] = loop->sensor;
+    fault_data[1] = state;
+    fault_data[2] = ((uint16_t)loop->last_psi >> 8) & 0xff;
+    fault_data[3] = ((uint16_t)loop->last_psi >> 0) & 0xff;
+
+    faulted_sensors |= (uint16_t)1 << loop->sensor;
+    fault_raise(FAULT_PRES_LOOP, fault_data, 4);
+}
+
+static void untrip(pres_loop_t *loop) {
+    loop->state = PRES_LOOP_OK;
+    faulted_sensors &= ~((uint16_t)1 << loop->sensor);
+    if (faulted_sensors == 0) {
+        fault_clear(FAULT_PRES_LOOP);
+    }
+}
+
+enum PRES_LOOP_SAMPLE pres_loop_update(pres_loop_t *loop, int16_t sample_psi) {
+    loop->last_psi = sample_psi;
+
+    enum PRES_LOOP_STATE reading = PRES_LOOP_OK;
+    if (sample_psi < PRES_LOOP_UNDER_RANGE_psi) {
+        reading = PRES_LOOP_UNDER_RANGE;
+    } else if (sample_psi > PRES_LOOP_OVER_RANGE_psi) {
+        reading = PRES_LOOP_OVER_RANGE;
+    }
+
+    if (reading != PRES_LOOP_OK) {
+        if (loop->invalid < UINT8_MAX) {
+            loop->invalid++;
+        }
+        loop->good = 0;
+        if (loop->bad < PRES_LOOP_TRIP_COUNT) {
+            loop->bad++;
+        }
+        // a loop that goes from open to shorted is raised again with the new state
+        if (loop->bad >= PRES_LOOP_TRIP_COUNT && loop->state != reading) {
+            trip(loop, reading);
+        }
+        return PRES_LOOP_INVALID;
+    }
+
+    loop->bad = 0;
+    if (loop->state == PRES_LOOP_OK) {
+        return PRES_LOOP_VALID;
+    }
+
+    if (loop->invalid < UINT8_MAX) {
+        loop->invalid++;
+    }
+    if (++loop->good < PRES_LOOP_CLEAR_COUNT) {
+        return PRES_LOOP_INVALID;
+    }
+    untrip(loop);
+    return PRES_LOOP_RECOVERED;
+}
+
+bool pres_loop_ok(const pres_loop_t *loop) {
+    return loop->state == PRES_LOOP_OK;
+}
+
+void pres_loop_report(pres_loop_t *loop) {
+    if (loop->state == PRES_LOOP_OK && loop->invalid == 0) {
+        return;
+    }
+
+    uint8_t payload[5];
+    payload[0] = loop->sensor;
+    payload[1] = loop->state;
+    payload[2] = loop->invalid;
+    payload[3] = ((uint16_t)loop->last_psi >> 8) & 0xff;
+    payload[4] = ((uint16_t)loop->last_psi >> 0) & 0xff;
+
+    can_msg_t msg;
+    build_prop_msg(PROP_MSG_PRES_LOOP, payload, sizeof(payload), &msg);
+    txb_enqueue(&msg);
+
+    loop->invalid = 0;
+}
@@ -0,0 +1,56 @@
+#ifndef PRES_LOOP_H
+#define PRES_LOOP_H
+
+#include "canlib/message_types.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Health of a 4-20 mA pressure loop, NAMUR NE 43 style. A reading under 3.6 mA means an
+// open or shorted loop or a failed transmitter, over 21 mA a shorted transmitter, and
+// neither is a pressure. PRES_LOOP_TRIP_COUNT such samples in a row put the channel in
+// fault and raise FAULT_PRES_LOOP. It takes PRES_LOOP_CLEAR_COUNT good samples in a row
+// to come back, so a loose wire that makes contact now and then stays in fault.
+//
+// Out of range samples and every sample taken while in fault are invalid and must be
+// kept out of the filters. A valid sample can still be below 0 psi, between 3.6 and 4 mA
+// or from a small zero offset, and goes to the filters as 0. The bands are in psi through
+// the channel's calibration.
+
+// (mA x10 - 40) / 160 mA * 1450 psi
+#define PRES_LOOP_mA_x10_TO_PSI(ma_x10) ((((int32_t)(ma_x10)) - 40) * 1450 / 160)
+#define PRES_LOOP_UNDER_RANGE_psi PRES_LOOP_mA_x10_TO_PSI(36) // 3.6 mA, -36 psi
+#define PRES_LOOP_OVER_RANGE_psi PRES_LOOP_mA_x10_TO_PSI(210) // 21 mA, 1540 psi
+
+#define PRES_LOOP_TRIP_COUNT 4
+#define PRES_LOOP_CLEAR_COUNT 32
+
+enum PRES_LOOP_STATE { PRES_LOOP_OK = 0, PRES_LOOP_UNDER_RANGE, PRES_LOOP_OVER_RANGE };
+
+enum PRES_LOOP_SAMPLE {
+    PRES_LOOP_VALID = 0,
+    PRES_LOOP_INVALID,
+    PRES_LOOP_RECOVERED // valid, the first since a fault: restart the filters from it
+};
+
+typedef struct {
+    enum SENSOR_ID sensor;
+    enum PRES_LOOP_STATE state; // debounced
+    uint8_t bad; // out of range samples in a row
+    uint8_t good; // in range samples in a row while in fault
+    uint8_t invalid; // invalid samples since the last report
+    int16_t last_psi;
+} pres_loop_t;
+
+void pres_loop_init(pres_loop_t *loop, enum SENSOR_ID sensor);
+
+// Check a new sample, returns whether it can be used
+enum PRES_LOOP_SAMPLE pres_loop_update(pres_loop_t *loop, int16_t sample_psi);
+
+bool pres_loop_ok(const pres_loop_t *loop);
+
+// Send PROP_MSG_PRES_LOOP if the loop is in fault or there were invalid samples since the
+// last report, to go with the channel's telemetry
+void pres_loop_report(pres_loop_t *loop);
+
+#endif /* PRES_LOOP_H */
@@ -0,0 +1,127 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "error_checks.h"
+#include "pres_rate.h"
+
+// Slot i of the window (oldest first) is weighted by 2i - (N - 1), its distance from the
+// middle in half samples. The slope is sum(w * p) / (sum(w^2) / 2) psi per sample.
+#define PRES_RATE_WEIGHT_SQ_SUM 1360 // sum of (2i - 15)^2 for i = 0..15
+
+// channels with FAULT_PRES_RATE active, by sensor id
+static uint16_t tripped_sensors = 0;
+
+void pres_rate_init(pres_rate_t *est,
+                    enum SENSOR_ID sensor,
+                    uint8_t sample_ms,
+                    int16_t rise_limit,
+                    int16_t drop_limit) {
+    est->sensor = sensor;
+    est->sample_ms = sample_ms;
+    est->rise_limit = rise_limit;
+    est->drop_limit = drop_limit;
+    est->head = 0;
+    est->count = 0;
+    est->rate = 0;
+    est->hold = 0;
+    est->trip = 0;
+    est->calm = 0;
+    est->tripped = false;
+}
+
+void pres_rate_restart(pres_rate_t *est) {
+    // an active fault clears the usual way once the new window is calm
+    est->head = 0;
+    est->count = 0;
+    est->rate = 0;
+    est->trip = 0;
+}
+
+void pres_rate_hold(pres_rate_t *est, uint16_t hold_ms) {
+    uint16_t samples = (hold_ms + est->sample_ms - 1) / est->sample_ms;
+    if (samples > UINT8_MAX) {
+        samples = UINT8_MAX;
+    }
+    if (samples > est->hold) {
+        est->hold = (uint8_t)samples;
+    }
+}
+
+static int16_t estimate(const pres_rate_t *est) {
+    int32_t sum = 0;
+    int8_t weight = 1 - PRES_RATE_WINDOW;
+    uint8_t i = est->head;
+    for (uint8_t n = 0; n < PRES_RATE_WINDOW; n++) {
+        sum += (int32_t)weight * est->window[i];
+        weight += 2;
+        i = (i + 1) % PRES_RATE_WINDOW;
+    }
+    // psi/s = sum * 2 / 1360 * 1000 / sample_ms, 2000 / 1360 = 25 / 17
+    int32_t rate = sum * 25 / (17 * (int32_t)est->sample_ms);
+    if (rate > INT16_MAX) {
+        rate = INT16_MAX;
+    } else if (rate < -INT16_MAX) {
+        rate = -INT16_MAX;
+    }
+    return (int16_t)rate;
+}
+
+static void trip(pres_rate_t *est, enum PRES_RATE_DIR dir) {
+    uint8_t fault_data[4];
+    fault_data[0] = est->sensor;
+    fault_data[1] = dir;
+    fault_data[2] = ((uint16_t)est->rate >> 8) & 0xff;
+    fault_data[3] = ((uint16_t)est->rate >> 0) & 0xff;
+
+    est->tripped = true;
+    tripped_sensors |= (uint16_t)1 << est->sensor;
+    fault_raise(FAULT_PRES_RATE, fault_data, 4);
+}
+
+int16_t pres_rate_update(pres_rate_t *est, int16_t sample_psi) {
+    if (est->count < PRES_RATE_WINDOW) {
+        est->window[est->count++] = sample_psi;
+        if (est->count < PRES_RATE_WINDOW) {
+            return 0;
+        }
+    } else {
+        est->window[est->head] = sample_psi;
+        est->head = (est->head + 1) % PRES_RATE_WINDOW;
+    }
+    est->rate = estimate(est);
+
+    if (est->hold) {
+        est->hold--;
+        est->trip = 0;
+        return est->rate;
+    }
+
+    bool rising = est->rise_limit && est->rate > est->rise_limit;
+    bool dropping = est->drop_limit && est->rate < -est->drop_limit;
+    if (rising || dropping) {
+        est->calm = 0;
+        if (est->trip < PRES_RATE_TRIP_COUNT) {
+            est->trip++;
+        }
+        if (est->trip >= PRES_RATE_TRIP_COUNT && !est->tripped) {
+            trip(est, rising ? PRES_RATE_RISE : PRES_RATE_DROP);
+        }
+        return est->rate;
+    }
+
+    est->trip = 0;
+    if (!est->tripped) {
+        return est->rate;
+    }
+    bool calm_rise = !est->rise_limit || est->rate < est->rise_limit / 2;
+    bool calm_drop = !est->drop_limit || est->rate > -est->drop_limit / 2;
+    est->calm = calm_rise && calm_drop ? est->calm + 1 : 0;
+    if (est->calm >= PRES_RATE_CLEAR_COUNT) {
+        est->tripped = false;
+        tripped_sensors &= ~((uint16_t)1 << est->sensor);
+        if (tripped_sensors == 0) {
+            fault_clear(FAULT_PRES_RATE);
+        }
+    }
+    return est->rate;
+}
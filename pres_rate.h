@@ -0,0 +1,61 @@
+#ifndef PRES_RATE_H
+#define PRES_RATE_H
+
+#include "canlib/message_types.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Rate of change of a pressure channel, from a least squares line through its last
+// PRES_RATE_WINDOW unfiltered samples. Runs on every sample at a fixed cost of one
+// multiply-accumulate per window slot. A rate past a channel's rise or drop limit on
+// PRES_RATE_TRIP_COUNT estimates in a row raises FAULT_PRES_RATE right away, instead of
+// waiting for the ground to see it through the low-pass filter.
+
+// 16 samples at 17 ms: about 10 psi/s of noise for 3 psi of sample noise, and the
+// estimate lags the pressure by half a window
+#define PRES_RATE_WINDOW 16
+
+#define PRES_RATE_TRIP_COUNT 2
+
+// the fault clears after a full window back under half the limit
+#define PRES_RATE_CLEAR_COUNT PRES_RATE_WINDOW
+
+// direction, sent with FAULT_PRES_RATE
+enum PRES_RATE_DIR { PRES_RATE_RISE = 0, PRES_RATE_DROP };
+
+typedef struct {
+    enum SENSOR_ID sensor;
+    uint8_t sample_ms;
+    int16_t rise_limit; // psi/s, 0 to disable
+    int16_t drop_limit; // psi/s as a positive number, 0 to disable
+
+    int16_t window[PRES_RATE_WINDOW];
+    uint8_t head; // oldest sample
+    uint8_t count;
+
+    int16_t rate; // psi/s, last estimate
+    uint8_t hold; // samples left with the limits off
+    uint8_t trip;
+    uint8_t calm;
+    bool tripped;
+} pres_rate_t;
+
+void pres_rate_init(pres_rate_t *est,
+                    enum SENSOR_ID sensor,
+                    uint8_t sample_ms,
+                    int16_t rise_limit,
+                    int16_t drop_limit);
+
+// Feed a new sample, taken sample_ms after the previous one. Returns the rate in psi/s,
+// 0 until the window has filled.
+int16_t pres_rate_update(pres_rate_t *est, int16_t sample_psi);
+
+// Start filling the window again, after a gap in the samples
+void pres_rate_restart(pres_rate_t *est);
+
+// Leave the limits alone for the next hold_ms, through a transient that's expected, like
+// a valve moving. The rate is still estimated. A shorter hold than the one left is ignored.
+void pres_rate_hold(pres_rate_t *est, uint16_t hold_ms);
+
+#endif /* PRES_RATE_H */
@@ -0,0 +1,87 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "canlib/canlib.h"
+
+#include "pres_stats.h"
+#include "prop_msg.h"
+
+void pres_stats_add(pres_stats_t *stats, int16_t sample_psi) {
+    if (stats->count == UINT8_MAX) {
+        return;
+    }
+    if (stats->count == 0) {
+        stats->first = sample_psi;
+        stats->min = sample_psi;
+        stats->max = sample_psi;
+    } else if (sample_psi < stats->min) {
+        stats->min = sample_psi;
+    } else if (sample_psi > stats->max) {
+        stats->max = sample_psi;
+    }
+
+    int32_t dev = (int32_t)sample_psi - stats->first;
+    if (dev > PRES_STATS_MAX_DEV) {
+        dev = PRES_STATS_MAX_DEV;
+    } else if (dev < -PRES_STATS_MAX_DEV) {
+        dev = -PRES_STATS_MAX_DEV;
+    }
+    stats->sum += dev;
+    stats->sum_sq += (uint32_t)(dev * dev);
+    stats->count++;
+}
+
+static uint16_t isqrt(uint32_t x) {
+    uint32_t root = 0;
+    uint32_t bit = 1UL << 30;
+    while (bit > x) {
+        bit >>= 2;
+    }
+    while (bit) {
+        if (x >= root + bit) {
+            x -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint16_t)root;
+}
+
+static uint8_t saturate(int32_t value) {
+    if (value < 0) {
+        return 0;
+    }
+    return value > PRES_STATS_SATURATED ? PRES_STATS_SATURATED : (uint8_t)value;
+}
+
+void pres_stats_report(pres_stats_t *stats, enum SENSOR_ID sensor) {
+    if (stats->count == 0) {
+        return;
+    }
+
+    // E[dev^2] - E[dev]^2, each term is under 2^24
+    int32_t mean_dev = stats->sum / stats->count;
+    uint32_t mean_sq = stats->sum_sq / stats->count;
+    uint32_t var = (uint32_t)(mean_dev * mean_dev);
+    var = mean_sq > var ? mean_sq - var : 0;
+    int32_t mean = stats->first + mean_dev;
+
+    uint8_t payload[7];
+    payload[0] = sensor;
+    payload[1] = ((uint16_t)stats->min >> 8) & 0xff;
+    payload[2] = ((uint16_t)stats->min >> 0) & 0xff;
+    payload[3] = ((uint16_t)stats->max >> 8) & 0xff;
+    payload[4] = ((uint16_t)stats->max >> 0) & 0xff;
+    payload[5] = saturate(mean - stats->min);
+    payload[6] = saturate(isqrt(var));
+
+    can_msg_t msg;
+    build_prop_msg(PROP_MSG_PRES_STATS, payload, sizeof(payload), &msg);
+    txb_enqueue(&msg);
+
+    stats->count = 0;
+    stats->sum = 0;
+    stats->sum_sq = 0;
+}
@@ -0,0 +1,34 @@
+#ifndef PRES_STATS_H
+#define PRES_STATS_H
+
+#include "canlib/message_types.h"
+
+#include <stdint.h>
+
+// Min, max, mean and standard deviation of a pressure channel's unfiltered samples over
+// one reporting window, so a spike between two filtered reports still shows up. Integer
+// arithmetic only. Samples are accumulated relative to the first one of the window,
+// clamped to +/- PRES_STATS_MAX_DEV psi, so the sum of squares fits in 32 bits for up to
+// 255 samples.
+
+#define PRES_STATS_MAX_DEV 4095
+
+// mean - min and stddev above this are sent as this
+#define PRES_STATS_SATURATED 0xff
+
+typedef struct {
+    uint8_t count;
+    int16_t first;
+    int16_t min;
+    int16_t max;
+    int32_t sum; // of sample - first
+    uint32_t sum_sq;
+} pres_stats_t;
+
+void pres_stats_add(pres_stats_t *stats, int16_t sample_psi);
+
+// Send the window as PROP_MSG_PRES_STATS and start a new one. Nothing is sent for an
+// empty window.
+void pres_stats_report(pres_stats_t *stats, enum SENSOR_ID sensor);
+
+#endif /* PRES_STATS_H */
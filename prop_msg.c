@@ -0,0 +1,70 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "canlib/canlib.h"
+
+#include "prop_msg.h"
+
+void build_prop_msg(enum PROP_MSG_ID id, const uint8_t *payload, uint8_t len, can_msg_t *output) {
+    if (len > PROP_MSG_MAX_PAYLOAD) {
+        len = PROP_MSG_MAX_PAYLOAD;
+    }
+
+    output->sid = MSG_DEBUG_MSG | BOARD_UNIQUE_ID;
+    output->data[0] = (uint8_t)id;
+    for (uint8_t i = 0; i < len; i++) {
+        output->data[i + 1] = payload[i];
+    }
+    output->data_len = len + 1;
+}
+
+bool is_prop_cmd(const can_msg_t *msg) {
+    if (get_message_type(msg) != MSG_DEBUG_MSG || msg->data_len < 2) {
+        return false;
+    }
+    if (msg->data[0] < 0x80) {
+        return false;
+    }
+    return msg->data[1] == BOARD_UNIQUE_ID || msg->data[1] == 0;
+}
+
+enum PROP_MSG_ID get_prop_msg_id(const can_msg_t *msg) {
+    return (enum PROP_MSG_ID)msg->data[0];
+}
+
+const uint8_t *get_prop_cmd_args(const can_msg_t *msg) {
+    return &msg->data[2];
+}
+
+uint8_t get_prop_cmd_args_len(const can_msg_t *msg) {
+    return msg->data_len > 2 ? msg->data_len - 2 : 0;
+}
+
+static uint8_t ping_args[PROP_MSG_MAX_PAYLOAD - 1];
+static uint8_t ping_len;
+static volatile bool ping_pending = false;
+
+void prop_ping_request(const can_msg_t *msg) {
+    if (ping_pending) {
+        return; // still answering the last one
+    }
+    ping_len = get_prop_cmd_args_len(msg);
+    if (ping_len > sizeof(ping_args)) {
+        ping_len = sizeof(ping_args);
+    }
+    for (uint8_t i = 0; i < ping_len; i++) {
+        ping_args[i] = get_prop_cmd_args(msg)[i];
+    }
+    ping_pending = true;
+}
+
+void prop_ping_heartbeat(void) {
+    if (!ping_pending) {
+        return;
+    }
+    can_msg_t msg;
+    build_prop_msg(PROP_MSG_PONG, ping_args, ping_len, &msg);
+    if (txb_enqueue(&msg)) {
+        ping_pending = false;
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef PROP_MSG_H
+#define PROP_MSG_H
+
+#include "canlib/canlib.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "prop_msg_ids.h"
+
+void build_prop_msg(enum PROP_MSG_ID id, const uint8_t *payload, uint8_t len, can_msg_t *output);
+
+// True if msg is a board-specific command addressed to this board
+bool is_prop_cmd(const can_msg_t *msg);
+
+enum PROP_MSG_ID get_prop_msg_id(const can_msg_t *msg);
+
+// Command arguments start after the target board id, at data[2]
+const uint8_t *get_prop_cmd_args(const can_msg_t *msg);
+uint8_t get_prop_cmd_args_len(const can_msg_t *msg);
+
+// Answer PROP_CMD_PING with a PROP_MSG_PONG echoing its arguments, for round-trip latency
+// measurements. The reply goes out from the main loop so the loop latency is included.
+// prop_ping_request() is safe to call from the ISR.
+void prop_ping_request(const can_msg_t *msg);
+void prop_ping_heartbeat(void);
+
+#endif /* PROP_MSG_H */
@@ -0,0 +1,60 @@
+#ifndef PROP_MSG_IDS_H
+#define PROP_MSG_IDS_H
+
+// Board-specific CAN frames. canlib has no message types for these, so they are sent as
+// MSG_DEBUG_MSG frames with an opcode in data[0] and up to 7 bytes of payload.
+// Commands from the ground use opcodes >= 0x80 and carry the target board id in data[1]
+// (0 addresses every board, same as MSG_RESET_CMD).
+// No dependencies so the host tools can include it too.
+
+#define PROP_MSG_MAX_PAYLOAD 7
+
+enum PROP_MSG_ID {
+    // board -> ground
+    PROP_MSG_VALVE_TIMING = 0x01,
+    PROP_MSG_VALVE_TIMING_HISTORY = 0x02,
+    PROP_MSG_SEQ_STATUS = 0x03,
+    PROP_MSG_SEQ_STEP_DONE = 0x04,
+    PROP_MSG_HALL_CAL = 0x05,
+    PROP_MSG_SOLENOID_SIGNATURE = 0x06,
+    PROP_MSG_FAULT_COUNTERS = 0x07,
+    PROP_MSG_EVENT_LOG = 0x08,
+    PROP_MSG_BOOT_INFO = 0x09, // warm restart flag, warm restart count (2), ms to telemetry (2)
+    PROP_MSG_CAN_RECOVERY = 0x0a,
+    PROP_MSG_CAN_ERRORS = 0x0b,
+    PROP_MSG_PONG = 0x0c, // echo of the PROP_CMD_PING arguments
+    PROP_MSG_INPUT_RECORD = 0x0d, // offset (2), up to 5 bytes of the stream
+    PROP_MSG_PRES_STATS = 0x0e, // sensor id, min (2), max (2), mean - min, stddev
+    PROP_MSG_CC_OSC = 0x0f, // peak Hz (2), peak 0.1 psi (2), bands over limit, samples lost
+    PROP_MSG_VALVE_AGREEMENT = 0x10, // actuator id, first bin, 2 histogram counts (2 each)
+    // sensor id, zero point in 1/16 counts (2), psi at the zero point, psi per count Q16 (2),
+    // last enum PRES_CAL_RESULT << 4 | enum PRES_CAL_SOURCE
+    PROP_MSG_PRES_CAL = 0x11,
+    PROP_MSG_PRES_LOOP = 0x12, // sensor id, enum PRES_LOOP_STATE, invalid samples, last psi (2)
+    // ADC offset and full-scale reading in 1/16 counts (2 each), their drift since the first
+    // cycle in 1/16 counts (1 each, saturating), enum ADC_CAL_RESULT
+    PROP_MSG_ADC_CAL = 0x13,
+
+    // ground -> board
+    PROP_CMD_VALVE_TIMING_DUMP = 0x80,
+    PROP_CMD_SEQ_CLEAR = 0x81,
+    PROP_CMD_SEQ_STEP = 0x82, // index, offset_ms (2), pin, state
+    PROP_CMD_SEQ_ARM = 0x83, // step count, 8 bit sum of all step bytes
+    PROP_CMD_SEQ_FIRE = 0x84,
+    PROP_CMD_SEQ_ABORT = 0x85,
+    PROP_CMD_HALL_CAL_START = 0x86,
+    PROP_CMD_HALL_CAL_REPORT = 0x87,
+    PROP_CMD_SOLENOID_WINDOW = 0x88, // capture window in ms
+    PROP_CMD_FAULT_COUNTERS = 0x89,
+    PROP_CMD_EVENT_LOG_DUMP = 0x8a,
+    PROP_CMD_CAN_RECOVERY_REPORT = 0x8b,
+    PROP_CMD_PING = 0x8c, // up to 6 bytes echoed back
+    PROP_CMD_INPUT_RECORD = 0x8d, // enum INPUT_RECORD_ACTION
+    PROP_CMD_VALVE_AGREEMENT_DUMP = 0x8e,
+    PROP_CMD_PRES_CAL_ZERO = 0x8f, // sensor id or 0xff for all, psi it reads now (signed)
+    PROP_CMD_PRES_CAL_SPAN = 0x90, // sensor id, reference psi (2, signed)
+    PROP_CMD_PRES_CAL_RESET = 0x91, // sensor id or 0xff for all
+    PROP_CMD_PRES_CAL_REPORT = 0x92,
+};
+
+#endif /* PROP_MSG_IDS_H */
@@ -1,22 +1,53 @@
-#include <stdbool.h>
-#include <xc.h>
-
-#include "mcc_generated_files/system/system.h"
 #include <math.h>
+#include <stdbool.h>
 
 #include "sensor_general.h"
 
-#define PT_OFFSET 0
-
 const float VREF = 3.3;
 
+// psi = (raw * raw_scale_q16 + raw_offset_q16) >> 16, rounded, with the ADC correction
+// folded into both. With a gain correction raw_scale_q16 can go a little over 16 bits,
+// raw * raw_scale_q16 still fits in 31.
+typedef struct {
+    hal_adc_channel_t channel;
+    // the calibration, in corrected counts
+    uint16_t zero_raw_x16;
+    int16_t zero_psi;
+    uint16_t scale_q16;
+    // what a reading uses
+    uint32_t raw_scale_q16;
+    int32_t raw_offset_q16;
+} pres_4_20_cal_t;
+
+// until there's an ADC correction
+#define PRES_4_20_NOMINAL_OFFSET_Q16                                                         \
+    (0x8000 -                                                                               \
+     (int32_t)(((uint32_t)PRES_4_20_NOMINAL_SCALE_Q16 * PRES_4_20_NOMINAL_ZERO_RAW_x16) >> 4))
+
+static pres_4_20_cal_t pres_nominal = {0,
+                                       PRES_4_20_NOMINAL_ZERO_RAW_x16,
+                                       0,
+                                       PRES_4_20_NOMINAL_SCALE_Q16,
+                                       PRES_4_20_NOMINAL_SCALE_Q16,
+                                       PRES_4_20_NOMINAL_OFFSET_Q16};
+static pres_4_20_cal_t pres_cals[PRES_4_20_MAX_CAL_CHANNELS];
+static uint8_t num_pres_cals = 0;
+
+static uint16_t adc_offset_x16 = 0;
+static uint16_t adc_gain_q15 = ADC_GAIN_UNITY_Q15;
+
+// corrected_x16 = (raw_x16 - adc_offset_x16) * adc_gain_q15 >> 15, and
+// psi = (corrected_x16 - zero_raw_x16) * scale_q16 / 16 + zero_psi
+static void update_coefficients(pres_4_20_cal_t *cal) {
+    uint32_t raw_scale = ((uint32_t)cal->scale_q16 * adc_gain_q15) >> 15;
+    cal->raw_scale_q16 = raw_scale;
+    cal->raw_offset_q16 = (int32_t)cal->zero_psi * 65536 -
+                          (int32_t)(((uint32_t)cal->scale_q16 * cal->zero_raw_x16) >> 4) -
+                          (int32_t)((raw_scale * adc_offset_x16) >> 4) + 0x8000;
+}
+
 void LED_init(void) {
-    TRISA4 = 0; // set A4, A3, A2 as output
-    TRISA3 = 0;
-    TRISA2 = 0;
-    LATA4 = 1; // turn the leds off
-    LATA3 = 1;
-    LATA2 = 1;
+    hal_led_init();
 }
 
 // D1 Green LED
@@ -55,24 +86,69 @@ void LED_heartbeat_R(void) {
     }
 }
 
-// 4-20mA pressure transducer
-uint32_t get_pressure_4_20_psi(adcc_channel_t adc_channel) {
-    adc_result_t voltage_raw = ADCC_GetSingleConversion(adc_channel);
+bool set_pressure_4_20_cal(hal_adc_channel_t adc_channel,
+                           uint16_t zero_raw_x16,
+                           int16_t zero_psi,
+                           uint16_t scale_q16) {
+    uint8_t i = 0;
+    while (i < num_pres_cals && pres_cals[i].channel != adc_channel) {
+        i++;
+    }
+    if (i == PRES_4_20_MAX_CAL_CHANNELS) {
+        return false;
+    }
+
+    pres_4_20_cal_t cal;
+    cal.channel = adc_channel;
+    cal.zero_raw_x16 = zero_raw_x16;
+    cal.zero_psi = zero_psi;
+    cal.scale_q16 = scale_q16;
+    update_coefficients(&cal);
+
+    pres_cals[i] = cal;
+    if (i == num_pres_cals) {
+        num_pres_cals++;
+    }
+    return true;
+}
 
-    float v = (voltage_raw + 0.5f) / 4096.0f * VREF;
+void set_adc_correction(uint16_t offset_x16, uint16_t gain_q15) {
+    adc_offset_x16 = offset_x16;
+    adc_gain_q15 = gain_q15;
 
-    const double r = 100;
-    const double pressure_range = 1450;
+    update_coefficients(&pres_nominal);
+    for (uint8_t i = 0; i < num_pres_cals; i++) {
+        update_coefficients(&pres_cals[i]);
+    }
+}
 
-    double current = v / r;
+uint16_t adc_correct_x16(uint16_t raw_x16) {
+    if (raw_x16 <= adc_offset_x16) {
+        return 0;
+    }
+    uint32_t corrected = ((uint32_t)(raw_x16 - adc_offset_x16) * adc_gain_q15) >> 15;
+    return corrected > UINT16_MAX ? UINT16_MAX : (uint16_t)corrected;
+}
 
-    int32_t pressure_psi = (int32_t)(((current - 0.004) / (0.02 - 0.004)) * pressure_range);
+// 4-20mA pressure transducer
+uint32_t get_pressure_4_20_psi(hal_adc_channel_t adc_channel) {
+    uint16_t voltage_raw = hal_adc_read(adc_channel);
+
+    const pres_4_20_cal_t *cal = &pres_nominal;
+    for (uint8_t i = 0; i < num_pres_cals; i++) {
+        if (pres_cals[i].channel == adc_channel) {
+            cal = &pres_cals[i];
+            break;
+        }
+    }
 
-    return (uint32_t)pressure_psi + PT_OFFSET;
+    int32_t pressure_q16 =
+        (int32_t)voltage_raw * (int32_t)cal->raw_scale_q16 + cal->raw_offset_q16;
+    return (uint32_t)(pressure_q16 >> 16);
 }
 
-uint32_t get_pressure_pneumatic_psi(adcc_channel_t adc_channel) {
-    adc_result_t voltage_raw = ADCC_GetSingleConversion(adc_channel);
+uint32_t get_pressure_pneumatic_psi(hal_adc_channel_t adc_channel) {
+    uint16_t voltage_raw = hal_adc_read(adc_channel);
 
     float v = ((voltage_raw + 0.5f) / 4096.0f * VREF) * 2.5; // 15kohm and 10kohm resistor divider
 
@@ -90,18 +166,27 @@ uint32_t get_pressure_pneumatic_psi(adcc_channel_t adc_channel) {
 #define LOW_PASS_RESPONSE_TIME 2.5 // seconds
 volatile double alpha_low = LOW_PASS_ALPHA(LOW_PASS_RESPONSE_TIME);
 
-uint16_t update_pressure_psi_low_pass(adcc_channel_t adc_channel, double *low_pass_pressure_psi) {
+uint16_t filter_pressure_psi_low_pass(int16_t pressure_psi, double *low_pass_pressure_psi) {
+    *low_pass_pressure_psi = alpha_low * (*low_pass_pressure_psi) + (1.0 - alpha_low) * pressure_psi;
 
+    return (uint16_t)(*low_pass_pressure_psi);
+}
+
+uint16_t update_pressure_psi_low_pass(hal_adc_channel_t adc_channel, double *low_pass_pressure_psi) {
     int16_t pressure_psi = get_pressure_4_20_psi(adc_channel);
 
-    *low_pass_pressure_psi = alpha_low * (*low_pass_pressure_psi) + (1.0 - alpha_low) * pressure_psi;
+    return filter_pressure_psi_low_pass(pressure_psi, low_pass_pressure_psi);
+}
 
-    return (uint16_t)(*low_pass_pressure_psi);
+void seed_pressure_psi_low_pass(hal_adc_channel_t adc_channel, double *low_pass_pressure_psi) {
+    int16_t pressure_psi = (int16_t)get_pressure_4_20_psi(adc_channel);
+    // an open loop reads far below zero, don't start the filter from that
+    *low_pass_pressure_psi = pressure_psi < 0 ? 0 : pressure_psi;
 }
 
 // 10kR thermistor
-uint16_t get_temperature_c(adcc_channel_t adc_channel) {
-    adc_result_t voltage_raw = ADCC_GetSingleConversion(adc_channel);
+uint16_t get_temperature_c(hal_adc_channel_t adc_channel) {
+    uint16_t voltage_raw = hal_adc_read(adc_channel);
     const float rdiv = 10000.0; // 10kohm divider resistor
 
     // beta, r0, t0 from
@@ -119,6 +204,6 @@ uint16_t get_temperature_c(adcc_channel_t adc_channel) {
     return (uint16_t)(1 / invk - 273);
 }
 
-uint16_t get_hall_sensor_reading(adcc_channel_t adc_channel) {
-    return ADCC_GetSingleConversion(adc_channel);
+uint16_t get_hall_sensor_reading(hal_adc_channel_t adc_channel) {
+    return hal_adc_read(adc_channel);
 }
@@ -3,16 +3,17 @@
 
 #define PRES_TIME_DIFF_ms 16 // 64 Hz
 
-#include "mcc_generated_files/adc/adcc.h"
+#include "hal.h"
+#include <stdbool.h>
 #include <stdint.h>
 // Contains miscellaneous sensor board-specific code
 
-#define LED_ON_G() (LATA2 = 0)
-#define LED_OFF_G() (LATA2 = 1)
-#define LED_ON_B() (LATA3 = 0)
-#define LED_OFF_B() (LATA3 = 1)
-#define LED_ON_R() (LATA4 = 0)
-#define LED_OFF_R() (LATA4 = 1)
+#define LED_ON_G() hal_led_set(HAL_LED_GREEN, true)
+#define LED_OFF_G() hal_led_set(HAL_LED_GREEN, false)
+#define LED_ON_B() hal_led_set(HAL_LED_BLUE, true)
+#define LED_OFF_B() hal_led_set(HAL_LED_BLUE, false)
+#define LED_ON_R() hal_led_set(HAL_LED_RED, true)
+#define LED_OFF_R() hal_led_set(HAL_LED_RED, false)
 
 // Initialize LEDS
 void LED_init(void);
@@ -23,11 +24,45 @@ void LED_heartbeat_G(void); // Green LED
 void LED_heartbeat_B(void); // Blue LED
 void LED_heartbeat_R(void); // Red LED
 
-// Read pressure sensor ADC and convert to PSI. Replace all negative values with
-// zero since canlib and RLCS don't like it.
-uint32_t get_pressure_4_20_psi(adcc_channel_t adc_channel);
-uint32_t get_pressure_pneumatic_psi(adcc_channel_t adc_channel);
-uint16_t update_pressure_psi_low_pass(adcc_channel_t adc_channel, double *low_pass_pressure_psi);
-uint16_t get_temperature_c(adcc_channel_t adc_channel);
-uint16_t get_hall_sensor_reading(adcc_channel_t adc_channel);
+// 1450 psi 4-20 mA transducer across 100 R: 3.3 V / 4096 / 100 R / 16 mA * 1450 psi
+#define PRES_4_20_mpsi_PER_COUNT 730
+
+// Nominal 4-20 mA conversion as a line through the ADC code that reads 0 psi, in 1/16
+// counts, with a slope in psi per count, Q16. This assumes a 3.3 V reference, which is
+// what the float conversion used. ADREF actually selects the FVR, so until a channel is
+// calibrated (see pres_cal.h) its readings carry the reference error.
+#define PRES_4_20_NOMINAL_ZERO_RAW_x16 7936 // 4 mA: 400 mV / 3.3 V * 4096 - 0.5
+#define PRES_4_20_NOMINAL_SCALE_Q16 47850 // 3.3 V / 4096 / 100 R / 16 mA * 1450 psi
+#define PRES_4_20_MAX_CAL_CHANNELS 3 // also the channels pres_cal.c keeps calibrations for
+
+// no gain correction, see set_adc_correction()
+#define ADC_GAIN_UNITY_Q15 32768
+
+// Read pressure sensor ADC and convert to PSI. Negative readings wrap, read the result
+// back as int16_t.
+uint32_t get_pressure_4_20_psi(hal_adc_channel_t adc_channel);
+// Convert adc_channel with the line through (zero_raw_x16 / 16, zero_psi) at scale_q16
+// psi per count from now on. The coefficients are worked out here once, so a reading
+// costs one multiply whatever the calibration. Returns false if every slot is taken.
+bool set_pressure_4_20_cal(hal_adc_channel_t adc_channel,
+                           uint16_t zero_raw_x16,
+                           int16_t zero_psi,
+                           uint16_t scale_q16);
+// ADC correction from the self-calibration (adc_cal.h): the conversions from now on take
+// offset_x16 / 16 counts off every reading and scale what's left by gain_q15 / 32768.
+// Folded into every channel's coefficients, so it costs nothing per reading either.
+void set_adc_correction(uint16_t offset_x16, uint16_t gain_q15);
+// An averaged reading in 1/16 counts with the ADC correction applied, what calibration
+// points are taken in
+uint16_t adc_correct_x16(uint16_t raw_x16);
+uint32_t get_pressure_pneumatic_psi(hal_adc_channel_t adc_channel);
+uint16_t update_pressure_psi_low_pass(hal_adc_channel_t adc_channel, double *low_pass_pressure_psi);
+// Feed the filter a sample that was already read, returns the filtered pressure. The
+// sample must not be negative, the result wouldn't fit.
+uint16_t filter_pressure_psi_low_pass(int16_t pressure_psi, double *low_pass_pressure_psi);
+// Start the filter from one reading instead of ramping up from zero on a cold start.
+// Negative readings start it from zero.
+void seed_pressure_psi_low_pass(hal_adc_channel_t adc_channel, double *low_pass_pressure_psi);
+uint16_t get_temperature_c(hal_adc_channel_t adc_channel);
+uint16_t get_hall_sensor_reading(hal_adc_channel_t adc_channel);
 #endif /* SENSOR_GEN_H */
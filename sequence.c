@@ -0,0 +1,231 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "canlib/canlib.h"
+
+#include "IOExpanderDriver.h"
+#include "hal.h"
+#include "prop_msg.h"
+#include "sequence.h"
+
+#define TICKS_PER_ms (1000 / SEQ_TICK_us)
+
+typedef struct {
+    uint16_t offset_ms;
+    uint8_t pin;
+    enum ACTUATOR_STATE state;
+} seq_step_t;
+
+static seq_step_t steps[SEQ_MAX_STEPS];
+static uint16_t loaded_mask = 0;
+static uint8_t step_count = 0;
+
+static uint8_t valid_pins = 0;
+static seq_step_cb_t step_callback = NULL;
+
+static volatile enum SEQ_STATE state = SEQ_EMPTY;
+static volatile enum SEQ_RESULT last_result = SEQ_OK;
+static volatile bool status_pending = false;
+static uint32_t arm_millis;
+
+// execution progress, written by the timer ISR
+static volatile uint32_t ticks = 0;
+static volatile uint8_t next_step = 0;
+static volatile uint32_t executed_us[SEQ_MAX_STEPS];
+static uint8_t reported_steps = 0;
+
+static enum SEQ_RESULT set_result(enum SEQ_RESULT result) {
+    last_result = result;
+    status_pending = true;
+    return result;
+}
+
+void sequence_init(uint8_t valid_pin_mask, seq_step_cb_t step_cb) {
+    valid_pins = valid_pin_mask;
+    step_callback = step_cb;
+    hal_tick_timer_stop();
+}
+
+enum SEQ_RESULT sequence_clear(void) {
+    if (state == SEQ_RUNNING) {
+        return set_result(SEQ_ERR_BUSY);
+    }
+    loaded_mask = 0;
+    step_count = 0;
+    state = SEQ_EMPTY;
+    return set_result(SEQ_OK);
+}
+
+enum SEQ_RESULT
+sequence_load_step(uint8_t index, uint16_t offset_ms, uint8_t pin, enum ACTUATOR_STATE step_state) {
+    if (state == SEQ_RUNNING) {
+        return set_result(SEQ_ERR_BUSY);
+    }
+    if (index >= SEQ_MAX_STEPS) {
+        return set_result(SEQ_ERR_INDEX);
+    }
+
+    // any change to the table needs a fresh arm
+    state = SEQ_LOADING;
+    steps[index].offset_ms = offset_ms;
+    steps[index].pin = pin;
+    steps[index].state = step_state;
+    loaded_mask |= (uint16_t)1 << index;
+
+    // steps aren't acked one by one, sequence_arm() validates the whole table
+    return SEQ_OK;
+}
+
+enum SEQ_RESULT sequence_arm(uint8_t count, uint8_t checksum) {
+    if (state == SEQ_RUNNING) {
+        return set_result(SEQ_ERR_BUSY);
+    }
+    if (count == 0 || count > SEQ_MAX_STEPS) {
+        return set_result(SEQ_ERR_INDEX);
+    }
+
+    uint8_t sum = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        const seq_step_t *step = &steps[i];
+
+        if (!(loaded_mask & ((uint16_t)1 << i))) {
+            return set_result(SEQ_ERR_MISSING_STEP);
+        }
+        if (step->offset_ms > SEQ_MAX_OFFSET_ms) {
+            return set_result(SEQ_ERR_OFFSET);
+        }
+        if (i > 0 && step->offset_ms < steps[i - 1].offset_ms) {
+            return set_result(SEQ_ERR_ORDER);
+        }
+        if (step->pin >= PCA_NUM_PINS || !(valid_pins & (1 << step->pin))) {
+            return set_result(SEQ_ERR_PIN);
+        }
+        if (step->state != ACTUATOR_ON && step->state != ACTUATOR_OFF) {
+            return set_result(SEQ_ERR_STATE);
+        }
+
+        sum += (step->offset_ms >> 8) & 0xff;
+        sum += step->offset_ms & 0xff;
+        sum += step->pin;
+        sum += step->state;
+    }
+    if (sum != checksum) {
+        return set_result(SEQ_ERR_CHECKSUM);
+    }
+
+    step_count = count;
+    arm_millis = millis();
+    state = SEQ_ARMED;
+    return set_result(SEQ_OK);
+}
+
+enum SEQ_RESULT sequence_fire(void) {
+    if (state != SEQ_ARMED) {
+        return set_result(SEQ_ERR_NOT_ARMED);
+    }
+
+    ticks = 0;
+    next_step = 0;
+    reported_steps = 0;
+    state = SEQ_RUNNING;
+
+    // steps at offset 0 go out right away, the rest from the timer. The timer starts
+    // first so they're timed from here, not from the count the last sequence left in it.
+    bool gie = hal_irq_disable();
+    hal_tick_timer_start();
+    sequence_handle_timer_interrupt();
+    hal_irq_restore(gie);
+    return set_result(SEQ_OK);
+}
+
+void sequence_abort(void) {
+    bool gie = hal_irq_disable();
+    if (state == SEQ_RUNNING || state == SEQ_ARMED) {
+        hal_tick_timer_stop();
+        state = SEQ_ABORTED;
+        status_pending = true;
+    }
+    hal_irq_restore(gie);
+}
+
+bool sequence_running(void) {
+    return state == SEQ_RUNNING;
+}
+
+void sequence_handle_timer_interrupt(void) {
+    if (state != SEQ_RUNNING) {
+        hal_tick_timer_stop();
+        return;
+    }
+
+    uint32_t now_ticks = ticks;
+    while (next_step < step_count &&
+           (uint32_t)steps[next_step].offset_ms * TICKS_PER_ms <= now_ticks) {
+        const seq_step_t *step = &steps[next_step];
+        executed_us[next_step] = now_ticks * SEQ_TICK_us + hal_tick_timer_elapsed_us();
+        step_callback(step->pin, step->state);
+        next_step++;
+    }
+
+    if (next_step >= step_count) {
+        hal_tick_timer_stop();
+        state = SEQ_DONE;
+        status_pending = true;
+    }
+
+    ticks = now_ticks + 1;
+}
+
+static void send_status(void) {
+    uint8_t payload[4];
+    payload[0] = state;
+    payload[1] = last_result;
+    payload[2] = step_count;
+    payload[3] = next_step;
+
+    can_msg_t msg;
+    build_prop_msg(PROP_MSG_SEQ_STATUS, payload, sizeof(payload), &msg);
+    if (txb_enqueue(&msg)) {
+        status_pending = false;
+    }
+}
+
+// planned offset next to the actual time the step went out, both from the fire command
+static bool send_step_report(uint8_t index) {
+    uint32_t actual_us = executed_us[index];
+
+    uint8_t payload[7];
+    payload[0] = index;
+    payload[1] = (steps[index].offset_ms >> 8) & 0xff;
+    payload[2] = (steps[index].offset_ms >> 0) & 0xff;
+    payload[3] = (actual_us >> 24) & 0xff;
+    payload[4] = (actual_us >> 16) & 0xff;
+    payload[5] = (actual_us >> 8) & 0xff;
+    payload[6] = (actual_us >> 0) & 0xff;
+
+    can_msg_t msg;
+    build_prop_msg(PROP_MSG_SEQ_STEP_DONE, payload, sizeof(payload), &msg);
+    return txb_enqueue(&msg);
+}
+
+void sequence_heartbeat(void) {
+    // a fire from the CAN ISR between the check and the write would be overwritten
+    bool gie = hal_irq_disable();
+    if (state == SEQ_ARMED && (millis() - arm_millis) > SEQ_ARM_TIMEOUT_ms) {
+        state = SEQ_LOADING;
+        set_result(SEQ_ERR_NOT_ARMED);
+    }
+    hal_irq_restore(gie);
+
+    // one step report per pass, in execution order
+    if (reported_steps < next_step) {
+        if (send_step_report(reported_steps)) {
+            reported_steps++;
+        }
+        return;
+    }
+
+    if (status_pending) {
+        send_status();
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+#include "canlib/message_types.h"
+#include "hal.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// On-board actuation sequences. The ground loads a table of (offset, pin, state) steps,
+// arms it and fires it with a single command. Steps are run from the tick timer interrupt
+// (see hal.h), which fires every SEQ_TICK_us while a sequence is running.
+
+#define SEQ_MAX_STEPS 16
+#define SEQ_MAX_OFFSET_ms 10000
+#define SEQ_TICK_us HAL_TICK_us
+
+// an armed sequence that isn't fired in this time is disarmed again
+#define SEQ_ARM_TIMEOUT_ms 30000
+
+enum SEQ_STATE {
+    SEQ_EMPTY = 0,
+    SEQ_LOADING,
+    SEQ_ARMED,
+    SEQ_RUNNING,
+    SEQ_DONE,
+    SEQ_ABORTED
+};
+
+enum SEQ_RESULT {
+    SEQ_OK = 0,
+    SEQ_ERR_INDEX,
+    SEQ_ERR_MISSING_STEP,
+    SEQ_ERR_ORDER,
+    SEQ_ERR_PIN,
+    SEQ_ERR_STATE,
+    SEQ_ERR_OFFSET,
+    SEQ_ERR_CHECKSUM,
+    SEQ_ERR_NOT_ARMED,
+    SEQ_ERR_BUSY
+};
+
+// Called from the timer ISR for every step, must not block
+typedef void (*seq_step_cb_t)(uint8_t pin, enum ACTUATOR_STATE state);
+
+void sequence_init(uint8_t valid_pin_mask, seq_step_cb_t step_cb);
+
+// Table management and triggers, called from the CAN handler
+enum SEQ_RESULT sequence_clear(void);
+enum SEQ_RESULT
+sequence_load_step(uint8_t index, uint16_t offset_ms, uint8_t pin, enum ACTUATOR_STATE state);
+enum SEQ_RESULT sequence_arm(uint8_t step_count, uint8_t checksum);
+enum SEQ_RESULT sequence_fire(void);
+
+// Stop a running or armed sequence. Steps already executed are not undone.
+void sequence_abort(void);
+
+bool sequence_running(void);
+
+// Call from the main loop: sends status and per-step execution reports
+void sequence_heartbeat(void);
+
+// Call from the ISR on a Timer2 match
+void sequence_handle_timer_interrupt(void);
+
+#endif /* SEQUENCE_H */
@@ -0,0 +1,215 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "canlib/canlib.h"
+
+#include "IOExpanderDriver.h"
+#include "error_checks.h"
+#include "hal.h"
+#include "prop_msg.h"
+#include "solenoid_capture.h"
+
+#define NUM_PINS PCA_NUM_PINS
+
+// Same conversion as check_12v_current_error(): 10 uV per count at 3.3 V / 12 bit after
+// the 100 V/V amplifier, across the 15 mR R7. 33000 / 61440 == 1100 / 2048.
+#define RAW_TO_12V_mA(raw) ((uint16_t)(((uint32_t)(raw) * 1100) >> 11))
+
+#define FLAG_ON_TRANSITION 0x10
+#define FLAG_DIP_FOUND 0x20
+#define FLAG_OUT_OF_ENVELOPE 0x40
+
+// what kind of envelope violation, sent with FAULT_SOLENOID
+enum SOLENOID_FAULT { SOLENOID_SHORT = 1, SOLENOID_OPEN_COIL, SOLENOID_HOLD_HIGH, SOLENOID_NO_PULL_IN };
+
+static hal_adc_channel_t channel;
+static uint8_t window_ms = SOLENOID_CAPTURE_DEFAULT_WINDOW_ms;
+
+static solenoid_envelope_t envelopes[NUM_PINS];
+static enum ACTUATOR_ID actuator_ids[NUM_PINS];
+static uint8_t envelope_mask = 0;
+
+// pins with FAULT_SOLENOID active
+static uint8_t faulted_pins = 0;
+
+static volatile bool start_pending = false;
+static volatile uint8_t start_pin;
+static volatile enum ACTUATOR_STATE start_state;
+static volatile uint32_t start_millis;
+
+static bool active = false;
+static uint32_t capture_millis;
+static solenoid_signature_t sig;
+static bool fault_sent;
+
+// dip tracking, the lowest point since the last peak
+static uint16_t dip_mA;
+static uint8_t dip_ms;
+
+// hold current is the mean over the last quarter of the window
+static uint32_t hold_accum;
+static uint16_t hold_count;
+
+void solenoid_capture_init(hal_adc_channel_t current_channel) {
+    channel = current_channel;
+}
+
+void solenoid_capture_set_envelope(uint8_t pin,
+                                   enum ACTUATOR_ID actuator,
+                                   const solenoid_envelope_t *envelope) {
+    if (pin >= NUM_PINS) {
+        return;
+    }
+    envelopes[pin] = *envelope;
+    actuator_ids[pin] = actuator;
+    envelope_mask |= 1 << pin;
+}
+
+void solenoid_capture_set_window(uint8_t new_window_ms) {
+    if (new_window_ms == 0 || new_window_ms > SOLENOID_CAPTURE_MAX_WINDOW_ms) {
+        new_window_ms = SOLENOID_CAPTURE_MAX_WINDOW_ms;
+    }
+    window_ms = new_window_ms;
+}
+
+void solenoid_capture_start(uint8_t pin, enum ACTUATOR_STATE state) {
+    start_pin = pin;
+    start_state = state;
+    start_millis = millis();
+    start_pending = true;
+}
+
+const solenoid_signature_t *solenoid_capture_last(void) {
+    return &sig;
+}
+
+static void begin_capture(void) {
+    bool gie = hal_irq_disable();
+    sig.pin = start_pin;
+    sig.state = start_state;
+    capture_millis = start_millis;
+    start_pending = false;
+    hal_irq_restore(gie);
+
+    // a change on another output restarts the capture, the signatures would overlap
+    active = true;
+    fault_sent = false;
+    sig.peak_mA = 0;
+    sig.peak_ms = 0;
+    sig.dip_found = false;
+    sig.dip_ms = 0;
+    sig.hold_mA = 0;
+    sig.in_envelope = true;
+    dip_mA = 0xffff;
+    dip_ms = 0;
+    hold_accum = 0;
+    hold_count = 0;
+}
+
+static void send_fault(enum SOLENOID_FAULT fault) {
+    if (fault_sent) {
+        return;
+    }
+    fault_sent = true;
+    sig.in_envelope = false;
+    faulted_pins |= 1 << sig.pin;
+
+    uint8_t fault_data[4];
+    fault_data[0] = actuator_ids[sig.pin];
+    fault_data[1] = fault;
+    fault_data[2] = (sig.peak_mA >> 8) & 0xff;
+    fault_data[3] = (sig.peak_mA >> 0) & 0xff;
+    fault_raise(FAULT_SOLENOID, fault_data, 4);
+}
+
+static void check_envelope(void) {
+    if (!(envelope_mask & (1 << sig.pin))) {
+        return;
+    }
+    const solenoid_envelope_t *env = &envelopes[sig.pin];
+
+    if (sig.peak_mA > env->peak_max_mA) {
+        send_fault(SOLENOID_SHORT);
+    }
+    if (sig.state != ACTUATOR_ON) {
+        return;
+    }
+    if (sig.hold_mA < env->hold_min_mA) {
+        send_fault(SOLENOID_OPEN_COIL);
+    } else if (sig.hold_mA > env->hold_max_mA) {
+        send_fault(SOLENOID_HOLD_HIGH);
+    } else if (env->dip_required && !sig.dip_found) {
+        send_fault(SOLENOID_NO_PULL_IN);
+    }
+}
+
+static void send_signature(void) {
+    uint8_t payload[7];
+    payload[0] = (sig.pin & 0x0f) | (sig.state == ACTUATOR_ON ? FLAG_ON_TRANSITION : 0) |
+                 (sig.dip_found ? FLAG_DIP_FOUND : 0) |
+                 (sig.in_envelope ? 0 : FLAG_OUT_OF_ENVELOPE);
+    payload[1] = (sig.peak_mA >> 8) & 0xff;
+    payload[2] = (sig.peak_mA >> 0) & 0xff;
+    payload[3] = sig.peak_ms;
+    payload[4] = sig.dip_ms;
+    payload[5] = (sig.hold_mA >> 8) & 0xff;
+    payload[6] = (sig.hold_mA >> 0) & 0xff;
+
+    can_msg_t msg;
+    build_prop_msg(PROP_MSG_SOLENOID_SIGNATURE, payload, sizeof(payload), &msg);
+    txb_enqueue(&msg);
+}
+
+void solenoid_capture_heartbeat(void) {
+    if (start_pending) {
+        begin_capture();
+    }
+    if (!active) {
+        return;
+    }
+
+    uint32_t elapsed = millis() - capture_millis;
+    if (elapsed >= window_ms) {
+        active = false;
+        sig.hold_mA = hold_count ? hold_accum / hold_count : 0;
+        check_envelope();
+        // only an ON transition checks the whole envelope, an OFF one can't clear an open
+        // coil
+        if (sig.in_envelope && sig.state == ACTUATOR_ON && (envelope_mask & (1 << sig.pin))) {
+            faulted_pins &= ~(1 << sig.pin);
+            if (faulted_pins == 0) {
+                fault_clear(FAULT_SOLENOID);
+            }
+        }
+        send_signature();
+        return;
+    }
+
+    uint16_t current_mA = RAW_TO_12V_mA(hal_adc_read(channel));
+
+    if (current_mA > sig.peak_mA) {
+        // new peak, any dip before it was just part of the rise
+        sig.peak_mA = current_mA;
+        sig.peak_ms = elapsed;
+        dip_mA = current_mA;
+        dip_ms = elapsed;
+    } else if (current_mA < dip_mA) {
+        dip_mA = current_mA;
+        dip_ms = elapsed;
+    } else if (!sig.dip_found && dip_mA + SOLENOID_DIP_MIN_mA <= sig.peak_mA &&
+               current_mA >= dip_mA + SOLENOID_DIP_MIN_mA) {
+        // came back up after dropping off the peak: the plunger has seated
+        sig.dip_found = true;
+        sig.dip_ms = dip_ms;
+    }
+
+    if (elapsed >= (uint32_t)(window_ms - window_ms / 4)) {
+        hold_accum += current_mA;
+        hold_count++;
+    }
+
+    // don't wait for the end of the window to report a short
+    if ((envelope_mask & (1 << sig.pin)) && current_mA > envelopes[sig.pin].peak_max_mA) {
+        send_fault(SOLENOID_SHORT);
+    }
+}
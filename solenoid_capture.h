@@ -0,0 +1,69 @@
+#ifndef SOLENOID_CAPTURE_H
+#define SOLENOID_CAPTURE_H
+
+#include "canlib/message_types.h"
+#include "hal.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Current signature of a solenoid on the 12 V rail. Every time actuator_set() changes an
+// output, current_sense_12v is sampled on each main loop pass for a short window and
+// reduced to a few features: inrush peak, the dip when the plunger moves, and the hold
+// current at the end of the window. A signature outside its pin's envelope raises
+// FAULT_SOLENOID, which clears once every faulted pin has had an ON transition inside its
+// envelope again.
+//
+// The sampling rate is whatever the main loop manages, not a timer. By the estimates in
+// tools/budget.cfg a pass takes about 1.3 ms on the INJ board and 60 us on the VENT board,
+// and a pass that runs STATUS and the sensor tasks together takes up to about 4.3 ms and
+// 2.3 ms. Times are whole milliseconds from millis(). A short inrush peak or a dip can
+// fall between two samples on a busy pass, so the peak reads low and the dip can be
+// missed, more so on the INJ board. Sampling from a timer is left for later: it would
+// share the ADC with the Timer4 chamber pressure sampler, which runs while the injector
+// is open, the same time as the injector's capture.
+
+#define SOLENOID_CAPTURE_DEFAULT_WINDOW_ms 100
+#define SOLENOID_CAPTURE_MAX_WINDOW_ms 250 // times are reported in a single byte
+
+// a dip has to be at least this far below the peak and be followed by a rise of at
+// least this much to count as plunger movement
+#define SOLENOID_DIP_MIN_mA 10
+
+typedef struct {
+    uint16_t peak_max_mA; // above this at any point is treated as a short
+    uint16_t hold_min_mA; // below this after pull-in is an open coil
+    uint16_t hold_max_mA;
+    bool dip_required; // no dip on an ON transition means the plunger didn't move
+} solenoid_envelope_t;
+
+typedef struct {
+    uint8_t pin;
+    enum ACTUATOR_STATE state;
+    uint16_t peak_mA;
+    uint8_t peak_ms;
+    bool dip_found;
+    uint8_t dip_ms;
+    uint16_t hold_mA;
+    bool in_envelope;
+} solenoid_signature_t;
+
+void solenoid_capture_init(hal_adc_channel_t current_channel);
+
+// Set the envelope and actuator id used in fault reports for an output pin. Pins without
+// an envelope are captured and reported but never flagged.
+void solenoid_capture_set_envelope(uint8_t pin,
+                                   enum ACTUATOR_ID actuator,
+                                   const solenoid_envelope_t *envelope);
+
+void solenoid_capture_set_window(uint8_t window_ms);
+
+// Called by actuator_set() when an output changes. Safe to call from the ISR.
+void solenoid_capture_start(uint8_t pin, enum ACTUATOR_STATE state);
+
+// Call from the main loop: samples during a capture and reports the result
+void solenoid_capture_heartbeat(void);
+
+const solenoid_signature_t *solenoid_capture_last(void);
+
+#endif /* SOLENOID_CAPTURE_H */
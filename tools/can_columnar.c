@@ -0,0 +1,866 @@
+// Streams a candump -L capture into one columnar file per decoded stream (see pcol.h),
+// and reads time ranges back out of those files.
+//
+//   candump -L can0 > coldflow.log
+//   ./can_columnar -o coldflow/ coldflow.log
+//   ./can_columnar -q coldflow/inj_pressure_fuel.pcol -s 1697040123.5 -e 1697040130
+//
+// Decoded: analog sensor data, actuator status and general board status from any board.
+// Every other frame is counted and skipped. The log is mmapped and parsed by hand in
+// slices, one thread per CPU (-j), while the previous slices' rows are appended to the
+// columns in log order, so a capture decodes at about the speed it can be read. Queries
+// mmap the column file and binary search the block time ranges, so only the blocks in the
+// range are touched.
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "message_types.h"
+#include "pcol.h"
+
+// the low bits of the SID are the board id
+#define SID_TYPE_MASK 0x7e0
+#define SID_BOARD_MASK 0x01f
+#define NUM_BOARDS (SID_BOARD_MASK + 1)
+#define NUM_IDS 256
+
+// Logs are parsed in slices of about this size, several at a time
+#define SLICE_SIZE (16 * 1024 * 1024)
+#define MAX_THREADS 16
+
+typedef struct {
+    const char *name;
+    uint8_t width;
+} col_def_t;
+
+static const col_def_t kind_cols[PCOL_NUM_KINDS][PCOL_MAX_COLS] = {
+    [PCOL_ANALOG] = {{"t_us", 8}, {"board_ms", 4}, {"value", 2}},
+    [PCOL_ACTUATOR] = {{"t_us", 8}, {"board_ms", 4}, {"state", 1}, {"requested", 1}},
+    [PCOL_STATUS] =
+        {{"t_us", 8}, {"board_ms", 4}, {"code", 1}, {"data_len", 1}, {"data", 4}},
+};
+static const uint8_t kind_num_cols[PCOL_NUM_KINDS] = {
+    [PCOL_ANALOG] = 3,
+    [PCOL_ACTUATOR] = 4,
+    [PCOL_STATUS] = 5,
+};
+static const char *const kind_names[PCOL_NUM_KINDS] = {
+    [PCOL_ANALOG] = "analog",
+    [PCOL_ACTUATOR] = "actuator",
+    [PCOL_STATUS] = "status",
+};
+
+// The streams the prop boards send, anything else gets a numbered name
+static const char *const sensor_names[NUM_IDS] = {
+    [SENSOR_PRESSURE_FUEL] = "pressure_fuel",
+    [SENSOR_PRESSURE_CC] = "pressure_cc",
+    [SENSOR_PRESSURE_OX] = "pressure_ox",
+    [SENSOR_PRESSURE_PNEUMATICS] = "pressure_pneumatics",
+    [SENSOR_HALL_FUEL_INJ] = "hall_fuel_inj",
+    [SENSOR_HALL_OX_INJ] = "hall_ox_inj",
+    [SENSOR_VENT_TEMP] = "vent_temp",
+    [SENSOR_BATT_VOLT] = "batt_volt",
+};
+static const char *const actuator_names[NUM_IDS] = {
+    [ACTUATOR_INJECTOR_VALVE] = "injector_valve",
+    [ACTUATOR_FILL_DUMP_VALVE] = "fill_dump_valve",
+    [ACTUATOR_VENT_VALVE] = "vent_valve",
+    [ACTUATOR_FUEL_INJECTOR] = "fuel_injector",
+    [ACTUATOR_OX_INJECTOR] = "ox_injector",
+};
+
+typedef struct {
+    pcol_header_t header;
+    FILE *f;
+    uint8_t *block;
+    size_t block_size;
+    size_t col_off[PCOL_MAX_COLS];
+    uint32_t rows; // in the current block
+    int64_t last_t_us;
+} stream_t;
+
+static stream_t *streams[PCOL_NUM_KINDS][NUM_BOARDS][NUM_IDS];
+static const char *out_dir = ".";
+static size_t num_threads = 1;
+
+static struct {
+    uint64_t lines;
+    uint64_t bytes;
+    uint64_t decoded[PCOL_NUM_KINDS];
+    uint64_t other; // frames of other types, extended and remote frames
+    uint64_t short_frames;
+    uint64_t bad_lines;
+    uint32_t files;
+} stats;
+
+static int8_t hex_val[256];
+static int16_t hex_pair[65536]; // two hex digits to a byte
+
+static void hex_init(void) {
+    memset(hex_val, -1, sizeof(hex_val));
+    for (int i = 0; i < 10; i++) {
+        hex_val['0' + i] = (int8_t)i;
+    }
+    for (int i = 0; i < 6; i++) {
+        hex_val['a' + i] = (int8_t)(10 + i);
+        hex_val['A' + i] = (int8_t)(10 + i);
+    }
+    for (int i = 0; i < 65536; i++) {
+        int8_t hi = hex_val[i >> 8];
+        int8_t lo = hex_val[i & 0xff];
+        hex_pair[i] = (hi < 0 || lo < 0) ? -1 : (int16_t)((hi << 4) | lo);
+    }
+}
+
+static const char *board_name(uint8_t board, char *buf, size_t len) {
+    if (board == BOARD_ID_PROPULSION_INJ) {
+        return "inj";
+    } else if (board == BOARD_ID_PROPULSION_VENT) {
+        return "vent";
+    }
+    snprintf(buf, len, "board%02x", board);
+    return buf;
+}
+
+static void stream_name(enum pcol_kind kind, uint8_t id, char *buf, size_t len) {
+    switch (kind) {
+        case PCOL_ANALOG:
+            if (sensor_names[id]) {
+                snprintf(buf, len, "%s", sensor_names[id]);
+            } else {
+                snprintf(buf, len, "sensor%u", id);
+            }
+            break;
+        case PCOL_ACTUATOR:
+            if (actuator_names[id]) {
+                snprintf(buf, len, "act_%s", actuator_names[id]);
+            } else {
+                snprintf(buf, len, "act_%u", id);
+            }
+            break;
+        default:
+            snprintf(buf, len, "status");
+            break;
+    }
+}
+
+static void write_header(stream_t *s) {
+    if (fseek(s->f, 0, SEEK_SET) != 0 || fwrite(&s->header, sizeof(s->header), 1, s->f) != 1) {
+        perror("write header");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static stream_t *stream_open(enum pcol_kind kind, uint8_t board, uint8_t id) {
+    stream_t *s = calloc(1, sizeof(*s));
+    if (!s) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    pcol_header_t *h = &s->header;
+    memcpy(h->magic, PCOL_MAGIC, sizeof(h->magic));
+    h->version = PCOL_VERSION;
+    h->board = board;
+    h->kind = kind;
+    h->id = id;
+    h->num_cols = kind_num_cols[kind];
+    h->sorted = 1;
+    h->rows_per_block = PCOL_ROWS_PER_BLOCK;
+    for (uint8_t i = 0; i < h->num_cols; i++) {
+        h->col_width[i] = kind_cols[kind][i].width;
+        strncpy(h->col_name[i], kind_cols[kind][i].name, PCOL_COL_NAME_LEN - 1);
+    }
+
+    char board_buf[16];
+    char name[PCOL_NAME_LEN];
+    stream_name(kind, id, name, sizeof(name));
+    snprintf(h->stream, sizeof(h->stream), "%s", name);
+
+    char path[4096];
+    snprintf(path,
+             sizeof(path),
+             "%s/%s_%s.pcol",
+             out_dir,
+             board_name(board, board_buf, sizeof(board_buf)),
+             name);
+    s->f = fopen(path, "w+b");
+    if (!s->f) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    write_header(s);
+
+    s->block_size = pcol_block_size(h);
+    s->block = calloc(1, s->block_size);
+    if (!s->block) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (uint8_t i = 0; i < h->num_cols; i++) {
+        s->col_off[i] = pcol_col_offset(h, i);
+    }
+    s->last_t_us = INT64_MIN;
+    stats.files++;
+    return s;
+}
+
+static void block_write(stream_t *s) {
+    pcol_block_t *b = (pcol_block_t *)s->block;
+    b->num_rows = s->rows;
+    if (fwrite(s->block, s->block_size, 1, s->f) != 1) {
+        perror("write block");
+        exit(EXIT_FAILURE);
+    }
+    s->header.num_rows += s->rows;
+    s->rows = 0;
+}
+
+// Returns the row to fill in, after setting the time columns
+static uint32_t stream_row(stream_t *s, int64_t t_us, uint32_t board_ms) {
+    pcol_block_t *b = (pcol_block_t *)s->block;
+    uint32_t r = s->rows;
+    if (r == 0) {
+        b->t_min_us = t_us;
+        b->t_max_us = t_us;
+    } else if (t_us < b->t_min_us) {
+        b->t_min_us = t_us;
+    } else if (t_us > b->t_max_us) {
+        b->t_max_us = t_us;
+    }
+    if (t_us < s->last_t_us) {
+        s->header.sorted = 0;
+    }
+    s->last_t_us = t_us;
+
+    memcpy(s->block + s->col_off[0] + (size_t)r * 8, &t_us, 8);
+    memcpy(s->block + s->col_off[1] + (size_t)r * 4, &board_ms, 4);
+    return r;
+}
+
+static void stream_row_done(stream_t *s) {
+    if (++s->rows == s->header.rows_per_block) {
+        block_write(s);
+    }
+}
+
+static void stream_close(stream_t *s) {
+    if (s->rows > 0) {
+        // zero the unused rows so the padding is the same every run
+        for (uint8_t i = 0; i < s->header.num_cols; i++) {
+            size_t width = s->header.col_width[i];
+            memset(s->block + s->col_off[i] + s->rows * width,
+                   0,
+                   (s->header.rows_per_block - s->rows) * width);
+        }
+        block_write(s);
+    }
+    write_header(s);
+    if (fclose(s->f) != 0) {
+        perror("close");
+        exit(EXIT_FAILURE);
+    }
+    free(s->block);
+    free(s);
+}
+
+static inline stream_t *stream_get(enum pcol_kind kind, uint8_t board, uint8_t id) {
+    stream_t *s = streams[kind][board][id];
+    if (!s) {
+        s = stream_open(kind, board, id);
+        streams[kind][board][id] = s;
+    }
+    return s;
+}
+
+static void decode_frame(int64_t t_us, uint16_t sid, const uint8_t *data, uint8_t len) {
+    uint16_t type = sid & SID_TYPE_MASK;
+    uint8_t board = sid & SID_BOARD_MASK;
+    uint32_t board_ms = ((uint32_t)data[0] << 16) | ((uint32_t)data[1] << 8) | data[2];
+    stream_t *s;
+    uint32_t r;
+
+    switch (type) {
+        case MSG_SENSOR_ANALOG: {
+            if (len < 6) {
+                stats.short_frames++;
+                return;
+            }
+            s = stream_get(PCOL_ANALOG, board, data[3]);
+            r = stream_row(s, t_us, board_ms);
+            uint16_t value = ((uint16_t)data[4] << 8) | data[5];
+            memcpy(s->block + s->col_off[2] + (size_t)r * 2, &value, 2);
+            stats.decoded[PCOL_ANALOG]++;
+            break;
+        }
+        case MSG_ACTUATOR_STATUS:
+            if (len < 6) {
+                stats.short_frames++;
+                return;
+            }
+            s = stream_get(PCOL_ACTUATOR, board, data[3]);
+            r = stream_row(s, t_us, board_ms);
+            s->block[s->col_off[2] + r] = data[4];
+            s->block[s->col_off[3] + r] = data[5];
+            stats.decoded[PCOL_ACTUATOR]++;
+            break;
+        case MSG_GENERAL_BOARD_STATUS:
+            if (len < 4) {
+                stats.short_frames++;
+                return;
+            }
+            s = stream_get(PCOL_STATUS, board, 0);
+            r = stream_row(s, t_us, board_ms);
+            s->block[s->col_off[2] + r] = data[3];
+            s->block[s->col_off[3] + r] = len - 4;
+            memcpy(s->block + s->col_off[4] + (size_t)r * 4, data + 4, 4);
+            stats.decoded[PCOL_STATUS]++;
+            break;
+        default:
+            stats.other++;
+            return;
+    }
+    stream_row_done(s);
+}
+
+// seconds[.fraction], to microseconds. Returns NULL if there are no digits.
+static const char *parse_time_us(const char *p, const char *end, int64_t *t_us) {
+    const char *start = p;
+    int64_t sec = 0;
+    while (p < end && (unsigned)(*p - '0') < 10) {
+        sec = sec * 10 + (*p++ - '0');
+    }
+    int64_t us = 0;
+    int digits = 0;
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && (unsigned)(*p - '0') < 10) {
+            if (digits < 6) {
+                us = us * 10 + (*p - '0');
+                digits++;
+            }
+            p++;
+        }
+    }
+    if (p == start) {
+        return NULL;
+    }
+    for (; digits < 6; digits++) {
+        us *= 10;
+    }
+    *t_us = sec * 1000000 + us;
+    return p;
+}
+
+// One parsed frame, between the parse threads and the column writer
+typedef struct {
+    int64_t t_us;
+    uint16_t sid;
+    uint8_t len;
+    uint8_t data[8];
+} frame_t;
+
+// A run of whole lines, parsed on its own
+typedef struct {
+    const char *start;
+    const char *end;
+    frame_t *frames;
+    size_t num_frames;
+    size_t cap_frames;
+    uint64_t lines;
+    uint64_t other;
+    uint64_t short_frames;
+    uint64_t bad_lines;
+} slice_t;
+
+static bool decoded_type(uint16_t type) {
+    return type == MSG_SENSOR_ANALOG || type == MSG_ACTUATOR_STATUS ||
+           type == MSG_GENERAL_BOARD_STATUS;
+}
+
+// (seconds.micros) iface SID#DATA
+static void parse_line(slice_t *slice, const char *p, const char *eol) {
+    int64_t t_us;
+    if (p >= eol || *p != '(' || !(p = parse_time_us(p + 1, eol, &t_us)) || p >= eol ||
+        *p != ')') {
+        slice->bad_lines++;
+        return;
+    }
+    p++;
+    while (p < eol && *p == ' ') {
+        p++;
+    }
+    while (p < eol && *p != ' ') {
+        p++;
+    }
+    while (p < eol && *p == ' ') {
+        p++;
+    }
+
+    const char *sid_start = p;
+    uint32_t sid = 0;
+    while (p < eol && hex_val[(uint8_t)*p] >= 0) {
+        sid = (sid << 4) | (uint32_t)hex_val[(uint8_t)*p++];
+    }
+    size_t sid_digits = p - sid_start;
+    if (p >= eol || *p != '#') {
+        slice->bad_lines++;
+        return;
+    }
+    p++;
+    if (sid_digits != 3 || (p < eol && *p == 'R') || !decoded_type(sid & SID_TYPE_MASK)) {
+        // 29 bit IDs and remote frames aren't ours
+        slice->other++;
+        return;
+    }
+
+    if (slice->num_frames == slice->cap_frames) {
+        slice->cap_frames = slice->cap_frames ? slice->cap_frames * 2 : 65536;
+        slice->frames = realloc(slice->frames, slice->cap_frames * sizeof(frame_t));
+        if (!slice->frames) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    frame_t *frame = &slice->frames[slice->num_frames];
+    frame->t_us = t_us;
+    frame->sid = (uint16_t)sid;
+    memset(frame->data, 0, sizeof(frame->data));
+
+    uint8_t len = 0;
+    while (len < sizeof(frame->data) && p + 1 < eol) {
+        int16_t byte = hex_pair[((uint8_t)p[0] << 8) | (uint8_t)p[1]];
+        if (byte < 0) {
+            break;
+        }
+        frame->data[len++] = (uint8_t)byte;
+        p += 2;
+    }
+    if (len < 3) {
+        slice->short_frames++;
+        return;
+    }
+    frame->len = len;
+    slice->num_frames++;
+}
+
+static void slice_parse(slice_t *slice) {
+    const char *p = slice->start;
+    const char *end = slice->end;
+    slice->num_frames = 0;
+    slice->lines = 0;
+    slice->other = 0;
+    slice->short_frames = 0;
+    slice->bad_lines = 0;
+    while (p < end) {
+        const char *eol = memchr(p, '\n', end - p);
+        if (!eol) {
+            // no newline at the end of the file
+            eol = end;
+        }
+        parse_line(slice, p, eol);
+        slice->lines++;
+        p = eol + 1;
+    }
+}
+
+static void *slice_parse_thread(void *arg) {
+    slice_parse(arg);
+    return NULL;
+}
+
+// Columns are appended in log order, by one thread
+static void slice_write(const slice_t *slice) {
+    for (size_t i = 0; i < slice->num_frames; i++) {
+        const frame_t *frame = &slice->frames[i];
+        decode_frame(frame->t_us, frame->sid, frame->data, frame->len);
+    }
+    stats.lines += slice->lines;
+    stats.other += slice->other;
+    stats.short_frames += slice->short_frames;
+    stats.bad_lines += slice->bad_lines;
+}
+
+// Cuts the next slices off [*pos, end) at line boundaries, returns how many
+static size_t window_fill(slice_t *window, const char **pos, const char *end) {
+    size_t n = 0;
+    while (n < num_threads && *pos < end) {
+        const char *start = *pos;
+        const char *cut = end;
+        if ((size_t)(end - start) > SLICE_SIZE) {
+            const char *eol = memchr(start + SLICE_SIZE, '\n', end - (start + SLICE_SIZE));
+            cut = eol ? eol + 1 : end;
+        }
+        window[n].start = start;
+        window[n].end = cut;
+        *pos = cut;
+        n++;
+    }
+    return n;
+}
+
+static void window_start(slice_t *window, size_t n, pthread_t *threads) {
+    if (num_threads > 1) {
+        for (size_t i = 0; i < n; i++) {
+            if (pthread_create(&threads[i], NULL, slice_parse_thread, &window[i]) != 0) {
+                perror("pthread_create");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+}
+
+static void window_finish(slice_t *window, size_t n, pthread_t *threads) {
+    for (size_t i = 0; i < n; i++) {
+        if (num_threads > 1) {
+            pthread_join(threads[i], NULL);
+        } else {
+            slice_parse(&window[i]);
+        }
+    }
+}
+
+// The next window of slices is parsed in parallel while this one's columns are written
+static void decode_map(const char *map, size_t size) {
+    static slice_t windows[2][MAX_THREADS];
+    pthread_t threads[MAX_THREADS];
+    const char *pos = map;
+    const char *end = map + size;
+    int cur = 0;
+
+    size_t n = window_fill(windows[cur], &pos, end);
+    window_start(windows[cur], n, threads);
+    window_finish(windows[cur], n, threads);
+    while (n > 0) {
+        size_t n_next = window_fill(windows[!cur], &pos, end);
+        window_start(windows[!cur], n_next, threads);
+        for (size_t i = 0; i < n; i++) {
+            slice_write(&windows[cur][i]);
+        }
+        window_finish(windows[!cur], n_next, threads);
+        cur = !cur;
+        n = n_next;
+    }
+    for (size_t i = 0; i < MAX_THREADS; i++) {
+        free(windows[0][i].frames);
+        free(windows[1][i].frames);
+        windows[0][i] = (slice_t){0};
+        windows[1][i] = (slice_t){0};
+    }
+}
+
+static void decode_fd(int fd, const char *path) {
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        const char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            perror(path);
+            exit(EXIT_FAILURE);
+        }
+        madvise((void *)map, st.st_size, MADV_SEQUENTIAL | MADV_WILLNEED);
+        decode_map(map, st.st_size);
+        stats.bytes += st.st_size;
+        munmap((void *)map, st.st_size);
+        return;
+    }
+
+    // a pipe, one slice at a time
+    char *buf = malloc(SLICE_SIZE);
+    if (!buf) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    slice_t slice = {0};
+    size_t have = 0;
+    for (;;) {
+        ssize_t n = read(fd, buf + have, SLICE_SIZE - have);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror(path);
+            exit(EXIT_FAILURE);
+        }
+        have += n;
+        stats.bytes += n;
+
+        const char *last_eol = have ? memrchr(buf, '\n', have) : NULL;
+        size_t used = n == 0 ? have : last_eol ? (size_t)(last_eol + 1 - buf) : 0;
+        if (used == 0 && have == SLICE_SIZE) {
+            fprintf(stderr, "%s: line longer than %d bytes\n", path, SLICE_SIZE);
+            exit(EXIT_FAILURE);
+        }
+        slice.start = buf;
+        slice.end = buf + used;
+        slice_parse(&slice);
+        slice_write(&slice);
+        memmove(buf, buf + used, have - used);
+        have -= used;
+        if (n == 0) {
+            break;
+        }
+    }
+    free(slice.frames);
+    free(buf);
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int decode(int argc, char **argv) {
+    hex_init();
+    if (mkdir(out_dir, 0777) != 0 && errno != EEXIST) {
+        perror(out_dir);
+        return EXIT_FAILURE;
+    }
+
+    double start = now_s();
+    if (argc == 0) {
+        decode_fd(STDIN_FILENO, "stdin");
+    }
+    for (int i = 0; i < argc; i++) {
+        int fd = open(argv[i], O_RDONLY);
+        if (fd < 0) {
+            perror(argv[i]);
+            return EXIT_FAILURE;
+        }
+        decode_fd(fd, argv[i]);
+        close(fd);
+    }
+    for (int k = 0; k < PCOL_NUM_KINDS; k++) {
+        for (int b = 0; b < NUM_BOARDS; b++) {
+            for (int id = 0; id < NUM_IDS; id++) {
+                if (streams[k][b][id]) {
+                    if (!streams[k][b][id]->header.sorted) {
+                        fprintf(stderr,
+                                "board 0x%02x %s: capture times go backwards, queries scan "
+                                "every block\n",
+                                b,
+                                streams[k][b][id]->header.stream);
+                    }
+                    stream_close(streams[k][b][id]);
+                    streams[k][b][id] = NULL;
+                }
+            }
+        }
+    }
+    double elapsed = now_s() - start;
+
+    fprintf(stderr,
+            "%llu lines, %.1f MB in %.2f s (%.0f MB/s) into %u files in %s\n",
+            (unsigned long long)stats.lines,
+            stats.bytes / 1e6,
+            elapsed,
+            elapsed > 0 ? stats.bytes / 1e6 / elapsed : 0,
+            stats.files,
+            out_dir);
+    for (int k = 0; k < PCOL_NUM_KINDS; k++) {
+        fprintf(stderr, "  %-9s %llu\n", kind_names[k], (unsigned long long)stats.decoded[k]);
+    }
+    fprintf(stderr,
+            "  other     %llu\n  short     %llu\n  bad lines %llu\n",
+            (unsigned long long)stats.other,
+            (unsigned long long)stats.short_frames,
+            (unsigned long long)stats.bad_lines);
+    return EXIT_SUCCESS;
+}
+
+static void print_row(const pcol_header_t *h, const uint8_t *block, uint32_t r) {
+    int64_t t_us;
+    memcpy(&t_us, block + pcol_col_offset(h, 0) + (size_t)r * 8, 8);
+    printf("%lld.%06lld", (long long)(t_us / 1000000), (long long)(t_us % 1000000));
+    for (uint8_t c = 1; c < h->num_cols; c++) {
+        const uint8_t *v = block + pcol_col_offset(h, c) + (size_t)r * h->col_width[c];
+        if (h->kind == PCOL_STATUS && c == 4) {
+            printf(",%02x%02x%02x%02x", v[0], v[1], v[2], v[3]);
+            continue;
+        }
+        uint32_t value = 0;
+        switch (h->col_width[c]) {
+            case 1:
+                value = v[0];
+                break;
+            case 2: {
+                uint16_t v16;
+                memcpy(&v16, v, 2);
+                value = v16;
+                break;
+            }
+            default:
+                memcpy(&value, v, 4);
+                break;
+        }
+        printf(",%u", value);
+    }
+    printf("\n");
+}
+
+// First row in a sorted block with a time at or after t_us
+static uint32_t lower_bound(const int64_t *t, uint32_t n, int64_t t_us) {
+    uint32_t lo = 0;
+    uint32_t hi = n;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (t[mid] < t_us) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Prints the rows with start_us <= t < end_us as CSV
+static int query(const char *path, int64_t start_us, int64_t end_us) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+    if ((size_t)st.st_size < sizeof(pcol_header_t)) {
+        fprintf(stderr, "%s: not a column file\n", path);
+        return EXIT_FAILURE;
+    }
+    const uint8_t *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+    const pcol_header_t *h = (const pcol_header_t *)map;
+    if (memcmp(h->magic, PCOL_MAGIC, sizeof(h->magic)) != 0 || h->version != PCOL_VERSION ||
+        h->num_cols < 2 || h->num_cols > PCOL_MAX_COLS || h->rows_per_block == 0) {
+        fprintf(stderr, "%s: not a version %d column file\n", path, PCOL_VERSION);
+        return EXIT_FAILURE;
+    }
+    size_t block_size = pcol_block_size(h);
+    size_t num_blocks = (st.st_size - sizeof(*h)) / block_size;
+    const uint8_t *blocks = map + sizeof(*h);
+#define BLOCK(i) ((const pcol_block_t *)(blocks + (i)*block_size))
+
+    // first block that ends at or after the start
+    size_t first = 0;
+    if (h->sorted) {
+        size_t hi = num_blocks;
+        while (first < hi) {
+            size_t mid = first + (hi - first) / 2;
+            if (BLOCK(mid)->t_max_us < start_us) {
+                first = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+    }
+
+    printf("t_s");
+    for (uint8_t c = 1; c < h->num_cols; c++) {
+        printf(",%.*s", PCOL_COL_NAME_LEN, h->col_name[c]);
+    }
+    printf("\n");
+
+    for (size_t i = first; i < num_blocks; i++) {
+        const pcol_block_t *b = BLOCK(i);
+        if (b->t_min_us >= end_us) {
+            if (h->sorted) {
+                break;
+            }
+            continue;
+        }
+        if (b->t_max_us < start_us || b->num_rows > h->rows_per_block) {
+            continue;
+        }
+        const uint8_t *block = (const uint8_t *)b;
+        const int64_t *t = (const int64_t *)(block + pcol_col_offset(h, 0));
+        uint32_t r = h->sorted ? lower_bound(t, b->num_rows, start_us) : 0;
+        for (; r < b->num_rows; r++) {
+            if (t[r] >= end_us) {
+                if (h->sorted) {
+                    break;
+                }
+                continue;
+            }
+            if (t[r] >= start_us) {
+                print_row(h, block, r);
+            }
+        }
+    }
+#undef BLOCK
+
+    munmap((void *)map, st.st_size);
+    close(fd);
+    return EXIT_SUCCESS;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [-o OUT_DIR] [-j THREADS] [candump.log ...]\n"
+            "       %s -q FILE.pcol [-s START_S] [-e END_S]\n",
+            prog,
+            prog);
+    exit(EXIT_FAILURE);
+}
+
+static int64_t parse_arg_time(const char *arg, const char *prog) {
+    int64_t t_us;
+    const char *end = arg + strlen(arg);
+    if (parse_time_us(arg, end, &t_us) != end) {
+        usage(prog);
+    }
+    return t_us;
+}
+
+int main(int argc, char **argv) {
+    const char *query_path = NULL;
+    int64_t start_us = INT64_MIN;
+    int64_t end_us = INT64_MAX;
+    int opt;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    num_threads = cpus < 1 ? 1 : cpus > MAX_THREADS ? MAX_THREADS : (size_t)cpus;
+    while ((opt = getopt(argc, argv, "o:j:q:s:e:")) != -1) {
+        switch (opt) {
+            case 'j':
+                num_threads = strtoul(optarg, NULL, 0);
+                if (num_threads < 1 || num_threads > MAX_THREADS) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'o':
+                out_dir = optarg;
+                break;
+            case 'q':
+                query_path = optarg;
+                break;
+            case 's':
+                start_us = parse_arg_time(optarg, argv[0]);
+                break;
+            case 'e':
+                end_us = parse_arg_time(optarg, argv[0]);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (query_path) {
+        if (optind != argc) {
+            usage(argv[0]);
+        }
+        return query(query_path, start_us, end_us);
+    }
+    return decode(argc - optind, argv + optind);
+}
@@ -0,0 +1,281 @@
+// Round-trip latency and bus load on a live SocketCAN bus, e.g. vcan0 shared by several
+// host simulators (host/propsim_*) and ground-software stand-ins.
+//
+// Pings one board with PROP_CMD_PING at a fixed period and times the PROP_MSG_PONG,
+// while recording every frame on the bus. Afterwards the recorded traffic is replayed
+// through a model of CAN arbitration at the configured bit rate, since vcan itself
+// delivers frames instantly, to estimate bus load and how long each ID waits for the bus.
+//
+//   ./can_latency -i vcan0 -b 0x0b -n 1000 -p 10
+
+#define _GNU_SOURCE
+
+#include <getopt.h>
+#include <net/if.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include "../prop_msg_ids.h"
+
+// from canlib/message_types.h
+#define MSG_DEBUG_MSG 0x180
+#define MSG_TYPE_MASK 0x7e0
+#define BOARD_ID_MASK 0x01f
+
+#define NUM_SIDS 0x800
+
+typedef struct {
+    uint64_t t_ns;
+    uint16_t sid;
+    uint8_t dlc;
+} frame_rec_t;
+
+static frame_rec_t *frames = NULL;
+static size_t num_frames = 0;
+static size_t cap_frames = 0;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void record(uint64_t t_ns, uint16_t sid, uint8_t dlc) {
+    if (num_frames == cap_frames) {
+        cap_frames = cap_frames ? cap_frames * 2 : 4096;
+        frames = realloc(frames, cap_frames * sizeof(*frames));
+        if (!frames) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    frames[num_frames++] = (frame_rec_t){t_ns, sid, dlc};
+}
+
+// Standard data frame with the worst case number of stuff bits, interframe space included
+static uint32_t frame_bits(uint8_t dlc) {
+    uint32_t stuffed = 34 + 8 * dlc;
+    return stuffed + (stuffed - 1) / 4 + 13;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int open_can(const char *iface) {
+    int s = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (s < 0) {
+        perror("socket");
+        exit(EXIT_FAILURE);
+    }
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, iface, IFNAMSIZ - 1);
+    if (ioctl(s, SIOCGIFINDEX, &ifr) < 0) {
+        perror(iface);
+        exit(EXIT_FAILURE);
+    }
+    struct sockaddr_can addr = {.can_family = AF_CAN, .can_ifindex = ifr.ifr_ifindex};
+    if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        exit(EXIT_FAILURE);
+    }
+    // our own pings count towards the bus load too
+    int on = 1;
+    setsockopt(s, SOL_CAN_RAW, CAN_RAW_RECV_OWN_MSGS, &on, sizeof(on));
+    return s;
+}
+
+// Single bus, lowest pending ID wins each time it goes idle
+static void model_arbitration(uint32_t bitrate, double elapsed_s) {
+    static uint64_t wait_sum[NUM_SIDS];
+    static uint64_t wait_max[NUM_SIDS];
+    static uint32_t count[NUM_SIDS];
+    bool *sent = calloc(num_frames, sizeof(bool));
+    uint64_t total_bits = 0;
+    uint64_t bus_free = 0;
+    size_t first_unsent = 0;
+
+    for (size_t done = 0; done < num_frames; done++) {
+        while (sent[first_unsent]) {
+            first_unsent++;
+        }
+        uint64_t t = frames[first_unsent].t_ns > bus_free ? frames[first_unsent].t_ns : bus_free;
+
+        size_t pick = first_unsent;
+        for (size_t i = first_unsent; i < num_frames && frames[i].t_ns <= t; i++) {
+            if (!sent[i] && frames[i].sid < frames[pick].sid) {
+                pick = i;
+            }
+        }
+
+        uint32_t bits = frame_bits(frames[pick].dlc);
+        uint64_t wait = t - frames[pick].t_ns;
+        uint16_t sid = frames[pick].sid;
+        wait_sum[sid] += wait;
+        if (wait > wait_max[sid]) {
+            wait_max[sid] = wait;
+        }
+        count[sid]++;
+        total_bits += bits;
+        bus_free = t + (uint64_t)bits * 1000000000ULL / bitrate;
+        sent[pick] = true;
+    }
+    free(sent);
+
+    printf("bus: %zu frames, %.1f frames/s, %.1f%% load at %u bit/s\n",
+           num_frames,
+           num_frames / elapsed_s,
+           100.0 * total_bits / (elapsed_s * bitrate),
+           bitrate);
+    printf("  sid  board   count   wait mean us   wait max us\n");
+    for (uint32_t sid = 0; sid < NUM_SIDS; sid++) {
+        if (count[sid]) {
+            printf("  %03x   0x%02x  %6u  %13.1f  %12.1f\n",
+                   sid,
+                   sid & BOARD_ID_MASK,
+                   count[sid],
+                   wait_sum[sid] / 1e3 / count[sid],
+                   wait_max[sid] / 1e3);
+        }
+    }
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s -i IFACE -b BOARD [-n COUNT] [-p PERIOD_MS] [-r BITRATE] [-s SOURCE]\n",
+            prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+    const char *iface = NULL;
+    int board = -1;
+    uint32_t count = 100;
+    uint32_t period_ms = 10;
+    uint32_t bitrate = 100000;
+    uint8_t source = 0x1f; // board id the pings are sent from
+
+    int opt;
+    while ((opt = getopt(argc, argv, "i:b:n:p:r:s:")) != -1) {
+        switch (opt) {
+            case 'i':
+                iface = optarg;
+                break;
+            case 'b':
+                board = (int)strtol(optarg, NULL, 0);
+                break;
+            case 'n':
+                count = strtoul(optarg, NULL, 0);
+                break;
+            case 'p':
+                period_ms = strtoul(optarg, NULL, 0);
+                break;
+            case 'r':
+                bitrate = strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                source = (uint8_t)strtoul(optarg, NULL, 0) & BOARD_ID_MASK;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (!iface || board <= 0 || count == 0 || bitrate == 0) {
+        usage(argv[0]);
+    }
+
+    int s = open_can(iface);
+    uint64_t *sent_at = calloc(count, sizeof(uint64_t));
+    uint64_t *rtt = calloc(count, sizeof(uint64_t));
+    uint32_t replies = 0;
+
+    uint64_t start = now_ns();
+    uint64_t next_ping = start;
+    uint32_t pings = 0;
+    // keep listening for a second after the last ping for late replies
+    uint64_t end = start + (uint64_t)count * period_ms * 1000000ULL + 1000000000ULL;
+
+    while (now_ns() < end) {
+        uint64_t t = now_ns();
+        if (pings < count && t >= next_ping) {
+            struct can_frame frame = {.can_id = MSG_DEBUG_MSG | source, .can_dlc = 4};
+            frame.data[0] = PROP_CMD_PING;
+            frame.data[1] = (uint8_t)board;
+            frame.data[2] = (pings >> 8) & 0xff;
+            frame.data[3] = pings & 0xff;
+            sent_at[pings] = now_ns();
+            if (write(s, &frame, sizeof(frame)) == sizeof(frame)) {
+                pings++;
+            }
+            next_ping += (uint64_t)period_ms * 1000000ULL;
+        }
+
+        uint64_t wait_ns = pings < count && next_ping > t ? next_ping - t : 1000000;
+        struct pollfd pfd = {.fd = s, .events = POLLIN};
+        if (poll(&pfd, 1, (int)(wait_ns / 1000000)) <= 0) {
+            continue;
+        }
+
+        struct can_frame frame;
+        while (recv(s, &frame, sizeof(frame), MSG_DONTWAIT) == sizeof(frame)) {
+            uint64_t rx = now_ns();
+            if (frame.can_id & (CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_ERR_FLAG)) {
+                continue;
+            }
+            uint16_t sid = frame.can_id & CAN_SFF_MASK;
+            record(rx, sid, frame.can_dlc);
+
+            if ((sid & MSG_TYPE_MASK) == MSG_DEBUG_MSG && (sid & BOARD_ID_MASK) == board &&
+                frame.can_dlc >= 3 && frame.data[0] == PROP_MSG_PONG) {
+                uint32_t seq = ((uint32_t)frame.data[1] << 8) | frame.data[2];
+                if (seq < pings && rtt[seq] == 0) {
+                    rtt[seq] = rx - sent_at[seq];
+                    replies++;
+                }
+            }
+        }
+    }
+    double elapsed_s = (now_ns() - start) / 1e9;
+
+    uint64_t *sorted = malloc(count * sizeof(uint64_t));
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < pings; i++) {
+        if (rtt[i]) {
+            sorted[n++] = rtt[i];
+        }
+    }
+    qsort(sorted, n, sizeof(uint64_t), cmp_u64);
+
+    printf("ping board 0x%02x: %u sent, %u answered", board, pings, replies);
+    if (n > 0) {
+        printf(", round trip us min %.1f median %.1f p99 %.1f max %.1f",
+               sorted[0] / 1e3,
+               sorted[n / 2] / 1e3,
+               sorted[(n * 99) / 100] / 1e3,
+               sorted[n - 1] / 1e3);
+    }
+    printf("\n");
+
+    model_arbitration(bitrate, elapsed_s);
+
+    free(sorted);
+    free(sent_at);
+    free(rtt);
+    free(frames);
+    close(s);
+    return replies == pings ? 0 : 1;
+}
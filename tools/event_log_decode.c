@@ -0,0 +1,136 @@
+// Decodes event log dumps (PROP_CMD_EVENT_LOG_DUMP) out of a candump -L capture.
+//
+//   candump -L can0 > dump.log
+//   ./event_log_decode < dump.log
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../event_log.h"
+#include "../prop_msg_ids.h"
+
+// from canlib/message_types.h, the low bits of the SID are the board id
+#define MSG_DEBUG_MSG 0x180
+#define MSG_TYPE_MASK 0x7e0
+#define BOARD_ID_MASK 0x01f
+
+// must match enum FAULT_ID in error_checks.h
+static const char *const fault_names[] = {
+    "BATT_UNDER_VOLTAGE", "BATT_OVER_VOLTAGE", "BATT_CRITICAL", "5V_OVER_CURRENT",
+    "12V_OVER_CURRENT",   "VALVE_TIMING",      "SOLENOID",      "PRES_RATE",
+    "CC_OSC",             "VALVE_MISMATCH",    "PRES_LOOP",     "ADC_REF",
+};
+#define NUM_FAULT_NAMES (sizeof(fault_names) / sizeof(fault_names[0]))
+
+static const char *fault_name(uint8_t id) {
+    return id < NUM_FAULT_NAMES ? fault_names[id] : "?";
+}
+
+static void print_reset_cause(uint16_t cause) {
+    printf("STATUS=0x%02x PCON0=0x%02x", cause >> 8, cause & 0xff);
+    if (cause & RESET_CAUSE_STKOVF) printf(" stack-overflow");
+    if (cause & RESET_CAUSE_STKUNF) printf(" stack-underflow");
+    if (!(cause & RESET_CAUSE_nWDTWV)) printf(" wdt-window");
+    if (!(cause & RESET_CAUSE_nRWDT)) printf(" wdt");
+    if (!(cause & RESET_CAUSE_nRMCLR)) printf(" mclr");
+    if (!(cause & RESET_CAUSE_nRI)) printf(" reset-instr");
+    if (!(cause & RESET_CAUSE_nPOR)) printf(" power-on");
+    else if (!(cause & RESET_CAUSE_nBOR)) printf(" brown-out");
+    if (!(cause & RESET_CAUSE_nTO)) printf(" (TO)");
+    if (!(cause & RESET_CAUSE_nPD)) printf(" (PD)");
+}
+
+// rec is bytes [1..7] of the EEPROM record, the sequence number isn't sent
+static void print_record(uint8_t board, const uint8_t *rec) {
+    uint8_t type = rec[0];
+    uint8_t boot = rec[1];
+    uint32_t ms = ((uint32_t)rec[2] << 16) | ((uint32_t)rec[3] << 8) | rec[4];
+    uint16_t arg = ((uint16_t)rec[5] << 8) | rec[6];
+
+    if (type == EVENT_LOG_END) {
+        printf("board 0x%02x: end of log, %u records\n", board, arg);
+        return;
+    }
+
+    printf("board 0x%02x boot %3u %10.3f s  ", board, boot, ms / 1000.0);
+    switch (type) {
+        case EVENT_BOOT:
+            printf("BOOT ");
+            print_reset_cause(arg);
+            break;
+        case EVENT_RESET_REQUEST:
+            printf("RESET_REQUEST %s", arg == RESET_BUS_DEAD  ? "bus dead"
+                                       : arg == RESET_CAN_CMD ? "CAN command"
+                                                              : "?");
+            break;
+        case EVENT_FAULT_RAISED:
+            printf("FAULT_RAISED %s data 0x%02x", fault_name(arg >> 8), arg & 0xff);
+            break;
+        case EVENT_FAULT_CLEARED:
+            printf("FAULT_CLEARED %s", fault_name(arg >> 8));
+            break;
+        case EVENT_SAFE_STATE_ENTER:
+            printf("SAFE_STATE_ENTER %s", arg == SAFE_STATE_CAN_IDLE        ? "CAN idle"
+                                          : arg == SAFE_STATE_BATT_CRITICAL ? "battery critical"
+                                                                            : "?");
+            break;
+        case EVENT_SAFE_STATE_EXIT:
+            printf("SAFE_STATE_EXIT");
+            break;
+        case EVENT_ACTUATORS:
+            printf("ACTUATORS outputs 0x%02x requested 0x%02x", arg >> 8, arg & 0xff);
+            break;
+        case EVENT_CAN_REINIT:
+            printf("CAN_REINIT attempt %u", arg);
+            break;
+        default:
+            printf("unknown type 0x%02x arg 0x%04x", type, arg);
+            break;
+    }
+    printf("\n");
+}
+
+int main(void) {
+    char line[256];
+    unsigned long records = 0;
+
+    while (fgets(line, sizeof(line), stdin)) {
+        // (timestamp) iface SID#DATA
+        char *frame = strchr(line, '#');
+        if (!frame) {
+            continue;
+        }
+        char *sid_start = frame;
+        while (sid_start > line && sid_start[-1] != ' ') {
+            sid_start--;
+        }
+        unsigned long sid = strtoul(sid_start, NULL, 16);
+        if ((sid & MSG_TYPE_MASK) != MSG_DEBUG_MSG) {
+            continue;
+        }
+
+        uint8_t data[8];
+        size_t len = 0;
+        const char *hex = frame + 1;
+        while (len < sizeof(data) && hex[0] && hex[1] && hex[0] != '\n') {
+            char byte[3] = {hex[0], hex[1], 0};
+            data[len++] = (uint8_t)strtoul(byte, NULL, 16);
+            hex += 2;
+        }
+        if (len != PROP_MSG_MAX_PAYLOAD + 1 || data[0] != PROP_MSG_EVENT_LOG) {
+            continue;
+        }
+
+        print_record(sid & BOARD_ID_MASK, data + 1);
+        records++;
+    }
+
+    if (records == 0) {
+        fprintf(stderr, "no event log records found\n");
+        return 1;
+    }
+    return 0;
+}
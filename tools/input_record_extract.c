@@ -0,0 +1,118 @@
+// Pulls an input recording dump (PROP_CMD_INPUT_RECORD) out of a candump -L capture and
+// writes the stream to a file the host build can replay.
+//
+//   candump -L can0 > dump.log
+//   ./input_record_extract -b 0x0b -o inj.rec < dump.log
+//   ./host/propsim_inj --replay inj.rec
+
+#define _GNU_SOURCE
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../prop_msg_ids.h"
+
+// from canlib/message_types.h, the low bits of the SID are the board id
+#define MSG_DEBUG_MSG 0x180
+#define MSG_TYPE_MASK 0x7e0
+#define BOARD_ID_MASK 0x01f
+
+// the board's buffer is far smaller, this only bounds a corrupt offset
+#define MAX_STREAM_LEN 0x10000
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s -b BOARD_ID -o OUT.rec < candump.log\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+    int board = -1;
+    const char *out_path = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "b:o:")) != -1) {
+        switch (opt) {
+            case 'b':
+                board = (int)strtol(optarg, NULL, 0);
+                break;
+            case 'o':
+                out_path = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (board < 0 || !out_path) {
+        usage(argv[0]);
+    }
+
+    static uint8_t stream[MAX_STREAM_LEN];
+    uint32_t expected = 0; // offset of the next chunk
+    bool done = false;
+    char line[256];
+
+    while (!done && fgets(line, sizeof(line), stdin)) {
+        // (timestamp) iface SID#DATA
+        char *frame = strchr(line, '#');
+        if (!frame) {
+            continue;
+        }
+        char *sid_start = frame;
+        while (sid_start > line && sid_start[-1] != ' ') {
+            sid_start--;
+        }
+        unsigned long sid = strtoul(sid_start, NULL, 16);
+        if ((sid & MSG_TYPE_MASK) != MSG_DEBUG_MSG || (int)(sid & BOARD_ID_MASK) != board) {
+            continue;
+        }
+
+        uint8_t data[8];
+        size_t len = 0;
+        const char *hex = frame + 1;
+        while (len < sizeof(data) && hex[0] && hex[1] && hex[0] != '\n') {
+            char byte[3] = {hex[0], hex[1], 0};
+            data[len++] = (uint8_t)strtoul(byte, NULL, 16);
+            hex += 2;
+        }
+        if (len < 3 || data[0] != PROP_MSG_INPUT_RECORD) {
+            continue;
+        }
+
+        uint32_t offset = (uint32_t)data[1] << 8 | data[2];
+        size_t chunk = len - 3;
+        if (offset == 0 && expected != 0) {
+            // a later dump, keep the newest
+            expected = 0;
+        }
+        if (offset != expected) {
+            fprintf(stderr, "missing bytes %u..%u, was a frame dropped?\n", expected, offset);
+            return 1;
+        }
+        if (offset + chunk > MAX_STREAM_LEN) {
+            fprintf(stderr, "offset 0x%x out of range\n", offset);
+            return 1;
+        }
+        if (chunk == 0) {
+            done = true;
+            break;
+        }
+        memcpy(&stream[offset], &data[3], chunk);
+        expected = offset + chunk;
+    }
+
+    if (!done) {
+        fprintf(stderr, "no complete dump from board 0x%02x found\n", board);
+        return 1;
+    }
+
+    FILE *out = fopen(out_path, "wb");
+    if (!out || fwrite(stream, 1, expected, out) != expected || fclose(out) != 0) {
+        perror(out_path);
+        return 1;
+    }
+    fprintf(stderr, "%u bytes\n", expected);
+    return 0;
+}
@@ -0,0 +1,78 @@
+#ifndef PCOL_H
+#define PCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Columnar files written by can_columnar, one per decoded stream: a board's sensor,
+// actuator or board status. Rows are grouped in blocks of rows_per_block, and every block
+// is written full size, padding included, so block k starts at a known offset. Each block
+// header carries the block's time range, so finding a time range in an mmap of the file
+// is a binary search over the block headers and then over one block's time column.
+//
+//   pcol_header_t
+//   block 0: pcol_block_t, column 0[rows_per_block], column 1[rows_per_block], ...
+//   block 1: ...
+//
+// Column 0 is the capture time in microseconds (int64_t), column 1 the board's 24 bit
+// millisecond timestamp (uint32_t), the rest depend on the kind. Host byte order.
+
+#define PCOL_MAGIC "PCOL"
+#define PCOL_VERSION 1
+#define PCOL_ROWS_PER_BLOCK 4096
+#define PCOL_MAX_COLS 8
+#define PCOL_NAME_LEN 32
+#define PCOL_COL_NAME_LEN 16
+
+enum pcol_kind {
+    PCOL_ANALOG, // value (uint16_t)
+    PCOL_ACTUATOR, // state, requested (uint8_t each)
+    PCOL_STATUS, // error code, data length (uint8_t each), data (4 bytes)
+    PCOL_NUM_KINDS
+};
+
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint8_t board;
+    uint8_t kind; // enum pcol_kind
+    uint8_t id; // sensor or actuator id, 0 for board status
+    uint8_t num_cols;
+    uint8_t sorted; // capture times never go backwards, binary search is valid
+    uint8_t reserved;
+    uint32_t rows_per_block;
+    uint64_t num_rows;
+    char stream[PCOL_NAME_LEN];
+    uint8_t col_width[PCOL_MAX_COLS];
+    char col_name[PCOL_MAX_COLS][PCOL_COL_NAME_LEN];
+} pcol_header_t;
+
+typedef struct {
+    uint32_t num_rows;
+    uint32_t reserved;
+    int64_t t_min_us;
+    int64_t t_max_us;
+} pcol_block_t;
+
+static inline size_t pcol_row_size(const pcol_header_t *h) {
+    size_t size = 0;
+    for (uint8_t i = 0; i < h->num_cols; i++) {
+        size += h->col_width[i];
+    }
+    return size;
+}
+
+static inline size_t pcol_block_size(const pcol_header_t *h) {
+    return sizeof(pcol_block_t) + pcol_row_size(h) * h->rows_per_block;
+}
+
+// Offset of column col within a block
+static inline size_t pcol_col_offset(const pcol_header_t *h, uint8_t col) {
+    size_t offset = sizeof(pcol_block_t);
+    for (uint8_t i = 0; i < col; i++) {
+        offset += (size_t)h->col_width[i] * h->rows_per_block;
+    }
+    return offset;
+}
+
+#endif /* PCOL_H */
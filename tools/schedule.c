@@ -0,0 +1,839 @@
+// Reads the main loop schedule out of the firmware sources, see schedule.h
+//
+// Each file is preprocessed once per board: comments and strings are blanked, #define
+// values are collected, and lines in inactive #if branches are blanked too. What is left
+// is scanned as a flat buffer, so calls that span lines need no special handling.
+
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../prop_msg_ids.h"
+#include "message_types.h"
+#include "schedule.h"
+
+#define MAX_DEFINES 256
+#define MAX_COND_DEPTH 32
+#define MAX_FUNCS 128
+#define MAX_FUNC_MSGS 8
+#define MAX_DECIMATIONS 16
+
+#define PERIOD_SUFFIX "_TIME_DIFF_ms"
+
+typedef struct {
+    const char *name;
+    int value;
+} known_t;
+
+#define KNOWN(x) {#x, x}
+#define NUM_KNOWN(table) (sizeof(table) / sizeof(table[0]))
+
+static const known_t known_boards[] = {
+    KNOWN(BOARD_ID_PROPULSION_INJ),
+    KNOWN(BOARD_ID_PROPULSION_VENT),
+};
+static const known_t known_sensors[] = {
+    KNOWN(SENSOR_BATT_VOLT),
+    KNOWN(SENSOR_PRESSURE_OX),
+    KNOWN(SENSOR_PRESSURE_FUEL),
+    KNOWN(SENSOR_PRESSURE_CC),
+    KNOWN(SENSOR_PRESSURE_PNEUMATICS),
+    KNOWN(SENSOR_HALL_OX_INJ),
+    KNOWN(SENSOR_HALL_FUEL_INJ),
+    KNOWN(SENSOR_VENT_TEMP),
+};
+static const known_t known_actuators[] = {
+    KNOWN(ACTUATOR_VENT_VALVE),
+    KNOWN(ACTUATOR_INJECTOR_VALVE),
+    KNOWN(ACTUATOR_FILL_DUMP_VALVE),
+    KNOWN(ACTUATOR_FUEL_INJECTOR),
+    KNOWN(ACTUATOR_OX_INJECTOR),
+};
+
+// board -> ground opcodes of MSG_DEBUG_MSG frames from build_prop_msg()
+static const known_t known_prop_msgs[] = {
+    KNOWN(PROP_MSG_VALVE_TIMING),
+    KNOWN(PROP_MSG_VALVE_TIMING_HISTORY),
+    KNOWN(PROP_MSG_SEQ_STATUS),
+    KNOWN(PROP_MSG_SEQ_STEP_DONE),
+    KNOWN(PROP_MSG_HALL_CAL),
+    KNOWN(PROP_MSG_SOLENOID_SIGNATURE),
+    KNOWN(PROP_MSG_FAULT_COUNTERS),
+    KNOWN(PROP_MSG_EVENT_LOG),
+    KNOWN(PROP_MSG_BOOT_INFO),
+    KNOWN(PROP_MSG_CAN_RECOVERY),
+    KNOWN(PROP_MSG_CAN_ERRORS),
+    KNOWN(PROP_MSG_PONG),
+    KNOWN(PROP_MSG_INPUT_RECORD),
+    KNOWN(PROP_MSG_PRES_STATS),
+    KNOWN(PROP_MSG_CC_OSC),
+    KNOWN(PROP_MSG_VALVE_AGREEMENT),
+    KNOWN(PROP_MSG_PRES_CAL),
+    KNOWN(PROP_MSG_PRES_LOOP),
+    KNOWN(PROP_MSG_ADC_CAL),
+};
+
+typedef struct {
+    const char *fn;
+    uint16_t type;
+    const known_t *ids; // NULL for message types without an id
+    size_t num_ids;
+    const char *id_prefix;
+    uint8_t max_dlc;
+} builder_t;
+
+static const builder_t builders[] = {
+    {"build_analog_data_msg",
+     MSG_SENSOR_ANALOG,
+     known_sensors,
+     NUM_KNOWN(known_sensors),
+     "SENSOR_",
+     6},
+    {"build_actuator_stat_msg",
+     MSG_ACTUATOR_STATUS,
+     known_actuators,
+     NUM_KNOWN(known_actuators),
+     "ACTUATOR_",
+     6},
+    {"build_board_stat_msg", MSG_GENERAL_BOARD_STATUS, NULL, 0, NULL, 8},
+    {"build_debug_msg", MSG_DEBUG_MSG, NULL, 0, NULL, 8},
+    {"build_prop_msg",
+     MSG_DEBUG_MSG,
+     known_prop_msgs,
+     NUM_KNOWN(known_prop_msgs),
+     "PROP_MSG_",
+     PROP_MSG_MAX_PAYLOAD + 1},
+};
+
+typedef struct {
+    char name[SCHED_NAME_LEN];
+    long value;
+} define_t;
+
+// One source file, preprocessed for one board
+typedef struct {
+    const char *path;
+    char *text; // comments and strings blanked
+    char *active; // text with directives and inactive lines blanked too
+    size_t len;
+    define_t defines[MAX_DEFINES];
+    int num_defines;
+} source_t;
+
+typedef struct {
+    const builder_t *builder;
+    int16_t id;
+    const char *id_name;
+} found_msg_t;
+
+// Library functions that build messages, and which ones
+typedef struct {
+    char name[SCHED_NAME_LEN];
+    found_msg_t msgs[MAX_FUNC_MSGS];
+    int num_msgs;
+} func_t;
+
+static func_t funcs[MAX_FUNCS];
+static int num_funcs;
+
+static bool is_ident(char c) {
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+static const known_t *find_known(const known_t *table, size_t n, const char *name, size_t len) {
+    for (size_t i = 0; i < n; i++) {
+        if (strlen(table[i].name) == len && strncmp(table[i].name, name, len) == 0) {
+            return &table[i];
+        }
+    }
+    return NULL;
+}
+
+const char *schedule_msg_name(uint16_t type, int16_t id, char *buf, size_t len) {
+    for (size_t i = 0; i < NUM_KNOWN(builders); i++) {
+        const builder_t *b = &builders[i];
+        if (b->type != type || !b->ids) {
+            continue;
+        }
+        const known_t *k = NULL;
+        for (size_t j = 0; j < b->num_ids; j++) {
+            if (b->ids[j].value == id) {
+                k = &b->ids[j];
+            }
+        }
+        if (k) {
+            snprintf(buf, len, "%s", k->name);
+        } else {
+            snprintf(buf, len, "%s%d", b->id_prefix, id);
+        }
+        return buf;
+    }
+    switch (type) {
+        case MSG_GENERAL_BOARD_STATUS:
+            snprintf(buf, len, "BOARD_STATUS");
+            break;
+        case MSG_DEBUG_MSG:
+            snprintf(buf, len, "DEBUG_MSG 0x%02x", id);
+            break;
+        case MSG_ACTUATOR_CMD:
+            snprintf(buf, len, "ACTUATOR_CMD");
+            break;
+        case MSG_RESET_CMD:
+            snprintf(buf, len, "RESET_CMD");
+            break;
+        default:
+            snprintf(buf, len, "MSG 0x%03x", type);
+            break;
+    }
+    return buf;
+}
+
+bool schedule_load_dir(schedule_t *s, const char *dir) {
+    static const char *const lib_names[] = SCHEDULE_LIBS;
+    const size_t num_libs = sizeof(lib_names) / sizeof(lib_names[0]);
+    char main_path[4096];
+    char lib_paths[sizeof(lib_names) / sizeof(lib_names[0])][4096];
+    const char *libs[sizeof(lib_names) / sizeof(lib_names[0])];
+    snprintf(main_path, sizeof(main_path), "%s/main.c", dir);
+    for (size_t i = 0; i < num_libs; i++) {
+        snprintf(lib_paths[i], sizeof(lib_paths[i]), "%s/%s", dir, lib_names[i]);
+        libs[i] = lib_paths[i];
+    }
+    return schedule_load(s, main_path, libs, (int)num_libs);
+}
+
+const char *schedule_board_name(uint8_t board) {
+    static char buf[16];
+    if (board == BOARD_ID_PROPULSION_INJ) {
+        return "inj";
+    } else if (board == BOARD_ID_PROPULSION_VENT) {
+        return "vent";
+    }
+    snprintf(buf, sizeof(buf), "0x%02x", board);
+    return buf;
+}
+
+static bool source_read(source_t *src, const char *path) {
+    memset(src, 0, sizeof(*src));
+    src->path = path;
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    src->text = malloc(len + 1);
+    src->active = malloc(len + 1);
+    if (!src->text || !src->active || fread(src->text, 1, len, f) != (size_t)len) {
+        perror(path);
+        fclose(f);
+        return false;
+    }
+    fclose(f);
+    src->len = len;
+    src->text[len] = '\0';
+
+    // blank comments and the insides of string and character literals, keep newlines
+    char *t = src->text;
+    for (size_t i = 0; i < src->len; i++) {
+        if (t[i] == '/' && t[i + 1] == '/') {
+            while (i < src->len && t[i] != '\n') {
+                t[i++] = ' ';
+            }
+        } else if (t[i] == '/' && t[i + 1] == '*') {
+            t[i++] = ' ';
+            t[i++] = ' ';
+            while (i < src->len && !(t[i] == '*' && t[i + 1] == '/')) {
+                if (t[i] != '\n') {
+                    t[i] = ' ';
+                }
+                i++;
+            }
+            if (i < src->len) {
+                t[i++] = ' ';
+                t[i] = ' ';
+            }
+        } else if (t[i] == '"' || t[i] == '\'') {
+            char quote = t[i++];
+            while (i < src->len && t[i] != quote && t[i] != '\n') {
+                if (t[i] == '\\' && i + 1 < src->len) {
+                    t[i++] = ' ';
+                }
+                t[i++] = ' ';
+            }
+        }
+    }
+    return true;
+}
+
+static void source_free(source_t *src) {
+    free(src->text);
+    free(src->active);
+}
+
+static const define_t *find_define(const source_t *src, const char *name, size_t len) {
+    for (int i = src->num_defines - 1; i >= 0; i--) {
+        if (strlen(src->defines[i].name) == len && strncmp(src->defines[i].name, name, len) == 0) {
+            return &src->defines[i];
+        }
+    }
+    return NULL;
+}
+
+static const char *skip_space(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '(')) {
+        p++;
+    }
+    return p;
+}
+
+static bool eval_condition(const source_t *src, uint8_t board, const char *p, const char *end) {
+    const char *board_cmp = memmem(p, end - p, "BOARD_UNIQUE_ID", 15);
+    if (board_cmp) {
+        const char *eq = memmem(board_cmp, end - board_cmp, "==", 2);
+        if (eq) {
+            const char *name = skip_space(eq + 2, end);
+            const char *name_end = name;
+            while (name_end < end && is_ident(*name_end)) {
+                name_end++;
+            }
+            const known_t *k =
+                find_known(known_boards, NUM_KNOWN(known_boards), name, name_end - name);
+            return k && k->value == board;
+        }
+        return true;
+    }
+
+    p = skip_space(p, end);
+    bool defined_op = false;
+    if (end - p > 7 && strncmp(p, "defined", 7) == 0) {
+        defined_op = true;
+        p = skip_space(p + 7, end);
+    }
+    const char *name_end = p;
+    while (name_end < end && is_ident(*name_end)) {
+        name_end++;
+    }
+    if (name_end == p) {
+        return true; // not something we can evaluate
+    }
+    for (const char *q = name_end; q < end; q++) {
+        if (*q != ' ' && *q != '\t' && *q != ')' && *q != '\r') {
+            return true; // an expression, assume it is on
+        }
+    }
+    if (isdigit((unsigned char)*p)) {
+        return strtol(p, NULL, 0) != 0;
+    }
+    const define_t *d = find_define(src, p, name_end - p);
+    return defined_op ? d != NULL : d && d->value != 0;
+}
+
+// Blanks directives and inactive lines into src->active, collects the #defines
+static void source_preprocess(source_t *src, uint8_t board) {
+    struct {
+        bool parent_active;
+        bool taken;
+    } cond[MAX_COND_DEPTH];
+    int depth = 0;
+    bool active = true;
+
+    src->num_defines = 0;
+    memcpy(src->active, src->text, src->len + 1);
+
+    char *line = src->text;
+    char *end = src->text + src->len;
+    while (line < end) {
+        char *eol = memchr(line, '\n', end - line);
+        if (!eol) {
+            eol = end;
+        }
+        char *p = line;
+        while (p < eol && (*p == ' ' || *p == '\t')) {
+            p++;
+        }
+
+        bool directive = p < eol && *p == '#';
+        if (directive) {
+            p++;
+            while (p < eol && (*p == ' ' || *p == '\t')) {
+                p++;
+            }
+            char *word = p;
+            while (p < eol && is_ident(*p)) {
+                p++;
+            }
+            size_t word_len = p - word;
+
+            if ((word_len == 2 && strncmp(word, "if", 2) == 0) ||
+                (word_len == 5 && strncmp(word, "ifdef", 5) == 0) ||
+                (word_len == 6 && strncmp(word, "ifndef", 6) == 0)) {
+                bool value = true;
+                if (active) {
+                    value = eval_condition(src, board, p, eol);
+                    if (word_len == 5) {
+                        const char *n = skip_space(p, eol);
+                        const char *n_end = n;
+                        while (n_end < eol && is_ident(*n_end)) {
+                            n_end++;
+                        }
+                        value = find_define(src, n, n_end - n) != NULL;
+                    } else if (word_len == 6) {
+                        const char *n = skip_space(p, eol);
+                        const char *n_end = n;
+                        while (n_end < eol && is_ident(*n_end)) {
+                            n_end++;
+                        }
+                        value = find_define(src, n, n_end - n) == NULL;
+                    }
+                }
+                if (depth < MAX_COND_DEPTH) {
+                    cond[depth].parent_active = active;
+                    cond[depth].taken = active && value;
+                    depth++;
+                }
+                active = active && value;
+            } else if (word_len == 4 && strncmp(word, "elif", 4) == 0 && depth > 0) {
+                bool parent = cond[depth - 1].parent_active;
+                active = parent && !cond[depth - 1].taken && eval_condition(src, board, p, eol);
+                cond[depth - 1].taken |= active;
+            } else if (word_len == 4 && strncmp(word, "else", 4) == 0 && depth > 0) {
+                active = cond[depth - 1].parent_active && !cond[depth - 1].taken;
+                cond[depth - 1].taken = true;
+            } else if (word_len == 5 && strncmp(word, "endif", 5) == 0 && depth > 0) {
+                depth--;
+                active = cond[depth].parent_active;
+            } else if (active && word_len == 6 && strncmp(word, "define", 6) == 0 &&
+                       src->num_defines < MAX_DEFINES) {
+                const char *n = skip_space(p, eol);
+                const char *n_end = n;
+                while (n_end < eol && is_ident(*n_end)) {
+                    n_end++;
+                }
+                const char *v = skip_space(n_end, eol);
+                char *v_end;
+                long value = strtol(v, &v_end, 0);
+                if (n_end > n && (size_t)(n_end - n) < SCHED_NAME_LEN) {
+                    define_t *d = &src->defines[src->num_defines++];
+                    memcpy(d->name, n, n_end - n);
+                    d->name[n_end - n] = '\0';
+                    // non-numeric defines count as defined, with value 1
+                    d->value = v_end > v ? value : 1;
+                }
+            }
+        }
+
+        if (directive || !active) {
+            for (char *q = src->active + (line - src->text); q < src->active + (eol - src->text);
+                 q++) {
+                *q = ' ';
+            }
+        }
+        line = eol + 1;
+    }
+}
+
+// Index of the bracket matching the one at open, or len
+static size_t match(const char *t, size_t len, size_t open) {
+    char o = t[open];
+    char c = o == '(' ? ')' : '}';
+    int depth = 0;
+    for (size_t i = open; i < len; i++) {
+        if (t[i] == o) {
+            depth++;
+        } else if (t[i] == c && --depth == 0) {
+            return i;
+        }
+    }
+    return len;
+}
+
+static size_t next_char(const char *t, size_t len, size_t i) {
+    while (i < len && isspace((unsigned char)t[i])) {
+        i++;
+    }
+    return i;
+}
+
+// The id argument of a builder call with arguments in t[open..close]
+static bool builder_id(const source_t *src, const builder_t *b, size_t open, size_t close,
+                       found_msg_t *out) {
+    out->builder = b;
+    out->id = -1;
+    out->id_name = NULL;
+    if (!b->ids) {
+        return true;
+    }
+    const char *t = src->active;
+    size_t prefix_len = strlen(b->id_prefix);
+    for (size_t i = open; i < close; i++) {
+        if (!is_ident(t[i]) || (i > 0 && is_ident(t[i - 1]))) {
+            continue;
+        }
+        size_t j = i;
+        while (j < close && is_ident(t[j])) {
+            j++;
+        }
+        if (j - i > prefix_len && strncmp(t + i, b->id_prefix, prefix_len) == 0) {
+            const known_t *k = find_known(b->ids, b->num_ids, t + i, j - i);
+            if (k) {
+                out->id = (int16_t)k->value;
+                out->id_name = k->name;
+                return true;
+            }
+        }
+        i = j;
+    }
+    fprintf(stderr,
+            "%s: %s call without a known %s id, add it to schedule.c\n",
+            src->path,
+            b->fn,
+            b->id_prefix);
+    return false;
+}
+
+static const builder_t *find_builder(const char *name, size_t len) {
+    for (size_t i = 0; i < NUM_KNOWN(builders); i++) {
+        if (strlen(builders[i].fn) == len && strncmp(builders[i].fn, name, len) == 0) {
+            return &builders[i];
+        }
+    }
+    return NULL;
+}
+
+static const func_t *find_func(const char *name, size_t len) {
+    for (int i = 0; i < num_funcs; i++) {
+        if (strlen(funcs[i].name) == len && strncmp(funcs[i].name, name, len) == 0) {
+            return &funcs[i];
+        }
+    }
+    return NULL;
+}
+
+// Calls visitor for every builder call in t[start..end), and with follow_funcs for the
+// messages of every library function called there, with the position of the call
+typedef bool (*call_visitor_t)(void *ctx, size_t pos, const found_msg_t *msg);
+
+static bool scan_calls(const source_t *src, size_t start, size_t end, bool follow_funcs,
+                       call_visitor_t visit, void *ctx) {
+    const char *t = src->active;
+    for (size_t i = start; i < end; i++) {
+        if (!is_ident(t[i]) || (i > 0 && is_ident(t[i - 1]))) {
+            continue;
+        }
+        size_t j = i;
+        while (j < end && is_ident(t[j])) {
+            j++;
+        }
+        size_t paren = next_char(t, end, j);
+        if (paren < end && t[paren] == '(') {
+            const builder_t *b = find_builder(t + i, j - i);
+            const func_t *f = follow_funcs ? find_func(t + i, j - i) : NULL;
+            if (b) {
+                found_msg_t msg;
+                if (!builder_id(src, b, paren, match(t, src->len, paren), &msg) ||
+                    !visit(ctx, i, &msg)) {
+                    return false;
+                }
+            } else if (f) {
+                for (int k = 0; k < f->num_msgs; k++) {
+                    if (!visit(ctx, i, &f->msgs[k])) {
+                        return false;
+                    }
+                }
+            }
+        }
+        i = j;
+    }
+    return true;
+}
+
+static bool add_func_msg(void *ctx, size_t pos, const found_msg_t *msg) {
+    (void)pos;
+    func_t *f = ctx;
+    for (int i = 0; i < f->num_msgs; i++) {
+        // one message per call, whichever branch builds it
+        if (f->msgs[i].builder == msg->builder && f->msgs[i].id == msg->id) {
+            return true;
+        }
+    }
+    if (f->num_msgs < MAX_FUNC_MSGS) {
+        f->msgs[f->num_msgs++] = *msg;
+    }
+    return true;
+}
+
+// Records the functions in a library file that build messages themselves. Calls between
+// library functions aren't followed, those are fault reports rather than telemetry.
+static bool scan_library(const source_t *src) {
+    const char *t = src->active;
+    size_t i = 0;
+    while (i < src->len) {
+        if (t[i] != '{') {
+            i++;
+            continue;
+        }
+        size_t close = match(t, src->len, i);
+        // a function body follows "name(args)"
+        size_t k = i;
+        while (k > 0 && isspace((unsigned char)t[k - 1])) {
+            k--;
+        }
+        if (k > 0 && t[k - 1] == ')') {
+            int depth = 0;
+            size_t p = k - 1;
+            for (;; p--) {
+                if (t[p] == ')') {
+                    depth++;
+                } else if (t[p] == '(' && --depth == 0) {
+                    break;
+                }
+                if (p == 0) {
+                    break;
+                }
+            }
+            size_t name_end = p;
+            while (name_end > 0 && isspace((unsigned char)t[name_end - 1])) {
+                name_end--;
+            }
+            size_t name = name_end;
+            while (name > 0 && is_ident(t[name - 1])) {
+                name--;
+            }
+            if (name_end > name && name_end - name < SCHED_NAME_LEN && num_funcs < MAX_FUNCS) {
+                func_t *f = &funcs[num_funcs];
+                memset(f, 0, sizeof(*f));
+                memcpy(f->name, t + name, name_end - name);
+                if (!scan_calls(src, i, close, false, add_func_msg, f)) {
+                    return false;
+                }
+                if (f->num_msgs > 0) {
+                    num_funcs++;
+                }
+            }
+        }
+        i = close + 1;
+    }
+    return true;
+}
+
+typedef struct {
+    schedule_t *s;
+    const source_t *src;
+    uint8_t board;
+    uint8_t task;
+    struct {
+        size_t start;
+        size_t end;
+        uint16_t factor;
+    } decimations[MAX_DECIMATIONS];
+    int num_decimations;
+} task_ctx_t;
+
+static bool add_task_msg(void *ctx, size_t pos, const found_msg_t *msg) {
+    task_ctx_t *c = ctx;
+    schedule_t *s = c->s;
+    if (s->num_msgs >= SCHED_MAX_MSGS) {
+        fprintf(stderr, "%s: more than %d scheduled messages\n", c->src->path, SCHED_MAX_MSGS);
+        return false;
+    }
+    uint16_t decimation = 1;
+    for (int i = 0; i < c->num_decimations; i++) {
+        if (pos > c->decimations[i].start && pos < c->decimations[i].end) {
+            decimation *= c->decimations[i].factor;
+        }
+    }
+    sched_msg_t *m = &s->msgs[s->num_msgs++];
+    memset(m, 0, sizeof(*m));
+    m->board = c->board;
+    m->task = c->task;
+    m->type = msg->builder->type;
+    m->id = msg->id;
+    snprintf(m->id_name, sizeof(m->id_name), "%s", msg->id_name ? msg->id_name : "");
+    m->max_dlc = msg->builder->max_dlc;
+    m->decimation = decimation;
+    m->period_ms = s->tasks[c->task].period_ms * decimation;
+    return true;
+}
+
+// `(x & 0xf) == 0` conditions in the task body and the blocks they guard
+static void find_decimations(task_ctx_t *c, size_t start, size_t end) {
+    const char *t = c->src->active;
+    for (size_t i = start; i + 3 < end && c->num_decimations < MAX_DECIMATIONS; i++) {
+        if (t[i] != '&' || t[i + 1] == '&' || (i > 0 && t[i - 1] == '&')) {
+            continue;
+        }
+        char *num_end;
+        unsigned long mask = strtoul(t + i + 1, &num_end, 0);
+        size_t j = next_char(t, end, num_end - t);
+        if (num_end == t + i + 1 || j >= end || t[j] != ')') {
+            continue;
+        }
+        j = next_char(t, end, j + 1);
+        if (j + 1 >= end || t[j] != '=' || t[j + 1] != '=') {
+            continue;
+        }
+        j = next_char(t, end, j + 2);
+        if (j >= end || t[j] != '0') {
+            continue;
+        }
+        // the mask must be 2^n - 1 for the rate to divide evenly
+        if (mask == 0 || (mask & (mask + 1)) != 0) {
+            continue;
+        }
+        size_t open = j;
+        while (open < end && t[open] != '{') {
+            open++;
+        }
+        if (open < end) {
+            c->decimations[c->num_decimations].start = open;
+            c->decimations[c->num_decimations].end = match(t, c->src->len, open);
+            c->decimations[c->num_decimations].factor = (uint16_t)(mask + 1);
+            c->num_decimations++;
+        }
+    }
+}
+
+// Every `millis() - last > PERIOD` block in the main loop
+static bool scan_main(schedule_t *s, const source_t *src, uint8_t board) {
+    const char *t = src->active;
+    const char *p = t;
+    while ((p = memmem(p, src->len - (p - t), "millis()", 8)) != NULL) {
+        size_t i = next_char(t, src->len, p - t + 8);
+        p += 8;
+        if (i >= src->len || t[i] != '-') {
+            continue;
+        }
+        i = next_char(t, src->len, i + 1);
+        while (i < src->len && is_ident(t[i])) {
+            i++;
+        }
+        i = next_char(t, src->len, i);
+        if (i >= src->len || t[i] != '>' || t[i + 1] == '=') {
+            continue;
+        }
+        i = next_char(t, src->len, i + 1);
+        size_t name = i;
+        while (i < src->len && is_ident(t[i])) {
+            i++;
+        }
+        size_t name_len = i - name;
+        i = next_char(t, src->len, i);
+        if (name_len == 0 || i >= src->len || t[i] != ')') {
+            continue;
+        }
+        size_t open = next_char(t, src->len, i + 1);
+        if (open >= src->len || t[open] != '{') {
+            continue;
+        }
+
+        const define_t *d = find_define(src, t + name, name_len);
+        size_t suffix_len = strlen(PERIOD_SUFFIX);
+        if (!d || name_len <= suffix_len ||
+            strncmp(t + name + name_len - suffix_len, PERIOD_SUFFIX, suffix_len) != 0) {
+            continue; // a timeout, not a periodic task
+        }
+        if (d->value <= 0) {
+            continue;
+        }
+        if (s->num_tasks >= SCHED_MAX_TASKS) {
+            fprintf(stderr, "%s: more than %d tasks\n", src->path, SCHED_MAX_TASKS);
+            return false;
+        }
+        sched_task_t *task = &s->tasks[s->num_tasks];
+        memset(task, 0, sizeof(*task));
+        snprintf(task->name, sizeof(task->name), "%.*s", (int)(name_len - suffix_len), t + name);
+        task->board = board;
+        task->period_ms = (uint32_t)d->value + 1;
+
+        task_ctx_t ctx = {.s = s, .src = src, .board = board, .task = s->num_tasks};
+        size_t close = match(t, src->len, open);
+        s->num_tasks++;
+        find_decimations(&ctx, open, close);
+        if (!scan_calls(src, open, close, true, add_task_msg, &ctx)) {
+            return false;
+        }
+        p = t + open;
+    }
+    return true;
+}
+
+// The boards main.c has sections for
+static bool find_boards(schedule_t *s, const source_t *src) {
+    const char *t = src->text;
+    const char *p = t;
+    while ((p = memmem(p, src->len - (p - t), "BOARD_UNIQUE_ID", 15)) != NULL) {
+        p += 15;
+        const char *q = p;
+        while (*q == ' ' || *q == '\t') {
+            q++;
+        }
+        if (q[0] != '=' || q[1] != '=') {
+            continue;
+        }
+        q = skip_space(q + 2, t + src->len);
+        const char *q_end = q;
+        while (is_ident(*q_end)) {
+            q_end++;
+        }
+        const known_t *k = find_known(known_boards, NUM_KNOWN(known_boards), q, q_end - q);
+        if (!k) {
+            fprintf(stderr,
+                    "%s: unknown board %.*s, add it to schedule.c\n",
+                    src->path,
+                    (int)(q_end - q),
+                    q);
+            return false;
+        }
+        bool seen = false;
+        for (uint8_t i = 0; i < s->num_boards; i++) {
+            seen |= s->boards[i] == k->value;
+        }
+        if (!seen && s->num_boards < SCHED_MAX_BOARDS) {
+            s->boards[s->num_boards++] = (uint8_t)k->value;
+        }
+    }
+    if (s->num_boards == 0) {
+        fprintf(stderr, "%s: no BOARD_UNIQUE_ID sections\n", src->path);
+        return false;
+    }
+    return true;
+}
+
+bool schedule_load(schedule_t *s, const char *main_path, const char *const *lib_paths,
+                   int num_libs) {
+    memset(s, 0, sizeof(*s));
+    source_t *libs = calloc(num_libs > 0 ? num_libs : 1, sizeof(source_t));
+    source_t main_src = {0};
+    bool ok = libs && source_read(&main_src, main_path) && find_boards(s, &main_src);
+    for (int i = 0; ok && i < num_libs; i++) {
+        ok = source_read(&libs[i], lib_paths[i]);
+    }
+
+    for (uint8_t b = 0; ok && b < s->num_boards; b++) {
+        uint8_t board = s->boards[b];
+        num_funcs = 0;
+        for (int i = 0; ok && i < num_libs; i++) {
+            source_preprocess(&libs[i], board);
+            ok = scan_library(&libs[i]);
+        }
+        if (ok) {
+            source_preprocess(&main_src, board);
+            ok = scan_main(s, &main_src, board);
+        }
+    }
+
+    if (libs) {
+        for (int i = 0; i < num_libs; i++) {
+            source_free(&libs[i]);
+        }
+        free(libs);
+    }
+    source_free(&main_src);
+    return ok;
+}
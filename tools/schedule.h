@@ -0,0 +1,76 @@
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// The periodic tasks in the main loop and the telemetry each one sends, read out of the
+// firmware sources for every board, so the host tools check against what the code does
+// rather than a copy of it.
+//
+// A task is an `if (millis() - last > NAME_TIME_DIFF_ms)` block in main.c. It runs every
+// NAME_TIME_DIFF_ms + 1 ms, since the comparison is strict and millis() counts whole
+// milliseconds. Messages are the build_*_msg() calls in the block, and in the functions
+// it calls from the library files (SCHEDULE_LIBS), and an `if ((count & 0xf) == 0)`
+// around a message divides its rate by 16. The #if/#elif on BOARD_UNIQUE_ID and the #if
+// guards on the period macros are evaluated per board.
+
+#define SCHED_MAX_BOARDS 4
+#define SCHED_MAX_TASKS 48
+#define SCHED_MAX_MSGS 96
+#define SCHED_NAME_LEN 48
+
+// Files besides main.c whose functions the main loop calls to send telemetry. Functions
+// that only send on a condition, like pres_loop_report() and hall_detector_report(), would
+// be counted at the full task rate and reported missing by telemetry_stats when quiet, so
+// budget.cfg has them as events instead.
+#define SCHEDULE_LIBS {"adc_cal.c", "error_checks.c", "pres_stats.c"}
+
+typedef struct {
+    char name[SCHED_NAME_LEN]; // period macro without _TIME_DIFF_ms, e.g. PRES_FUEL
+    uint8_t board;
+    uint32_t period_ms;
+} sched_task_t;
+
+typedef struct {
+    uint8_t board;
+    uint8_t task; // index into tasks
+    uint16_t type; // MSG_xxx
+    int16_t id; // sensor or actuator id, -1 for message types without one
+    char id_name[SCHED_NAME_LEN];
+    uint8_t max_dlc;
+    uint16_t decimation;
+    uint32_t period_ms; // task period times the decimation
+} sched_msg_t;
+
+typedef struct {
+    uint8_t boards[SCHED_MAX_BOARDS];
+    uint8_t num_boards;
+    sched_task_t tasks[SCHED_MAX_TASKS];
+    uint8_t num_tasks;
+    sched_msg_t msgs[SCHED_MAX_MSGS];
+    uint8_t num_msgs;
+} schedule_t;
+
+// Reads main_path and the library files. Returns false after printing the reason if a
+// file can't be read or a sensor, actuator or board name isn't known.
+bool schedule_load(schedule_t *s, const char *main_path, const char *const *lib_paths,
+                   int num_libs);
+
+// main.c and SCHEDULE_LIBS in the firmware directory dir
+bool schedule_load_dir(schedule_t *s, const char *dir);
+
+// SENSOR_xxx or ACTUATOR_xxx for messages with an id, otherwise the message type.
+// id is the opcode for MSG_DEBUG_MSG.
+const char *schedule_msg_name(uint16_t type, int16_t id, char *buf, size_t len);
+
+// "inj", "vent", or the id in hex
+const char *schedule_board_name(uint8_t board);
+
+// Standard data frame with the worst case number of stuff bits, interframe space included
+static inline uint32_t can_frame_bits(uint8_t dlc) {
+    uint32_t stuffed = 34 + 8 * dlc;
+    return stuffed + (stuffed - 1) / 4 + 13;
+}
+
+#endif /* SCHEDULE_H */
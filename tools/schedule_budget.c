@@ -0,0 +1,420 @@
+// Worst case CAN bus load and CPU load of every board, from the periodic tasks in main.c
+// and the execution times in budget.cfg. Fails when a board is over its budget.
+//
+//   ./schedule_budget -s .. budget.cfg
+//
+// Bus load assumes every message at its scheduled rate, with the longest data length it
+// is sent with and the worst case bit stuffing. Messages sent on events only count when
+// budget.cfg gives them a worst case rate, replies to commands don't. CPU load is the sum
+// of each task's, interrupt's and event's time over its period. The main loop is
+// cooperative, so a task can also be held up by one run of every other task: the longest
+// loop pass, stretched by the interrupts that run during it, has to fit in the shortest
+// period, or tasks slip.
+//
+// The exit status is 1 if a budget is exceeded, 2 if the firmware or the config can't be
+// read or they don't match.
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "schedule.h"
+
+#define LINE_LEN 256
+#define MAX_TOKENS 8
+#define MAX_EXTRAS 8
+
+// An interrupt, or a message sent on an event, at its worst case rate
+typedef struct {
+    char name[SCHED_NAME_LEN];
+    double hz;
+    double us;
+    uint8_t dlc; // events only
+} extra_t;
+
+typedef struct {
+    double bus_bps; // 0 for no limit
+    double cpu_pct;
+    bool listed;
+    double loop_us;
+    double task_us[SCHED_MAX_TASKS]; // by task index, < 0 if not given
+    extra_t isrs[MAX_EXTRAS];
+    uint8_t num_isrs;
+    extra_t events[MAX_EXTRAS];
+    uint8_t num_events;
+} board_budget_t;
+
+typedef struct {
+    uint32_t bitrate;
+    uint32_t fosc;
+    double bus_bps; // all boards together
+    board_budget_t boards[SCHED_MAX_BOARDS];
+    int num_times;
+    int num_estimates;
+} budget_t;
+
+static int board_index(const schedule_t *s, const char *name) {
+    for (uint8_t b = 0; b < s->num_boards; b++) {
+        if (strcmp(schedule_board_name(s->boards[b]), name) == 0) {
+            return b;
+        }
+    }
+    return -1;
+}
+
+static int task_index(const schedule_t *s, uint8_t board, const char *name) {
+    for (uint8_t t = 0; t < s->num_tasks; t++) {
+        if (s->tasks[t].board == board && strcmp(s->tasks[t].name, name) == 0) {
+            return t;
+        }
+    }
+    return -1;
+}
+
+// "12%" is a percentage of the bitrate, anything else bit/s. Returns false if malformed.
+static bool parse_bus(const char *text, const budget_t *b, double *bps) {
+    char *end;
+    double value = strtod(text, &end);
+    if (end == text || value <= 0) {
+        return false;
+    }
+    if (*end == '%' && end[1] == '\0') {
+        *bps = value / 100 * b->bitrate;
+        return true;
+    }
+    *bps = value;
+    return *end == '\0';
+}
+
+static bool parse_pct(const char *text, double *pct) {
+    char *end;
+    *pct = strtod(text, &end);
+    return end != text && *pct > 0 && *end == '%' && end[1] == '\0';
+}
+
+// Instruction cycles, Fosc / 4, into microseconds. A leading '~' marks an estimate.
+static bool parse_cycles(const char *text, budget_t *b, double *us) {
+    bool estimate = *text == '~';
+    char *end;
+    double cycles = strtod(text + estimate, &end);
+    if (!b->fosc || end == text + estimate || cycles < 0 || *end != '\0') {
+        return false;
+    }
+    *us = cycles * 4e6 / b->fosc;
+    b->num_times++;
+    b->num_estimates += estimate;
+    return true;
+}
+
+static bool parse_hz(const char *text, double *hz) {
+    char *end;
+    *hz = strtod(text, &end);
+    return end != text && *hz > 0 && *end == '\0';
+}
+
+static bool add_extra(extra_t *extras, uint8_t *num, const char *name, const char *hz) {
+    if (*num >= MAX_EXTRAS || strlen(name) >= SCHED_NAME_LEN) {
+        return false;
+    }
+    extra_t *e = &extras[*num];
+    snprintf(e->name, sizeof(e->name), "%s", name);
+    if (!parse_hz(hz, &e->hz)) {
+        return false;
+    }
+    (*num)++;
+    return true;
+}
+
+static bool budget_load(budget_t *b, const schedule_t *s, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    for (uint8_t i = 0; i < SCHED_MAX_BOARDS; i++) {
+        for (uint8_t t = 0; t < SCHED_MAX_TASKS; t++) {
+            b->boards[i].task_us[t] = -1;
+        }
+    }
+
+    char line[LINE_LEN];
+    bool ok = true;
+    for (int num = 1; fgets(line, sizeof(line), f); num++) {
+        char *hash = strchr(line, '#');
+        if (hash) {
+            *hash = '\0';
+        }
+        char *tok[MAX_TOKENS];
+        int n = 0;
+        char *t = strtok(line, " \t\r\n");
+        for (; t && n < MAX_TOKENS; t = strtok(NULL, " \t\r\n")) {
+            tok[n++] = t;
+        }
+        if (n == 0) {
+            continue;
+        }
+
+        // Bus limits given as percentages need the bitrate, and cycle counts the clock, so
+        // those have to come first
+        bool valid = false;
+        if (strcmp(tok[0], "bitrate") == 0 && n == 2) {
+            b->bitrate = strtoul(tok[1], NULL, 0);
+            valid = b->bitrate > 0;
+        } else if (strcmp(tok[0], "fosc") == 0 && n == 2) {
+            b->fosc = strtoul(tok[1], NULL, 0);
+            valid = b->fosc > 0;
+        } else if (strcmp(tok[0], "bus") == 0 && n == 2) {
+            valid = b->bitrate && parse_bus(tok[1], b, &b->bus_bps);
+        } else if (n >= 2 && (strcmp(tok[0], "board") == 0 || strcmp(tok[0], "loop") == 0 ||
+                              strcmp(tok[0], "task") == 0 || strcmp(tok[0], "isr") == 0 ||
+                              strcmp(tok[0], "event") == 0)) {
+            int board = board_index(s, tok[1]);
+            if (board < 0) {
+                fprintf(stderr, "%s:%d: main.c has no board %s\n", path, num, tok[1]);
+                ok = false;
+                continue;
+            }
+            board_budget_t *bb = &b->boards[board];
+            if (strcmp(tok[0], "board") == 0) {
+                valid = b->bitrate && n % 2 == 0;
+                for (int i = 2; valid && i < n; i += 2) {
+                    if (strcmp(tok[i], "bus") == 0) {
+                        valid = parse_bus(tok[i + 1], b, &bb->bus_bps);
+                    } else if (strcmp(tok[i], "cpu") == 0) {
+                        valid = parse_pct(tok[i + 1], &bb->cpu_pct);
+                    } else {
+                        valid = false;
+                    }
+                }
+                bb->listed = true;
+            } else if (strcmp(tok[0], "loop") == 0 && n == 3) {
+                valid = parse_cycles(tok[2], b, &bb->loop_us);
+            } else if (strcmp(tok[0], "isr") == 0 && n == 5) {
+                valid = add_extra(bb->isrs, &bb->num_isrs, tok[2], tok[3]) &&
+                        parse_cycles(tok[4], b, &bb->isrs[bb->num_isrs - 1].us);
+            } else if (strcmp(tok[0], "event") == 0 && n == 6) {
+                unsigned long dlc = strtoul(tok[4], NULL, 0);
+                valid = dlc <= 8 && add_extra(bb->events, &bb->num_events, tok[2], tok[3]) &&
+                        parse_cycles(tok[5], b, &bb->events[bb->num_events - 1].us);
+                if (valid) {
+                    bb->events[bb->num_events - 1].dlc = (uint8_t)dlc;
+                }
+            } else if (strcmp(tok[0], "task") == 0 && n == 4) {
+                int task = task_index(s, s->boards[board], tok[2]);
+                if (task < 0) {
+                    fprintf(stderr,
+                            "%s:%d: main.c has no task %s_TIME_DIFF_ms on %s\n",
+                            path,
+                            num,
+                            tok[2],
+                            tok[1]);
+                    ok = false;
+                    continue;
+                }
+                valid = parse_cycles(tok[3], b, &bb->task_us[task]);
+            }
+        }
+        if (!valid) {
+            fprintf(stderr, "%s:%d: can't parse this line\n", path, num);
+            ok = false;
+        }
+    }
+    fclose(f);
+
+    if (ok && b->bitrate == 0) {
+        fprintf(stderr, "%s: no bitrate\n", path);
+        ok = false;
+    }
+    if (ok && b->fosc == 0) {
+        fprintf(stderr, "%s: no fosc\n", path);
+        ok = false;
+    }
+    for (uint8_t i = 0; ok && i < s->num_boards; i++) {
+        if (!b->boards[i].listed) {
+            fprintf(stderr, "%s: no budget for board %s\n", path,
+                    schedule_board_name(s->boards[i]));
+            ok = false;
+        }
+    }
+    for (uint8_t t = 0; ok && t < s->num_tasks; t++) {
+        int board = board_index(s, schedule_board_name(s->tasks[t].board));
+        if (b->boards[board].task_us[t] < 0) {
+            fprintf(stderr,
+                    "%s: no execution time for task %s %s\n",
+                    path,
+                    schedule_board_name(s->tasks[t].board),
+                    s->tasks[t].name);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+static const char *verdict(double value, double limit) {
+    if (limit <= 0) {
+        return "";
+    }
+    return value > limit ? "OVER" : "ok";
+}
+
+// Returns the number of budgets exceeded
+static int check(const schedule_t *s, const budget_t *b) {
+    int over = 0;
+    double total_bps = 0;
+
+    for (uint8_t i = 0; i < s->num_boards; i++) {
+        uint8_t board = s->boards[i];
+        const board_budget_t *bb = &b->boards[i];
+        const char *name = schedule_board_name(board);
+
+        printf("%s\n", name);
+        printf("  %-32s %9s %11s %9s\n", "message", "period ms", "worst bit/s", "bus %");
+        double bps = 0;
+        for (uint8_t m = 0; m < s->num_msgs; m++) {
+            const sched_msg_t *msg = &s->msgs[m];
+            if (msg->board != board) {
+                continue;
+            }
+            char msg_name[SCHED_NAME_LEN + 16];
+            double msg_bps = can_frame_bits(msg->max_dlc) * 1000.0 / msg->period_ms;
+            printf("  %-32s %9u %11.0f %8.2f%%\n",
+                   schedule_msg_name(msg->type, msg->id, msg_name, sizeof(msg_name)),
+                   msg->period_ms,
+                   msg_bps,
+                   msg_bps * 100 / b->bitrate);
+            bps += msg_bps;
+        }
+        for (uint8_t e = 0; e < bb->num_events; e++) {
+            const extra_t *ev = &bb->events[e];
+            char ev_name[SCHED_NAME_LEN + 16];
+            double ev_bps = can_frame_bits(ev->dlc) * ev->hz;
+            snprintf(ev_name, sizeof(ev_name), "%s (event)", ev->name);
+            printf("  %-32s %9.0f %11.0f %8.2f%%\n",
+                   ev_name,
+                   1000 / ev->hz,
+                   ev_bps,
+                   ev_bps * 100 / b->bitrate);
+            bps += ev_bps;
+        }
+
+        printf("  %-32s %9s %11s %9s\n", "task", "period ms", "time us", "cpu %");
+        double cpu = 0;
+        double pass_us = bb->loop_us;
+        uint32_t shortest_ms = 0;
+        for (uint8_t t = 0; t < s->num_tasks; t++) {
+            const sched_task_t *task = &s->tasks[t];
+            if (task->board != board) {
+                continue;
+            }
+            double task_cpu = bb->task_us[t] / (task->period_ms * 1000.0);
+            printf("  %-32s %9u %11.0f %8.2f%%\n",
+                   task->name,
+                   task->period_ms,
+                   bb->task_us[t],
+                   task_cpu * 100);
+            cpu += task_cpu;
+            pass_us += bb->task_us[t];
+            if (shortest_ms == 0 || task->period_ms < shortest_ms) {
+                shortest_ms = task->period_ms;
+            }
+        }
+        // events are handled in the main loop, one per pass at most
+        for (uint8_t e = 0; e < bb->num_events; e++) {
+            const extra_t *ev = &bb->events[e];
+            char ev_name[SCHED_NAME_LEN + 16];
+            double ev_cpu = ev->us * ev->hz / 1e6;
+            snprintf(ev_name, sizeof(ev_name), "%s (event)", ev->name);
+            printf("  %-32s %9.0f %11.0f %8.2f%%\n", ev_name, 1000 / ev->hz, ev->us, ev_cpu * 100);
+            cpu += ev_cpu;
+            pass_us += ev->us;
+        }
+
+        printf("  %-32s %9s %11s %9s\n", "interrupt", "rate Hz", "time us", "cpu %");
+        double isr_cpu = 0;
+        for (uint8_t i = 0; i < bb->num_isrs; i++) {
+            const extra_t *isr = &bb->isrs[i];
+            double cpu_share = isr->us * isr->hz / 1e6;
+            printf("  %-32s %9.0f %11.0f %8.2f%%\n", isr->name, isr->hz, isr->us, cpu_share * 100);
+            isr_cpu += cpu_share;
+        }
+        cpu += isr_cpu;
+        // the main loop only gets what the interrupts leave
+        pass_us = isr_cpu < 1 ? pass_us / (1 - isr_cpu) : 1e12;
+
+        double bus_limit = bb->bus_bps;
+        double cpu_limit = bb->cpu_pct / 100;
+        const char *bus_verdict = verdict(bps, bus_limit);
+        const char *cpu_verdict = verdict(cpu, cpu_limit);
+        const char *pass_verdict = verdict(pass_us, shortest_ms * 1000.0);
+        printf("  bus  %8.0f bit/s %6.2f%%", bps, bps * 100 / b->bitrate);
+        if (bus_limit > 0) {
+            printf("  budget %.0f bit/s  %s", bus_limit, bus_verdict);
+        }
+        printf("\n  cpu  %15.2f%%", cpu * 100);
+        if (cpu_limit > 0) {
+            printf("  budget %.2f%%  %s", cpu_limit * 100, cpu_verdict);
+        }
+        printf("\n  loop %12.0f us   longest pass, shortest period %u ms  %s\n\n",
+               pass_us,
+               shortest_ms,
+               pass_verdict);
+        over += strcmp(bus_verdict, "OVER") == 0;
+        over += strcmp(cpu_verdict, "OVER") == 0;
+        over += strcmp(pass_verdict, "OVER") == 0;
+        total_bps += bps;
+    }
+
+    const char *total_verdict = verdict(total_bps, b->bus_bps);
+    printf("all boards  bus %.0f bit/s %.2f%% of %u", total_bps, total_bps * 100 / b->bitrate,
+           b->bitrate);
+    if (b->bus_bps > 0) {
+        printf("  budget %.0f bit/s  %s", b->bus_bps, total_verdict);
+    }
+    printf("\n");
+    over += strcmp(total_verdict, "OVER") == 0;
+
+    if (b->num_estimates) {
+        printf("\n%d of %d times are estimates (~), measure them\n", b->num_estimates,
+               b->num_times);
+    }
+    if (over) {
+        printf("\n%d budget%s exceeded\n", over, over == 1 ? "" : "s");
+    }
+    return over;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-s FIRMWARE_DIR] budget.cfg\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+    const char *firmware_dir = "..";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:")) != -1) {
+        switch (opt) {
+            case 's':
+                firmware_dir = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+    }
+
+    static schedule_t sched;
+    static budget_t budget;
+    if (!schedule_load_dir(&sched, firmware_dir) ||
+        !budget_load(&budget, &sched, argv[optind])) {
+        return 2;
+    }
+    return check(&sched, &budget) ? 1 : 0;
+}
@@ -0,0 +1,807 @@
+// Rate, inter-arrival jitter, gaps and bus load of every telemetry stream in candump -L
+// captures or on a live SocketCAN bus, checked against the schedule in main.c.
+//
+//   ./telemetry_stats -s .. coldflow-*.log
+//   ./telemetry_stats -s .. -i vcan0 -d 60
+//
+// A stream is a (board, message type, sensor or actuator id) triple, or the opcode for
+// debug messages. Intervals go into a log-scale histogram (under 1% error), so memory
+// doesn't grow with the capture and a day of logs takes seconds. Several files are
+// separate sessions: the time between them is not a gap and doesn't count towards rates.
+//
+// Streams main.c schedules are flagged when their rate is off by more than -t percent,
+// the 99th percentile of |interval - period| is more than -j percent of the period, an
+// interval is more than -g periods long, or a board is heard but the stream isn't.
+// Streams several tasks send share an opcode, so only their rate and gaps are checked.
+// The exit status is 1 if anything was flagged.
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <math.h>
+#include <net/if.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include "message_types.h"
+#include "schedule.h"
+
+// the low bits of the SID are the board id
+#define SID_TYPE_MASK 0x7e0
+#define SID_BOARD_MASK 0x01f
+#define NUM_SIDS 0x800
+#define NUM_BOARDS (SID_BOARD_MASK + 1)
+
+// Interval histogram in microseconds: exact below 2048, then 1024 bins per power of two
+#define HIST_SUB_BITS 10
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_EXACT (2 * HIST_SUB)
+#define HIST_MAX_SHIFT 30 // about 38 hours
+#define HIST_BINS (HIST_EXACT + HIST_MAX_SHIFT * HIST_SUB)
+
+#define NUM_LONGEST 3
+
+#define READ_CHUNK_SIZE (16 * 1024 * 1024)
+
+typedef struct {
+    int64_t start_us;
+    int64_t len_us;
+} gap_t;
+
+typedef struct {
+    uint16_t sid;
+    int16_t id;
+    uint64_t frames;
+    uint64_t intervals;
+    uint64_t bits;
+    int64_t span_us; // closed sessions
+    int64_t session_first_us;
+    int64_t last_us;
+    uint32_t session;
+    gap_t longest[NUM_LONGEST]; // longest first
+    double period_us; // scheduled period, 0 if main.c doesn't send it
+    double sender_period_us; // longest period of the tasks sending it
+    uint8_t senders; // tasks sending it
+    uint32_t hist[HIST_BINS]; // intervals
+    uint32_t dev_hist[HIST_BINS]; // |interval - period| for scheduled streams
+} stream_t;
+
+// streams are keyed by SID and id byte
+static stream_t *streams[NUM_SIDS][256];
+static stream_t **stream_list;
+static size_t num_streams;
+static size_t cap_streams;
+
+static uint32_t session; // one per file, starts at 1
+static int64_t session_first_us;
+static int64_t session_last_us;
+static bool session_empty = true;
+static int64_t total_span_us;
+static uint64_t board_bits[NUM_BOARDS];
+static uint64_t board_frames[NUM_BOARDS];
+static uint64_t total_frames;
+static uint64_t bad_lines;
+
+static const schedule_t *sched; // NULL without -s
+
+static volatile sig_atomic_t stop;
+
+static int8_t hex_val[256];
+
+static void hex_init(void) {
+    memset(hex_val, -1, sizeof(hex_val));
+    for (int i = 0; i < 10; i++) {
+        hex_val['0' + i] = (int8_t)i;
+    }
+    for (int i = 0; i < 6; i++) {
+        hex_val['a' + i] = (int8_t)(10 + i);
+        hex_val['A' + i] = (int8_t)(10 + i);
+    }
+}
+
+static uint32_t hist_bin(uint64_t us) {
+    if (us < HIST_EXACT) {
+        return (uint32_t)us;
+    }
+    int msb = 63 - __builtin_clzll(us);
+    int shift = msb - HIST_SUB_BITS;
+    if (shift > HIST_MAX_SHIFT) {
+        return HIST_BINS - 1;
+    }
+    uint32_t mantissa = (uint32_t)(us >> shift) - HIST_SUB;
+    return HIST_EXACT + (shift - 1) * HIST_SUB + mantissa;
+}
+
+// Middle of the bin, in microseconds
+static double hist_value(uint32_t bin) {
+    if (bin < HIST_EXACT) {
+        return bin;
+    }
+    uint32_t shift = (bin - HIST_EXACT) / HIST_SUB + 1;
+    uint64_t mantissa = (bin - HIST_EXACT) % HIST_SUB + HIST_SUB;
+    return (double)(mantissa << shift) + ((1ULL << shift) - 1) / 2.0;
+}
+
+// Expected period of a stream from the schedule, left 0 if main.c doesn't send it. A
+// stream sent by several tasks, like one opcode for several sensors, arrives at the sum
+// of their rates but not evenly spaced, so only its rate and gaps can be checked.
+static void stream_schedule(stream_t *s, uint8_t board, uint16_t type, int16_t id) {
+    if (!sched) {
+        return;
+    }
+    double rate = 0;
+    for (uint8_t i = 0; i < sched->num_msgs; i++) {
+        const sched_msg_t *m = &sched->msgs[i];
+        if (m->board == board && m->type == type && (m->id < 0 || m->id == id)) {
+            rate += 1.0 / m->period_ms;
+            if (m->period_ms * 1000.0 > s->sender_period_us) {
+                s->sender_period_us = m->period_ms * 1000.0;
+            }
+            s->senders++;
+        }
+    }
+    if (rate > 0) {
+        s->period_us = 1000 / rate;
+    }
+}
+
+static stream_t *stream_get(uint16_t sid, uint8_t id) {
+    stream_t *s = streams[sid][id];
+    if (s) {
+        return s;
+    }
+    s = calloc(1, sizeof(*s));
+    if (!s) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    s->sid = sid;
+    s->id = id;
+    stream_schedule(s, sid & SID_BOARD_MASK, sid & SID_TYPE_MASK, id);
+    streams[sid][id] = s;
+    if (num_streams == cap_streams) {
+        cap_streams = cap_streams ? cap_streams * 2 : 64;
+        stream_list = realloc(stream_list, cap_streams * sizeof(*stream_list));
+        if (!stream_list) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    stream_list[num_streams++] = s;
+    return s;
+}
+
+static void session_start(void) {
+    if (!session_empty) {
+        total_span_us += session_last_us - session_first_us;
+    }
+    session++;
+    session_empty = true;
+}
+
+static void record_gap(stream_t *s, int64_t start_us, int64_t len_us) {
+    if (len_us <= s->longest[NUM_LONGEST - 1].len_us) {
+        return;
+    }
+    int i = NUM_LONGEST - 1;
+    while (i > 0 && s->longest[i - 1].len_us < len_us) {
+        s->longest[i] = s->longest[i - 1];
+        i--;
+    }
+    s->longest[i] = (gap_t){start_us, len_us};
+}
+
+static void record_frame(int64_t t_us, uint16_t sid, const uint8_t *data, uint8_t len) {
+    uint16_t type = sid & SID_TYPE_MASK;
+    uint8_t board = sid & SID_BOARD_MASK;
+    uint8_t id = 0;
+    if ((type == MSG_SENSOR_ANALOG || type == MSG_ACTUATOR_STATUS) && len >= 4) {
+        id = data[3];
+    } else if (type == MSG_DEBUG_MSG && len >= 1) {
+        id = data[0];
+    }
+
+    if (session_empty) {
+        session_first_us = t_us;
+        session_empty = false;
+    }
+    session_last_us = t_us;
+
+    uint32_t bits = can_frame_bits(len);
+    board_bits[board] += bits;
+    board_frames[board]++;
+    total_frames++;
+
+    stream_t *s = stream_get(sid, id);
+    s->frames++;
+    s->bits += bits;
+    if (s->session != session) {
+        if (s->session != 0) {
+            s->span_us += s->last_us - s->session_first_us;
+        }
+        s->session = session;
+        s->session_first_us = t_us;
+    } else {
+        int64_t interval = t_us - s->last_us;
+        if (interval < 0) {
+            interval = 0;
+        }
+        s->hist[hist_bin((uint64_t)interval)]++;
+        if (s->senders == 1) {
+            s->dev_hist[hist_bin((uint64_t)llabs(interval - (int64_t)s->period_us))]++;
+        }
+        s->intervals++;
+        record_gap(s, s->last_us, interval);
+    }
+    s->last_us = t_us;
+}
+
+// seconds[.fraction], to microseconds. Returns NULL if there are no digits.
+static const char *parse_time_us(const char *p, const char *end, int64_t *t_us) {
+    const char *start = p;
+    int64_t sec = 0;
+    while (p < end && (unsigned)(*p - '0') < 10) {
+        sec = sec * 10 + (*p++ - '0');
+    }
+    int64_t us = 0;
+    int digits = 0;
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && (unsigned)(*p - '0') < 10) {
+            if (digits < 6) {
+                us = us * 10 + (*p - '0');
+                digits++;
+            }
+            p++;
+        }
+    }
+    if (p == start) {
+        return NULL;
+    }
+    for (; digits < 6; digits++) {
+        us *= 10;
+    }
+    *t_us = sec * 1000000 + us;
+    return p;
+}
+
+// (seconds.micros) iface SID#DATA
+static void parse_line(const char *p, const char *eol) {
+    int64_t t_us;
+    if (p >= eol || *p != '(' || !(p = parse_time_us(p + 1, eol, &t_us)) || p >= eol ||
+        *p != ')') {
+        bad_lines++;
+        return;
+    }
+    p++;
+    while (p < eol && *p == ' ') {
+        p++;
+    }
+    while (p < eol && *p != ' ') {
+        p++;
+    }
+    while (p < eol && *p == ' ') {
+        p++;
+    }
+    const char *sid_start = p;
+    uint32_t sid = 0;
+    while (p < eol && hex_val[(uint8_t)*p] >= 0) {
+        sid = (sid << 4) | (uint32_t)hex_val[(uint8_t)*p++];
+    }
+    if (p >= eol || *p != '#' || p - sid_start != 3) {
+        // 29 bit IDs aren't ours
+        bad_lines += p >= eol || *p != '#';
+        return;
+    }
+    p++;
+    uint8_t data[8];
+    uint8_t len = 0;
+    while (len < sizeof(data) && p + 1 < eol) {
+        int8_t hi = hex_val[(uint8_t)p[0]];
+        int8_t lo = hex_val[(uint8_t)p[1]];
+        if (hi < 0 || lo < 0) {
+            break;
+        }
+        data[len++] = (uint8_t)((hi << 4) | lo);
+        p += 2;
+    }
+    record_frame(t_us, (uint16_t)sid, data, len);
+}
+
+static size_t parse_buf(const char *buf, size_t len, bool last) {
+    const char *p = buf;
+    const char *end = buf + len;
+    while (p < end) {
+        const char *eol = memchr(p, '\n', end - p);
+        if (!eol) {
+            if (!last) {
+                break;
+            }
+            eol = end;
+        }
+        parse_line(p, eol);
+        p = eol + 1;
+    }
+    return p > end ? len : (size_t)(p - buf);
+}
+
+static void read_log(int fd, const char *path) {
+    session_start();
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        const char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            perror(path);
+            exit(EXIT_FAILURE);
+        }
+        madvise((void *)map, st.st_size, MADV_SEQUENTIAL);
+        parse_buf(map, st.st_size, true);
+        munmap((void *)map, st.st_size);
+        return;
+    }
+
+    char *buf = malloc(READ_CHUNK_SIZE);
+    if (!buf) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    size_t have = 0;
+    for (;;) {
+        ssize_t n = read(fd, buf + have, READ_CHUNK_SIZE - have);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror(path);
+            exit(EXIT_FAILURE);
+        }
+        have += n;
+        size_t used = parse_buf(buf, have, n == 0);
+        if (used == 0 && have == READ_CHUNK_SIZE) {
+            fprintf(stderr, "%s: line longer than %d bytes\n", path, READ_CHUNK_SIZE);
+            exit(EXIT_FAILURE);
+        }
+        memmove(buf, buf + used, have - used);
+        have -= used;
+        if (n == 0) {
+            break;
+        }
+    }
+    free(buf);
+}
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+static void read_live(const char *iface, double duration_s) {
+    int s = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (s < 0) {
+        perror("socket");
+        exit(EXIT_FAILURE);
+    }
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, iface, IFNAMSIZ - 1);
+    if (ioctl(s, SIOCGIFINDEX, &ifr) < 0) {
+        perror(iface);
+        exit(EXIT_FAILURE);
+    }
+    struct sockaddr_can addr = {.can_family = AF_CAN, .can_ifindex = ifr.ifr_ifindex};
+    if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        exit(EXIT_FAILURE);
+    }
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    session_start();
+    struct timespec start;
+    clock_gettime(CLOCK_REALTIME, &start);
+    while (!stop) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        double elapsed = (ts.tv_sec - start.tv_sec) + (ts.tv_nsec - start.tv_nsec) / 1e9;
+        if (duration_s > 0 && elapsed >= duration_s) {
+            break;
+        }
+        struct pollfd pfd = {.fd = s, .events = POLLIN};
+        if (poll(&pfd, 1, 100) <= 0) {
+            continue;
+        }
+        struct can_frame frame;
+        while (recv(s, &frame, sizeof(frame), MSG_DONTWAIT) == sizeof(frame)) {
+            if (frame.can_id & (CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_ERR_FLAG)) {
+                continue;
+            }
+            clock_gettime(CLOCK_REALTIME, &ts);
+            int64_t t_us = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+            uint8_t len = frame.can_dlc > 8 ? 8 : frame.can_dlc;
+            record_frame(t_us, frame.can_id & CAN_SFF_MASK, frame.data, len);
+        }
+    }
+    close(s);
+}
+
+// Value in microseconds at percentile pct of a histogram of n values
+static double hist_percentile(const uint32_t *hist, uint64_t n, double pct) {
+    uint64_t target = (uint64_t)ceil(n * pct / 100.0);
+    if (target == 0) {
+        target = 1;
+    }
+    uint64_t seen = 0;
+    for (uint32_t b = 0; b < HIST_BINS; b++) {
+        seen += hist[b];
+        if (seen >= target) {
+            return hist_value(b);
+        }
+    }
+    return 0;
+}
+
+typedef struct {
+    double dev;
+    uint32_t count;
+} deviation_t;
+
+static int cmp_dev(const void *a, const void *b) {
+    double x = ((const deviation_t *)a)->dev;
+    double y = ((const deviation_t *)b)->dev;
+    return (x > y) - (x < y);
+}
+
+// Bins report their midpoint, which can be past the longest interval seen
+static double percentile(const stream_t *s, double pct) {
+    double value = hist_percentile(s->hist, s->intervals, pct);
+    double longest = (double)s->longest[0].len_us;
+    return value > longest ? longest : value;
+}
+
+// Percentiles of |interval - nominal|, in microseconds. Scheduled streams keep their own
+// histogram of that, for the rest it is worked out from the intervals with the median as
+// the nominal.
+static void jitter(const stream_t *s, double nominal, double *p50, double *p99) {
+    if (s->senders == 1) {
+        *p50 = hist_percentile(s->dev_hist, s->intervals, 50);
+        *p99 = hist_percentile(s->dev_hist, s->intervals, 99);
+        return;
+    }
+    static deviation_t devs[HIST_BINS];
+    uint32_t n = 0;
+    for (uint32_t b = 0; b < HIST_BINS; b++) {
+        if (s->hist[b]) {
+            devs[n].dev = fabs(hist_value(b) - nominal);
+            devs[n].count = s->hist[b];
+            n++;
+        }
+    }
+    qsort(devs, n, sizeof(devs[0]), cmp_dev);
+    uint64_t t50 = (s->intervals + 1) / 2;
+    uint64_t t99 = (uint64_t)ceil(s->intervals * 0.99);
+    uint64_t seen = 0;
+    *p50 = *p99 = 0;
+    bool have50 = false;
+    for (uint32_t i = 0; i < n; i++) {
+        seen += devs[i].count;
+        if (!have50 && seen >= t50) {
+            *p50 = devs[i].dev;
+            have50 = true;
+        }
+        if (seen >= t99) {
+            *p99 = devs[i].dev;
+            break;
+        }
+    }
+}
+
+static uint64_t count_longer(const stream_t *s, double us) {
+    uint64_t n = 0;
+    for (uint32_t b = hist_bin((uint64_t)us); b < HIST_BINS; b++) {
+        if (hist_value(b) > us) {
+            n += s->hist[b];
+        }
+    }
+    return n;
+}
+
+static int cmp_stream(const void *a, const void *b) {
+    const stream_t *x = *(stream_t *const *)a;
+    const stream_t *y = *(stream_t *const *)b;
+    int bx = x->sid & SID_BOARD_MASK;
+    int by = y->sid & SID_BOARD_MASK;
+    if (bx != by) {
+        return bx - by;
+    }
+    if (x->sid != y->sid) {
+        return x->sid - y->sid;
+    }
+    return x->id - y->id;
+}
+
+typedef struct {
+    double rate_tol;
+    double jitter_tol;
+    double gap_factor;
+    uint32_t bitrate;
+} limits_t;
+
+static bool board_heard(uint8_t board) {
+    return board_frames[board & SID_BOARD_MASK] > 0;
+}
+
+static int report(const limits_t *lim) {
+    // every stream's last session is still open
+    for (size_t i = 0; i < num_streams; i++) {
+        stream_t *s = stream_list[i];
+        s->span_us += s->last_us - s->session_first_us;
+    }
+    session_start();
+    double span_s = total_span_us / 1e6;
+    int flagged = 0;
+    char name[64];
+
+    printf("%llu frames over %.1f s",
+           (unsigned long long)total_frames,
+           span_s);
+    if (bad_lines) {
+        printf(", %llu unreadable lines", (unsigned long long)bad_lines);
+    }
+    printf("\n\nbus load at %u bit/s\n", lim->bitrate);
+    uint64_t all_bits = 0;
+    for (int b = 0; b < NUM_BOARDS; b++) {
+        if (board_frames[b] && span_s > 0) {
+            printf("  %-5s %8.1f frames/s %9.0f bit/s %6.2f%%\n",
+                   schedule_board_name(b),
+                   board_frames[b] / span_s,
+                   board_bits[b] / span_s,
+                   100.0 * board_bits[b] / span_s / lim->bitrate);
+            all_bits += board_bits[b];
+        }
+    }
+    if (span_s > 0) {
+        printf("  total %8.1f frames/s %9.0f bit/s %6.2f%%\n",
+               total_frames / span_s,
+               all_bits / span_s,
+               100.0 * all_bits / span_s / lim->bitrate);
+    }
+
+    qsort(stream_list, num_streams, sizeof(*stream_list), cmp_stream);
+    printf("\n%-5s %-28s %9s %8s %8s %8s %8s %8s %8s %8s %8s %6s  %s\n",
+           "board",
+           "stream",
+           "frames",
+           "rate Hz",
+           "sched Hz",
+           "p1 ms",
+           "p50 ms",
+           "p99 ms",
+           "max ms",
+           "jit50 ms",
+           "jit99 ms",
+           "gaps",
+           "status");
+
+    for (size_t i = 0; i < num_streams; i++) {
+        const stream_t *s = stream_list[i];
+        uint8_t board = s->sid & SID_BOARD_MASK;
+        uint16_t type = s->sid & SID_TYPE_MASK;
+        double period_ms = s->period_us / 1000;
+        double span = s->span_us / 1e6;
+        double rate = span > 0 ? s->intervals / span : 0;
+        double p50 = s->intervals ? percentile(s, 50) : 0;
+        double nominal_us = s->senders == 1 ? s->period_us : p50;
+        double gap_us = period_ms > 0 ? s->sender_period_us : p50;
+        double jit50 = 0;
+        double jit99 = 0;
+        if (s->intervals) {
+            jitter(s, nominal_us, &jit50, &jit99);
+        }
+        uint64_t gaps = s->intervals ? count_longer(s, gap_us * lim->gap_factor) : 0;
+
+        char status[64] = "";
+        if (period_ms > 0) {
+            double expected_rate = 1000.0 / period_ms;
+            if (rate < expected_rate * (1 - lim->rate_tol)) {
+                strcat(status, "SLOW ");
+            } else if (rate > expected_rate * (1 + lim->rate_tol)) {
+                strcat(status, "FAST ");
+            }
+            if (s->senders == 1 && jit99 > nominal_us * lim->jitter_tol) {
+                strcat(status, "JITTER ");
+            }
+            if (gaps) {
+                strcat(status, "GAPS ");
+            }
+            if (s->intervals == 0) {
+                strcat(status, "ONE-FRAME ");
+            }
+            if (status[0]) {
+                flagged++;
+            } else {
+                strcpy(status, "ok");
+            }
+        }
+
+        schedule_msg_name(type, s->id, name, sizeof(name));
+        printf("%-5s %-28s %9llu %8.3f ",
+               schedule_board_name(board),
+               name,
+               (unsigned long long)s->frames,
+               rate);
+        if (period_ms > 0) {
+            printf("%8.3f ", 1000.0 / period_ms);
+        } else {
+            printf("%8s ", "-");
+        }
+        if (s->intervals) {
+            printf("%8.1f %8.1f %8.1f %8.1f %8.2f %8.2f %6llu  %s\n",
+                   percentile(s, 1) / 1e3,
+                   p50 / 1e3,
+                   percentile(s, 99) / 1e3,
+                   s->longest[0].len_us / 1e3,
+                   jit50 / 1e3,
+                   jit99 / 1e3,
+                   (unsigned long long)gaps,
+                   status);
+        } else {
+            printf("%8s %8s %8s %8s %8s %8s %6s  %s\n", "-", "-", "-", "-", "-", "-", "-", status);
+        }
+    }
+
+    if (sched) {
+        for (uint8_t i = 0; i < sched->num_msgs; i++) {
+            const sched_msg_t *m = &sched->msgs[i];
+            uint16_t sid = m->type | m->board;
+            bool seen = false;
+            for (int id = 0; id < 256 && !seen; id++) {
+                seen = streams[sid][id] && (m->id < 0 || m->id == id);
+            }
+            if (!seen && board_heard(m->board)) {
+                schedule_msg_name(m->type, m->id, name, sizeof(name));
+                printf("%-5s %-28s %9d %8.3f %8.3f %8s %8s %8s %8s %8s %8s %6s  MISSING\n",
+                       schedule_board_name(m->board),
+                       name,
+                       0,
+                       0.0,
+                       1000.0 / m->period_ms,
+                       "-",
+                       "-",
+                       "-",
+                       "-",
+                       "-",
+                       "-",
+                       "-");
+                flagged++;
+            }
+        }
+    }
+
+    // where the worst gaps were, for finding them in the log
+    bool header = false;
+    for (size_t i = 0; i < num_streams; i++) {
+        const stream_t *s = stream_list[i];
+        uint8_t board = s->sid & SID_BOARD_MASK;
+        uint16_t type = s->sid & SID_TYPE_MASK;
+        if (s->senders == 0) {
+            continue;
+        }
+        for (int g = 0; g < NUM_LONGEST; g++) {
+            if (s->longest[g].len_us <= s->sender_period_us * lim->gap_factor) {
+                break;
+            }
+            if (!header) {
+                printf("\nlongest gaps\n");
+                header = true;
+            }
+            schedule_msg_name(type, s->id, name, sizeof(name));
+            printf("  %-5s %-28s %10.1f ms after %lld.%06lld\n",
+                   schedule_board_name(board),
+                   name,
+                   s->longest[g].len_us / 1e3,
+                   (long long)(s->longest[g].start_us / 1000000),
+                   (long long)(s->longest[g].start_us % 1000000));
+        }
+    }
+
+    if (sched) {
+        printf("\n%d stream%s flagged\n", flagged, flagged == 1 ? "" : "s");
+    }
+    return flagged ? 1 : 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [-s FIRMWARE_DIR] [-r BITRATE] [-t RATE_PCT] [-j JITTER_PCT] "
+            "[-g GAP_PERIODS]\n"
+            "          [candump.log ... | -i IFACE [-d SECONDS]]\n",
+            prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+    const char *firmware_dir = NULL;
+    const char *iface = NULL;
+    double duration_s = 0;
+    limits_t lim = {
+        .rate_tol = 0.05,
+        .jitter_tol = 0.25,
+        .gap_factor = 3,
+        .bitrate = 100000,
+    };
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:r:t:j:g:i:d:")) != -1) {
+        switch (opt) {
+            case 's':
+                firmware_dir = optarg;
+                break;
+            case 'r':
+                lim.bitrate = strtoul(optarg, NULL, 0);
+                break;
+            case 't':
+                lim.rate_tol = atof(optarg) / 100;
+                break;
+            case 'j':
+                lim.jitter_tol = atof(optarg) / 100;
+                break;
+            case 'g':
+                lim.gap_factor = atof(optarg);
+                break;
+            case 'i':
+                iface = optarg;
+                break;
+            case 'd':
+                duration_s = atof(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (lim.bitrate == 0 || lim.gap_factor <= 1 || (iface && optind != argc)) {
+        usage(argv[0]);
+    }
+
+    static schedule_t schedule;
+    if (firmware_dir) {
+        if (!schedule_load_dir(&schedule, firmware_dir)) {
+            return 2;
+        }
+        sched = &schedule;
+    }
+
+    hex_init();
+    if (iface) {
+        read_live(iface, duration_s);
+    } else if (optind == argc) {
+        read_log(STDIN_FILENO, "stdin");
+    } else {
+        for (int i = optind; i < argc; i++) {
+            int fd = open(argv[i], O_RDONLY);
+            if (fd < 0) {
+                perror(argv[i]);
+                return 2;
+            }
+            read_log(fd, argv[i]);
+            close(fd);
+        }
+    }
+
+    return report(&lim);
+}
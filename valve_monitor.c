@@ -0,0 +1,158 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "canlib/canlib.h"
+
+#include "error_checks.h"
+#include "prop_msg.h"
+#include "valve_monitor.h"
+
+// bins per report frame
+#define REPORT_BINS 2
+#define REPORT_FRAMES (VALVE_MONITOR_BINS / REPORT_BINS)
+
+static valve_monitor_t *monitors[VALVE_MONITOR_MAX_VALVES];
+static uint8_t num_monitors = 0;
+
+static uint16_t tripped_actuators = 0;
+
+static volatile bool report_requested = false;
+static bool report_sending = false;
+static uint8_t report_idx = 0; // monitor * REPORT_FRAMES + frame
+
+void valve_monitor_init(valve_monitor_t *mon, enum ACTUATOR_ID actuator, uint16_t allowance_ms) {
+    mon->actuator = actuator;
+    mon->allowance_ms = allowance_ms;
+    // the first update sets the baseline, there's no command to time yet
+    mon->requested = ACTUATOR_UNK;
+    mon->matched = true;
+    mon->disagreeing = false;
+    mon->tripped = false;
+    for (uint8_t i = 0; i < VALVE_MONITOR_BINS; i++) {
+        mon->hist[i] = 0;
+    }
+
+    if (num_monitors < VALVE_MONITOR_MAX_VALVES) {
+        monitors[num_monitors++] = mon;
+    }
+}
+
+static void count(valve_monitor_t *mon, uint8_t bin) {
+    if (mon->hist[bin] < UINT16_MAX) {
+        mon->hist[bin]++;
+    }
+}
+
+static uint8_t latency_bin(uint32_t latency_ms) {
+    uint8_t bin = 0;
+    uint32_t edge = VALVE_MONITOR_BIN0_ms;
+    while (bin < VALVE_MONITOR_LATENCY_BINS - 1 && latency_ms >= edge) {
+        bin++;
+        edge <<= 1;
+    }
+    return bin;
+}
+
+static void trip(valve_monitor_t *mon, enum ACTUATOR_STATE measured, uint32_t disagree_ms) {
+    uint8_t fault_data[4];
+    fault_data[0] = mon->actuator;
+    fault_data[1] = mon->requested;
+    fault_data[2] = measured;
+    // seconds, so a stuck valve still shows how long it's been
+    fault_data[3] = disagree_ms / 1000 > UINT8_MAX ? UINT8_MAX : disagree_ms / 1000;
+
+    mon->tripped = true;
+    tripped_actuators |= (uint16_t)1 << mon->actuator;
+    fault_raise(FAULT_VALVE_MISMATCH, fault_data, 4);
+}
+
+static void untrip(valve_monitor_t *mon) {
+    mon->tripped = false;
+    tripped_actuators &= ~((uint16_t)1 << mon->actuator);
+    if (tripped_actuators == 0) {
+        fault_clear(FAULT_VALVE_MISMATCH);
+    }
+}
+
+void valve_monitor_update(valve_monitor_t *mon,
+                          enum ACTUATOR_STATE requested,
+                          enum ACTUATOR_STATE measured) {
+    uint32_t now = millis();
+
+    if (requested != mon->requested) {
+        if (mon->requested != ACTUATOR_UNK && !mon->matched) {
+            count(mon, VALVE_MONITOR_NO_MATCH);
+        }
+        mon->matched = mon->requested == ACTUATOR_UNK;
+        mon->requested = requested;
+        mon->request_millis = now;
+    }
+
+    if (requested == ACTUATOR_UNK) {
+        // nothing driven yet to compare with
+        mon->disagreeing = false;
+        return;
+    }
+    if (measured == ACTUATOR_UNK) {
+        return;
+    }
+
+    if (measured == requested) {
+        if (!mon->matched) {
+            mon->matched = true;
+            count(mon, latency_bin(now - mon->request_millis));
+        }
+        mon->disagreeing = false;
+        if (mon->tripped) {
+            untrip(mon);
+        }
+        return;
+    }
+
+    if (!mon->disagreeing) {
+        mon->disagreeing = true;
+        mon->disagree_millis = now;
+    }
+    uint32_t disagree_ms = now - mon->disagree_millis;
+    if (disagree_ms > mon->allowance_ms) {
+        // raising again refreshes the duration sent with the repeats
+        trip(mon, measured, disagree_ms);
+    }
+}
+
+void valve_monitor_request_report(void) {
+    report_requested = true;
+}
+
+void valve_monitor_heartbeat(void) {
+    if (report_requested) {
+        report_requested = false;
+        report_sending = true;
+        report_idx = 0;
+    }
+    if (!report_sending) {
+        return;
+    }
+    if (report_idx >= num_monitors * REPORT_FRAMES) {
+        report_sending = false;
+        return;
+    }
+
+    const valve_monitor_t *mon = monitors[report_idx / REPORT_FRAMES];
+    uint8_t first = (report_idx % REPORT_FRAMES) * REPORT_BINS;
+
+    uint8_t payload[2 + 2 * REPORT_BINS];
+    payload[0] = mon->actuator;
+    payload[1] = first;
+    for (uint8_t i = 0; i < REPORT_BINS; i++) {
+        payload[2 + 2 * i] = (mon->hist[first + i] >> 8) & 0xff;
+        payload[3 + 2 * i] = (mon->hist[first + i] >> 0) & 0xff;
+    }
+
+    // one frame per call so a report doesn't fill the tx buffer
+    can_msg_t msg;
+    build_prop_msg(PROP_MSG_VALVE_AGREEMENT, payload, sizeof(payload), &msg);
+    if (txb_enqueue(&msg)) {
+        report_idx++;
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef VALVE_MONITOR_H
+#define VALVE_MONITOR_H
+
+#include "canlib/message_types.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Watches a valve's requested state against its measured position. A disagreement that
+// lasts longer than the valve's allowance raises FAULT_VALVE_MISMATCH, which clears once
+// every monitored valve agrees again. Independently of the fault, the time from each change
+// of the requested state to the first matching measurement goes into a histogram that the
+// ground can ask for.
+//
+// A measured state of ACTUATOR_UNK means no feedback yet: the disagreement timer doesn't
+// start and a running one isn't stopped. A requested state of ACTUATOR_UNK means the
+// valve isn't driven yet, and stops the timer.
+
+#define VALVE_MONITOR_MAX_VALVES 4
+
+// Histogram bins: bin 0 is under VALVE_MONITOR_BIN0_ms, each following bin twice as wide,
+// and the last latency bin holds everything from VALVE_MONITOR_BIN0_ms << 5 up.
+// VALVE_MONITOR_NO_MATCH counts commands replaced before the valve ever matched them.
+#define VALVE_MONITOR_BIN0_ms 32
+#define VALVE_MONITOR_LATENCY_BINS 7
+#define VALVE_MONITOR_NO_MATCH VALVE_MONITOR_LATENCY_BINS
+#define VALVE_MONITOR_BINS (VALVE_MONITOR_LATENCY_BINS + 1)
+
+typedef struct {
+    enum ACTUATOR_ID actuator;
+    uint16_t allowance_ms;
+
+    enum ACTUATOR_STATE requested;
+    uint32_t request_millis; // when requested last changed
+    bool matched; // measured has agreed since the last change
+
+    bool disagreeing;
+    uint32_t disagree_millis; // start of the current disagreement
+    bool tripped;
+
+    uint16_t hist[VALVE_MONITOR_BINS];
+} valve_monitor_t;
+
+void valve_monitor_init(valve_monitor_t *mon, enum ACTUATOR_ID actuator, uint16_t allowance_ms);
+
+// Call at a regular rate with the state the valve is driven to and the state its feedback
+// shows. The histogram resolution is the call interval.
+void valve_monitor_update(valve_monitor_t *mon,
+                          enum ACTUATOR_STATE requested,
+                          enum ACTUATOR_STATE measured);
+
+// Send every monitored valve's histogram, a frame per main loop pass. Safe to call from the
+// ISR.
+void valve_monitor_request_report(void);
+
+// Call from the main loop: sends requested histograms
+void valve_monitor_heartbeat(void);
+
+#endif /* VALVE_MONITOR_H */
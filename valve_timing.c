@@ -0,0 +1,182 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "canlib/canlib.h"
+
+#include "error_checks.h"
+#include "hal.h"
+#include "prop_msg.h"
+#include "sensor_general.h"
+#include "valve_timing.h"
+
+static hal_adc_channel_t fuel_channel;
+static hal_adc_channel_t ox_channel;
+static const hall_detector_t *fuel_det;
+static const hall_detector_t *ox_det;
+
+static volatile bool start_pending = false;
+static volatile enum ACTUATOR_STATE start_commanded;
+static volatile uint32_t start_millis;
+
+static bool active = false;
+static uint32_t command_millis;
+static valve_timing_t current;
+static bool fuel_done;
+static bool ox_done;
+
+static valve_timing_t history[VALVE_TIMING_HISTORY_LEN];
+static uint8_t history_head = 0; // next slot to write
+static uint8_t history_count = 0;
+
+static volatile bool history_requested = false;
+static uint8_t history_send_idx = 0;
+static bool history_sending = false;
+
+void valve_timing_init(hal_adc_channel_t fuel,
+                       hal_adc_channel_t ox,
+                       const hall_detector_t *fuel_detector,
+                       const hall_detector_t *ox_detector) {
+    fuel_channel = fuel;
+    ox_channel = ox;
+    fuel_det = fuel_detector;
+    ox_det = ox_detector;
+}
+
+void valve_timing_start(enum ACTUATOR_STATE commanded) {
+    if (commanded != ACTUATOR_ON && commanded != ACTUATOR_OFF) {
+        return;
+    }
+    // picked up by the next heartbeat, this can be called from the sequence executor ISR
+    start_commanded = commanded;
+    start_millis = millis();
+    start_pending = true;
+}
+
+static void begin_measurement(void) {
+    bool gie = hal_irq_disable();
+    current.commanded = start_commanded;
+    command_millis = start_millis;
+    start_pending = false;
+    hal_irq_restore(gie);
+
+    // a new command restarts the measurement, the previous one is dropped
+    active = true;
+    current.fuel_ms = VALVE_TIMING_NO_TRANSITION;
+    current.ox_ms = VALVE_TIMING_NO_TRANSITION;
+    fuel_done = false;
+    ox_done = false;
+}
+
+bool valve_timing_active(void) {
+    return active;
+}
+
+void valve_timing_request_history(void) {
+    history_requested = true;
+}
+
+static uint8_t missed_mask(void) {
+    return (fuel_done ? 0 : VALVE_TIMING_FUEL_MISSED) | (ox_done ? 0 : VALVE_TIMING_OX_MISSED);
+}
+
+static void send_result(void) {
+    uint8_t payload[6];
+    payload[0] = current.commanded;
+    payload[1] = (current.fuel_ms >> 8) & 0xff;
+    payload[2] = (current.fuel_ms >> 0) & 0xff;
+    payload[3] = (current.ox_ms >> 8) & 0xff;
+    payload[4] = (current.ox_ms >> 0) & 0xff;
+    payload[5] = missed_mask();
+
+    can_msg_t msg;
+    build_prop_msg(PROP_MSG_VALVE_TIMING, payload, sizeof(payload), &msg);
+    txb_enqueue(&msg);
+}
+
+static void finish(void) {
+    active = false;
+
+    history[history_head] = current;
+    history_head = (history_head + 1) % VALVE_TIMING_HISTORY_LEN;
+    if (history_count < VALVE_TIMING_HISTORY_LEN) {
+        history_count++;
+    }
+
+    send_result();
+
+    // stays active until a measurement where both valves move
+    if (fuel_done && ox_done) {
+        fault_clear(FAULT_VALVE_TIMING);
+    } else {
+        // both valves can miss on the same command, so they go out as a mask
+        uint8_t fault_data[2];
+        fault_data[0] = missed_mask();
+        fault_data[1] = current.commanded;
+        fault_raise(FAULT_VALVE_TIMING, fault_data, 2);
+    }
+}
+
+// Oldest entry first, one frame per call so a dump doesn't fill the tx buffer
+static void send_history(void) {
+    if (history_requested) {
+        history_requested = false;
+        history_sending = true;
+        history_send_idx = 0;
+    }
+    if (!history_sending) {
+        return;
+    }
+    if (history_send_idx >= history_count) {
+        history_sending = false;
+        return;
+    }
+
+    uint8_t oldest = (history_head + VALVE_TIMING_HISTORY_LEN - history_count) %
+                     VALVE_TIMING_HISTORY_LEN;
+    const valve_timing_t *entry =
+        &history[(oldest + history_send_idx) % VALVE_TIMING_HISTORY_LEN];
+
+    uint8_t payload[6];
+    payload[0] = history_send_idx;
+    payload[1] = entry->commanded;
+    payload[2] = (entry->fuel_ms >> 8) & 0xff;
+    payload[3] = (entry->fuel_ms >> 0) & 0xff;
+    payload[4] = (entry->ox_ms >> 8) & 0xff;
+    payload[5] = (entry->ox_ms >> 0) & 0xff;
+
+    can_msg_t msg;
+    build_prop_msg(PROP_MSG_VALVE_TIMING_HISTORY, payload, sizeof(payload), &msg);
+    if (txb_enqueue(&msg)) {
+        history_send_idx++;
+    }
+}
+
+void valve_timing_heartbeat(void) {
+    send_history();
+
+    if (start_pending) {
+        begin_measurement();
+    }
+
+    if (!active) {
+        return;
+    }
+
+    uint32_t elapsed = millis() - command_millis;
+
+    // raw threshold crossing, debouncing would only add latency here
+    if (!fuel_done &&
+        hall_detector_in_state(fuel_det, get_hall_sensor_reading(fuel_channel), current.commanded)) {
+        fuel_done = true;
+        current.fuel_ms = elapsed;
+    }
+    if (!ox_done &&
+        hall_detector_in_state(ox_det, get_hall_sensor_reading(ox_channel), current.commanded)) {
+        ox_done = true;
+        current.ox_ms = elapsed;
+    }
+
+    if ((fuel_done && ox_done) || elapsed > VALVE_TIMING_TIMEOUT_ms) {
+        finish();
+    }
+}
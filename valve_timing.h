@@ -0,0 +1,50 @@
+#ifndef VALVE_TIMING_H
+#define VALVE_TIMING_H
+
+#include "canlib/message_types.h"
+#include "hal.h"
+
+#include "hall_detector.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Measures how long the fuel and ox injectors take to move after the injector output
+// changes, by sampling both hall sensors on every main loop pass until they cross
+// their detector's threshold for the commanded state.
+
+// give up and raise a fault if a valve hasn't moved by then
+#define VALVE_TIMING_TIMEOUT_ms 1000
+
+#define VALVE_TIMING_HISTORY_LEN 16
+
+// reported time for a valve that never transitioned
+#define VALVE_TIMING_NO_TRANSITION 0xffff
+
+// valves that never transitioned, in the result frame and the FAULT_VALVE_TIMING data
+#define VALVE_TIMING_FUEL_MISSED 0x1
+#define VALVE_TIMING_OX_MISSED 0x2
+
+typedef struct {
+    enum ACTUATOR_STATE commanded;
+    uint16_t fuel_ms;
+    uint16_t ox_ms;
+} valve_timing_t;
+
+void valve_timing_init(hal_adc_channel_t fuel_channel,
+                       hal_adc_channel_t ox_channel,
+                       const hall_detector_t *fuel_detector,
+                       const hall_detector_t *ox_detector);
+
+// Call right after the injector output changed. Safe to call from the ISR.
+void valve_timing_start(enum ACTUATOR_STATE commanded);
+
+// Call from the main loop: samples while a measurement is running and sends results
+void valve_timing_heartbeat(void);
+
+// Send the stored history over CAN, a frame per main loop pass. Safe to call from the ISR.
+void valve_timing_request_history(void);
+
+bool valve_timing_active(void);
+
+#endif /* VALVE_TIMING_H */
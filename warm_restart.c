@@ -0,0 +1,81 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "canlib/canlib.h"
+
+#include "event_log.h"
+#include "hal.h"
+#include "prop_msg.h"
+#include "warm_restart.h"
+
+#define WARM_MAGIC 0x5741
+
+typedef struct {
+    uint16_t magic;
+    uint8_t size; // catches a layout change between firmware versions
+    warm_state_t state;
+    uint16_t checksum;
+} saved_state_t;
+
+static HAL_PERSISTENT saved_state_t saved;
+
+static bool warm = false;
+static uint16_t warm_restarts = 0;
+static bool telemetry_sent = false;
+
+// Fletcher-16 over everything before the checksum
+static uint16_t checksum(void) {
+    const uint8_t *p = (const uint8_t *)&saved;
+    uint8_t sum1 = 0;
+    uint8_t sum2 = 0;
+    for (uint8_t i = 0; i < offsetof(saved_state_t, checksum); i++) {
+        sum1 = (sum1 + p[i]) % 255;
+        sum2 = (sum2 + sum1) % 255;
+    }
+    return ((uint16_t)sum2 << 8) | sum1;
+}
+
+bool warm_restart_restore(uint16_t reset_cause, warm_state_t *state) {
+    bool software_reset = !(reset_cause & RESET_CAUSE_nRI) &&
+                          (reset_cause & RESET_CAUSE_nPOR) && (reset_cause & RESET_CAUSE_nBOR);
+
+    warm = software_reset && saved.magic == WARM_MAGIC && saved.size == sizeof(warm_state_t) &&
+           saved.checksum == checksum();
+    if (warm) {
+        *state = saved.state;
+        warm_restarts = ++state->warm_restarts;
+    }
+
+    // a later reset that doesn't go through warm_restart_save() must cold-start
+    saved.magic = 0;
+    return warm;
+}
+
+void warm_restart_save(const warm_state_t *state) {
+    saved.magic = WARM_MAGIC;
+    saved.size = sizeof(warm_state_t);
+    saved.state = *state;
+    saved.checksum = checksum();
+}
+
+void warm_restart_telemetry_sent(void) {
+    if (telemetry_sent) {
+        return;
+    }
+
+    // millis() starts in timer0_init(), only SYSTEM_Initialize() runs before that
+    uint32_t now = millis();
+    uint16_t elapsed_ms = now > UINT16_MAX ? UINT16_MAX : (uint16_t)now;
+
+    uint8_t payload[5];
+    payload[0] = warm;
+    payload[1] = (warm_restarts >> 8) & 0xff;
+    payload[2] = (warm_restarts >> 0) & 0xff;
+    payload[3] = (elapsed_ms >> 8) & 0xff;
+    payload[4] = (elapsed_ms >> 0) & 0xff;
+
+    can_msg_t msg;
+    build_prop_msg(PROP_MSG_BOOT_INFO, payload, sizeof(payload), &msg);
+    telemetry_sent = txb_enqueue(&msg);
+}
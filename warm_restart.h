@@ -0,0 +1,34 @@
+#ifndef WARM_RESTART_H
+#define WARM_RESTART_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "error_checks.h"
+
+// Board state carried across a software RESET() in RAM that the startup code leaves
+// alone. It is only restored after a RESET instruction, and only if the magic word, size
+// and checksum all match. Power-on, brown-out, MCLR and watchdog resets cold-start.
+
+#define WARM_NUM_FILTERS 2
+
+typedef struct {
+    double pres_low_pass[WARM_NUM_FILTERS];
+    uint8_t requested_actuators; // one bit per valve, set if requested on
+    fault_counter_t fault_counters[NUM_FAULTS];
+    uint16_t can_resets; // tier 2 CAN recoveries
+    uint16_t warm_restarts;
+} warm_state_t;
+
+// Copy the saved state out and invalidate it. Returns true for a warm restart, state is
+// left untouched otherwise. reset_cause is from hal_get_reset_cause().
+bool warm_restart_restore(uint16_t reset_cause, warm_state_t *state);
+
+// Call right before RESET()
+void warm_restart_save(const warm_state_t *state);
+
+// Call whenever sensor telemetry is sent. The first call after boot reports whether this
+// was a warm restart and how long it took to get telemetry out.
+void warm_restart_telemetry_sent(void);
+
+#endif /* WARM_RESTART_H */